@@ -0,0 +1,73 @@
+/*
+ * Copyright (c) 2026 The Libevent authors
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef ATOMIC_INTERNAL_H_INCLUDED_
+#define ATOMIC_INTERNAL_H_INCLUDED_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "event2/event-config.h"
+
+/* A few atomic operations on unsigned ints, for the places where one thread
+ * hands data to another without taking a lock.
+ *
+ * EVUTIL_ATOMIC_LOAD_() has acquire semantics, EVUTIL_ATOMIC_STORE_() has
+ * release semantics, and EVUTIL_ATOMIC_ADD_() (which returns the new value)
+ * and EVUTIL_ATOMIC_FENCE_() are full barriers.
+ *
+ * If EVUTIL_HAVE_ATOMICS_ is not defined, the compiler gives us no way to
+ * do this, and callers have to fall back to locking. */
+
+#if defined(__clang__) || \
+    (defined(__GNUC__) && (__GNUC__ > 4 || \
+	(__GNUC__ == 4 && __GNUC_MINOR__ >= 7)))
+#define EVUTIL_HAVE_ATOMICS_
+#define EVUTIL_ATOMIC_LOAD_(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define EVUTIL_ATOMIC_STORE_(p, v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#define EVUTIL_ATOMIC_ADD_(p, v) __atomic_add_fetch((p), (v), __ATOMIC_SEQ_CST)
+#define EVUTIL_ATOMIC_FENCE_() __atomic_thread_fence(__ATOMIC_SEQ_CST)
+#elif defined(_MSC_VER)
+#include <intrin.h>
+/* Interlocked operations are full barriers */
+#define EVUTIL_HAVE_ATOMICS_
+#define EVUTIL_ATOMIC_LOAD_(p)						\
+	((unsigned)_InterlockedOr((volatile long *)(p), 0))
+#define EVUTIL_ATOMIC_STORE_(p, v)					\
+	((void)_InterlockedExchange((volatile long *)(p), (long)(v)))
+#define EVUTIL_ATOMIC_ADD_(p, v)					\
+	((unsigned)_InterlockedExchangeAdd((volatile long *)(p), (long)(v)) + (v))
+#define EVUTIL_ATOMIC_FENCE_() do {					\
+		volatile long evutil_fence_ = 0;			\
+		(void)_InterlockedOr(&evutil_fence_, 0);		\
+	} while (0)
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ATOMIC_INTERNAL_H_INCLUDED_ */
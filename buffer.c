@@ -2867,6 +2867,27 @@ evbuffer_peek(struct evbuffer *buffer, ev_ssize_t len,
 	return idx;
 }
 
+int
+evbuffer_peek_first_chain_(struct evbuffer *buf, struct evbuffer_iovec *vec)
+{
+	struct evbuffer_chain *chain;
+	int r = -1;
+
+	EVBUFFER_LOCK(buf);
+	for (chain = buf->first; chain; chain = chain->next) {
+		if (!chain->off)
+			continue;
+		vec->iov_base = (void *)(chain->buffer + chain->misalign);
+		vec->iov_len = chain->off;
+		r = !(chain->flags & (EVBUFFER_IMMUTABLE|EVBUFFER_SENDFILE|
+			EVBUFFER_MEM_PINNED_ANY));
+		break;
+	}
+	EVBUFFER_UNLOCK(buf);
+
+	return r;
+}
+
 
 int
 evbuffer_add_vprintf(struct evbuffer *buf, const char *fmt, va_list ap)
@@ -230,6 +230,10 @@ struct bufferevent_private {
 	} conn_address;
 
 	struct evdns_getaddrinfo_request *dns_request;
+
+	/** State for an in-progress "Happy Eyeballs" connect started by
+	 * bufferevent_socket_connect_hostname(); NULL if there is none. */
+	struct bufferevent_connect_race *connect_race;
 };
 
 /** Possible operations for a control callback. */
@@ -301,10 +305,12 @@ struct bufferevent_ops {
 extern const struct bufferevent_ops bufferevent_ops_socket;
 extern const struct bufferevent_ops bufferevent_ops_filter;
 extern const struct bufferevent_ops bufferevent_ops_pair;
+extern const struct bufferevent_ops bufferevent_ops_pair_cross;
 
 #define BEV_IS_SOCKET(bevp) ((bevp)->be_ops == &bufferevent_ops_socket)
 #define BEV_IS_FILTER(bevp) ((bevp)->be_ops == &bufferevent_ops_filter)
 #define BEV_IS_PAIR(bevp) ((bevp)->be_ops == &bufferevent_ops_pair)
+#define BEV_IS_PAIR_CROSS(bevp) ((bevp)->be_ops == &bufferevent_ops_pair_cross)
 
 #if defined(EVENT__HAVE_OPENSSL) || defined(EVENT__HAVE_MBEDTLS)
 /* We cannot use the same trick with external declaration,
@@ -148,6 +148,18 @@ bufferevent_inbuf_wm_cb(struct evbuffer *buf,
 		bufferevent_wm_unsuspend_read(bufev);
 }
 
+/* Run stmt, which invokes the user's callback fn; if the bufferevent's base
+ * is recording a timeline, note it there as the given kind of thing.  (A
+ * bufferevent made with the old API on the current base has no ev_base.) */
+#define TRACED(bufev, kind, fn, stmt) do {				\
+		struct event_base *tbase_ = (bufev)->ev_base;		\
+		ev_uint64_t tstart_ = tbase_ ? EVTRACE_BEGIN(tbase_) : 0; \
+		stmt;							\
+		if (tstart_)						\
+			evtrace_record_(tbase_, (kind), tstart_,	\
+			    (void (*)(void))(fn), (bufev), -1, 0, -1);	\
+	} while (0)
+
 static void
 bufferevent_run_deferred_callbacks_locked(struct event_callback *cb, void *arg)
 {
@@ -160,16 +172,19 @@ bufferevent_run_deferred_callbacks_locked(struct event_callback *cb, void *arg)
 		/* The "connected" happened before any reads or writes, so
 		   send it first. */
 		bufev_private->eventcb_pending &= ~BEV_EVENT_CONNECTED;
-		bufev->errorcb(bufev, BEV_EVENT_CONNECTED, bufev->cbarg);
+		TRACED(bufev, EVTRACE_BEV_EVENT, bufev->errorcb,
+		    bufev->errorcb(bufev, BEV_EVENT_CONNECTED, bufev->cbarg));
 	}
 	if (bufev_private->readcb_pending && bufev->readcb) {
 		bufev_private->readcb_pending = 0;
-		bufev->readcb(bufev, bufev->cbarg);
+		TRACED(bufev, EVTRACE_BEV_READ, bufev->readcb,
+		    bufev->readcb(bufev, bufev->cbarg));
 		bufferevent_inbuf_wm_check(bufev);
 	}
 	if (bufev_private->writecb_pending && bufev->writecb) {
 		bufev_private->writecb_pending = 0;
-		bufev->writecb(bufev, bufev->cbarg);
+		TRACED(bufev, EVTRACE_BEV_WRITE, bufev->writecb,
+		    bufev->writecb(bufev, bufev->cbarg));
 	}
 	if (bufev_private->eventcb_pending && bufev->errorcb) {
 		short what = bufev_private->eventcb_pending;
@@ -177,7 +192,8 @@ bufferevent_run_deferred_callbacks_locked(struct event_callback *cb, void *arg)
 		bufev_private->eventcb_pending = 0;
 		bufev_private->errno_pending = 0;
 		EVUTIL_SET_SOCKET_ERROR(err);
-		bufev->errorcb(bufev, what, bufev->cbarg);
+		TRACED(bufev, EVTRACE_BEV_EVENT, bufev->errorcb,
+		    bufev->errorcb(bufev, what, bufev->cbarg));
 	}
 	bufferevent_decref_and_unlock_(bufev);
 }
@@ -199,20 +215,23 @@ bufferevent_run_deferred_callbacks_unlocked(struct event_callback *cb, void *arg
 		bufferevent_event_cb errorcb = bufev->errorcb;
 		void *cbarg = bufev->cbarg;
 		bufev_private->eventcb_pending &= ~BEV_EVENT_CONNECTED;
-		UNLOCKED(errorcb(bufev, BEV_EVENT_CONNECTED, cbarg));
+		TRACED(bufev, EVTRACE_BEV_EVENT, errorcb,
+		    UNLOCKED(errorcb(bufev, BEV_EVENT_CONNECTED, cbarg)));
 	}
 	if (bufev_private->readcb_pending && bufev->readcb) {
 		bufferevent_data_cb readcb = bufev->readcb;
 		void *cbarg = bufev->cbarg;
 		bufev_private->readcb_pending = 0;
-		UNLOCKED(readcb(bufev, cbarg));
+		TRACED(bufev, EVTRACE_BEV_READ, readcb,
+		    UNLOCKED(readcb(bufev, cbarg)));
 		bufferevent_inbuf_wm_check(bufev);
 	}
 	if (bufev_private->writecb_pending && bufev->writecb) {
 		bufferevent_data_cb writecb = bufev->writecb;
 		void *cbarg = bufev->cbarg;
 		bufev_private->writecb_pending = 0;
-		UNLOCKED(writecb(bufev, cbarg));
+		TRACED(bufev, EVTRACE_BEV_WRITE, writecb,
+		    UNLOCKED(writecb(bufev, cbarg)));
 	}
 	if (bufev_private->eventcb_pending && bufev->errorcb) {
 		bufferevent_event_cb errorcb = bufev->errorcb;
@@ -222,7 +241,8 @@ bufferevent_run_deferred_callbacks_unlocked(struct event_callback *cb, void *arg
 		bufev_private->eventcb_pending = 0;
 		bufev_private->errno_pending = 0;
 		EVUTIL_SET_SOCKET_ERROR(err);
-		UNLOCKED(errorcb(bufev,what,cbarg));
+		TRACED(bufev, EVTRACE_BEV_EVENT, errorcb,
+		    UNLOCKED(errorcb(bufev,what,cbarg)));
 	}
 	bufferevent_decref_and_unlock_(bufev);
 #undef UNLOCKED
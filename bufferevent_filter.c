@@ -56,6 +56,7 @@
 #include "log-internal.h"
 #include "mm-internal.h"
 #include "bufferevent-internal.h"
+#include "evbuffer-internal.h"
 #include "util-internal.h"
 
 /* prototypes */
@@ -224,6 +225,141 @@ bufferevent_filter_new(struct bufferevent *underlying,
 	return downcast(bufev_f);
 }
 
+/* State for a filter created with bufferevent_filter_inplace_new(). */
+struct be_filter_inplace {
+	bufferevent_filter_inplace_cb process_in;
+	bufferevent_filter_inplace_cb process_out;
+	void (*free_context)(void *);
+	void *context;
+};
+
+/* Run an in-place filter over the data in src, one chain at a time.  Every
+ * chain the filter passes in full is moved to dst as it is; we only copy
+ * when the filter stops in the middle of a chain, when the chain is
+ * read-only, or when we have to glue the chains together because the
+ * filter can't make progress on the first one alone. */
+static enum bufferevent_filter_result
+be_filter_inplace_run(struct evbuffer *src, struct evbuffer *dst,
+    ev_ssize_t dst_limit, enum bufferevent_flush_mode mode,
+    bufferevent_filter_inplace_cb cb, void *ctx)
+{
+	size_t moved = 0;
+
+	while (dst_limit < 0 || moved < (size_t)dst_limit) {
+		struct evbuffer_iovec v;
+		unsigned char *tmp = NULL;
+		size_t len;
+		ev_ssize_t n;
+		int writable = evbuffer_peek_first_chain_(src, &v);
+
+		if (writable < 0)
+			break;
+		len = v.iov_len;
+		if (dst_limit >= 0 && len > (size_t)dst_limit - moved)
+			len = (size_t)dst_limit - moved;
+
+		if (writable) {
+			n = cb(v.iov_base, len, mode, ctx);
+		} else {
+			if (!(tmp = mm_malloc(len)))
+				return BEV_ERROR;
+			evbuffer_copyout(src, tmp, len);
+			n = cb(tmp, len, mode, ctx);
+		}
+
+		if (n < 0 || (size_t)n > len) {
+			mm_free(tmp);
+			return BEV_ERROR;
+		}
+		if (tmp) {
+			if (n && (evbuffer_add(dst, tmp, n) < 0 ||
+				evbuffer_drain(src, n) < 0)) {
+				mm_free(tmp);
+				return BEV_ERROR;
+			}
+			mm_free(tmp);
+		} else if (n && evbuffer_remove_buffer(src, dst, n) != n) {
+			return BEV_ERROR;
+		}
+		moved += n;
+
+		if (n == 0 && len == v.iov_len &&
+		    evbuffer_get_length(src) > len) {
+			/* The filter wants to see more than this chain
+			 * holds, but can't say how much: double the
+			 * contiguous piece and try again, so that a frame
+			 * is copied a bounded number of times without
+			 * linearizing everything behind it. */
+			size_t want = len * 2;
+			if (want > evbuffer_get_length(src))
+				want = evbuffer_get_length(src);
+			if (!evbuffer_pullup(src, (ev_ssize_t)want))
+				return BEV_ERROR;
+			continue;
+		}
+		if ((size_t)n < len)
+			break;
+	}
+
+	return moved ? BEV_OK : BEV_NEED_MORE;
+}
+
+static enum bufferevent_filter_result
+be_filter_inplace_input(struct evbuffer *src, struct evbuffer *dst,
+    ev_ssize_t lim, enum bufferevent_flush_mode state, void *ctx)
+{
+	struct be_filter_inplace *f = ctx;
+	return be_filter_inplace_run(src, dst, lim, state, f->process_in,
+	    f->context);
+}
+
+static enum bufferevent_filter_result
+be_filter_inplace_output(struct evbuffer *src, struct evbuffer *dst,
+    ev_ssize_t lim, enum bufferevent_flush_mode state, void *ctx)
+{
+	struct be_filter_inplace *f = ctx;
+	return be_filter_inplace_run(src, dst, lim, state, f->process_out,
+	    f->context);
+}
+
+static void
+be_filter_inplace_free(void *ctx)
+{
+	struct be_filter_inplace *f = ctx;
+	if (f->free_context)
+		f->free_context(f->context);
+	mm_free(f);
+}
+
+struct bufferevent *
+bufferevent_filter_inplace_new(struct bufferevent *underlying,
+    bufferevent_filter_inplace_cb input_filter,
+    bufferevent_filter_inplace_cb output_filter,
+    int options,
+    void (*free_context)(void *),
+    void *ctx)
+{
+	struct be_filter_inplace *f;
+	struct bufferevent *bev;
+
+	if (!underlying)
+		return NULL;
+	if (!(f = mm_calloc(1, sizeof(*f))))
+		return NULL;
+	f->process_in = input_filter;
+	f->process_out = output_filter;
+	f->free_context = free_context;
+	f->context = ctx;
+
+	bev = bufferevent_filter_new(underlying,
+	    input_filter ? be_filter_inplace_input : NULL,
+	    output_filter ? be_filter_inplace_output : NULL,
+	    options, be_filter_inplace_free, f);
+	if (!bev)
+		mm_free(f);
+	return bev;
+}
+
 static void
 be_filter_unlink(struct bufferevent *bev)
 {
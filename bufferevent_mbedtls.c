@@ -327,6 +327,9 @@ static struct le_ssl_ops le_mbedtls_ops = {
 	(void (*)(struct bufferevent_ssl *))mbedtls_set_ssl_noops,
 	conn_closed,
 	print_err,
+	NULL, /* enable_ktls */
+	NULL, /* ktls_active */
+	NULL, /* prepare_connect */
 };
 
 struct bufferevent *
@@ -32,15 +32,26 @@
 #endif
 
 #include <string.h>
+#include <time.h>
 
 #include <openssl/ssl.h>
 #include <openssl/err.h>
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+#include <openssl/rand.h>
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+#include <openssl/core_names.h>
+#endif
 #include "openssl-compat.h"
 
 #include "event2/bufferevent.h"
 #include "event2/bufferevent_struct.h"
+#include "event2/bufferevent_ssl.h"
 #include "event2/buffer.h"
 
+#include "ht-internal.h"
+#include "mm-internal.h"
+#include "evthread-internal.h"
 #include "ssl-compat.h"
 
 /*
@@ -407,6 +418,777 @@ static size_t SSL_pending_wrap(void *ssl)
 	return SSL_pending(ssl);
 }
 
+static void
+openssl_enable_ktls(void *ssl)
+{
+#ifdef SSL_OP_ENABLE_KTLS
+	SSL_set_options(ssl, SSL_OP_ENABLE_KTLS);
+#endif
+}
+
+static short
+openssl_ktls_active(void *ssl)
+{
+	short what = 0;
+#if defined(SSL_OP_ENABLE_KTLS) && !defined(OPENSSL_NO_KTLS)
+	BIO *wbio = SSL_get_wbio(ssl), *rbio = SSL_get_rbio(ssl);
+	if (wbio && BIO_get_ktls_send(wbio))
+		what |= EV_WRITE;
+	if (rbio && BIO_get_ktls_recv(rbio))
+		what |= EV_READ;
+#endif
+	return what;
+}
+
+static struct le_ssl_ops le_openssl_ops;
+
+/* ====================
+   Session resumption: a sharded session cache and rotating ticket keys for
+   servers, and a per-host session store for clients.
+*/
+
+#if OPENSSL_VERSION_NUMBER >= 0x10101000L && !defined(LIBRESSL_VERSION_NUMBER)
+#define HAVE_SESSION_RESUMPTION
+#endif
+
+#ifdef HAVE_SESSION_RESUMPTION
+
+/* ex_data indices for our data hanging off SSL_CTX and SSL objects */
+static int session_cache_idx = -1;
+static int ticket_keys_idx = -1;
+static int session_store_idx = -1;
+static CRYPTO_ONCE resumption_once = CRYPTO_ONCE_STATIC_INIT;
+
+#define SESSION_CACHE_SHARDS 16
+
+struct session_cache_entry {
+	HT_ENTRY(session_cache_entry) node;
+	TAILQ_ENTRY(session_cache_entry) next;
+	time_t expires;
+	unsigned id_len;
+	unsigned char id[SSL_MAX_SSL_SESSION_ID_LENGTH];
+	/* The session, as serialized by i2d_SSL_SESSION() */
+	size_t der_len;
+	unsigned char *der;
+};
+
+static inline unsigned
+session_cache_entry_hash(const struct session_cache_entry *e)
+{
+	unsigned h = 0;
+	unsigned i;
+	for (i = 0; i < e->id_len; ++i)
+		h = h * 31 + e->id[i];
+	return h;
+}
+
+static inline int
+session_cache_entry_eq(const struct session_cache_entry *a,
+    const struct session_cache_entry *b)
+{
+	return a->id_len == b->id_len && !memcmp(a->id, b->id, a->id_len);
+}
+
+struct session_cache_shard {
+	void *lock;
+	HT_HEAD(session_cache_map, session_cache_entry) map;
+	/* Oldest first */
+	TAILQ_HEAD(session_cache_list, session_cache_entry) entries;
+	size_t max;
+	ev_uint64_t hits;
+	ev_uint64_t misses;
+	ev_uint64_t evictions;
+};
+
+struct session_cache {
+	struct session_cache_shard shards[SESSION_CACHE_SHARDS];
+};
+
+HT_PROTOTYPE(session_cache_map, session_cache_entry, node,
+    session_cache_entry_hash, session_cache_entry_eq)
+HT_GENERATE(session_cache_map, session_cache_entry, node,
+    session_cache_entry_hash, session_cache_entry_eq, 0.5,
+    mm_malloc, mm_realloc, mm_free)
+
+#define TICKET_KEYS_MAX 9
+
+struct ticket_key {
+	unsigned char name[16];
+	unsigned char hmac[32];
+	unsigned char aes[32];
+};
+
+struct ticket_keys {
+	void *lock;
+	/* keys[0] encrypts new tickets; the rest are only for decrypting */
+	struct ticket_key keys[TICKET_KEYS_MAX];
+	int n_keys;
+	int keep;
+	int rotate_secs;
+	time_t rotated_at;
+};
+
+struct session_store_entry {
+	HT_ENTRY(session_store_entry) node;
+	TAILQ_ENTRY(session_store_entry) next;
+	SSL_SESSION *session;
+	char *key;
+};
+
+static inline unsigned
+session_store_entry_hash(const struct session_store_entry *e)
+{
+	return ht_string_hash_(e->key);
+}
+
+static inline int
+session_store_entry_eq(const struct session_store_entry *a,
+    const struct session_store_entry *b)
+{
+	return !strcmp(a->key, b->key);
+}
+
+struct bufferevent_openssl_session_store {
+	void *lock;
+	HT_HEAD(session_store_map, session_store_entry) map;
+	/* Least recently used first */
+	TAILQ_HEAD(session_store_list, session_store_entry) entries;
+	size_t max;
+};
+
+HT_PROTOTYPE(session_store_map, session_store_entry, node,
+    session_store_entry_hash, session_store_entry_eq)
+HT_GENERATE(session_store_map, session_store_entry, node,
+    session_store_entry_hash, session_store_entry_eq, 0.5,
+    mm_malloc, mm_realloc, mm_free)
+
+/* What we hang off a client SSL: where to keep its sessions */
+struct session_store_ref {
+	struct bufferevent_openssl_session_store *store;
+	char key[1];
+};
+
+static void
+session_cache_free(struct session_cache *cache)
+{
+	struct session_cache_entry *ent;
+	int i;
+
+	for (i = 0; i < SESSION_CACHE_SHARDS; ++i) {
+		struct session_cache_shard *shard = &cache->shards[i];
+		while ((ent = TAILQ_FIRST(&shard->entries))) {
+			TAILQ_REMOVE(&shard->entries, ent, next);
+			mm_free(ent);
+		}
+		HT_CLEAR(session_cache_map, &shard->map);
+		EVTHREAD_FREE_LOCK(shard->lock, 0);
+	}
+	mm_free(cache);
+}
+
+static void
+session_cache_ex_free(void *parent, void *ptr, CRYPTO_EX_DATA *ad,
+    int idx, long argl, void *argp)
+{
+	if (ptr)
+		session_cache_free(ptr);
+}
+
+static void
+ticket_keys_free(struct ticket_keys *keys)
+{
+	EVTHREAD_FREE_LOCK(keys->lock, 0);
+	OPENSSL_cleanse(keys->keys, sizeof(keys->keys));
+	mm_free(keys);
+}
+
+static void
+ticket_keys_ex_free(void *parent, void *ptr, CRYPTO_EX_DATA *ad,
+    int idx, long argl, void *argp)
+{
+	if (ptr)
+		ticket_keys_free(ptr);
+}
+
+static void
+session_store_ref_ex_free(void *parent, void *ptr, CRYPTO_EX_DATA *ad,
+    int idx, long argl, void *argp)
+{
+	if (ptr)
+		mm_free(ptr);
+}
+
+static void
+resumption_init(void)
+{
+	session_cache_idx = SSL_CTX_get_ex_new_index(0, NULL, NULL, NULL,
+	    session_cache_ex_free);
+	ticket_keys_idx = SSL_CTX_get_ex_new_index(0, NULL, NULL, NULL,
+	    ticket_keys_ex_free);
+	session_store_idx = SSL_get_ex_new_index(0, NULL, NULL, NULL,
+	    session_store_ref_ex_free);
+}
+
+static int
+resumption_init_once(void)
+{
+	if (!CRYPTO_THREAD_run_once(&resumption_once, resumption_init))
+		return -1;
+	if (session_cache_idx < 0 || ticket_keys_idx < 0 ||
+	    session_store_idx < 0)
+		return -1;
+	return 0;
+}
+
+static struct session_cache_shard *
+session_cache_shard(struct session_cache *cache,
+    const struct session_cache_entry *find)
+{
+	unsigned h = session_cache_entry_hash(find);
+	return &cache->shards[(h >> 16) % SESSION_CACHE_SHARDS];
+}
+
+/* Unlink and free a cache entry.  Called with the shard locked. */
+static void
+session_cache_remove(struct session_cache_shard *shard,
+    struct session_cache_entry *ent)
+{
+	HT_REMOVE(session_cache_map, &shard->map, ent);
+	TAILQ_REMOVE(&shard->entries, ent, next);
+	mm_free(ent);
+}
+
+static int
+session_cache_new_cb(SSL *ssl, SSL_SESSION *sess)
+{
+	struct session_cache *cache =
+	    SSL_CTX_get_ex_data(SSL_get_SSL_CTX(ssl), session_cache_idx);
+	struct session_cache_shard *shard;
+	struct session_cache_entry *ent, *old;
+	const unsigned char *id;
+	unsigned char *p;
+	unsigned id_len;
+	int der_len;
+	time_t now = time(NULL);
+
+	if (!cache)
+		return 0;
+
+	id = SSL_SESSION_get_id(sess, &id_len);
+	der_len = i2d_SSL_SESSION(sess, NULL);
+	if (!id_len || id_len > SSL_MAX_SSL_SESSION_ID_LENGTH || der_len <= 0)
+		return 0;
+
+	ent = mm_malloc(sizeof(*ent) + der_len);
+	if (!ent)
+		return 0;
+	ent->id_len = id_len;
+	memcpy(ent->id, id, id_len);
+	ent->der = (unsigned char *)(ent + 1);
+	p = ent->der;
+	ent->der_len = i2d_SSL_SESSION(sess, &p);
+	ent->expires = SSL_SESSION_get_time(sess) + SSL_SESSION_get_timeout(sess);
+
+	shard = session_cache_shard(cache, ent);
+	EVLOCK_LOCK(shard->lock, 0);
+	if ((old = HT_FIND(session_cache_map, &shard->map, ent)))
+		session_cache_remove(shard, old);
+	/* Expired sessions are at the front: drop them, then make room */
+	while ((old = TAILQ_FIRST(&shard->entries)) &&
+	    (old->expires <= now || HT_SIZE(&shard->map) >= shard->max)) {
+		if (old->expires > now)
+			++shard->evictions;
+		session_cache_remove(shard, old);
+	}
+	HT_INSERT(session_cache_map, &shard->map, ent);
+	TAILQ_INSERT_TAIL(&shard->entries, ent, next);
+	EVLOCK_UNLOCK(shard->lock, 0);
+
+	/* We keep a serialized copy, not the reference */
+	return 0;
+}
+
+static SSL_SESSION *
+session_cache_get_cb(SSL *ssl, const unsigned char *id, int id_len, int *copy)
+{
+	struct session_cache *cache =
+	    SSL_CTX_get_ex_data(SSL_get_SSL_CTX(ssl), session_cache_idx);
+	struct session_cache_shard *shard;
+	struct session_cache_entry find, *ent;
+	SSL_SESSION *sess = NULL;
+
+	*copy = 0;
+	if (!cache || id_len <= 0 || id_len > SSL_MAX_SSL_SESSION_ID_LENGTH)
+		return NULL;
+
+	find.id_len = id_len;
+	memcpy(find.id, id, id_len);
+	shard = session_cache_shard(cache, &find);
+
+	EVLOCK_LOCK(shard->lock, 0);
+	ent = HT_FIND(session_cache_map, &shard->map, &find);
+	if (ent && ent->expires <= time(NULL)) {
+		session_cache_remove(shard, ent);
+		ent = NULL;
+	}
+	if (ent) {
+		const unsigned char *p = ent->der;
+		sess = d2i_SSL_SESSION(NULL, &p, (long)ent->der_len);
+	}
+	if (sess)
+		++shard->hits;
+	else
+		++shard->misses;
+	EVLOCK_UNLOCK(shard->lock, 0);
+
+	return sess;
+}
+
+/* Put a session into a store, taking over the caller's reference. */
+static void
+session_store_put(struct bufferevent_openssl_session_store *store,
+    const char *key, SSL_SESSION *sess)
+{
+	struct session_store_entry find, *ent;
+
+	find.key = (char *)key;
+
+	EVLOCK_LOCK(store->lock, 0);
+	ent = HT_FIND(session_store_map, &store->map, &find);
+	if (ent) {
+		SSL_SESSION_free(ent->session);
+		TAILQ_REMOVE(&store->entries, ent, next);
+	} else {
+		size_t len = strlen(key);
+		while (HT_SIZE(&store->map) >= store->max &&
+		    (ent = TAILQ_FIRST(&store->entries))) {
+			HT_REMOVE(session_store_map, &store->map, ent);
+			TAILQ_REMOVE(&store->entries, ent, next);
+			SSL_SESSION_free(ent->session);
+			mm_free(ent);
+		}
+		ent = mm_malloc(sizeof(*ent) + len + 1);
+		if (!ent) {
+			EVLOCK_UNLOCK(store->lock, 0);
+			SSL_SESSION_free(sess);
+			return;
+		}
+		ent->key = (char *)(ent + 1);
+		memcpy(ent->key, key, len + 1);
+		HT_INSERT(session_store_map, &store->map, ent);
+	}
+	ent->session = sess;
+	TAILQ_INSERT_TAIL(&store->entries, ent, next);
+	EVLOCK_UNLOCK(store->lock, 0);
+}
+
+/* Return a private copy of the session stored under key, or NULL.  The
+ * connection gets a copy so that its own fate (see new_session_cb) can't
+ * affect the stored session. */
+static SSL_SESSION *
+session_store_get(struct bufferevent_openssl_session_store *store,
+    const char *key)
+{
+	struct session_store_entry find, *ent;
+	SSL_SESSION *sess = NULL;
+
+	find.key = (char *)key;
+
+	EVLOCK_LOCK(store->lock, 0);
+	ent = HT_FIND(session_store_map, &store->map, &find);
+	if (ent) {
+		if (!SSL_SESSION_is_resumable(ent->session) ||
+		    SSL_SESSION_get_time(ent->session) +
+		    SSL_SESSION_get_timeout(ent->session) <= time(NULL)) {
+			HT_REMOVE(session_store_map, &store->map, ent);
+			TAILQ_REMOVE(&store->entries, ent, next);
+			SSL_SESSION_free(ent->session);
+			mm_free(ent);
+		} else {
+			sess = SSL_SESSION_dup(ent->session);
+			TAILQ_REMOVE(&store->entries, ent, next);
+			TAILQ_INSERT_TAIL(&store->entries, ent, next);
+		}
+	}
+	EVLOCK_UNLOCK(store->lock, 0);
+
+	return sess;
+}
+
+/* The SSL_CTX may be shared by servers with a session cache and clients with
+ * a session store, so we dispatch on the side of the connection. */
+static int
+new_session_cb(SSL *ssl, SSL_SESSION *sess)
+{
+	struct session_store_ref *ref;
+
+	if (SSL_is_server(ssl))
+		return session_cache_new_cb(ssl, sess);
+
+	ref = SSL_get_ex_data(ssl, session_store_idx);
+	if (!ref)
+		return 0;
+	/* Keep a copy: OpenSSL marks the session of a connection that is
+	 * closed without a close_notify as not resumable, and we don't want
+	 * that to spoil the next connection. */
+	sess = SSL_SESSION_dup(sess);
+	if (sess)
+		session_store_put(ref->store, ref->key, sess);
+	return 0;
+}
+
+static void
+openssl_prepare_connect(void *ssl)
+{
+	struct session_store_ref *ref;
+	SSL_SESSION *sess;
+
+	if (session_store_idx < 0)
+		return;
+	ref = SSL_get_ex_data(ssl, session_store_idx);
+	if (!ref)
+		return;
+	sess = session_store_get(ref->store, ref->key);
+	if (sess) {
+		SSL_set_session(ssl, sess);
+		SSL_SESSION_free(sess);
+	}
+}
+
+/* Switch to a new key.  Called with the keys locked. */
+static int
+ticket_keys_rotate(struct ticket_keys *keys, const unsigned char *material)
+{
+	struct ticket_key key;
+	int n = keys->n_keys;
+
+	if (material)
+		memcpy(&key, material, sizeof(key));
+	else if (RAND_bytes((unsigned char *)&key, sizeof(key)) != 1)
+		return -1;
+
+	if (n > keys->keep)
+		n = keys->keep;
+	memmove(&keys->keys[1], &keys->keys[0], n * sizeof(keys->keys[0]));
+	keys->keys[0] = key;
+	keys->n_keys = n + 1;
+	keys->rotated_at = time(NULL);
+	OPENSSL_cleanse(&key, sizeof(key));
+	return 0;
+}
+
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+typedef EVP_MAC_CTX ticket_hmac_ctx;
+static int
+ticket_hmac_init(EVP_MAC_CTX *hctx, const unsigned char *secret)
+{
+	OSSL_PARAM params[3];
+	params[0] = OSSL_PARAM_construct_octet_string(OSSL_MAC_PARAM_KEY,
+	    (void *)secret, 32);
+	params[1] = OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST,
+	    (char *)"SHA256", 0);
+	params[2] = OSSL_PARAM_construct_end();
+	return EVP_MAC_CTX_set_params(hctx, params);
+}
+#else
+typedef HMAC_CTX ticket_hmac_ctx;
+static int
+ticket_hmac_init(HMAC_CTX *hctx, const unsigned char *secret)
+{
+	return HMAC_Init_ex(hctx, secret, 32, EVP_sha256(), NULL);
+}
+#endif
+
+static int
+ticket_key_cb(SSL *ssl, unsigned char *name, unsigned char *iv,
+    EVP_CIPHER_CTX *cctx, ticket_hmac_ctx *hctx, int enc)
+{
+	struct ticket_keys *keys =
+	    SSL_CTX_get_ex_data(SSL_get_SSL_CTX(ssl), ticket_keys_idx);
+	int i, r = -1;
+
+	if (!keys)
+		return -1;
+
+	EVLOCK_LOCK(keys->lock, 0);
+	if (keys->rotate_secs &&
+	    time(NULL) - keys->rotated_at >= keys->rotate_secs)
+		ticket_keys_rotate(keys, NULL);
+
+	if (enc) {
+		struct ticket_key *key = &keys->keys[0];
+		if (RAND_bytes(iv, EVP_CIPHER_iv_length(EVP_aes_256_cbc())) != 1)
+			goto done;
+		memcpy(name, key->name, sizeof(key->name));
+		if (EVP_EncryptInit_ex(cctx, EVP_aes_256_cbc(), NULL,
+			key->aes, iv) != 1 ||
+		    ticket_hmac_init(hctx, key->hmac) != 1)
+			goto done;
+		r = 1;
+	} else {
+		r = 0;
+		for (i = 0; i < keys->n_keys; ++i) {
+			struct ticket_key *key = &keys->keys[i];
+			if (memcmp(name, key->name, sizeof(key->name)))
+				continue;
+			if (EVP_DecryptInit_ex(cctx, EVP_aes_256_cbc(), NULL,
+				key->aes, iv) != 1 ||
+			    ticket_hmac_init(hctx, key->hmac) != 1) {
+				r = -1;
+				break;
+			}
+			/* Tickets under an old key get renewed */
+			r = i ? 2 : 1;
+			break;
+		}
+	}
+done:
+	EVLOCK_UNLOCK(keys->lock, 0);
+	return r;
+}
+
+#endif /* HAVE_SESSION_RESUMPTION */
+
+int
+bufferevent_openssl_ctx_set_session_cache(SSL_CTX *ctx,
+    size_t max_sessions, long timeout)
+{
+#ifdef HAVE_SESSION_RESUMPTION
+	struct session_cache *cache, *old;
+	size_t per_shard;
+	int i;
+
+	if (!ctx || !max_sessions || timeout < 0 || resumption_init_once() < 0)
+		return -1;
+
+	cache = mm_calloc(1, sizeof(*cache));
+	if (!cache)
+		return -1;
+	per_shard = (max_sessions + SESSION_CACHE_SHARDS - 1) /
+	    SESSION_CACHE_SHARDS;
+	for (i = 0; i < SESSION_CACHE_SHARDS; ++i) {
+		struct session_cache_shard *shard = &cache->shards[i];
+		EVTHREAD_ALLOC_LOCK(shard->lock, 0);
+		HT_INIT(session_cache_map, &shard->map);
+		TAILQ_INIT(&shard->entries);
+		shard->max = per_shard;
+	}
+
+	old = SSL_CTX_get_ex_data(ctx, session_cache_idx);
+	if (!SSL_CTX_set_ex_data(ctx, session_cache_idx, cache)) {
+		session_cache_free(cache);
+		return -1;
+	}
+	if (old)
+		session_cache_free(old);
+
+	if (timeout)
+		SSL_CTX_set_timeout(ctx, timeout);
+	SSL_CTX_set_session_cache_mode(ctx,
+	    SSL_CTX_get_session_cache_mode(ctx) |
+	    SSL_SESS_CACHE_SERVER | SSL_SESS_CACHE_NO_INTERNAL);
+	SSL_CTX_sess_set_new_cb(ctx, new_session_cb);
+	SSL_CTX_sess_set_get_cb(ctx, session_cache_get_cb);
+	return 0;
+#else
+	return -1;
+#endif
+}
+
+int
+bufferevent_openssl_ctx_get_session_cache_stats(SSL_CTX *ctx,
+    struct bufferevent_openssl_session_cache_stats *stats)
+{
+#ifdef HAVE_SESSION_RESUMPTION
+	struct session_cache *cache;
+	int i;
+
+	if (!ctx || session_cache_idx < 0)
+		return -1;
+	cache = SSL_CTX_get_ex_data(ctx, session_cache_idx);
+	if (!cache)
+		return -1;
+
+	memset(stats, 0, sizeof(*stats));
+	for (i = 0; i < SESSION_CACHE_SHARDS; ++i) {
+		struct session_cache_shard *shard = &cache->shards[i];
+		EVLOCK_LOCK(shard->lock, 0);
+		stats->entries += HT_SIZE(&shard->map);
+		stats->hits += shard->hits;
+		stats->misses += shard->misses;
+		stats->evictions += shard->evictions;
+		EVLOCK_UNLOCK(shard->lock, 0);
+	}
+	return 0;
+#else
+	return -1;
+#endif
+}
+
+int
+bufferevent_openssl_ctx_set_ticket_keys(SSL_CTX *ctx, int rotate_secs, int keep)
+{
+#ifdef HAVE_SESSION_RESUMPTION
+	struct ticket_keys *keys, *old;
+
+	if (!ctx || rotate_secs < 0 || keep < 0 || keep >= TICKET_KEYS_MAX ||
+	    resumption_init_once() < 0)
+		return -1;
+
+	keys = mm_calloc(1, sizeof(*keys));
+	if (!keys)
+		return -1;
+	EVTHREAD_ALLOC_LOCK(keys->lock, 0);
+	keys->keep = keep;
+	keys->rotate_secs = rotate_secs;
+	if (ticket_keys_rotate(keys, NULL) < 0) {
+		ticket_keys_free(keys);
+		return -1;
+	}
+
+	old = SSL_CTX_get_ex_data(ctx, ticket_keys_idx);
+	if (!SSL_CTX_set_ex_data(ctx, ticket_keys_idx, keys)) {
+		ticket_keys_free(keys);
+		return -1;
+	}
+	if (old)
+		ticket_keys_free(old);
+
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+	SSL_CTX_set_tlsext_ticket_key_evp_cb(ctx, ticket_key_cb);
+#else
+	SSL_CTX_set_tlsext_ticket_key_cb(ctx, ticket_key_cb);
+#endif
+	return 0;
+#else
+	return -1;
+#endif
+}
+
+int
+bufferevent_openssl_ctx_rotate_ticket_key(SSL_CTX *ctx,
+    const unsigned char *key, size_t keylen)
+{
+#ifdef HAVE_SESSION_RESUMPTION
+	struct ticket_keys *keys;
+	int r;
+
+	if (!ctx || ticket_keys_idx < 0)
+		return -1;
+	if (key && keylen != BUFFEREVENT_OPENSSL_TICKET_KEY_LEN)
+		return -1;
+	keys = SSL_CTX_get_ex_data(ctx, ticket_keys_idx);
+	if (!keys)
+		return -1;
+
+	EVLOCK_LOCK(keys->lock, 0);
+	r = ticket_keys_rotate(keys, key);
+	EVLOCK_UNLOCK(keys->lock, 0);
+	return r;
+#else
+	return -1;
+#endif
+}
+
+struct bufferevent_openssl_session_store *
+bufferevent_openssl_session_store_new(size_t max_hosts)
+{
+#ifdef HAVE_SESSION_RESUMPTION
+	struct bufferevent_openssl_session_store *store;
+
+	if (!max_hosts || resumption_init_once() < 0)
+		return NULL;
+	store = mm_calloc(1, sizeof(*store));
+	if (!store)
+		return NULL;
+	EVTHREAD_ALLOC_LOCK(store->lock, 0);
+	HT_INIT(session_store_map, &store->map);
+	TAILQ_INIT(&store->entries);
+	store->max = max_hosts;
+	return store;
+#else
+	return NULL;
+#endif
+}
+
+void
+bufferevent_openssl_session_store_free(
+    struct bufferevent_openssl_session_store *store)
+{
+#ifdef HAVE_SESSION_RESUMPTION
+	struct session_store_entry *ent;
+
+	if (!store)
+		return;
+	while ((ent = TAILQ_FIRST(&store->entries))) {
+		TAILQ_REMOVE(&store->entries, ent, next);
+		SSL_SESSION_free(ent->session);
+		mm_free(ent);
+	}
+	HT_CLEAR(session_store_map, &store->map);
+	EVTHREAD_FREE_LOCK(store->lock, 0);
+	mm_free(store);
+#endif
+}
+
+int
+bufferevent_openssl_set_session_store(struct bufferevent *bev,
+    struct bufferevent_openssl_session_store *store,
+    const char *host, int port)
+{
+#ifdef HAVE_SESSION_RESUMPTION
+	struct bufferevent_ssl *bev_ssl;
+	struct session_store_ref *ref, *old;
+	SSL_CTX *ctx;
+	size_t len;
+	long mode;
+	int r = -1;
+
+	if (!BEV_IS_SSL(bev) || !store || !host ||
+	    resumption_init_once() < 0)
+		return -1;
+
+	BEV_LOCK(bev);
+	bev_ssl = bufferevent_ssl_upcast(bev);
+	if (bev_ssl->ssl_ops != &le_openssl_ops ||
+	    SSL_is_server(bev_ssl->ssl))
+		goto done;
+
+	len = strlen(host) + 8;
+	ref = mm_malloc(sizeof(*ref) + len);
+	if (!ref)
+		goto done;
+	ref->store = store;
+	evutil_snprintf(ref->key, len + 1, "%s:%d", host, port);
+
+	old = SSL_get_ex_data(bev_ssl->ssl, session_store_idx);
+	if (!SSL_set_ex_data(bev_ssl->ssl, session_store_idx, ref)) {
+		mm_free(ref);
+		goto done;
+	}
+	if (old)
+		mm_free(old);
+
+	ctx = SSL_get_SSL_CTX(bev_ssl->ssl);
+	mode = SSL_CTX_get_session_cache_mode(ctx) | SSL_SESS_CACHE_CLIENT;
+	/* Keep client sessions out of the internal cache, unless it is
+	 * also used for serving */
+	if (!(mode & SSL_SESS_CACHE_SERVER))
+		mode |= SSL_SESS_CACHE_NO_INTERNAL_STORE;
+	SSL_CTX_set_session_cache_mode(ctx, mode);
+	SSL_CTX_sess_set_new_cb(ctx, new_session_cb);
+
+	if (SSL_in_before(bev_ssl->ssl))
+		openssl_prepare_connect(bev_ssl->ssl);
+	r = 0;
+done:
+	BEV_UNLOCK(bev);
+	return r;
+#else
+	return -1;
+#endif
+}
+
 static struct le_ssl_ops le_openssl_ops = {
 	SSL_init,
 	SSL_context_free,
@@ -430,6 +1212,13 @@ static struct le_ssl_ops le_openssl_ops = {
 	decrement_buckets,
 	conn_closed,
 	print_err,
+	openssl_enable_ktls,
+	openssl_ktls_active,
+#ifdef HAVE_SESSION_RESUMPTION
+	openssl_prepare_connect,
+#else
+	NULL,
+#endif
 };
 
 struct bufferevent *
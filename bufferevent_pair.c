@@ -37,8 +37,10 @@
 #include "event2/bufferevent.h"
 #include "event2/bufferevent_struct.h"
 #include "event2/event.h"
+#include "atomic-internal.h"
 #include "defer-internal.h"
 #include "bufferevent-internal.h"
+#include "evthread-internal.h"
 #include "mm-internal.h"
 #include "util-internal.h"
 
@@ -334,11 +336,15 @@ be_pair_flush(struct bufferevent *bev, short iotype,
 	return 0;
 }
 
+static struct bufferevent *be_pair_cross_get_partner(struct bufferevent *);
+
 struct bufferevent *
 bufferevent_pair_get_partner(struct bufferevent *bev)
 {
 	struct bufferevent_pair *bev_p;
 	struct bufferevent *partner = NULL;
+	if (BEV_IS_PAIR_CROSS(bev))
+		return be_pair_cross_get_partner(bev);
 	if (!BEV_IS_PAIR(bev))
 		return NULL;
 	bev_p = upcast(bev);
@@ -360,3 +366,428 @@ const struct bufferevent_ops bufferevent_ops_pair = {
 	be_pair_flush,
 	NULL, /* ctrl */
 };
+
+/*
+ * Pairs whose ends belong to different event_bases.
+ *
+ * Each end owns its own lock; what one end writes reaches the other through
+ * a single-producer/single-consumer ring of evbuffers, so that neither side
+ * ever waits for the other's lock.  The writer moves its whole output buffer
+ * into a fresh evbuffer (which moves chains, not bytes) and pushes that; it
+ * wakes the reader with event_active() only when the reader may have found
+ * the ring empty.  A writer that finds the ring full leaves its data in its
+ * output buffer and asks to be woken when there is room.
+ */
+
+#define PAIR_RING_SIZE 64
+
+struct pair_ring {
+	/* The next slot to read; only the reader changes it */
+	unsigned head;
+	/* Keep the reader's and the writer's index on different cache lines */
+	char pad[64 - sizeof(unsigned)];
+	/* The next slot to write; only the writer changes it */
+	unsigned tail;
+	/* Set by the writer when it found the ring full */
+	unsigned want_space;
+	/* Set by the writer once it won't write anything more */
+	unsigned eof;
+	struct evbuffer *slots[PAIR_RING_SIZE];
+};
+
+struct pair_channel {
+	/* Protects ends and refcnt, and the rings if there are no atomics */
+	void *lock;
+	struct bufferevent_pair_cross *ends[2];
+	int refcnt;
+	/* rings[i] carries what ends[i] writes */
+	struct pair_ring rings[2];
+};
+
+struct bufferevent_pair_cross {
+	struct bufferevent_private bev;
+	struct pair_channel *chan;
+	int side;
+	/* Activated by the other end when there is data, room, or EOF */
+	struct event notify;
+	unsigned eof_reported : 1;
+};
+
+static inline struct bufferevent_pair_cross *
+upcast_cross(struct bufferevent *bev)
+{
+	struct bufferevent_pair_cross *bev_p;
+	bev_p = EVUTIL_UPCAST(bev, struct bufferevent_pair_cross, bev.bev);
+	EVUTIL_ASSERT(BEV_IS_PAIR_CROSS(&bev_p->bev.bev));
+	return bev_p;
+}
+
+#ifdef EVUTIL_HAVE_ATOMICS_
+#define RING_LOCK(chan) EVUTIL_NIL_STMT_
+#define RING_UNLOCK(chan) EVUTIL_NIL_STMT_
+#define RING_LOAD(p) EVUTIL_ATOMIC_LOAD_(p)
+#define RING_STORE(p, v) EVUTIL_ATOMIC_STORE_(p, v)
+#define RING_FENCE() EVUTIL_ATOMIC_FENCE_()
+#else
+#define RING_LOCK(chan) EVLOCK_LOCK((chan)->lock, 0)
+#define RING_UNLOCK(chan) EVLOCK_UNLOCK((chan)->lock, 0)
+#define RING_LOAD(p) (*(p))
+#define RING_STORE(p, v) (*(p) = (v))
+#define RING_FENCE() EVUTIL_NIL_STMT_
+#endif
+
+/* Writer side: is there room for one more evbuffer? */
+static int
+pair_ring_has_room(struct pair_channel *chan, struct pair_ring *r)
+{
+	int room;
+	RING_LOCK(chan);
+	room = r->tail - RING_LOAD(&r->head) < PAIR_RING_SIZE;
+	RING_UNLOCK(chan);
+	return room;
+}
+
+/* Writer side: add buf, which must fit.  Returns 1 if the reader needs to
+ * be woken up. */
+static int
+pair_ring_push(struct pair_channel *chan, struct pair_ring *r,
+    struct evbuffer *buf)
+{
+	unsigned tail;
+	int wake;
+
+	RING_LOCK(chan);
+	tail = r->tail;
+	r->slots[tail % PAIR_RING_SIZE] = buf;
+	RING_STORE(&r->tail, tail + 1);
+	/* Pairs with the fence in pair_ring_pop(): either the reader sees
+	 * the new tail, or we see that it has caught up with the old one. */
+	RING_FENCE();
+	wake = RING_LOAD(&r->head) == tail;
+	RING_UNLOCK(chan);
+	return wake;
+}
+
+/* Reader side: take the oldest evbuffer, or return NULL. */
+static struct evbuffer *
+pair_ring_pop(struct pair_channel *chan, struct pair_ring *r)
+{
+	struct evbuffer *buf = NULL;
+	unsigned head;
+
+	RING_LOCK(chan);
+	head = r->head;
+	RING_FENCE();
+	if (head != RING_LOAD(&r->tail)) {
+		buf = r->slots[head % PAIR_RING_SIZE];
+		RING_STORE(&r->head, head + 1);
+	}
+	RING_UNLOCK(chan);
+	return buf;
+}
+
+static void
+be_pair_cross_wake_partner(struct bufferevent_pair_cross *bev_p)
+{
+	struct pair_channel *chan = bev_p->chan;
+	struct bufferevent_pair_cross *partner;
+
+	EVLOCK_LOCK(chan->lock, 0);
+	partner = chan->ends[!bev_p->side];
+	if (partner)
+		event_active(&partner->notify, EV_READ, 1);
+	EVLOCK_UNLOCK(chan->lock, 0);
+}
+
+/* Hand our output over to the partner.  Called with bev locked. */
+static void
+be_pair_cross_push(struct bufferevent_pair_cross *bev_p, int ignore_enabled)
+{
+	struct bufferevent *bev = downcast(bev_p);
+	struct pair_channel *chan = bev_p->chan;
+	struct pair_ring *r = &chan->rings[bev_p->side];
+	struct evbuffer *buf;
+
+	if (!ignore_enabled &&
+	    (!(bev->enabled & EV_WRITE) || bev_p->bev.write_suspended))
+		return;
+	if (!evbuffer_get_length(bev->output) || RING_LOAD(&r->eof))
+		return;
+	if (!pair_ring_has_room(chan, r)) {
+		RING_STORE(&r->want_space, 1);
+		RING_FENCE();
+		/* The reader may have made room before it could see our
+		 * request */
+		if (!pair_ring_has_room(chan, r))
+			return;
+	}
+	if (!(buf = evbuffer_new()))
+		return;
+
+	evbuffer_unfreeze(bev->output, 1);
+	evbuffer_add_buffer(buf, bev->output);
+	evbuffer_freeze(bev->output, 1);
+
+	if (pair_ring_push(chan, r, buf))
+		be_pair_cross_wake_partner(bev_p);
+
+	BEV_DEL_GENERIC_WRITE_TIMEOUT(bev);
+	bufferevent_trigger_nolock_(bev, EV_WRITE, 0);
+}
+
+/* Take what the partner has sent us.  Called with bev locked. */
+static void
+be_pair_cross_pull(struct bufferevent_pair_cross *bev_p)
+{
+	struct bufferevent *bev = downcast(bev_p);
+	struct pair_channel *chan = bev_p->chan;
+	struct pair_ring *r = &chan->rings[!bev_p->side];
+	struct evbuffer *buf;
+	int n = 0, drained = 0, eof;
+
+	if (!(bev->enabled & EV_READ) || bev_p->bev.read_suspended)
+		return;
+
+	/* Everything pushed before the EOF flag is set will be in the ring
+	 * by the time we have checked the flag */
+	eof = RING_LOAD(&r->eof);
+	evbuffer_unfreeze(bev->input, 0);
+	while (!bev->wm_read.high ||
+	    evbuffer_get_length(bev->input) < bev->wm_read.high) {
+		if (!(buf = pair_ring_pop(chan, r))) {
+			drained = 1;
+			break;
+		}
+		evbuffer_add_buffer(bev->input, buf);
+		evbuffer_free(buf);
+		++n;
+	}
+	evbuffer_freeze(bev->input, 0);
+
+	if (n) {
+		/* pair_ring_pop() has fenced since we made room */
+		if (RING_LOAD(&r->want_space)) {
+			RING_STORE(&r->want_space, 0);
+			be_pair_cross_wake_partner(bev_p);
+		}
+		BEV_RESET_GENERIC_READ_TIMEOUT(bev);
+		bufferevent_trigger_nolock_(bev, EV_READ, 0);
+	}
+
+	if (drained && eof && !bev_p->eof_reported) {
+		bev_p->eof_reported = 1;
+		bufferevent_run_eventcb_(bev, BEV_EVENT_EOF|BEV_EVENT_READING, 0);
+	}
+}
+
+/* Tell the partner we won't write anything more. */
+static void
+be_pair_cross_finish(struct bufferevent_pair_cross *bev_p)
+{
+	struct pair_ring *r = &bev_p->chan->rings[bev_p->side];
+
+	if (RING_LOAD(&r->eof))
+		return;
+	RING_STORE(&r->eof, 1);
+	be_pair_cross_wake_partner(bev_p);
+}
+
+static void
+be_pair_cross_notify_cb(evutil_socket_t fd, short what, void *arg)
+{
+	struct bufferevent_pair_cross *bev_p = arg;
+	struct bufferevent *bev = downcast(bev_p);
+
+	bufferevent_incref_and_lock_(bev);
+	be_pair_cross_pull(bev_p);
+	/* Maybe the partner made room for us */
+	be_pair_cross_push(bev_p, 0);
+	bufferevent_decref_and_unlock_(bev);
+}
+
+static void
+be_pair_cross_outbuf_cb(struct evbuffer *outbuf,
+    const struct evbuffer_cb_info *info, void *arg)
+{
+	struct bufferevent_pair_cross *bev_p = arg;
+
+	if (info->n_added > info->n_deleted) {
+		bufferevent_incref_and_lock_(downcast(bev_p));
+		be_pair_cross_push(bev_p, 0);
+		bufferevent_decref_and_unlock_(downcast(bev_p));
+	}
+}
+
+static int
+be_pair_cross_enable(struct bufferevent *bev, short events)
+{
+	struct bufferevent_pair_cross *bev_p = upcast_cross(bev);
+
+	bufferevent_incref_and_lock_(bev);
+	if (events & EV_READ) {
+		BEV_RESET_GENERIC_READ_TIMEOUT(bev);
+		be_pair_cross_pull(bev_p);
+	}
+	if (events & EV_WRITE) {
+		if (evbuffer_get_length(bev->output))
+			BEV_RESET_GENERIC_WRITE_TIMEOUT(bev);
+		be_pair_cross_push(bev_p, 0);
+	}
+	bufferevent_decref_and_unlock_(bev);
+	return 0;
+}
+
+static void
+be_pair_cross_unlink(struct bufferevent *bev)
+{
+	struct bufferevent_pair_cross *bev_p = upcast_cross(bev);
+	struct pair_channel *chan = bev_p->chan;
+
+	/* The partner gets an EOF */
+	be_pair_cross_finish(bev_p);
+
+	EVLOCK_LOCK(chan->lock, 0);
+	chan->ends[bev_p->side] = NULL;
+	EVLOCK_UNLOCK(chan->lock, 0);
+	/* Nobody can activate it any more */
+	event_del_noblock(&bev_p->notify);
+}
+
+static void
+pair_channel_decref(struct pair_channel *chan)
+{
+	struct evbuffer *buf;
+	int i, refcnt;
+
+	EVLOCK_LOCK(chan->lock, 0);
+	refcnt = --chan->refcnt;
+	EVLOCK_UNLOCK(chan->lock, 0);
+	if (refcnt)
+		return;
+
+	for (i = 0; i < 2; ++i)
+		while ((buf = pair_ring_pop(chan, &chan->rings[i])))
+			evbuffer_free(buf);
+	EVTHREAD_FREE_LOCK(chan->lock, 0);
+	mm_free(chan);
+}
+
+static void
+be_pair_cross_destruct(struct bufferevent *bev)
+{
+	struct bufferevent_pair_cross *bev_p = upcast_cross(bev);
+
+	event_debug_unassign(&bev_p->notify);
+	pair_channel_decref(bev_p->chan);
+}
+
+static int
+be_pair_cross_flush(struct bufferevent *bev, short iotype,
+    enum bufferevent_flush_mode mode)
+{
+	struct bufferevent_pair_cross *bev_p = upcast_cross(bev);
+
+	if (mode == BEV_NORMAL || !(iotype & EV_WRITE))
+		return 0;
+
+	bufferevent_incref_and_lock_(bev);
+	be_pair_cross_push(bev_p, 1);
+	if (mode == BEV_FINISHED && !evbuffer_get_length(bev->output))
+		be_pair_cross_finish(bev_p);
+	bufferevent_decref_and_unlock_(bev);
+	return 0;
+}
+
+static struct bufferevent *
+be_pair_cross_get_partner(struct bufferevent *bev)
+{
+	struct bufferevent_pair_cross *bev_p = upcast_cross(bev);
+	struct bufferevent_pair_cross *partner;
+
+	EVLOCK_LOCK(bev_p->chan->lock, 0);
+	partner = bev_p->chan->ends[!bev_p->side];
+	EVLOCK_UNLOCK(bev_p->chan->lock, 0);
+	return partner ? downcast(partner) : NULL;
+}
+
+const struct bufferevent_ops bufferevent_ops_pair_cross = {
+	"pair_cross_elt",
+	evutil_offsetof(struct bufferevent_pair_cross, bev.bev),
+	be_pair_cross_enable,
+	be_pair_disable,
+	be_pair_cross_unlink,
+	be_pair_cross_destruct,
+	bufferevent_generic_adj_timeouts_,
+	be_pair_cross_flush,
+	NULL, /* ctrl */
+};
+
+static struct bufferevent_pair_cross *
+bufferevent_pair_cross_elt_new(struct event_base *base, int options,
+    struct pair_channel *chan, int side)
+{
+	struct bufferevent_pair_cross *bufev;
+	if (! (bufev = mm_calloc(1, sizeof(struct bufferevent_pair_cross))))
+		return NULL;
+	if (bufferevent_init_common_(&bufev->bev, base,
+		&bufferevent_ops_pair_cross, options)) {
+		mm_free(bufev);
+		return NULL;
+	}
+	bufev->chan = chan;
+	bufev->side = side;
+	event_assign(&bufev->notify, base, -1, 0, be_pair_cross_notify_cb,
+	    bufev);
+	/* From here on, destruct releases the channel */
+	++chan->refcnt;
+	chan->ends[side] = bufev;
+	if (!evbuffer_add_cb(bufev->bev.bev.output, be_pair_cross_outbuf_cb,
+		bufev)) {
+		bufferevent_free(downcast(bufev));
+		return NULL;
+	}
+
+	bufferevent_init_generic_timeout_cbs_(&bufev->bev.bev);
+
+	evbuffer_freeze(bufev->bev.bev.input, 0);
+	evbuffer_freeze(bufev->bev.bev.output, 1);
+
+	return bufev;
+}
+
+int
+bufferevent_pair_new_cross(struct event_base *base1,
+    struct event_base *base2, int options, struct bufferevent *pair[2])
+{
+	struct pair_channel *chan;
+	struct bufferevent_pair_cross *bufev1, *bufev2;
+
+	if (base1 != base2 && !EVTHREAD_LOCKING_ENABLED())
+		return -1;
+
+	if (!(chan = mm_calloc(1, sizeof(*chan))))
+		return -1;
+	EVTHREAD_ALLOC_LOCK(chan->lock, 0);
+	/* Our own reference, until both ends hold theirs */
+	chan->refcnt = 1;
+
+	options |= BEV_OPT_DEFER_CALLBACKS;
+
+	bufev1 = bufferevent_pair_cross_elt_new(base1, options, chan, 0);
+	if (!bufev1) {
+		pair_channel_decref(chan);
+		return -1;
+	}
+	bufev2 = bufferevent_pair_cross_elt_new(base2, options, chan, 1);
+	if (!bufev2) {
+		bufferevent_free(downcast(bufev1));
+		pair_channel_decref(chan);
+		return -1;
+	}
+	pair_channel_decref(chan);
+
+	pair[0] = downcast(bufev1);
+	pair[1] = downcast(bufev2);
+
+	return 0;
+}
@@ -0,0 +1,386 @@
+/*
+ * Copyright (c) 2026 The Libevent authors
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "event2/event-config.h"
+#include "evconfig-private.h"
+
+#include <sys/types.h>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#endif
+#ifdef EVENT__HAVE_FCNTL_H
+#include <fcntl.h>
+#endif
+#ifdef EVENT__HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#include <errno.h>
+
+#include "event2/util.h"
+#include "event2/buffer.h"
+#include "event2/bufferevent.h"
+#include "event2/bufferevent_struct.h"
+#include "event2/event.h"
+#include "bufferevent-internal.h"
+#include "mm-internal.h"
+#include "util-internal.h"
+
+#if defined(EVENT__HAVE_SPLICE) && defined(SPLICE_F_NONBLOCK)
+#define USE_SPLICE
+#endif
+
+/* When copying, stop reading once the other side has this much output
+ * pending, and start again when it is down to half of it. */
+#define RELAY_MAX_OUTPUT (512*1024)
+/* Most bytes to move into the pipe at a time; the default pipe capacity */
+#define RELAY_PIPE_SIZE 65536
+/* Most pipe fills per callback, so that one busy relay can't starve the
+ * rest of the loop */
+#define RELAY_SPLICE_ROUNDS 16
+
+/* One direction of a relay */
+struct relay_dir {
+	struct bufferevent_relay *relay;
+	struct bufferevent *src;
+	struct bufferevent *dst;
+	ev_uint64_t relayed;
+#ifdef USE_SPLICE
+	/* Data read from src waits here until dst can take it */
+	evutil_socket_t pipe[2];
+	size_t in_pipe;
+	struct event *readev;
+	struct event *writeev;
+	unsigned eof : 1;
+#endif
+	unsigned done : 1;
+};
+
+struct bufferevent_relay {
+	/* a to b, and b to a */
+	struct relay_dir dirs[2];
+	bufferevent_relay_cb eventcb;
+	void *ctx;
+	unsigned spliced : 1;
+};
+
+/* The direction that writes to the source of d */
+static inline struct relay_dir *
+relay_reverse(struct relay_dir *d)
+{
+	return &d->relay->dirs[d == &d->relay->dirs[0]];
+}
+
+static void
+relay_report(struct relay_dir *d, struct bufferevent *bev, short what)
+{
+	struct bufferevent_relay *relay = d->relay;
+
+	d->done = 1;
+	if (relay->eventcb)
+		relay->eventcb(relay, bev, what, relay->ctx);
+}
+
+static void
+relay_readcb(struct bufferevent *bev, void *ctx)
+{
+	struct relay_dir *d = ctx;
+	struct evbuffer *src = bufferevent_get_input(bev);
+	struct evbuffer *dst = bufferevent_get_output(d->dst);
+
+	d->relayed += evbuffer_get_length(src);
+	evbuffer_add_buffer(dst, src);
+
+	if (evbuffer_get_length(dst) >= RELAY_MAX_OUTPUT) {
+		/* We're giving the other side data faster than it can pass
+		 * it on.  Stop reading here until it has drained to half. */
+		bufferevent_setwatermark(d->dst, EV_WRITE,
+		    RELAY_MAX_OUTPUT/2, RELAY_MAX_OUTPUT);
+		bufferevent_disable(bev, EV_READ);
+	}
+}
+
+static void
+relay_writecb(struct bufferevent *bev, void *ctx)
+{
+	/* bev drained its output: start reading from its partner again */
+	struct relay_dir *d = relay_reverse(ctx);
+
+	bufferevent_setwatermark(bev, EV_WRITE, 0, 0);
+	if (!d->done)
+		bufferevent_enable(d->src, EV_READ);
+}
+
+static void
+relay_eventcb(struct bufferevent *bev, short what, void *ctx)
+{
+	struct relay_dir *d = ctx;
+
+	if (what & BEV_EVENT_CONNECTED)
+		return;
+	if (what & BEV_EVENT_EOF) {
+		/* Pass on whatever came in with the EOF */
+		struct evbuffer *src = bufferevent_get_input(bev);
+		d->relayed += evbuffer_get_length(src);
+		evbuffer_add_buffer(bufferevent_get_output(d->dst), src);
+	}
+	relay_report(d, bev, what);
+}
+
+#ifdef USE_SPLICE
+/* Stop both events of a direction that is finished. */
+static void
+relay_splice_stop(struct relay_dir *d)
+{
+	event_del(d->readev);
+	event_del(d->writeev);
+}
+
+/* Move as much data from src to dst as we can without blocking. */
+static void
+relay_splice_pump(struct relay_dir *d)
+{
+	evutil_socket_t src_fd = bufferevent_getfd(d->src);
+	evutil_socket_t dst_fd = bufferevent_getfd(d->dst);
+	struct evbuffer *pending = bufferevent_get_output(d->dst);
+	ev_ssize_t n;
+	int rounds = 0;
+
+	while (rounds < RELAY_SPLICE_ROUNDS) {
+		/* Whatever dst had in its output buffer when we took over
+		 * goes first */
+		if (evbuffer_get_length(pending)) {
+			evbuffer_unfreeze(pending, 1);
+			n = evbuffer_write(pending, dst_fd);
+			evbuffer_freeze(pending, 1);
+			if (n < 0)
+				goto write_failed;
+			continue;
+		}
+		if (d->in_pipe) {
+			n = splice(d->pipe[0], NULL, dst_fd, NULL, d->in_pipe,
+			    SPLICE_F_MOVE|SPLICE_F_NONBLOCK);
+			if (n < 0)
+				goto write_failed;
+			d->in_pipe -= n;
+			d->relayed += n;
+			continue;
+		}
+		if (d->eof) {
+			relay_splice_stop(d);
+			relay_report(d, d->src, BEV_EVENT_EOF|BEV_EVENT_READING);
+			return;
+		}
+		n = splice(src_fd, NULL, d->pipe[1], NULL, RELAY_PIPE_SIZE,
+		    SPLICE_F_MOVE|SPLICE_F_NONBLOCK);
+		if (n == 0) {
+			d->eof = 1;
+		} else if (n < 0) {
+			if (!EVUTIL_ERR_RW_RETRIABLE(errno)) {
+				relay_splice_stop(d);
+				relay_report(d, d->src,
+				    BEV_EVENT_ERROR|BEV_EVENT_READING);
+				return;
+			}
+			/* Everything is written: wait for more to read */
+			event_del(d->writeev);
+			event_add(d->readev, NULL);
+			return;
+		} else {
+			d->in_pipe = n;
+			++rounds;
+		}
+	}
+	/* Out of rounds with data still coming: src is still readable, so
+	 * we'll be back on the next iteration of the loop. */
+	return;
+
+write_failed:
+	if (!EVUTIL_ERR_RW_RETRIABLE(errno)) {
+		relay_splice_stop(d);
+		relay_report(d, d->dst, BEV_EVENT_ERROR|BEV_EVENT_WRITING);
+		return;
+	}
+	/* dst is full: stop reading until it has taken what we have */
+	event_del(d->readev);
+	event_add(d->writeev, NULL);
+}
+
+static void
+relay_splice_cb(evutil_socket_t fd, short what, void *arg)
+{
+	relay_splice_pump(arg);
+}
+
+static int
+relay_can_splice(struct bufferevent *bev)
+{
+	return BEV_IS_SOCKET(bev) &&
+	    !BEV_UPCAST(bev)->rate_limiting &&
+	    !BEV_UPCAST(bev)->connecting &&
+	    bufferevent_getfd(bev) != EVUTIL_INVALID_SOCKET;
+}
+
+static int
+relay_splice_setup(struct relay_dir *d)
+{
+	struct event_base *base = bufferevent_get_base(d->src);
+
+	if (evutil_make_internal_pipe_(d->pipe) < 0) {
+		d->pipe[0] = d->pipe[1] = EVUTIL_INVALID_SOCKET;
+		return -1;
+	}
+	d->readev = event_new(base, bufferevent_getfd(d->src),
+	    EV_READ|EV_PERSIST, relay_splice_cb, d);
+	d->writeev = event_new(base, bufferevent_getfd(d->dst),
+	    EV_WRITE|EV_PERSIST, relay_splice_cb, d);
+	if (!d->readev || !d->writeev)
+		return -1;
+	return 0;
+}
+
+static void
+relay_splice_free(struct relay_dir *d)
+{
+	if (d->readev)
+		event_free(d->readev);
+	if (d->writeev)
+		event_free(d->writeev);
+	if (d->pipe[0] != EVUTIL_INVALID_SOCKET)
+		evutil_closesocket(d->pipe[0]);
+	if (d->pipe[1] != EVUTIL_INVALID_SOCKET)
+		evutil_closesocket(d->pipe[1]);
+	d->readev = d->writeev = NULL;
+	d->pipe[0] = d->pipe[1] = EVUTIL_INVALID_SOCKET;
+}
+#endif
+
+struct bufferevent_relay *
+bufferevent_relay_new(struct bufferevent *a, struct bufferevent *b,
+    int flags, bufferevent_relay_cb eventcb, void *ctx)
+{
+	struct bufferevent_relay *relay;
+	int i;
+
+	if (!a || !b || a == b ||
+	    bufferevent_get_base(a) != bufferevent_get_base(b))
+		return NULL;
+
+	relay = mm_calloc(1, sizeof(*relay));
+	if (!relay)
+		return NULL;
+	relay->eventcb = eventcb;
+	relay->ctx = ctx;
+	relay->dirs[0].src = relay->dirs[1].dst = a;
+	relay->dirs[1].src = relay->dirs[0].dst = b;
+	for (i = 0; i < 2; ++i) {
+		relay->dirs[i].relay = relay;
+#ifdef USE_SPLICE
+		relay->dirs[i].pipe[0] = relay->dirs[i].pipe[1] =
+		    EVUTIL_INVALID_SOCKET;
+#endif
+	}
+
+#ifdef USE_SPLICE
+	if (!(flags & BEV_RELAY_NO_SPLICE) &&
+	    relay_can_splice(a) && relay_can_splice(b)) {
+		relay->spliced = 1;
+		for (i = 0; i < 2; ++i) {
+			if (relay_splice_setup(&relay->dirs[i]) < 0) {
+				relay_splice_free(&relay->dirs[0]);
+				relay_splice_free(&relay->dirs[1]);
+				relay->spliced = 0;
+				break;
+			}
+		}
+	}
+	if (relay->spliced) {
+		for (i = 0; i < 2; ++i) {
+			struct relay_dir *d = &relay->dirs[i];
+			struct evbuffer *input = bufferevent_get_input(d->src);
+
+			bufferevent_setcb(d->src, NULL, NULL, NULL, NULL);
+			bufferevent_disable(d->src, EV_READ|EV_WRITE);
+			/* The pump writes out dst's output buffer first */
+			d->relayed += evbuffer_get_length(input);
+			evbuffer_add_buffer(bufferevent_get_output(d->dst),
+			    input);
+		}
+		for (i = 0; i < 2; ++i)
+			event_active(relay->dirs[i].readev, EV_READ, 1);
+		return relay;
+	}
+#endif
+
+	for (i = 0; i < 2; ++i) {
+		struct relay_dir *d = &relay->dirs[i];
+		bufferevent_setcb(d->src, relay_readcb, relay_writecb,
+		    relay_eventcb, d);
+		bufferevent_enable(d->src, EV_READ|EV_WRITE);
+	}
+	for (i = 0; i < 2; ++i) {
+		struct relay_dir *d = &relay->dirs[i];
+		if (evbuffer_get_length(bufferevent_get_input(d->src)))
+			relay_readcb(d->src, d);
+	}
+	return relay;
+}
+
+void
+bufferevent_relay_free(struct bufferevent_relay *relay)
+{
+	int i;
+
+	for (i = 0; i < 2; ++i) {
+		struct relay_dir *d = &relay->dirs[i];
+#ifdef USE_SPLICE
+		if (relay->spliced) {
+			relay_splice_free(d);
+			continue;
+		}
+#endif
+		bufferevent_setcb(d->src, NULL, NULL, NULL, NULL);
+		bufferevent_setwatermark(d->src, EV_WRITE, 0, 0);
+	}
+	mm_free(relay);
+}
+
+int
+bufferevent_relay_is_spliced(struct bufferevent_relay *relay)
+{
+	return relay->spliced;
+}
+
+ev_uint64_t
+bufferevent_relay_get_relayed(struct bufferevent_relay *relay,
+    struct bufferevent *bev)
+{
+	int i;
+
+	for (i = 0; i < 2; ++i)
+		if (relay->dirs[i].src == bev)
+			return relay->dirs[i].relayed;
+	return 0;
+}
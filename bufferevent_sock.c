@@ -30,6 +30,7 @@
 #include "evconfig-private.h"
 
 #include <sys/types.h>
+#include <sys/queue.h>
 
 #ifdef EVENT__HAVE_SYS_TIME_H
 #include <sys/time.h>
@@ -476,7 +477,8 @@ bufferevent_connect_getaddrinfo_cb(int result, struct evutil_addrinfo *ai,
 		return;
 	}
 
-	/* XXX use the other addrinfos? */
+	/* Only used for bufferevents that can't take part in a connection
+	 * race; see bufferevent_connect_race below. */
 	bufferevent_socket_set_conn_address_(bev, ai->ai_addr, (int)ai->ai_addrlen);
 	r = bufferevent_socket_connect(bev, ai->ai_addr, (int)ai->ai_addrlen);
 	if (r < 0)
@@ -485,6 +487,490 @@ bufferevent_connect_getaddrinfo_cb(int result, struct evutil_addrinfo *ai,
 	evutil_freeaddrinfo(ai);
 }
 
+/*
+ * "Happy Eyeballs" (RFC 8305) support for bufferevent_socket_connect_hostname.
+ *
+ * When the caller doesn't care about the address family, we look up A and
+ * AAAA records with two separate requests, so that we can start connecting
+ * as soon as either one answers.  Every address we learn about goes into a
+ * per-family queue; we try them alternating between families (IPv6 first),
+ * starting a new attempt whenever the previous one fails or has been
+ * outstanding for BEV_CONNECT_ATTEMPT_DELAY_MSEC.  The first socket to finish
+ * connecting wins and is installed into the bufferevent; all the others are
+ * closed.
+ */
+
+/* How long to wait for the AAAA answer once we have an A answer before
+ * connecting anyway ("Resolution Delay" in RFC 8305). */
+#define BEV_CONNECT_RESOLUTION_DELAY_MSEC 50
+/* How long to let a connection attempt run before starting another one in
+ * parallel ("Connection Attempt Delay" in RFC 8305). */
+#define BEV_CONNECT_ATTEMPT_DELAY_MSEC 250
+
+/* Indices into the per-family arrays of a bufferevent_connect_race. */
+#define BEV_RACE_V6 0
+#define BEV_RACE_V4 1
+
+struct bufferevent_connect_race;
+
+/* One outstanding lookup made on behalf of a connection race. */
+struct bufferevent_connect_lookup {
+	struct bufferevent_connect_race *race;
+	struct evdns_getaddrinfo_request *request;
+	/* True until the lookup's callback has been invoked. */
+	unsigned pending : 1;
+};
+
+/* One socket that we're trying to connect. */
+struct bufferevent_connect_attempt {
+	TAILQ_ENTRY(bufferevent_connect_attempt) next;
+	struct bufferevent_connect_race *race;
+	struct event ev;
+	evutil_socket_t fd;
+	const struct evutil_addrinfo *ai;
+};
+
+/* Queue of addresses of a single family that we haven't tried yet. */
+struct bufferevent_connect_addrq {
+	const struct evutil_addrinfo **addrs;
+	int n_addrs;
+	int n_alloc;
+	int next;
+};
+
+struct bufferevent_connect_race {
+	/* The bufferevent we're connecting. Each pending lookup holds a
+	 * reference to it. */
+	struct bufferevent *bev;
+
+	/* The A/AAAA lookups.  If we only need a single lookup, we use the
+	 * first one. */
+	struct bufferevent_connect_lookup lookups[2];
+	/* The number of lookups whose callbacks have not run yet. */
+	int n_lookups_pending;
+	/* The first error reported by any lookup. */
+	int dns_error;
+
+	/* Every addrinfo list we have received; freed with the race. */
+	struct evutil_addrinfo *results;
+	/* Not-yet-tried addresses, by family. */
+	struct bufferevent_connect_addrq addrq[2];
+	/* The family of the most recent attempt, or -1 if none. */
+	int last_family;
+
+	TAILQ_HEAD(, bufferevent_connect_attempt) attempts;
+	/* Fires when it's time to start the next attempt (or, before we
+	 * have started, when the resolution delay expires.) */
+	struct event delay;
+	/* Enforces the write timeout of the bufferevent over the whole
+	 * connection race, as bufferevent_socket_connect does. */
+	struct event timeout;
+
+	/* The socket error from the last failed attempt. */
+	int last_error;
+
+	/* Set once we have started connecting. */
+	unsigned started : 1;
+	/* Set once we are no longer waiting on the resolution delay. */
+	unsigned resolution_delay_done : 1;
+	/* Set once the race has been won, lost, or abandoned. */
+	unsigned done : 1;
+};
+
+static void bufferevent_connect_race_try_next(struct bufferevent_connect_race *race);
+
+static int
+bufferevent_connect_addrq_push(struct bufferevent_connect_addrq *q,
+    const struct evutil_addrinfo *ai)
+{
+	if (q->n_addrs == q->n_alloc) {
+		int n_alloc = q->n_alloc ? q->n_alloc * 2 : 4;
+		const struct evutil_addrinfo **addrs =
+		    mm_realloc((void *)q->addrs, n_alloc * sizeof(*addrs));
+		if (!addrs)
+			return -1;
+		q->addrs = addrs;
+		q->n_alloc = n_alloc;
+	}
+	q->addrs[q->n_addrs++] = ai;
+	return 0;
+}
+
+static int
+bufferevent_connect_addrq_empty(const struct bufferevent_connect_addrq *q)
+{
+	return q->next == q->n_addrs;
+}
+
+/* Return true iff there is nothing left that could still connect. */
+static int
+bufferevent_connect_race_exhausted(struct bufferevent_connect_race *race)
+{
+	return race->n_lookups_pending == 0 &&
+	    TAILQ_EMPTY(&race->attempts) &&
+	    bufferevent_connect_addrq_empty(&race->addrq[BEV_RACE_V6]) &&
+	    bufferevent_connect_addrq_empty(&race->addrq[BEV_RACE_V4]);
+}
+
+static void
+bufferevent_connect_attempt_free(struct bufferevent_connect_attempt *attempt)
+{
+	TAILQ_REMOVE(&attempt->race->attempts, attempt, next);
+	event_del(&attempt->ev);
+	if (attempt->fd >= 0)
+		evutil_closesocket(attempt->fd);
+	mm_free(attempt);
+}
+
+static void
+bufferevent_connect_race_free(struct bufferevent_connect_race *race)
+{
+	EVUTIL_ASSERT(race->done && race->n_lookups_pending == 0);
+	EVUTIL_ASSERT(TAILQ_EMPTY(&race->attempts));
+	if (race->results)
+		evutil_freeaddrinfo(race->results);
+	mm_free((void *)race->addrq[BEV_RACE_V6].addrs);
+	mm_free((void *)race->addrq[BEV_RACE_V4].addrs);
+	mm_free(race);
+}
+
+/* Stop everything the race is doing.  The race itself stays around until
+ * the callbacks of any lookups we cancel here have run. */
+static void
+bufferevent_connect_race_stop(struct bufferevent_connect_race *race)
+{
+	struct bufferevent_private *bev_p = BEV_UPCAST(race->bev);
+	int i;
+
+	race->done = 1;
+	if (bev_p->connect_race == race)
+		bev_p->connect_race = NULL;
+
+	event_del(&race->delay);
+	event_del(&race->timeout);
+	while (!TAILQ_EMPTY(&race->attempts))
+		bufferevent_connect_attempt_free(TAILQ_FIRST(&race->attempts));
+	for (i = 0; i < 2; ++i) {
+		if (race->lookups[i].request) {
+			struct evdns_getaddrinfo_request *req =
+			    race->lookups[i].request;
+			race->lookups[i].request = NULL;
+			evutil_getaddrinfo_cancel_async_(req);
+		}
+	}
+}
+
+/* Free the race if nothing refers to it any longer.  Returns 1 if we freed
+ * it. */
+static int
+bufferevent_connect_race_maybe_free(struct bufferevent_connect_race *race)
+{
+	if (!race->done || race->n_lookups_pending)
+		return 0;
+	bufferevent_connect_race_free(race);
+	return 1;
+}
+
+/* Abandon the race for 'bev', if there is one, without telling the user.
+ * Called when the bufferevent gets a new fd or is being freed. */
+static void
+bufferevent_connect_race_cancel(struct bufferevent_private *bev_p,
+    int unsuspend)
+{
+	struct bufferevent_connect_race *race = bev_p->connect_race;
+	if (!race)
+		return;
+
+	if (race->n_lookups_pending)
+		bev_p->dns_error = EVUTIL_EAI_CANCEL;
+	bufferevent_connect_race_stop(race);
+	if (unsuspend) {
+		bufferevent_unsuspend_write_(&bev_p->bev, BEV_SUSPEND_LOOKUP);
+		bufferevent_unsuspend_read_(&bev_p->bev, BEV_SUSPEND_LOOKUP);
+	}
+	bufferevent_connect_race_maybe_free(race);
+}
+
+/* Give up on the race and tell the user. */
+static void
+bufferevent_connect_race_fail(struct bufferevent_connect_race *race,
+    short what)
+{
+	struct bufferevent *bev = race->bev;
+	struct bufferevent_private *bev_p = BEV_UPCAST(bev);
+	int err = race->last_error;
+
+	if (!race->results)
+		bev_p->dns_error = race->dns_error ? race->dns_error :
+		    EVUTIL_EAI_NODATA;
+
+	bufferevent_connect_race_stop(race);
+	bufferevent_connect_race_maybe_free(race);
+
+	bufferevent_unsuspend_write_(bev, BEV_SUSPEND_LOOKUP);
+	bufferevent_unsuspend_read_(bev, BEV_SUSPEND_LOOKUP);
+
+	/* Let the user see why the last attempt failed. */
+	if (err)
+		EVUTIL_SET_SOCKET_ERROR(err);
+	bufferevent_run_eventcb_(bev, what, 0);
+}
+
+/* 'attempt' has connected: hand its socket to the bufferevent. */
+static void
+bufferevent_connect_race_win(struct bufferevent_connect_attempt *attempt)
+{
+	struct bufferevent_connect_race *race = attempt->race;
+	struct bufferevent *bev = race->bev;
+	evutil_socket_t fd = attempt->fd;
+
+	attempt->fd = -1;
+	bufferevent_socket_set_conn_address_(bev, attempt->ai->ai_addr,
+	    attempt->ai->ai_addrlen);
+
+	bufferevent_connect_race_stop(race);
+	bufferevent_connect_race_maybe_free(race);
+
+	bufferevent_setfd(bev, fd);
+	bufferevent_unsuspend_write_(bev, BEV_SUSPEND_LOOKUP);
+	bufferevent_unsuspend_read_(bev, BEV_SUSPEND_LOOKUP);
+	bufferevent_run_eventcb_(bev, BEV_EVENT_CONNECTED, 0);
+}
+
+/* Record that an attempt failed, and move on to the next address. */
+static void
+bufferevent_connect_attempt_failed(struct bufferevent_connect_attempt *attempt,
+    int err)
+{
+	struct bufferevent_connect_race *race = attempt->race;
+
+	race->last_error = err;
+	bufferevent_connect_attempt_free(attempt);
+	bufferevent_connect_race_try_next(race);
+}
+
+static void
+bufferevent_connect_attempt_cb(evutil_socket_t fd, short what, void *arg)
+{
+	struct bufferevent_connect_attempt *attempt = arg;
+	struct bufferevent *bev = attempt->race->bev;
+	int c;
+
+	bufferevent_incref_and_lock_(bev);
+
+	c = evutil_socket_finished_connecting_(fd);
+	if (c > 0)
+		bufferevent_connect_race_win(attempt);
+	else if (c < 0)
+		bufferevent_connect_attempt_failed(attempt,
+		    evutil_socket_geterror(fd));
+
+	bufferevent_decref_and_unlock_(bev);
+}
+
+/* Pop the next address to try, alternating between address families. */
+static const struct evutil_addrinfo *
+bufferevent_connect_race_next_addr(struct bufferevent_connect_race *race)
+{
+	struct bufferevent_connect_addrq *q;
+	int family = race->last_family == BEV_RACE_V6 ?
+	    BEV_RACE_V4 : BEV_RACE_V6;
+
+	if (bufferevent_connect_addrq_empty(&race->addrq[family]))
+		family = !family;
+	q = &race->addrq[family];
+	if (bufferevent_connect_addrq_empty(q))
+		return NULL;
+
+	race->last_family = family;
+	return q->addrs[q->next++];
+}
+
+/* Launch connection attempts until one of them is in progress, or until we
+ * run out of addresses. */
+static void
+bufferevent_connect_race_try_next(struct bufferevent_connect_race *race)
+{
+	const struct evutil_addrinfo *ai;
+	struct timeval tv;
+
+	if (race->done)
+		return;
+
+	event_del(&race->delay);
+
+	while ((ai = bufferevent_connect_race_next_addr(race))) {
+		struct bufferevent_connect_attempt *attempt;
+		evutil_socket_t fd;
+		int r;
+
+		fd = evutil_socket_(ai->ai_family,
+		    SOCK_STREAM|EVUTIL_SOCK_NONBLOCK, 0);
+		if (fd < 0) {
+			race->last_error = EVUTIL_SOCKET_ERROR();
+			continue;
+		}
+		r = evutil_socket_connect_(&fd, ai->ai_addr, (int)ai->ai_addrlen);
+		if (r < 0 || r == 2) {
+			/* Failed, or refused right away. */
+			race->last_error = evutil_socket_geterror(fd);
+			evutil_closesocket(fd);
+			continue;
+		}
+
+		attempt = mm_calloc(1, sizeof(*attempt));
+		if (!attempt) {
+			race->last_error = ENOMEM;
+			evutil_closesocket(fd);
+			continue;
+		}
+		attempt->race = race;
+		attempt->fd = fd;
+		attempt->ai = ai;
+		TAILQ_INSERT_TAIL(&race->attempts, attempt, next);
+
+		if (r == 1) {
+			/* Connected already. */
+			bufferevent_connect_race_win(attempt);
+			return;
+		}
+
+		event_assign(&attempt->ev, race->bev->ev_base, fd, EV_WRITE,
+		    bufferevent_connect_attempt_cb, attempt);
+		if (event_add(&attempt->ev, NULL) < 0) {
+			bufferevent_connect_attempt_free(attempt);
+			continue;
+		}
+
+		tv.tv_sec = 0;
+		tv.tv_usec = BEV_CONNECT_ATTEMPT_DELAY_MSEC * 1000;
+		event_add(&race->delay, &tv);
+		return;
+	}
+
+	if (bufferevent_connect_race_exhausted(race))
+		bufferevent_connect_race_fail(race, BEV_EVENT_ERROR);
+}
+
+/* Begin connecting, unless we should give the AAAA lookup a little longer
+ * to answer. */
+static void
+bufferevent_connect_race_start(struct bufferevent_connect_race *race)
+{
+	struct timeval tv;
+
+	if (race->started) {
+		/* If an attempt is younger than the attempt delay, let it be;
+		 * otherwise the new addresses can be tried right away. */
+		if (!event_pending(&race->delay, EV_TIMEOUT, NULL))
+			bufferevent_connect_race_try_next(race);
+		return;
+	}
+
+	if (!race->resolution_delay_done &&
+	    !bufferevent_connect_addrq_empty(&race->addrq[BEV_RACE_V4]) &&
+	    bufferevent_connect_addrq_empty(&race->addrq[BEV_RACE_V6]) &&
+	    race->lookups[BEV_RACE_V6].pending) {
+		if (!event_pending(&race->delay, EV_TIMEOUT, NULL)) {
+			tv.tv_sec = 0;
+			tv.tv_usec = BEV_CONNECT_RESOLUTION_DELAY_MSEC * 1000;
+			event_add(&race->delay, &tv);
+		}
+		return;
+	}
+
+	if (bufferevent_connect_addrq_empty(&race->addrq[BEV_RACE_V6]) &&
+	    bufferevent_connect_addrq_empty(&race->addrq[BEV_RACE_V4])) {
+		if (bufferevent_connect_race_exhausted(race))
+			bufferevent_connect_race_fail(race, BEV_EVENT_ERROR);
+		return;
+	}
+
+	race->started = 1;
+	if (evutil_timerisset(&race->bev->timeout_write))
+		event_add(&race->timeout, &race->bev->timeout_write);
+	bufferevent_connect_race_try_next(race);
+}
+
+static void
+bufferevent_connect_race_delay_cb(evutil_socket_t fd, short what, void *arg)
+{
+	struct bufferevent_connect_race *race = arg;
+	struct bufferevent *bev = race->bev;
+
+	bufferevent_incref_and_lock_(bev);
+	if (!race->started) {
+		race->resolution_delay_done = 1;
+		bufferevent_connect_race_start(race);
+	} else {
+		bufferevent_connect_race_try_next(race);
+	}
+	bufferevent_decref_and_unlock_(bev);
+}
+
+static void
+bufferevent_connect_race_timeout_cb(evutil_socket_t fd, short what, void *arg)
+{
+	struct bufferevent_connect_race *race = arg;
+	struct bufferevent *bev = race->bev;
+
+	bufferevent_incref_and_lock_(bev);
+	race->last_error = 0;
+	bufferevent_connect_race_fail(race,
+	    BEV_EVENT_WRITING|BEV_EVENT_TIMEOUT);
+	bufferevent_decref_and_unlock_(bev);
+}
+
+static void
+bufferevent_connect_race_getaddrinfo_cb(int result, struct evutil_addrinfo *ai,
+    void *arg)
+{
+	struct bufferevent_connect_lookup *lookup = arg;
+	struct bufferevent_connect_race *race = lookup->race;
+	struct bufferevent *bev = race->bev;
+	struct evutil_addrinfo *a;
+
+	BEV_LOCK(bev);
+
+	lookup->request = NULL;
+	lookup->pending = 0;
+	--race->n_lookups_pending;
+
+	if (race->done) {
+		if (ai)
+			evutil_freeaddrinfo(ai);
+		bufferevent_connect_race_maybe_free(race);
+		goto done;
+	}
+
+	if (result != 0) {
+		if (!race->dns_error)
+			race->dns_error = result;
+		if (ai)
+			evutil_freeaddrinfo(ai);
+		ai = NULL;
+	}
+
+	for (a = ai; a; a = a->ai_next) {
+		int family;
+		if (a->ai_family == AF_INET6)
+			family = BEV_RACE_V6;
+		else if (a->ai_family == AF_INET)
+			family = BEV_RACE_V4;
+		else
+			continue;
+		if (bufferevent_connect_addrq_push(&race->addrq[family], a) < 0)
+			break;
+	}
+	if (ai)
+		race->results = evutil_addrinfo_append_(race->results, ai);
+
+	bufferevent_connect_race_start(race);
+
+done:
+	bufferevent_decref_and_unlock_(bev);
+}
+
 int
 bufferevent_socket_connect_hostname(struct bufferevent *bev,
     struct evdns_base *evdns_base, int family, const char *hostname, int port)
@@ -498,6 +984,79 @@ bufferevent_socket_connect_hostname(struct bufferevent *bev,
 	return bufferevent_socket_connect_hostname_hints(bev, evdns_base, &hint, hostname, port);
 }
 
+/* Start a connection race for 'bev'.  Called with the bufferevent locked.
+ * Returns 0 on success, -1 if we couldn't allocate the race. */
+static int
+bufferevent_connect_race_new(struct bufferevent *bev,
+    struct evdns_base *evdns_base, const struct evutil_addrinfo *hints_in,
+    const char *hostname, const char *portbuf)
+{
+	struct bufferevent_private *bev_p = BEV_UPCAST(bev);
+	struct bufferevent_connect_race *race;
+	struct evutil_addrinfo hints[2], *ai = NULL;
+	int n_lookups = 1;
+	int i;
+
+	race = mm_calloc(1, sizeof(*race));
+	if (!race)
+		return -1;
+	race->bev = bev;
+	race->last_family = -1;
+	TAILQ_INIT(&race->attempts);
+	evtimer_assign(&race->delay, bev->ev_base,
+	    bufferevent_connect_race_delay_cb, race);
+	evtimer_assign(&race->timeout, bev->ev_base,
+	    bufferevent_connect_race_timeout_cb, race);
+
+	memcpy(&hints[0], hints_in, sizeof(hints[0]));
+	memcpy(&hints[1], hints_in, sizeof(hints[1]));
+	if (hints_in->ai_family == AF_UNSPEC && evdns_base) {
+		/* Don't launch two lookups for an address literal. */
+		hints[0].ai_flags |= EVUTIL_AI_NUMERICHOST;
+		if (evutil_getaddrinfo(hostname, portbuf, &hints[0], &ai) == 0) {
+			evutil_freeaddrinfo(ai);
+		} else {
+			n_lookups = 2;
+			hints[BEV_RACE_V6].ai_family = AF_INET6;
+			hints[BEV_RACE_V4].ai_family = AF_INET;
+		}
+		hints[0].ai_flags = hints_in->ai_flags;
+	}
+
+	bev_p->connect_race = race;
+	for (i = 0; i < n_lookups; ++i) {
+		race->lookups[i].race = race;
+		race->lookups[i].pending = 1;
+	}
+
+	/* Note that the callbacks may be invoked before
+	 * evutil_getaddrinfo_async_() returns.  We count ourselves as a
+	 * pending lookup so that the race can't finish (and be freed) until
+	 * we have launched everything. */
+	race->n_lookups_pending = n_lookups + 1;
+	for (i = 0; i < n_lookups; ++i) {
+		struct evdns_getaddrinfo_request *req;
+		if (race->done) {
+			race->lookups[i].pending = 0;
+			--race->n_lookups_pending;
+			continue;
+		}
+		bufferevent_incref_(bev);
+		req = evutil_getaddrinfo_async_(evdns_base, hostname, portbuf,
+		    &hints[i], bufferevent_connect_race_getaddrinfo_cb,
+		    &race->lookups[i]);
+		if (race->lookups[i].pending)
+			race->lookups[i].request = req;
+	}
+	--race->n_lookups_pending;
+	if (race->done)
+		bufferevent_connect_race_maybe_free(race);
+	else
+		bufferevent_connect_race_start(race);
+
+	return 0;
+}
+
 int
 bufferevent_socket_connect_hostname_hints(struct bufferevent *bev,
     struct evdns_base *evdns_base, const struct evutil_addrinfo *hints_in,
@@ -506,6 +1065,7 @@ bufferevent_socket_connect_hostname_hints(struct bufferevent *bev,
 	char portbuf[10];
 	struct bufferevent_private *bev_p =
 	    EVUTIL_UPCAST(bev, struct bufferevent_private, bev);
+	int r = 0;
 
 	if (hints_in->ai_family != AF_INET && hints_in->ai_family != AF_INET6 &&
 	    hints_in->ai_family != AF_UNSPEC)
@@ -518,16 +1078,30 @@ bufferevent_socket_connect_hostname_hints(struct bufferevent *bev,
 
 	evutil_snprintf(portbuf, sizeof(portbuf), "%d", port);
 
+	bufferevent_connect_race_cancel(bev_p, 0);
+
 	bufferevent_suspend_write_(bev, BEV_SUSPEND_LOOKUP);
 	bufferevent_suspend_read_(bev, BEV_SUSPEND_LOOKUP);
 
-	bufferevent_incref_(bev);
-	bev_p->dns_request = evutil_getaddrinfo_async_(evdns_base, hostname,
-	    portbuf, hints_in, bufferevent_connect_getaddrinfo_cb, bev);
+	/* We can only race several sockets against each other if we get to
+	 * pick the socket, and if the bufferevent does its own I/O on it. */
+	if (BEV_IS_SOCKET(bev) && bufferevent_getfd(bev) < 0) {
+		r = bufferevent_connect_race_new(bev, evdns_base, hints_in,
+		    hostname, portbuf);
+		if (r < 0) {
+			bufferevent_unsuspend_write_(bev, BEV_SUSPEND_LOOKUP);
+			bufferevent_unsuspend_read_(bev, BEV_SUSPEND_LOOKUP);
+		}
+	} else {
+		bufferevent_incref_(bev);
+		bev_p->dns_request = evutil_getaddrinfo_async_(evdns_base,
+		    hostname, portbuf, hints_in,
+		    bufferevent_connect_getaddrinfo_cb, bev);
+	}
 
 	BEV_UNLOCK(bev);
 
-	return 0;
+	return r;
 }
 
 int
@@ -611,6 +1185,7 @@ be_socket_destruct(struct bufferevent *bufev)
 		EVUTIL_CLOSESOCKET(fd);
 
 	evutil_getaddrinfo_cancel_async_(bufev_p->dns_request);
+	bufferevent_connect_race_cancel(bufev_p, 0);
 }
 
 static int
@@ -644,6 +1219,7 @@ be_socket_setfd(struct bufferevent *bufev, evutil_socket_t fd)
 		bufferevent_enable(bufev, bufev->enabled);
 
 	evutil_getaddrinfo_cancel_async_(bufev_p->dns_request);
+	bufferevent_connect_race_cancel(bufev_p, 1);
 
 	BEV_UNLOCK(bufev);
 }
@@ -334,16 +334,109 @@ do_read(struct bufferevent_ssl *bev_ssl, int n_to_read) {
 	return result;
 }
 
+/* do_write() for when the kernel does the encryption (kTLS): write the
+ * plaintext straight to the socket, as bufferevent_sock does.  This lets
+ * sendfile() segments go out without ever being copied to user space. */
+static int
+do_write_ktls(struct bufferevent_ssl *bev_ssl)
+{
+	struct bufferevent *bev = &bev_ssl->bev.bev;
+	evutil_socket_t fd = event_get_fd(&bev->ev_write);
+	ev_ssize_t atmost = bufferevent_get_write_max_(&bev_ssl->bev);
+	int r;
+
+	if (bev_ssl->bev.write_suspended)
+		return 0;
+
+	r = evbuffer_write_atmost(bev->output, fd, atmost);
+	if (r < 0) {
+		int err = evutil_socket_geterror(fd);
+		if (EVUTIL_ERR_RW_RETRIABLE(err))
+			return OP_BLOCKED;
+		bufferevent_ssl_stop_reading(bev_ssl);
+		bufferevent_ssl_stop_writing(bev_ssl);
+		bufferevent_run_eventcb_(bev,
+		    BEV_EVENT_WRITING|BEV_EVENT_ERROR, 0);
+		return OP_ERR | OP_BLOCKED;
+	} else if (r == 0) {
+		return OP_BLOCKED;
+	}
+
+	bufferevent_decrement_write_buckets_(&bev_ssl->bev, r);
+	bufferevent_trigger_nolock_(bev, EV_WRITE, BEV_OPT_DEFER_CALLBACKS);
+	return OP_MADE_PROGRESS;
+}
+
+/* Return how much plaintext to put in the next record: small records until
+ * record_ramp bytes have gone out since the connection started or last went
+ * idle, large ones after that. */
+static size_t
+record_size(struct bufferevent_ssl *bev_ssl)
+{
+	struct timeval now, diff;
+
+	if (!bev_ssl->record_small)
+		return bev_ssl->record_large;
+
+	if (evutil_timerisset(&bev_ssl->record_idle) &&
+	    evutil_timerisset(&bev_ssl->last_write_tv) &&
+	    bev_ssl->record_sent) {
+		event_base_gettimeofday_cached(bev_ssl->bev.bev.ev_base, &now);
+		evutil_timersub(&now, &bev_ssl->last_write_tv, &diff);
+		if (evutil_timercmp(&diff, &bev_ssl->record_idle, >=)) {
+			bev_ssl->record_sent = 0;
+			++bev_ssl->record_stats.idle_resets;
+		}
+	}
+
+	if (bev_ssl->record_sent < bev_ssl->record_ramp)
+		return bev_ssl->record_small;
+	return bev_ssl->record_large;
+}
+
+/* Copy up to len bytes, starting offset bytes into the output buffer, into
+ * the staging buffer, so that the data of several small chains goes out as
+ * one record instead of one record per chain.  Return the number of bytes
+ * gathered, or 0 if we couldn't. */
+static size_t
+gather_record(struct bufferevent_ssl *bev_ssl, size_t offset, size_t len)
+{
+	struct evbuffer *output = bev_ssl->bev.bev.output;
+	struct evbuffer_ptr pos;
+	ev_ssize_t r;
+
+	if (!bev_ssl->write_stage) {
+		bev_ssl->write_stage = mm_malloc(BUFFEREVENT_SSL_RECORD_LARGE);
+		if (!bev_ssl->write_stage)
+			return 0;
+	}
+	if (len > BUFFEREVENT_SSL_RECORD_LARGE)
+		len = BUFFEREVENT_SSL_RECORD_LARGE;
+
+	if (evbuffer_ptr_set(output, &pos, offset, EVBUFFER_PTR_SET) < 0)
+		return 0;
+	r = evbuffer_copyout_from(output, &pos, bev_ssl->write_stage, len);
+	return r < 0 ? 0 : (size_t)r;
+}
+
 /* Return a bitmask of OP_MADE_PROGRESS (if we wrote anything); OP_BLOCKED (if
    we're now blocked); and OP_ERR (if an error occurred). */
 static int
-do_write(struct bufferevent_ssl *bev_ssl, int atmost)
+do_write(struct bufferevent_ssl *bev_ssl)
 {
 	int i, r, n, n_written = 0;
 	struct bufferevent *bev = &bev_ssl->bev.bev;
 	struct evbuffer *output = bev->output;
 	struct evbuffer_iovec space[8];
 	int result = 0;
+	ev_ssize_t atmost;
+	size_t len, record, want;
+	const void *buf;
+
+	if (bev_ssl->ktls_write)
+		return do_write_ktls(bev_ssl);
+
+	record = record_size(bev_ssl);
 
 	if (bev_ssl->last_write > 0)
 		atmost = bev_ssl->last_write;
@@ -373,9 +466,29 @@ do_write(struct bufferevent_ssl *bev_ssl, int atmost)
 			continue;
 		}
 
+		/* A retried write must be repeated with the same data;
+		 * otherwise cut the data into records of the current size. */
+		want = bev_ssl->last_write > 0 ?
+		    (size_t)bev_ssl->last_write : record;
+		buf = space[i].iov_base;
+		len = space[i].iov_len;
+		if (len > want) {
+			len = want;
+		} else if (len < want &&
+		    (ev_ssize_t)(n_written + len) < atmost &&
+		    evbuffer_get_length(output) > n_written + len) {
+			size_t gathered;
+			if ((ev_ssize_t)want > atmost - n_written)
+				want = atmost - n_written;
+			gathered = gather_record(bev_ssl, n_written, want);
+			if (gathered > len) {
+				buf = bev_ssl->write_stage;
+				len = gathered;
+			}
+		}
+
 		bev_ssl->ssl_ops->clear_error();
-		r = bev_ssl->ssl_ops->write(bev_ssl->ssl, space[i].iov_base,
-		    space[i].iov_len);
+		r = bev_ssl->ssl_ops->write(bev_ssl->ssl, buf, len);
 		if (r > 0) {
 			result |= OP_MADE_PROGRESS;
 			if (bev_ssl->write_blocked_on_read)
@@ -384,10 +497,27 @@ do_write(struct bufferevent_ssl *bev_ssl, int atmost)
 			n_written += r;
 			bev_ssl->last_write = -1;
 			bev_ssl->ssl_ops->decrement_buckets(bev_ssl);
-			space[i].iov_base = (unsigned char *)space[i].iov_base + r;
-			space[i].iov_len -= r;
-			if (space[i].iov_len == 0)
-				++i;
+			if (record < bev_ssl->record_large)
+				++bev_ssl->record_stats.small_records;
+			else
+				++bev_ssl->record_stats.large_records;
+			bev_ssl->record_stats.bytes += r;
+			bev_ssl->record_sent += r;
+			if (bev_ssl->record_sent >= bev_ssl->record_ramp)
+				record = bev_ssl->record_large;
+			if (buf == bev_ssl->write_stage)
+				++bev_ssl->record_stats.coalesced_records;
+			while (r > 0 && i < n) {
+				size_t done = space[i].iov_len;
+				if (done > (size_t)r)
+					done = r;
+				space[i].iov_base =
+				    (unsigned char *)space[i].iov_base + done;
+				space[i].iov_len -= done;
+				r -= (int)done;
+				if (space[i].iov_len == 0)
+					++i;
+			}
 		} else {
 			int err = bev_ssl->ssl_ops->get_error(bev_ssl->ssl, r);
 			bev_ssl->ssl_ops->print_err(err);
@@ -396,14 +526,14 @@ do_write(struct bufferevent_ssl *bev_ssl, int atmost)
 				if (bev_ssl->write_blocked_on_read)
 					if (clear_wbor(bev_ssl) < 0)
 						return OP_ERR | result;
-				bev_ssl->last_write = space[i].iov_len;
+				bev_ssl->last_write = len;
 			} else if (bev_ssl->ssl_ops->err_is_want_read(err)) {
 				/* This read operation requires a write, and the
 				 * underlying is full */
 				if (!bev_ssl->write_blocked_on_read)
 					if (set_wbor(bev_ssl) < 0)
 						return OP_ERR | result;
-				bev_ssl->last_write = space[i].iov_len;
+				bev_ssl->last_write = len;
 			} else {
 				bev_ssl->ssl_ops->conn_closed(bev_ssl, BEV_EVENT_WRITING, err, r);
 				bev_ssl->last_write = -1;
@@ -413,6 +543,8 @@ do_write(struct bufferevent_ssl *bev_ssl, int atmost)
 		}
 	}
 	if (n_written) {
+		event_base_gettimeofday_cached(bev->ev_base,
+		    &bev_ssl->last_write_tv);
 		if (evbuffer_drain(output, n_written))
 			return OP_ERR | result;
 
@@ -424,8 +556,6 @@ do_write(struct bufferevent_ssl *bev_ssl, int atmost)
 	return result;
 }
 
-#define WRITE_FRAME 15000
-
 /* Try to figure out how many bytes to read; return 0 if we shouldn't be
  * reading. */
 static int
@@ -480,7 +610,7 @@ consider_reading(struct bufferevent_ssl *bev_ssl)
 	int all_result_flags = 0;
 
 	while (bev_ssl->write_blocked_on_read) {
-		r = do_write(bev_ssl, WRITE_FRAME);
+		r = do_write(bev_ssl);
 		if (r & (OP_BLOCKED|OP_ERR))
 			break;
 	}
@@ -570,12 +700,7 @@ consider_writing(struct bufferevent_ssl *bev_ssl)
 	    (! bev_ssl->bev.write_suspended) &&
 	    evbuffer_get_length(output) &&
 	    (!target || (! wm->high || evbuffer_get_length(target) < wm->high))) {
-		int n_to_write;
-		if (wm && wm->high)
-			n_to_write = wm->high - evbuffer_get_length(target);
-		else
-			n_to_write = WRITE_FRAME;
-		r = do_write(bev_ssl, n_to_write);
+		r = do_write(bev_ssl);
 		if (r & (OP_BLOCKED|OP_ERR))
 			break;
 	}
@@ -706,6 +831,26 @@ set_open_callbacks(struct bufferevent_ssl *bev_ssl, evutil_socket_t fd)
 	}
 }
 
+/* Find out whether the SSL library has handed the session keys to the
+ * kernel, if we asked it to. */
+static void
+check_ktls(struct bufferevent_ssl *bev_ssl)
+{
+	short what;
+
+	if (bev_ssl->underlying ||
+	    !(bev_ssl->flags & BUFFEREVENT_SSL_KTLS) ||
+	    !bev_ssl->ssl_ops->ktls_active)
+		return;
+	what = bev_ssl->ssl_ops->ktls_active(bev_ssl->ssl);
+	bev_ssl->ktls_read = !!(what & EV_READ);
+	bev_ssl->ktls_write = !!(what & EV_WRITE);
+	/* Let file segments added from now on be sent with sendfile() */
+	if (bev_ssl->ktls_write)
+		evbuffer_set_flags(bev_ssl->bev.bev.output,
+		    EVBUFFER_FLAG_DRAINS_TO_FD);
+}
+
 static int
 do_handshake(struct bufferevent_ssl *bev_ssl)
 {
@@ -728,6 +873,7 @@ do_handshake(struct bufferevent_ssl *bev_ssl)
 		evutil_socket_t fd = event_get_fd(&bev_ssl->bev.bev.ev_read);
 		/* We're done! */
 		bev_ssl->state = BUFFEREVENT_SSL_OPEN;
+		check_ktls(bev_ssl);
 		set_open_callbacks(bev_ssl, fd); /* XXXX handle failure */
 		/* Call do_read and do_write as needed */
 		bufferevent_enable(&bev_ssl->bev.bev, bev_ssl->bev.bev.enabled);
@@ -939,6 +1085,8 @@ be_ssl_destruct(struct bufferevent *bev)
 		}
 	}
 	bev_ssl->ssl_ops->free(bev_ssl->ssl, bev_ssl->bev.options);
+	if (bev_ssl->write_stage)
+		mm_free(bev_ssl->write_stage);
 }
 
 static int
@@ -979,10 +1127,13 @@ be_ssl_set_fd(struct bufferevent_ssl *bev_ssl,
 		if (!bev_ssl->ssl_ops->clear(bev_ssl->ssl))
 			return -1;
 		bev_ssl->ssl_ops->set_connect_state(bev_ssl->ssl);
+		if (bev_ssl->ssl_ops->prepare_connect)
+			bev_ssl->ssl_ops->prepare_connect(bev_ssl->ssl);
 		if (set_handshake_callbacks(bev_ssl, fd) < 0)
 			return -1;
 		break;
 	case BUFFEREVENT_SSL_OPEN:
+		check_ktls(bev_ssl);
 		if (set_open_callbacks(bev_ssl, fd) < 0)
 			return -1;
 		break;
@@ -1066,6 +1217,13 @@ bufferevent_ssl_new_impl(struct event_base *base,
 	bev_ssl->old_state = state;
 	bev_ssl->last_write = -1;
 
+	bev_ssl->record_small = BUFFEREVENT_SSL_RECORD_SMALL;
+	bev_ssl->record_large = BUFFEREVENT_SSL_RECORD_LARGE;
+	bev_ssl->record_ramp = BUFFEREVENT_SSL_RECORD_RAMP;
+	bev_ssl->record_idle.tv_sec = BUFFEREVENT_SSL_RECORD_IDLE_MSEC / 1000;
+	bev_ssl->record_idle.tv_usec =
+	    (BUFFEREVENT_SSL_RECORD_IDLE_MSEC % 1000) * 1000;
+
 	bev_ssl->ssl_ops->init_bio_counts(bev_ssl);
 
 	fd = be_ssl_auto_fd(bev_ssl, fd);
@@ -1132,7 +1290,8 @@ ev_uint64_t bufferevent_ssl_set_flags(struct bufferevent *bev, ev_uint64_t flags
 	ev_uint64_t old_flags = EV_UINT64_MAX;
 	struct bufferevent_ssl *bev_ssl;
 
-	flags &= (BUFFEREVENT_SSL_DIRTY_SHUTDOWN|BUFFEREVENT_SSL_BATCH_WRITE);
+	flags &= (BUFFEREVENT_SSL_DIRTY_SHUTDOWN|BUFFEREVENT_SSL_BATCH_WRITE|
+	    BUFFEREVENT_SSL_KTLS);
 	if (!flags || !BEV_IS_SSL(bev))
 		return old_flags;
 
@@ -1140,6 +1299,9 @@ ev_uint64_t bufferevent_ssl_set_flags(struct bufferevent *bev, ev_uint64_t flags
 	bev_ssl = bufferevent_ssl_upcast(bev);
 	old_flags = bev_ssl->flags;
 	bev_ssl->flags |= flags;
+	if ((flags & BUFFEREVENT_SSL_KTLS) && bev_ssl->ssl_ops->enable_ktls &&
+	    !bev_ssl->underlying)
+		bev_ssl->ssl_ops->enable_ktls(bev_ssl->ssl);
 	BEV_UNLOCK(bev);
 
 	return old_flags;
@@ -1162,6 +1324,69 @@ ev_uint64_t bufferevent_ssl_clear_flags(struct bufferevent *bev, ev_uint64_t fla
 	return old_flags;
 }
 
+short
+bufferevent_ssl_get_ktls(struct bufferevent *bev)
+{
+	short what = 0;
+	struct bufferevent_ssl *bev_ssl;
+
+	if (!BEV_IS_SSL(bev))
+		return 0;
+
+	BEV_LOCK(bev);
+	bev_ssl = bufferevent_ssl_upcast(bev);
+	if (bev_ssl->ktls_read)
+		what |= EV_READ;
+	if (bev_ssl->ktls_write)
+		what |= EV_WRITE;
+	BEV_UNLOCK(bev);
+
+	return what;
+}
+
+int
+bufferevent_ssl_set_record_size(struct bufferevent *bev,
+    size_t small_size, size_t large_size, size_t ramp_bytes,
+    const struct timeval *idle)
+{
+	struct bufferevent_ssl *bev_ssl;
+
+	if (!large_size)
+		large_size = BUFFEREVENT_SSL_RECORD_LARGE;
+	if (large_size > BUFFEREVENT_SSL_RECORD_LARGE ||
+	    small_size > large_size)
+		return -1;
+	if (!BEV_IS_SSL(bev))
+		return -1;
+
+	BEV_LOCK(bev);
+	bev_ssl = bufferevent_ssl_upcast(bev);
+	bev_ssl->record_small = small_size;
+	bev_ssl->record_large = large_size;
+	bev_ssl->record_ramp = ramp_bytes;
+	if (idle)
+		bev_ssl->record_idle = *idle;
+	else
+		evutil_timerclear(&bev_ssl->record_idle);
+	BEV_UNLOCK(bev);
+
+	return 0;
+}
+
+int
+bufferevent_ssl_get_record_stats(struct bufferevent *bev,
+    struct bufferevent_ssl_record_stats *stats)
+{
+	if (!BEV_IS_SSL(bev))
+		return -1;
+
+	BEV_LOCK(bev);
+	*stats = bufferevent_ssl_upcast(bev)->record_stats;
+	BEV_UNLOCK(bev);
+
+	return 0;
+}
+
 int
 bufferevent_ssl_get_allow_dirty_shutdown(struct bufferevent *bev)
 {
@@ -0,0 +1,452 @@
+/*
+ * Copyright (c) 2026 The Libevent authors
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "evconfig-private.h"
+
+#include <sys/types.h>
+
+#include "event2/event-config.h"
+
+#include <limits.h>
+#include <string.h>
+
+#include "event2/util.h"
+#include "event2/buffer.h"
+#include "event2/bufferevent.h"
+#include "event2/bufferevent_zlib.h"
+#include "log-internal.h"
+#include "mm-internal.h"
+#include "evthread-internal.h"
+#include "util-internal.h"
+#include "zlib-internal.h"
+
+#ifdef EVENT__HAVE_LIBZ
+
+/* zlib 1.2.4 and 1.2.5 test these with "FOO-0"; keep -Wundef quiet. */
+#ifndef _LARGEFILE64_SOURCE
+#define _LARGEFILE64_SOURCE 0
+#endif
+#ifndef _LFS64_LARGEFILE
+#define _LFS64_LARGEFILE 0
+#endif
+#ifndef _FILE_OFFSET_BITS
+#define _FILE_OFFSET_BITS 0
+#endif
+#ifndef off64_t
+#define off64_t ev_int64_t
+#endif
+
+#include <zlib.h>
+
+/* How much output space we ask for at a time. */
+#define EVZLIB_CHUNK 4096
+
+struct evzlib_stream_ {
+	z_stream z;
+	/** The pool we came from, and will go back to. */
+	struct bufferevent_zlib_pool *pool;
+	/** True iff we compress rather than decompress. */
+	unsigned compress : 1;
+	/** True iff we have reached the end of a stream; more data starts a
+	 * new one. */
+	unsigned finished : 1;
+};
+
+struct bufferevent_zlib_pool {
+	void *lock;
+	int refcnt;
+	enum bufferevent_zlib_format format;
+	int level;
+	/** How many idle streams of each kind we keep. */
+	int max_idle;
+	/** Idle decompressors ([0]) and compressors ([1]), all reset. */
+	struct evzlib_stream_ **idle[2];
+	int n_idle[2];
+};
+
+static voidpf
+evzlib_alloc(voidpf opaque, uInt items, uInt size)
+{
+	(void)opaque;
+	return mm_calloc(items, size);
+}
+
+static void
+evzlib_free(voidpf opaque, voidpf address)
+{
+	(void)opaque;
+	mm_free(address);
+}
+
+static void
+evzlib_stream_destroy(struct evzlib_stream_ *s)
+{
+	if (s->compress)
+		deflateEnd(&s->z);
+	else
+		inflateEnd(&s->z);
+	mm_free(s);
+}
+
+struct bufferevent_zlib_pool *
+bufferevent_zlib_pool_new(enum bufferevent_zlib_format format, int level,
+    int max_idle)
+{
+	struct bufferevent_zlib_pool *pool;
+
+	if (format != BUFFEREVENT_ZLIB_DEFLATE &&
+	    format != BUFFEREVENT_ZLIB_ZLIB &&
+	    format != BUFFEREVENT_ZLIB_GZIP)
+		return NULL;
+	if (level < -1 || level > 9 || max_idle < 0)
+		return NULL;
+
+	if (!(pool = mm_calloc(1, sizeof(*pool))))
+		return NULL;
+	if (max_idle) {
+		pool->idle[0] = mm_calloc(max_idle, sizeof(*pool->idle[0]));
+		pool->idle[1] = mm_calloc(max_idle, sizeof(*pool->idle[1]));
+		if (!pool->idle[0] || !pool->idle[1]) {
+			mm_free(pool->idle[0]);
+			mm_free(pool->idle[1]);
+			mm_free(pool);
+			return NULL;
+		}
+	}
+	EVTHREAD_ALLOC_LOCK(pool->lock, 0);
+	pool->refcnt = 1;
+	pool->format = format;
+	pool->level = level;
+	pool->max_idle = max_idle;
+	return pool;
+}
+
+void
+evzlib_pool_incref_(struct bufferevent_zlib_pool *pool)
+{
+	EVLOCK_LOCK(pool->lock, 0);
+	++pool->refcnt;
+	EVLOCK_UNLOCK(pool->lock, 0);
+}
+
+void
+bufferevent_zlib_pool_free(struct bufferevent_zlib_pool *pool)
+{
+	int refcnt, i, kind;
+
+	if (!pool)
+		return;
+	EVLOCK_LOCK(pool->lock, 0);
+	refcnt = --pool->refcnt;
+	EVLOCK_UNLOCK(pool->lock, 0);
+	if (refcnt)
+		return;
+
+	for (kind = 0; kind < 2; ++kind) {
+		for (i = 0; i < pool->n_idle[kind]; ++i)
+			evzlib_stream_destroy(pool->idle[kind][i]);
+		mm_free(pool->idle[kind]);
+	}
+	EVTHREAD_FREE_LOCK(pool->lock, 0);
+	mm_free(pool);
+}
+
+struct evzlib_stream_ *
+evzlib_stream_new_(struct bufferevent_zlib_pool *pool, int compress)
+{
+	struct evzlib_stream_ *s = NULL;
+	int bits, r;
+
+	compress = !!compress;
+	EVLOCK_LOCK(pool->lock, 0);
+	if (pool->n_idle[compress])
+		s = pool->idle[compress][--pool->n_idle[compress]];
+	++pool->refcnt;
+	EVLOCK_UNLOCK(pool->lock, 0);
+	if (s)
+		return s;
+
+	if (!(s = mm_calloc(1, sizeof(*s))))
+		goto err;
+	s->z.zalloc = evzlib_alloc;
+	s->z.zfree = evzlib_free;
+	s->pool = pool;
+	s->compress = compress;
+
+	switch (pool->format) {
+	case BUFFEREVENT_ZLIB_DEFLATE:
+		bits = -MAX_WBITS;
+		break;
+	case BUFFEREVENT_ZLIB_ZLIB:
+		bits = MAX_WBITS;
+		break;
+	case BUFFEREVENT_ZLIB_GZIP:
+	default:
+		bits = MAX_WBITS + 16;
+		break;
+	}
+	if (compress) {
+		r = deflateInit2(&s->z, pool->level, Z_DEFLATED, bits, 8,
+		    Z_DEFAULT_STRATEGY);
+	} else {
+		/* Take either zlib or gzip data when we expect a header */
+		if (bits > 0)
+			bits = MAX_WBITS + 32;
+		r = inflateInit2(&s->z, bits);
+	}
+	if (r != Z_OK) {
+		event_warnx("%s: can't set up zlib: %s", __func__,
+		    s->z.msg ? s->z.msg : "unknown error");
+		mm_free(s);
+		goto err;
+	}
+	return s;
+err:
+	bufferevent_zlib_pool_free(pool);
+	return NULL;
+}
+
+void
+evzlib_stream_free_(struct evzlib_stream_ *s)
+{
+	struct bufferevent_zlib_pool *pool;
+	int r, kept = 0;
+
+	if (!s)
+		return;
+	pool = s->pool;
+	r = s->compress ? deflateReset(&s->z) : inflateReset(&s->z);
+	s->finished = 0;
+	if (r == Z_OK) {
+		EVLOCK_LOCK(pool->lock, 0);
+		if (pool->n_idle[s->compress] < pool->max_idle) {
+			pool->idle[s->compress][pool->n_idle[s->compress]++] = s;
+			kept = 1;
+		}
+		EVLOCK_UNLOCK(pool->lock, 0);
+	}
+	if (!kept)
+		evzlib_stream_destroy(s);
+	bufferevent_zlib_pool_free(pool);
+}
+
+enum bufferevent_filter_result
+evzlib_stream_process_(struct evzlib_stream_ *s, struct evbuffer *src,
+    struct evbuffer *dst, ev_ssize_t limit, enum bufferevent_flush_mode mode)
+{
+	size_t produced = 0;
+	int flush;
+
+	if (!s->compress)
+		flush = Z_SYNC_FLUSH;
+	else if (mode == BEV_FINISHED)
+		flush = Z_FINISH;
+	else if (mode == BEV_FLUSH)
+		flush = Z_SYNC_FLUSH;
+	else
+		flush = Z_NO_FLUSH;
+
+	for (;;) {
+		struct evbuffer_iovec in, out;
+		size_t total = evbuffer_get_length(src), in_len = 0, out_len;
+		size_t n_in, n_out;
+		int r;
+
+		if (s->finished) {
+			if (!total)
+				break;
+			/* More data after the end: that's another stream */
+			r = s->compress ? deflateReset(&s->z) :
+			    inflateReset(&s->z);
+			if (r != Z_OK)
+				return BEV_ERROR;
+			s->finished = 0;
+		}
+
+		if (total) {
+			if (evbuffer_peek(src, -1, NULL, &in, 1) < 1)
+				return BEV_ERROR;
+			if (!in.iov_len) {
+				/* Skip an empty chain at the front */
+				if (!evbuffer_pullup(src, 1) ||
+				    evbuffer_peek(src, -1, NULL, &in, 1) < 1)
+					return BEV_ERROR;
+			}
+			in_len = in.iov_len;
+			if (in_len > UINT_MAX)
+				in_len = UINT_MAX;
+		}
+		if (evbuffer_reserve_space(dst, EVZLIB_CHUNK, &out, 1) < 1)
+			return BEV_ERROR;
+		out_len = out.iov_len > UINT_MAX ? UINT_MAX : out.iov_len;
+
+		s->z.next_in = in_len ? (Bytef *)in.iov_base : Z_NULL;
+		s->z.avail_in = (uInt)in_len;
+		s->z.next_out = (Bytef *)out.iov_base;
+		s->z.avail_out = (uInt)out_len;
+
+		if (s->compress)
+			r = deflate(&s->z, in_len == total ? flush : Z_NO_FLUSH);
+		else
+			r = inflate(&s->z, flush);
+
+		n_in = in_len - s->z.avail_in;
+		n_out = out_len - s->z.avail_out;
+		out.iov_len = n_out;
+		evbuffer_commit_space(dst, &out, 1);
+		evbuffer_drain(src, n_in);
+		produced += n_out;
+
+		if (r == Z_STREAM_END) {
+			s->finished = 1;
+			continue;
+		}
+		if (r == Z_BUF_ERROR)
+			break; /* no progress possible */
+		if (r != Z_OK)
+			return BEV_ERROR;
+		if (limit >= 0 && produced >= (size_t)limit)
+			break;
+		if (s->z.avail_out && !evbuffer_get_length(src))
+			break;
+	}
+
+	return produced ? BEV_OK : BEV_NEED_MORE;
+}
+
+#else /* !EVENT__HAVE_LIBZ */
+
+struct bufferevent_zlib_pool *
+bufferevent_zlib_pool_new(enum bufferevent_zlib_format format, int level,
+    int max_idle)
+{
+	(void)format;
+	(void)level;
+	(void)max_idle;
+	return NULL;
+}
+
+void
+bufferevent_zlib_pool_free(struct bufferevent_zlib_pool *pool)
+{
+	(void)pool;
+}
+
+void
+evzlib_pool_incref_(struct bufferevent_zlib_pool *pool)
+{
+	(void)pool;
+}
+
+struct evzlib_stream_ *
+evzlib_stream_new_(struct bufferevent_zlib_pool *pool, int compress)
+{
+	(void)pool;
+	(void)compress;
+	return NULL;
+}
+
+void
+evzlib_stream_free_(struct evzlib_stream_ *s)
+{
+	(void)s;
+}
+
+enum bufferevent_filter_result
+evzlib_stream_process_(struct evzlib_stream_ *s, struct evbuffer *src,
+    struct evbuffer *dst, ev_ssize_t limit, enum bufferevent_flush_mode mode)
+{
+	(void)s;
+	(void)src;
+	(void)dst;
+	(void)limit;
+	(void)mode;
+	return BEV_ERROR;
+}
+
+#endif /* EVENT__HAVE_LIBZ */
+
+/* The context of a bufferevent from bufferevent_zlib_new().  We only take
+ * streams from the pool once data goes in their direction. */
+struct bufferevent_zlib_filter {
+	struct bufferevent_zlib_pool *pool;
+	struct evzlib_stream_ *in;
+	struct evzlib_stream_ *out;
+};
+
+static enum bufferevent_filter_result
+be_zlib_input_filter(struct evbuffer *src, struct evbuffer *dst,
+    ev_ssize_t lim, enum bufferevent_flush_mode state, void *ctx)
+{
+	struct bufferevent_zlib_filter *f = ctx;
+
+	if (!f->in && !(f->in = evzlib_stream_new_(f->pool, 0)))
+		return BEV_ERROR;
+	return evzlib_stream_process_(f->in, src, dst, lim, state);
+}
+
+static enum bufferevent_filter_result
+be_zlib_output_filter(struct evbuffer *src, struct evbuffer *dst,
+    ev_ssize_t lim, enum bufferevent_flush_mode state, void *ctx)
+{
+	struct bufferevent_zlib_filter *f = ctx;
+
+	if (!f->out && !(f->out = evzlib_stream_new_(f->pool, 1)))
+		return BEV_ERROR;
+	return evzlib_stream_process_(f->out, src, dst, lim, state);
+}
+
+static void
+be_zlib_free_filter(void *ctx)
+{
+	struct bufferevent_zlib_filter *f = ctx;
+
+	evzlib_stream_free_(f->in);
+	evzlib_stream_free_(f->out);
+	bufferevent_zlib_pool_free(f->pool);
+	mm_free(f);
+}
+
+struct bufferevent *
+bufferevent_zlib_new(struct bufferevent *underlying,
+    struct bufferevent_zlib_pool *pool, int options)
+{
+	struct bufferevent_zlib_filter *f;
+	struct bufferevent *bev;
+
+	if (!underlying || !pool)
+		return NULL;
+	if (!(f = mm_calloc(1, sizeof(*f))))
+		return NULL;
+	evzlib_pool_incref_(pool);
+	f->pool = pool;
+
+	bev = bufferevent_filter_new(underlying, be_zlib_input_filter,
+	    be_zlib_output_filter, options, be_zlib_free_filter, f);
+	if (!bev)
+		be_zlib_free_filter(f);
+	return bev;
+}
@@ -91,6 +91,21 @@
 #define USING_TIMERFD
 #endif
 
+#if defined(__linux__) && !defined(EVENT__HAVE_WEPOLL)
+#include <sys/ioctl.h>
+#ifndef EPIOCSPARAMS
+/* From <linux/eventpoll.h>; Linux 6.9 and later understand it. */
+struct epoll_params {
+	uint32_t busy_poll_usecs;
+	uint16_t busy_poll_budget;
+	uint8_t prefer_busy_poll;
+	uint8_t pad_;
+};
+#define EPIOCSPARAMS _IOW(0x8A, 0x01, struct epoll_params)
+#endif
+#define USING_EPOLL_BUSY_POLL
+#endif
+
 #ifdef EVENT__HAVE_WEPOLL
 typedef HANDLE epoll_handle;
 #define INVALID_EPOLL_HANDLE NULL
@@ -104,9 +119,15 @@ static void close_epoll_handle(int h) { close(h); }
 struct epollop {
 	struct epoll_event *events;
 	int nevents;
+	/* Largest nevents may grow to */
+	int max_nevents;
+	/* How many polls in a row have used at most a quarter of events */
+	int n_underused;
 	epoll_handle epfd;
 #ifdef USING_TIMERFD
 	int timerfd;
+	/* Set if timerfd may be armed or expired, and so wake us up */
+	int timerfd_armed;
 #endif
 };
 
@@ -161,6 +182,11 @@ const struct eventop epollops = {
 
 #define INITIAL_NEVENT 32
 #define MAX_NEVENT 4096
+/* The kernel refuses to fill in more than this many at once */
+#define EPOLL_MAX_NEVENT ((int)(INT_MAX / sizeof(struct epoll_event)))
+/* Halve the event array after this many polls in a row that used at most a
+ * quarter of it */
+#define EPOLL_SHRINK_AFTER 32
 
 /* On Linux kernels at least up to 2.6.24.4, epoll can't handle timeout
  * values bigger than (LONG_MAX - 999ULL)/HZ.  HZ in the wild can be
@@ -170,6 +196,26 @@ const struct eventop epollops = {
  */
 #define MAX_EPOLL_TIMEOUT_MSEC (35*60*1000)
 
+#ifdef USING_EPOLL_BUSY_POLL
+/* Ask the kernel to busy-poll the network devices of the sockets in the
+ * epoll set for up to budget before epoll_wait() sleeps.  Older kernels
+ * don't know how; that's fine. */
+static void
+epoll_set_busy_poll(epoll_handle epfd, const struct timeval *budget)
+{
+	struct epoll_params params;
+	ev_uint64_t usec =
+	    (ev_uint64_t)budget->tv_sec * 1000000 + budget->tv_usec;
+
+	memset(&params, 0, sizeof(params));
+	params.busy_poll_usecs = usec > UINT32_MAX ? UINT32_MAX : (uint32_t)usec;
+	params.busy_poll_budget = 8; /* the kernel's default */
+	params.prefer_busy_poll = 1;
+	if (ioctl(epfd, EPIOCSPARAMS, &params) < 0)
+		event_debug(("%s: EPIOCSPARAMS: %s", __func__, strerror(errno)));
+}
+#endif
+
 static void *
 epoll_init(struct event_base *base)
 {
@@ -201,13 +247,20 @@ epoll_init(struct event_base *base)
 	epollop->epfd = epfd;
 
 	/* Initialize fields */
-	epollop->events = mm_calloc(INITIAL_NEVENT, sizeof(struct epoll_event));
+	epollop->max_nevents = MAX_NEVENT;
+	if (base->max_batch_size)
+		epollop->max_nevents = base->max_batch_size > EPOLL_MAX_NEVENT ?
+		    EPOLL_MAX_NEVENT : base->max_batch_size;
+	epollop->nevents = epollop->max_nevents < INITIAL_NEVENT ?
+	    epollop->max_nevents : INITIAL_NEVENT;
+	epollop->events = mm_calloc(epollop->nevents,
+	    sizeof(struct epoll_event));
 	if (epollop->events == NULL) {
 		mm_free(epollop);
 		close_epoll_handle(epfd);
 		return (NULL);
 	}
-	epollop->nevents = INITIAL_NEVENT;
+	base->cur_batch_size = epollop->nevents;
 
 #ifndef EVENT__HAVE_WEPOLL
 	if ((base->flags & EVENT_BASE_FLAG_EPOLL_USE_CHANGELIST) != 0 ||
@@ -218,6 +271,11 @@ epoll_init(struct event_base *base)
 	}
 #endif
 
+#ifdef USING_EPOLL_BUSY_POLL
+	if (base->busy_poll_flags & EVENT_BUSY_POLL_KERNEL)
+		epoll_set_busy_poll(epfd, &base->busy_poll_max);
+#endif
+
 #ifdef USING_TIMERFD
 	/*
 	  The epoll interface ordinarily gives us one-millisecond precision,
@@ -233,7 +291,9 @@ epoll_init(struct event_base *base)
 		if (epollop->timerfd >= 0) {
 			struct epoll_event epev;
 			memset(&epev, 0, sizeof(epev));
-			epev.data.fd = epollop->timerfd;
+			/* Every other fd carries its fdinfo; a NULL
+			 * pointer marks the timerfd. */
+			epev.data.ptr = NULL;
 			epev.events = EPOLLIN;
 			if (epoll_ctl(epollop->epfd, EPOLL_CTL_ADD, fd, &epev) < 0) {
 				event_warn("epoll_ctl(timerfd)");
@@ -302,10 +362,13 @@ epoll_op_to_string(int op)
 	ch->close_change,                          \
 	change_to_string(ch->close_change)
 
+/* Apply a single change to the epoll set.  fdinfo is the backend data that
+ * evmap keeps next to the events of ch->fd; we hand it to the kernel so that
+ * epoll_dispatch() finds those events without looking the fd up again. */
 static int
 epoll_apply_one_change(struct event_base *base,
     struct epollop *epollop,
-    const struct event_change *ch)
+    const struct event_change *ch, void *fdinfo)
 {
 	struct epoll_event epev;
 	int op, events = 0;
@@ -327,7 +390,8 @@ epoll_apply_one_change(struct event_base *base,
 #ifdef EVENT__HAVE_WEPOLL
 	epev.data.sock = ch->fd;
 #else
-	epev.data.fd = ch->fd;
+	EVUTIL_ASSERT(fdinfo != NULL);
+	epev.data.ptr = fdinfo;
 #endif
 	epev.events = events;
 	if (epoll_ctl(epollop->epfd, op, ch->fd, &epev) == 0) {
@@ -407,7 +471,8 @@ epoll_apply_changes(struct event_base *base)
 
 	for (i = 0; i < changelist->n_changes; ++i) {
 		ch = &changelist->changes[i];
-		if (epoll_apply_one_change(base, epollop, ch) < 0)
+		if (epoll_apply_one_change(base, epollop, ch,
+			evmap_io_get_fdinfo_(&base->io, ch->fd)) < 0)
 			r = -1;
 	}
 
@@ -432,7 +497,7 @@ epoll_nochangelist_add(struct event_base *base, evutil_socket_t fd,
 		ch.close_change = EV_CHANGE_ADD |
 		    (events & EV_ET);
 
-	return epoll_apply_one_change(base, base->evbase, &ch);
+	return epoll_apply_one_change(base, base->evbase, &ch, p);
 }
 
 static int
@@ -453,7 +518,23 @@ epoll_nochangelist_del(struct event_base *base, evutil_socket_t fd,
 		ch.close_change = EV_CHANGE_DEL |
 		    (events & EV_ET);
 
-	return epoll_apply_one_change(base, base->evbase, &ch);
+	return epoll_apply_one_change(base, base->evbase, &ch, p);
+}
+
+static void
+epoll_resize_events(struct event_base *base, struct epollop *epollop,
+    int new_nevents)
+{
+	struct epoll_event *new_events;
+
+	epollop->n_underused = 0;
+	new_events = mm_realloc(epollop->events,
+	    new_nevents * sizeof(struct epoll_event));
+	if (new_events) {
+		epollop->events = new_events;
+		epollop->nevents = new_nevents;
+		base->cur_batch_size = new_nevents;
+	}
 }
 
 static int
@@ -461,7 +542,7 @@ epoll_dispatch(struct event_base *base, struct timeval *tv)
 {
 	struct epollop *epollop = base->evbase;
 	struct epoll_event *events = epollop->events;
-	int i, res;
+	int i, res, n_io;
 #if defined(EVENT__HAVE_EPOLL_PWAIT2)
 	struct timespec ts = { 0, 0 };
 #else /* no epoll_pwait2() */
@@ -469,7 +550,19 @@ epoll_dispatch(struct event_base *base, struct timeval *tv)
 #endif /* EVENT__HAVE_EPOLL_PWAIT2 */
 
 #ifdef USING_TIMERFD
-	if (epollop->timerfd >= 0) {
+	/* Timeouts that the base lets be late (see
+	 * event_config_set_timer_slack()) are good enough in milliseconds, so
+	 * they don't need a timerfd_settime() call; but an earlier precise
+	 * timeout mustn't wake us while we wait for them. */
+	if (epollop->timerfd >= 0 && tv != NULL && !base->timeout_precise &&
+	    epollop->timerfd_armed) {
+		struct itimerspec is;
+		memset(&is, 0, sizeof(is));
+		if (timerfd_settime(epollop->timerfd, 0, &is, NULL) < 0)
+			event_warn("timerfd_settime");
+		epollop->timerfd_armed = 0;
+	}
+	if (epollop->timerfd >= 0 && (tv == NULL || base->timeout_precise)) {
 		struct itimerspec is;
 		is.it_interval.tv_sec = 0;
 		is.it_interval.tv_nsec = 0;
@@ -493,6 +586,8 @@ epoll_dispatch(struct event_base *base, struct timeval *tv)
 		if (timerfd_settime(epollop->timerfd, 0, &is, NULL) < 0) {
 			event_warn("timerfd_settime");
 		}
+		epollop->timerfd_armed =
+		    is.it_value.tv_sec != 0 || is.it_value.tv_nsec != 0;
 	} else
 #endif
 	if (tv != NULL) {
@@ -533,12 +628,15 @@ epoll_dispatch(struct event_base *base, struct timeval *tv)
 	event_debug(("%s: epoll_wait reports %d", __func__, res));
 	EVUTIL_ASSERT(res <= epollop->nevents);
 
+	n_io = res;
 	for (i = 0; i < res; i++) {
 		int what = events[i].events;
 		short ev = 0;
 #ifdef USING_TIMERFD
-		if (events[i].data.fd == epollop->timerfd)
+		if (events[i].data.ptr == NULL) {
+			--n_io;
 			continue;
+		}
 #endif
 
 		if (what & EPOLLERR) {
@@ -560,22 +658,34 @@ epoll_dispatch(struct event_base *base, struct timeval *tv)
 #ifdef EVENT__HAVE_WEPOLL
 		evmap_io_active_(base, events[i].data.sock, ev);
 #else
-		evmap_io_active_(base, events[i].data.fd, ev | EV_ET);
+		evmap_io_active_fdinfo_(base, events[i].data.ptr, ev | EV_ET);
 #endif
 	}
 
-	if (res == epollop->nevents && epollop->nevents < MAX_NEVENT) {
+	/* A poll that could not block and found nothing tells us nothing
+	 * about how busy we are; don't let busy-polling shrink the array. */
+	if (!res && tv && !evutil_timerisset(tv))
+		return (0);
+	/* The timerfd waking us up is not part of the batch */
+	event_base_count_batch_(base, n_io);
+
+	if (res == epollop->nevents && epollop->nevents < epollop->max_nevents) {
 		/* We used all of the event space this time.  We should
 		   be ready for more events next time. */
-		int new_nevents = epollop->nevents * 2;
-		struct epoll_event *new_events;
-
-		new_events = mm_realloc(epollop->events,
-		    new_nevents * sizeof(struct epoll_event));
-		if (new_events) {
-			epollop->events = new_events;
-			epollop->nevents = new_nevents;
+		int new_nevents = epollop->nevents > epollop->max_nevents / 2 ?
+		    epollop->max_nevents : epollop->nevents * 2;
+		epoll_resize_events(base, epollop, new_nevents);
+	} else if (res <= epollop->nevents / 4 &&
+	    epollop->nevents > INITIAL_NEVENT) {
+		/* Give the memory back if we keep needing much less. */
+		if (++epollop->n_underused >= EPOLL_SHRINK_AFTER) {
+			int new_nevents = epollop->nevents / 2;
+			if (new_nevents < INITIAL_NEVENT)
+				new_nevents = INITIAL_NEVENT;
+			epoll_resize_events(base, epollop, new_nevents);
 		}
+	} else {
+		epollop->n_underused = 0;
 	}
 
 	return (0);
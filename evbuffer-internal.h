@@ -34,6 +34,7 @@ extern "C" {
 #include "event2/event-config.h"
 #include "evconfig-private.h"
 #include "event2/util.h"
+#include "event2/buffer_compat.h"
 #include "event2/event_struct.h"
 #include "util-internal.h"
 #include "defer-internal.h"
@@ -328,6 +329,12 @@ int evbuffer_read_setup_vecs_(struct evbuffer *buf, ev_ssize_t howmuch,
     struct evbuffer_iovec *vecs, int n_vecs, struct evbuffer_chain ***chainp,
     int exact);
 
+/** Helper: set *vec to the data in the first non-empty chain of buf.
+ * Returns 1 if that data may be modified in place, 0 if it is read-only
+ * (a reference, a file segment, or pinned), and -1 if buf is empty. */
+int evbuffer_peek_first_chain_(struct evbuffer *buf,
+    struct evbuffer_iovec *vec);
+
 /* Helper macro: copies an evbuffer_iovec in ei to a win32 WSABUF in i. */
 #define WSABUF_FROM_EVBUFFER_IOV(i,ei) do {		\
 		(i)->buf = (ei)->iov_base;		\
@@ -102,6 +102,7 @@
 #include "ipv6-internal.h"
 #include "util-internal.h"
 #include "evthread-internal.h"
+#include "ht-internal.h"
 #ifdef _WIN32
 #include <ctype.h>
 #include <winsock2.h>
@@ -170,6 +171,19 @@
 /* Default maximum number of simultaneous TCP client connections that DNS server can hold. */
 #define MAX_CLIENT_CONNECTIONS 10
 
+/* Fixed-point scale of nameserver->err_rate: NS_ERR_SCALE means every recent
+ * request to the server failed. */
+#define NS_ERR_SCALE 1024
+/* With select-by-rtt, one pick in this many is plain round-robin, so that
+ * slow servers get a chance to show that they have become fast again. */
+#define NS_EXPLORE_INTERVAL 16
+
+/* Bump a counter of a nameserver, and the matching one of its evdns_base. */
+#define NS_STATS_INC(ns, field) do {		\
+		++(ns)->stats.field;			\
+		++(ns)->base->stats.field;		\
+	} while (0)
+
 struct reply {
 	unsigned int type;
 	unsigned int have_answer : 1;
@@ -210,7 +224,7 @@ struct evdns_request {
 	struct search_state *search_state;
 	char *search_origname;	/* needs to be free()ed */
 	int search_flags;
-	u16 tcp_flags;
+	u16 tcp_flags; /* DNS_QUERY_USEVC, DNS_QUERY_IGNTC, DNS_QUERY_HEDGE */
 };
 
 struct request {
@@ -221,6 +235,7 @@ struct request {
 	int reissue_count;
 	int tx_count;  /* the number of times that this packet has been sent */
 	struct nameserver *ns;	/* the server which we last sent it */
+	struct nameserver *hedge_ns; /* the second server it went to, if any */
 
 	/* these objects are kept in a circular list */
 	/* XXX We could turn this into a CIRCLEQ. */
@@ -232,6 +247,10 @@ struct request {
 	unsigned request_appended :1;	/* true if the request pointer is data which follows this struct */
 	unsigned transmit_me :1;  /* needs to be transmitted */
 	unsigned need_cname :1;   /* make a separate callback for CNAME */
+	unsigned tcp_inflight :1; /* written to ns->connection, not answered yet */
+	unsigned tcp_resend :1;   /* must be resent after losing ns->connection */
+	unsigned tcp_reply_mark;  /* ns->tcp_replies when this was last sent */
+	struct timeval tx_time;   /* when this was last sent */
 
 	/* XXXX This is a horrible hack. */
 	char **put_cname_in_ptr; /* store the cname here if we get one. */
@@ -264,6 +283,19 @@ struct client_tcp_connection {
 struct nameserver {
 	evutil_socket_t socket;	 /* a connected UDP socket */
 	struct tcp_connection *connection; /* intended for TCP support */
+	/* Number of requests written to 'connection' and not yet answered.
+	 * While it is nonzero the connection is not idle. */
+	int tcp_requests_inflight;
+	/* Number of replies received over TCP; used to tell whether a
+	 * connection is still alive when one of its requests times out. */
+	unsigned tcp_replies;
+	/* Smoothed round trip time in microseconds, raised by timeouts; 0 if
+	 * we have neither a sample nor a timeout yet. */
+	int srtt_usec;
+	/* Recent rate of timeouts, out of NS_ERR_SCALE. */
+	int err_rate;
+	/* Counters for evdns_base_get_nameserver_stats() */
+	struct evdns_stats stats;
 	struct sockaddr_storage address;
 	ev_socklen_t addrlen;
 	int failed_times;  /* number of times which we have given this server a chance */
@@ -307,11 +339,49 @@ struct evdns_server_port {
 	unsigned max_client_connections;
 	struct timeval tcp_idle_timeout;
 
+	/* Precompiled answers we send without asking user_callback. */
+	HT_HEAD(server_static_reply_map, server_static_reply) static_replies;
+
 #ifndef EVENT__DISABLE_THREAD_SUPPORT
 	void *lock;
 #endif
 };
 
+/* A precompiled answer to every question about one (name, type, class),
+ * added with evdns_server_port_add_static_reply(). */
+struct server_static_reply {
+	HT_ENTRY(server_static_reply) node;
+	char *name; /* The name, in lowercase. */
+	u16 type;
+	u16 dns_question_class;
+	u16 n_answer; /* Number of RRs in answer. */
+	u16 answer_len;
+	/* The encoded RRs.  Their owner names are all compressed to point at
+	 * the question name, so the same bytes work for any request. */
+	u8 *answer;
+};
+
+static inline unsigned
+server_static_reply_hash(const struct server_static_reply *r)
+{
+	return ht_string_hash_(r->name) ^ (r->type << 16) ^ r->dns_question_class;
+}
+
+static inline int
+server_static_reply_eq(const struct server_static_reply *a,
+    const struct server_static_reply *b)
+{
+	return a->type == b->type &&
+	    a->dns_question_class == b->dns_question_class &&
+	    !strcmp(a->name, b->name);
+}
+
+HT_PROTOTYPE(server_static_reply_map, server_static_reply, node,
+    server_static_reply_hash, server_static_reply_eq)
+HT_GENERATE(server_static_reply_map, server_static_reply, node,
+    server_static_reply_hash, server_static_reply_eq, 0.5,
+    mm_malloc, mm_realloc, mm_free)
+
 /* Represents part of a reply being built.	(That is, a single RR.) */
 struct server_reply_item {
 	struct server_reply_item *next; /* next item in sequence. */
@@ -390,6 +460,10 @@ struct evdns_base {
 	int global_max_nameserver_timeout;
 	/* true iff we will use the 0x20 hack to prevent poisoning attacks. */
 	int global_randomize_case;
+	/* true iff nameserver_pick() prefers the fastest healthy server. */
+	int global_select_by_rtt;
+	/* Number of picks made with global_select_by_rtt set. */
+	unsigned ns_pick_count;
 	/* Maximum size of a UDP DNS packet. */
 	u16 global_max_udp_size;
 
@@ -397,8 +471,8 @@ struct evdns_base {
 	 * probing to see if it has returned?  */
 	struct timeval global_nameserver_probe_initial_timeout;
 
-	/* Combination of DNS_QUERY_USEVC, DNS_QUERY_IGNTC flags
-	 * to control requests via TCP. */
+	/* Combination of DNS_QUERY_USEVC, DNS_QUERY_IGNTC, DNS_QUERY_HEDGE
+	 * flags to control how requests are sent. */
 	u16 global_tcp_flags;
 	/* Idle timeout for outgoing TCP connections. */
 	struct timeval global_tcp_idle_timeout;
@@ -418,6 +492,9 @@ struct evdns_base {
 	int getaddrinfo_ipv4_answered;
 	int getaddrinfo_ipv6_answered;
 
+	/* Counters for evdns_base_get_stats(), summed over all nameservers. */
+	struct evdns_stats stats;
+
 	struct search_state *global_search_state;
 
 	TAILQ_HEAD(hosts_list, hosts_entry) hostsdb;
@@ -464,11 +541,17 @@ evdns_get_global_base(void)
 #define REQ_HEAD(base, id) ((base)->req_heads[id % (base)->n_req_heads])
 
 static struct nameserver *nameserver_pick(struct evdns_base *base);
+static struct nameserver *nameserver_pick_fastest(struct evdns_base *base, struct nameserver *exclude);
+static void nameserver_note_reply(struct nameserver *ns, struct request *req);
+static void nameserver_note_error(struct nameserver *ns);
+static void nameserver_note_timeout(struct nameserver *ns);
+static void nameserver_note_hedge_loss(struct nameserver *ns, struct request *req);
 static void evdns_request_insert(struct request *req, struct request **head);
 static void evdns_request_remove(struct request *req, struct request **head);
 static void nameserver_ready_callback(evutil_socket_t fd, short events, void *arg);
 static int evdns_transmit(struct evdns_base *base);
 static int evdns_request_transmit(struct request *req);
+static void nameserver_tcp_close(struct nameserver *server, int retransmit);
 static void nameserver_send_probe(struct nameserver *const ns);
 static void search_request_finished(struct evdns_request *const);
 static int search_try_next(struct evdns_request *const req);
@@ -640,6 +723,45 @@ disconnect_and_free_connection(struct tcp_connection *conn)
 	mm_free(conn);
 }
 
+/* Note that a request has been written to its nameserver's TCP connection.
+ * A connection with outstanding requests has no read timeout: the requests
+ * have their own timeouts. */
+static void
+request_tcp_sent(struct request *req)
+{
+	struct nameserver *ns = req->ns;
+	struct tcp_connection *conn = ns->connection;
+
+	req->tcp_reply_mark = ns->tcp_replies;
+	if (req->tcp_inflight)
+		return;
+	req->tcp_inflight = 1;
+	if (ns->tcp_requests_inflight++ == 0 && conn && conn->bev) {
+		bufferevent_set_timeouts(conn->bev, NULL,
+		    &ns->base->global_tcp_idle_timeout);
+	}
+}
+
+/* Note that a request is no longer outstanding on its nameserver's TCP
+ * connection.  Once the last one is gone, the idle timeout applies. */
+static void
+request_tcp_done(struct request *req)
+{
+	struct nameserver *ns = req->ns;
+	struct tcp_connection *conn;
+
+	if (!req->tcp_inflight)
+		return;
+	req->tcp_inflight = 0;
+	EVUTIL_ASSERT(ns && ns->tcp_requests_inflight > 0);
+	conn = ns->connection;
+	if (--ns->tcp_requests_inflight == 0 && conn && conn->bev) {
+		bufferevent_set_timeouts(conn->bev,
+		    &ns->base->global_tcp_idle_timeout,
+		    &ns->base->global_tcp_idle_timeout);
+	}
+}
+
 /* This walks the list of inflight requests to find the */
 /* one with a matching transaction id. Returns NULL on */
 /* failure */
@@ -719,6 +841,7 @@ nameserver_probe_failed(struct nameserver *const ns) {
 static void
 request_swap_ns(struct request *req, struct nameserver *ns) {
 	if (ns && req->ns != ns) {
+		request_tcp_done(req);
 		EVUTIL_ASSERT(req->ns->requests_inflight > 0);
 		req->ns->requests_inflight--;
 		ns->requests_inflight++;
@@ -757,8 +880,7 @@ nameserver_failed(struct nameserver *const ns, const char *msg, int err) {
 	ns->failed_times = 1;
 
 	if (ns->connection) {
-		disconnect_and_free_connection(ns->connection);
-		ns->connection = NULL;
+		nameserver_tcp_close(ns, 0);
 	} else if (err == ENOTCONN) {
 		/* XXX: If recvfrom results in ENOTCONN, the socket remains readable
 		 * which triggers another recvfrom. The observed behavior is 100% CPU use.
@@ -866,6 +988,7 @@ request_finished(struct request *const req, struct request **head, int free_hand
 	log(EVDNS_LOG_DEBUG, "Removing timeout for request %p", (void *)req);
 	if (was_inflight) {
 		evtimer_del(&req->timeout_event);
+		request_tcp_done(req);
 		base->global_requests_inflight--;
 		req->ns->requests_inflight--;
 	} else {
@@ -1149,6 +1272,7 @@ reply_handle(struct request *const req, u16 flags, u32 ttl, struct reply *reply)
 			return;
 		default:
 			/* we got a good reply from the nameserver: it is up. */
+			nameserver_note_reply(req->ns, req);
 			if (req->handle == req->ns->probe_request) {
 				/* Avoid double-free */
 				req->ns->probe_request = NULL;
@@ -1161,6 +1285,7 @@ reply_handle(struct request *const req, u16 flags, u32 ttl, struct reply *reply)
 			log(EVDNS_LOG_DEBUG, "Recieved truncated reply(flags 0x%x, transanc ID: %d). Retransmiting via TCP.",
 				req->handle->tcp_flags, req->trans_id);
 			req->handle->tcp_flags |= DNS_QUERY_USEVC;
+			NS_STATS_INC(req->ns, tc_fallbacks);
 			client_retransmit_through_tcp(req->handle);
 			return;
 		}
@@ -1187,6 +1312,7 @@ reply_handle(struct request *const req, u16 flags, u32 ttl, struct reply *reply)
 		reply_schedule_callback(req, ttl, 0, reply);
 		if (req->handle == req->ns->probe_request)
 			req->ns->probe_request = NULL; /* Avoid double-free */
+		nameserver_note_reply(req->ns, req);
 		nameserver_up(req->ns);
 		request_finished(req, &REQ_HEAD(req->base, req->trans_id), 1);
 	}
@@ -1250,7 +1376,7 @@ name_parse(u8 *packet, int length, int *idx, char *name_out, int name_out_len) {
 
 /* parses a raw request from a nameserver */
 static int
-reply_parse(struct evdns_base *base, u8 *packet, int length)
+reply_parse(struct evdns_base *base, struct nameserver *ns, u8 *packet, int length)
 {
 	int j = 0, k = 0;  /* index into packet */
 	u16 t_;	 /* used by the macros */
@@ -1284,6 +1410,15 @@ reply_parse(struct evdns_base *base, u8 *packet, int length)
 
 	/* If it's not an answer, it doesn't correspond to any request. */
 	if (!(flags & _QR_MASK)) return -1;  /* must be an answer */
+	/* A hedged request can be answered by either of the servers it was
+	 * sent to; whichever answers first gets the credit (or blame). */
+	if (ns != req->ns && ns == req->hedge_ns &&
+	    (req->handle->tcp_flags & DNS_QUERY_HEDGE) &&
+	    !(req->handle->tcp_flags & DNS_QUERY_USEVC)) {
+		nameserver_note_hedge_loss(req->ns, req);
+		request_swap_ns(req, ns);
+	}
+	NS_STATS_INC(ns, replies);
 	if ((flags & (_RCODE_MASK|_TC_MASK)) && (flags & (_RCODE_MASK|_TC_MASK)) != DNS_ERR_NOTEXIST) {
 		/* there was an error and it's not NXDOMAIN */
 		goto err;
@@ -1453,9 +1588,167 @@ reply_parse(struct evdns_base *base, u8 *packet, int length)
 	return -1;
 }
 
+/* Lowercase 'name' in place. */
+static void
+evdns_name_to_lower(char *name)
+{
+	for (; *name; ++name)
+		*name = EVUTIL_TOLOWER_(*name);
+}
+
+/* Try to answer a raw request (packet,length) from the static replies of */
+/* port, without building a server_request.  Return 0 if we answered it, */
+/* -1 if it has to go through the user callback, or -2 if we answered it */
+/* but had to drop the TCP client, which the caller must not touch again. */
+static int
+server_port_static_reply(u8 *packet, int length,
+    struct evdns_server_port *port, struct sockaddr *addr,
+    ev_socklen_t addrlen, struct client_tcp_connection *client)
+{
+	int j = 0;	/* index into packet */
+	u16 t_;	 /* used by the macros */
+	u32 t32_;  /* used by the macros */
+	char tmp_name[256]; /* used by the macros */
+
+	int i;
+	u16 trans_id, flags, questions, answers, authority, additional;
+	u16 type, class, rdlen;
+	u32 ttl;
+	int question_start, question_len;
+	int has_opt = 0;
+	size_t max_udp_reply_size = DNS_MAX_UDP_SIZE;
+	struct server_static_reply find, *ent;
+	u8 stack_buf[DNS_MAX_UDP_SIZE];
+	u8 *buf = stack_buf;
+	size_t len, size;
+	int truncated, r = 0;
+
+	ASSERT_LOCKED(port);
+
+	GET16(trans_id);
+	GET16(flags);
+	GET16(questions);
+	GET16(answers);
+	GET16(authority);
+	GET16(additional);
+
+	if (flags & (_QR_MASK|_OP_MASK))
+		return -1;
+	if (questions != 1)
+		return -1;
+
+	question_start = j;
+	if (name_parse(packet, length, &j, tmp_name, sizeof(tmp_name))<0)
+		return -1;
+	GET16(type);
+	GET16(class);
+	question_len = j - question_start;
+
+	evdns_name_to_lower(tmp_name);
+	find.name = tmp_name;
+	find.type = type;
+	find.dns_question_class = class;
+	ent = HT_FIND(server_static_reply_map, &port->static_replies, &find);
+	if (!ent)
+		return -1;
+
+	for (i = 0; i < answers + authority; ++i) {
+		SKIP_NAME;
+		j += 2 /* type */ + 2 /* class */ + 4 /* ttl */;
+		GET16(rdlen);
+		j += rdlen;
+	}
+	for (i = 0; i < additional; ++i) {
+		SKIP_NAME;
+		GET16(type);
+		GET16(class);
+		GET32(ttl);
+		GET16(rdlen);
+		(void)ttl;
+		j += rdlen;
+		if (type == TYPE_OPT) {
+			has_opt = 1;
+			max_udp_reply_size = MAX(class, DNS_MAX_UDP_SIZE);
+			break;
+		}
+	}
+
+	/* The OPT RR takes 11 bytes */
+	size = 12 + question_len + (has_opt ? 11 : 0);
+	truncated = !client && size + ent->answer_len > max_udp_reply_size;
+	if (!truncated)
+		size += ent->answer_len;
+	/* Plain UDP replies always fit on the stack; only TCP and large EDNS
+	 * replies need the heap. */
+	if (size > sizeof(stack_buf) && !(buf = mm_malloc(size)))
+		return -1;
+
+	/* Header, then the question exactly as the client sent it, so that
+	 * case randomization survives and the answers can point at it. */
+	flags = (flags & (_RD_MASK|_CD_MASK)) | _QR_MASK | _AA_MASK;
+	t_ = htons(trans_id);
+	memcpy(buf, &t_, 2);
+	t_ = htons(flags);
+	memcpy(buf + 2, &t_, 2);
+	t_ = htons(1);
+	memcpy(buf + 4, &t_, 2);
+	t_ = htons(ent->n_answer);
+	memcpy(buf + 6, &t_, 2);
+	memset(buf + 8, 0, 2);
+	t_ = htons(has_opt ? 1 : 0);
+	memcpy(buf + 10, &t_, 2);
+	len = 12;
+	memcpy(buf + len, packet + question_start, question_len);
+	len += question_len;
+
+	if (truncated) {
+		/* Tell the client to retry over TCP. */
+		buf[2] |= _TC_MASK >> 8;
+		memset(buf + 6, 0, 2);
+	} else {
+		memcpy(buf + len, ent->answer, ent->answer_len);
+		len += ent->answer_len;
+	}
+
+	if (has_opt) {
+		/* The OPT pseudo-RR, as in evdns_server_request_add_reply */
+		buf[len++] = 0; /* NAME, always 0 */
+		t_ = htons(TYPE_OPT);
+		memcpy(buf + len, &t_, 2);
+		t_ = htons(DNS_MAX_UDP_SIZE);
+		memcpy(buf + len + 2, &t_, 2);
+		memset(buf + len + 4, 0, 6); /* TTL and RDLEN */
+		len += 10;
+	}
+
+	if (client) {
+		struct bufferevent *bev = client->connection.bev;
+		t_ = htons((u16)len);
+		if (bufferevent_write(bev, &t_, sizeof(t_)) ||
+		    bufferevent_write(bev, buf, len)) {
+			log(EVDNS_LOG_WARN, "Failed to send static reply to client %p",
+			    (void *)client);
+			evdns_remove_tcp_client(port, client);
+			r = -2;
+		}
+	} else if (sendto(port->socket, (void *)buf, (int)len, 0,
+		addr, addrlen) < 0) {
+		/* UDP clients will retry; don't queue anything. */
+		int err = evutil_socket_geterror(port->socket);
+		log(EVDNS_LOG_DEBUG, "Error %s (%d) while sending static reply",
+		    evutil_socket_error_to_string(err), err);
+	}
+	EVUTIL_ASSERT(len == size);
+	if (buf != stack_buf)
+		mm_free(buf);
+	return r;
+err:
+	return -1;
+}
+
 /* Parse a raw request (packet,length) sent to a nameserver port (port) from */
 /* a DNS client (addr,addrlen), and if it's well-formed, call the corresponding */
-/* callback. */
+/* callback.  Return -2 if the TCP client was dropped while answering. */
 static int
 request_parse(u8 *packet, int length, struct evdns_server_port *port,
 				struct sockaddr *addr, ev_socklen_t addrlen, struct client_tcp_connection *client)
@@ -1473,6 +1766,13 @@ request_parse(u8 *packet, int length, struct evdns_server_port *port,
 
 	ASSERT_LOCKED(port);
 
+	if (HT_SIZE(&port->static_replies)) {
+		int r = server_port_static_reply(packet, length, port, addr,
+		    addrlen, client);
+		if (r != -1)
+			return r;
+	}
+
 	/* Get the header fields */
 	GET16(trans_id);
 	GET16(flags);
@@ -1607,6 +1907,138 @@ transaction_id_pick(struct evdns_base *base) {
 	}
 }
 
+/* Return the request timeout of 'base' in usec, capped like RTT samples. */
+static int
+nameserver_timeout_usec(const struct evdns_base *base)
+{
+	const struct timeval *tv = &base->global_timeout;
+
+	if (tv->tv_sec >= 60)
+		return 60 * 1000000;
+	return (int)(tv->tv_sec * 1000000 + tv->tv_usec);
+}
+
+/* Return the expected cost of sending a request to 'ns': its smoothed RTT,
+ * or the request timeout if we have none, inflated by up to 9x for servers
+ * whose requests have been timing out. */
+static ev_uint64_t
+nameserver_cost(const struct nameserver *ns)
+{
+	ev_uint64_t rtt = ns->srtt_usec ? ns->srtt_usec :
+	    nameserver_timeout_usec(ns->base);
+	return rtt * (NS_ERR_SCALE + 8 * ns->err_rate);
+}
+
+/* Return the cheapest good nameserver other than 'exclude', or NULL if
+ * there is none.  A server we know nothing about yet comes first, so that
+ * it gets measured; ties go to the first one after server_head. */
+static struct nameserver *
+nameserver_pick_fastest(struct evdns_base *base, struct nameserver *exclude)
+{
+	struct nameserver *ns = base->server_head, *best = NULL;
+	ev_uint64_t best_cost = 0;
+
+	ASSERT_LOCKED(base);
+	if (!ns)
+		return NULL;
+	do {
+		if (ns->state && ns != exclude) {
+			ev_uint64_t cost;
+			if (!ns->srtt_usec && !ns->err_rate)
+				return ns;
+			cost = nameserver_cost(ns);
+			if (!best || cost < best_cost) {
+				best = ns;
+				best_cost = cost;
+			}
+		}
+		ns = ns->next;
+	} while (ns != base->server_head);
+	return best;
+}
+
+/* Return the evdns_stats.rtt_histogram bucket for an RTT in usec. */
+static int
+rtt_histogram_bucket(int usec)
+{
+	int msec = usec / 1000, bucket = 0;
+	while (msec && bucket < EVDNS_RTT_HISTOGRAM_BUCKETS - 1) {
+		msec >>= 1;
+		++bucket;
+	}
+	return bucket;
+}
+
+/* Update the RTT and error rate estimates of a nameserver that has just
+ * answered 'req'. */
+static void
+nameserver_note_reply(struct nameserver *ns, struct request *req)
+{
+	struct timeval now, rtt;
+	int sample;
+
+	ns->err_rate -= ns->err_rate >> 3;
+	/* As in TCP (Karn's algorithm), only a request sent exactly once
+	 * gives an unambiguous RTT sample. */
+	if (req->tx_count != 1)
+		return;
+	evutil_gettimeofday(&now, NULL);
+	evutil_timersub(&now, &req->tx_time, &rtt);
+	if (rtt.tv_sec < 0)
+		return;
+	if (rtt.tv_sec > 60)
+		rtt.tv_sec = 60;
+	sample = (int)(rtt.tv_sec * 1000000 + rtt.tv_usec);
+	if (sample <= 0)
+		sample = 1;
+	if (!ns->srtt_usec)
+		ns->srtt_usec = sample;
+	else
+		ns->srtt_usec += (sample - ns->srtt_usec) / 8;
+	NS_STATS_INC(ns, rtt_histogram[rtt_histogram_bucket(sample)]);
+}
+
+/* Note that a nameserver has failed to answer a request usefully. */
+static void
+nameserver_note_error(struct nameserver *ns)
+{
+	ns->err_rate += (NS_ERR_SCALE - ns->err_rate) >> 3;
+}
+
+/* Note that a request sent to a nameserver has timed out. */
+static void
+nameserver_note_timeout(struct nameserver *ns)
+{
+	int timeout = nameserver_timeout_usec(ns->base);
+
+	nameserver_note_error(ns);
+	/* A timeout gives no RTT sample, but it says the server is slow:
+	 * back off as TCP does with its RTO, up to the timeout itself. */
+	if (!ns->srtt_usec || ns->srtt_usec > timeout / 2)
+		ns->srtt_usec = timeout;
+	else
+		ns->srtt_usec *= 2;
+}
+
+/* Note that the other server a hedged request went to answered before 'ns'
+ * did: 'ns' takes at least as long as that took. */
+static void
+nameserver_note_hedge_loss(struct nameserver *ns, struct request *req)
+{
+	struct timeval now, elapsed;
+	int usec;
+
+	evutil_gettimeofday(&now, NULL);
+	evutil_timersub(&now, &req->tx_time, &elapsed);
+	if (elapsed.tv_sec < 0)
+		return;
+	if (elapsed.tv_sec > 60)
+		elapsed.tv_sec = 60;
+	usec = (int)(elapsed.tv_sec * 1000000 + elapsed.tv_usec);
+	if (usec > ns->srtt_usec)
+		ns->srtt_usec = usec;
+}
+
 /* choose a namesever to use. This function will try to ignore */
 /* nameservers which we think are down and load balance across the rest */
 /* by updating the server_head global each time. */
@@ -1623,6 +2055,15 @@ nameserver_pick(struct evdns_base *base) {
 		return base->server_head;
 	}
 
+	if (base->global_select_by_rtt && base->global_good_nameservers > 1 &&
+	    ++base->ns_pick_count % NS_EXPLORE_INTERVAL) {
+		picked = nameserver_pick_fastest(base, NULL);
+		/* keep rotating, so that ties are broken round-robin */
+		base->server_head = base->server_head->next;
+		if (picked)
+			return picked;
+	}
+
 	/* remember that nameservers are in a circular list */
 	for (;;) {
 		if (base->server_head->state) {
@@ -1683,7 +2124,7 @@ nameserver_read(struct nameserver *ns) {
 		}
 
 		ns->timedout = 0;
-		reply_parse(ns->base, packet, r);
+		reply_parse(ns->base, ns, packet, r);
 	}
 done:
 	mm_free(packet);
@@ -2075,6 +2516,7 @@ evdns_add_server_port_with_base(struct event_base *base, evutil_socket_t socket,
 	port->tcp_idle_timeout.tv_usec = 0;
 	port->client_connections_count = 0;
 	LIST_INIT(&port->client_connections);
+	HT_INIT(server_static_reply_map, &port->static_replies);
 	event_assign(&port->event, port->event_base,
 				 port->socket, EV_READ | EV_PERSIST,
 				 server_port_ready_callback, port);
@@ -2109,6 +2551,7 @@ evdns_add_server_port_with_listener(struct event_base *base, struct evconnlisten
 	port->max_client_connections = MAX_CLIENT_CONNECTIONS;
 	port->client_connections_count = 0;
 	LIST_INIT(&port->client_connections);
+	HT_INIT(server_static_reply_map, &port->static_replies);
 	port->listener = listener;
 	evconnlistener_set_cb(port->listener, incoming_conn_cb, port);
 
@@ -2192,7 +2635,15 @@ server_tcp_read_packet_cb(struct bufferevent *bev, void *ctx)
 		if (!msg)
 			break;
 
-		request_parse(msg, msg_len, port, NULL, 0, client);
+		if (request_parse(msg, msg_len, port, NULL, 0, client) == -2) {
+			/* The client, and conn with it, is gone already. */
+			mm_free(msg);
+			rc = port->refcnt;
+			EVDNS_UNLOCK(port);
+			if (!rc)
+				server_port_free(port);
+			return;
+		}
 		mm_free(msg);
 		msg = NULL;
 		conn->awaiting_packet_size = 0;
@@ -2408,6 +2859,140 @@ evdns_server_request_set_flags(struct evdns_server_request *exreq, int flags)
 	req->base.flags |= flags;
 }
 
+static void
+server_port_clear_static_replies(struct evdns_server_port *port)
+{
+	struct server_static_reply **ent, *victim;
+	ent = HT_START(server_static_reply_map, &port->static_replies);
+	while (ent) {
+		victim = *ent;
+		ent = HT_NEXT_RMV(server_static_reply_map,
+		    &port->static_replies, ent);
+		mm_free(victim->name);
+		mm_free(victim->answer);
+		mm_free(victim);
+	}
+	HT_CLEAR(server_static_reply_map, &port->static_replies);
+}
+
+/* exported function */
+int
+evdns_server_port_add_static_reply(struct evdns_server_port *port, const char *name, int type, int class, int ttl, int datalen, int is_name, const char *data)
+{
+	struct server_static_reply find, *ent;
+	char lname[256];
+	u8 *buf;
+	size_t buf_len;
+	off_t j = 0;
+	u16 t_;
+	u32 t32_;
+	u8 *answer;
+	int result = -1;
+
+	if (strlcpy(lname, name, sizeof(lname)) >= sizeof(lname))
+		return -1;
+	evdns_name_to_lower(lname);
+	if (!is_name && datalen < 0)
+		return -1;
+
+	/* The fixed part of the RR, then its data: a name takes at most two
+	 * bytes more than its text. */
+	buf_len = 12 + (is_name ? strlen(data) + 2 : (size_t)datalen);
+	if (!(buf = mm_malloc(buf_len)))
+		return -1;
+
+	/* Encode the RR, with its owner name pointing at the question. */
+	APPEND16(0xc000 | 12);
+	APPEND16(type);
+	APPEND16(class);
+	APPEND32(ttl);
+	if (is_name) {
+		off_t len_idx = j, r;
+		j += 2;
+		r = dnsname_to_labels(buf, buf_len, j, data, strlen(data), NULL);
+		if (r < 0)
+			goto overflow;
+		t_ = htons((u16)(r - j));
+		memcpy(buf + len_idx, &t_, 2);
+		j = r;
+	} else {
+		APPEND16(datalen);
+		if (j + datalen > (off_t)buf_len)
+			goto overflow;
+		if (datalen)
+			memcpy(buf + j, data, datalen);
+		j += datalen;
+	}
+
+	EVDNS_LOCK(port);
+	find.name = lname;
+	find.type = type;
+	find.dns_question_class = class;
+	ent = HT_FIND(server_static_reply_map, &port->static_replies, &find);
+	if (!ent) {
+		if (!(ent = mm_calloc(1, sizeof(*ent))))
+			goto done;
+		if (!(ent->name = mm_strdup(lname))) {
+			mm_free(ent);
+			goto done;
+		}
+		ent->type = type;
+		ent->dns_question_class = class;
+		HT_INSERT(server_static_reply_map, &port->static_replies, ent);
+	}
+	/* Leave room for the header, the question and an OPT RR. */
+	if (ent->n_answer == 0xffff ||
+	    ent->answer_len + j > 0xffff - 12 - EVDNS_NAME_MAX - 4 - 11)
+		goto done;
+	if (!(answer = mm_realloc(ent->answer, ent->answer_len + j)))
+		goto done;
+	memcpy(answer + ent->answer_len, buf, j);
+	ent->answer = answer;
+	ent->answer_len += (u16)j;
+	++ent->n_answer;
+	result = 0;
+done:
+	EVDNS_UNLOCK(port);
+overflow:
+	mm_free(buf);
+	return result;
+}
+
+/* exported function */
+int
+evdns_server_port_add_static_a_reply(struct evdns_server_port *port, const char *name, int n, const void *addrs, int ttl)
+{
+	int i;
+	for (i = 0; i < n; ++i) {
+		if (evdns_server_port_add_static_reply(port, name, TYPE_A,
+			CLASS_INET, ttl, 4, 0, (const char *)addrs + i*4) < 0)
+			return -1;
+	}
+	return 0;
+}
+
+/* exported function */
+int
+evdns_server_port_add_static_aaaa_reply(struct evdns_server_port *port, const char *name, int n, const void *addrs, int ttl)
+{
+	int i;
+	for (i = 0; i < n; ++i) {
+		if (evdns_server_port_add_static_reply(port, name, TYPE_AAAA,
+			CLASS_INET, ttl, 16, 0, (const char *)addrs + i*16) < 0)
+			return -1;
+	}
+	return 0;
+}
+
+/* exported function */
+void
+evdns_server_port_clear_static_replies(struct evdns_server_port *port)
+{
+	EVDNS_LOCK(port);
+	server_port_clear_static_replies(port);
+	EVDNS_UNLOCK(port);
+}
+
 static int
 evdns_server_request_format_response(struct server_request *req, int err)
 {
@@ -2666,6 +3251,8 @@ server_port_free(struct evdns_server_port *port)
 		event_debug_unassign(&port->event);
 	}
 
+	server_port_clear_static_replies(port);
+
 	EVTHREAD_FREE_LOCK(port->lock, EVTHREAD_LOCKTYPE_RECURSIVE);
 	mm_free(port);
 }
@@ -2690,18 +3277,22 @@ evdns_server_request_get_requesting_addr(struct evdns_server_request *req_, stru
 	return req->addrlen;
 }
 
+/* Resend (or give up on) every request of 'server' that was marked with
+ * tcp_resend by nameserver_tcp_close(). */
 static void
 retransmit_all_tcp_requests_for(struct nameserver *server)
 {
 	int i = 0;
 	for (i = 0; i < server->base->n_req_heads; ++i) {
-		struct request *started_at = server->base->req_heads[i];
-		struct request *req = started_at;
+		struct request *started_at, *req;
+	again:
+		started_at = req = server->base->req_heads[i];
 		if (!req)
 			continue;
 
 		do {
-			if (req->ns == server && (req->handle->tcp_flags & DNS_QUERY_USEVC)) {
+			if (req->ns == server && req->tcp_resend) {
+				req->tcp_resend = 0;
 				if (req->tx_count >= req->base->global_max_retransmits) {
 					log(EVDNS_LOG_DEBUG, "Giving up on request %p; tx_count==%d",
 						(void *)req, req->tx_count);
@@ -2711,10 +3302,46 @@ retransmit_all_tcp_requests_for(struct nameserver *server)
 					(void) evtimer_del(&req->timeout_event);
 					evdns_request_transmit(req);
 				}
+				/* The list may have changed under us; rescan it. */
+				goto again;
+			}
+			req = req->next;
+		} while (req != started_at);
+	}
+}
+
+/* Drop the TCP connection to 'server'.  If 'retransmit' is set, every
+ * request that was outstanding on it (or already marked with tcp_resend) is
+ * sent again right away over a new connection; otherwise those requests are
+ * left to their timeouts. */
+static void
+nameserver_tcp_close(struct nameserver *server, int retransmit)
+{
+	int i;
+
+	ASSERT_LOCKED(server->base);
+	disconnect_and_free_connection(server->connection);
+	server->connection = NULL;
+	if (!server->tcp_requests_inflight && !retransmit)
+		return;
+
+	for (i = 0; i < server->base->n_req_heads; ++i) {
+		struct request *started_at, *req;
+		started_at = req = server->base->req_heads[i];
+		if (!req)
+			continue;
+		do {
+			if (req->ns == server && req->tcp_inflight) {
+				req->tcp_inflight = 0;
+				req->tcp_resend = retransmit;
 			}
 			req = req->next;
 		} while (req != started_at);
 	}
+	server->tcp_requests_inflight = 0;
+
+	if (retransmit)
+		retransmit_all_tcp_requests_for(server);
 }
 
 /* this is a libevent callback function which is called when a request */
@@ -2729,6 +3356,16 @@ evdns_request_timeout_callback(evutil_socket_t fd, short events, void *arg) {
 
 	log(EVDNS_LOG_DEBUG, "Request %p timed out", arg);
 	EVDNS_LOCK(base);
+	if (req->ns) {
+		/* SERVFAIL replies are also handled here, with events == 0;
+		 * those came back quickly, so they don't count against srtt. */
+		if (events & EV_TIMEOUT) {
+			nameserver_note_timeout(req->ns);
+			NS_STATS_INC(req->ns, timeouts);
+		} else {
+			nameserver_note_error(req->ns);
+		}
+	}
 
 	if (req->tx_count >= req->base->global_max_retransmits) {
 		struct nameserver *ns = req->ns;
@@ -2740,13 +3377,24 @@ evdns_request_timeout_callback(evutil_socket_t fd, short events, void *arg) {
 		request_finished(req, &REQ_HEAD(req->base, req->trans_id), 1);
 		nameserver_failed(ns, "request timed out.", 0);
 	} else {
-		/* if request is using tcp connection, so tear connection */
-		if (req->handle->tcp_flags & DNS_QUERY_USEVC) {
-			disconnect_and_free_connection(req->ns->connection);
-			req->ns->connection = NULL;
-
-			/* client can have the only connection to DNS server */
-			retransmit_all_tcp_requests_for(req->ns);
+		struct nameserver *ns = req->ns;
+		struct tcp_connection *conn = ns->connection;
+		if ((req->handle->tcp_flags & DNS_QUERY_USEVC) &&
+		    conn && conn->state == TS_CONNECTED &&
+		    req->tcp_inflight &&
+		    req->tcp_reply_mark != ns->tcp_replies) {
+			/* The connection has answered other queries since this
+			 * one was sent, so it is alive: keep it, and resend
+			 * just this request over it. */
+			log(EVDNS_LOG_DEBUG, "Retransmitting request %p; tx_count==%d by tcp", arg, req->tx_count);
+			(void) evtimer_del(&req->timeout_event);
+			evdns_request_transmit(req);
+		} else if (req->handle->tcp_flags & DNS_QUERY_USEVC) {
+			/* The connection looks dead; tear it down and resend
+			 * everything that was pending on it over a new one.
+			 * (client can have the only connection to DNS server) */
+			req->tcp_resend = 1;
+			nameserver_tcp_close(ns, 1);
 		} else {
 			/* retransmit it */
 			log(EVDNS_LOG_DEBUG, "Retransmitting request %p; tx_count==%d by udp", arg, req->tx_count);
@@ -2812,7 +3460,7 @@ evdns_tcp_connect_if_disconnected(struct nameserver *server)
 	if (conn && conn->state != TS_DISCONNECTED && conn->bev != NULL)
 		return 0;
 
-	disconnect_and_free_connection(conn);
+	nameserver_tcp_close(server, 0);
 	conn = new_tcp_connecton(bufferevent_socket_new(server->base->event_base, -1, BEV_OPT_CLOSE_ON_FREE));
 	if (!conn)
 		return 2;
@@ -2846,8 +3494,7 @@ client_tcp_read_packet_cb(struct bufferevent *bev, void *ctx)
 
 	while (1) {
 		if (tcp_read_message(conn, &msg, &msg_len)) {
-			disconnect_and_free_connection(server->connection);
-			server->connection = NULL;
+			nameserver_tcp_close(server, 1);
 			EVDNS_UNLOCK(server->base);
 			return;
 		}
@@ -2856,7 +3503,8 @@ client_tcp_read_packet_cb(struct bufferevent *bev, void *ctx)
 		if (!msg)
 			break;
 
-		reply_parse(server->base, msg, msg_len);
+		server->tcp_replies++;
+		reply_parse(server->base, server, msg, msg_len);
 		mm_free(msg);
 		msg = NULL;
 		conn->awaiting_packet_size = 0;
@@ -2878,12 +3526,11 @@ client_tcp_event_cb(struct bufferevent *bev, short events, void *ctx) {
 
 	log(EVDNS_LOG_DEBUG, "Event %d on connection %p", events, (void *)conn);
 
-	if (events & (BEV_EVENT_TIMEOUT)) {
-		disconnect_and_free_connection(server->connection);
-		server->connection = NULL;
-	} else if (events & (BEV_EVENT_EOF | BEV_EVENT_ERROR)) {
-		disconnect_and_free_connection(server->connection);
-		server->connection = NULL;
+	if (events & (BEV_EVENT_TIMEOUT | BEV_EVENT_EOF | BEV_EVENT_ERROR)) {
+		/* Either the connection was idle for too long, or the server
+		 * closed it; whatever was still pending on it has to be sent
+		 * again. */
+		nameserver_tcp_close(server, 1);
 	} else if (events & BEV_EVENT_CONNECTED) {
 		EVUTIL_ASSERT (conn->state == TS_CONNECTING);
 		conn->state = TS_CONNECTED;
@@ -2924,15 +3571,46 @@ evdns_request_transmit_through_tcp(struct request *req, struct nameserver *serve
 		goto fail;
 	if (evtimer_add(&req->timeout_event, &req->base->global_timeout) < 0)
 		goto fail;
+	request_tcp_sent(req);
 
 	return 0;
 fail:
 	log(EVDNS_LOG_WARN, "Failed to send request %p via tcp connection %p", (void *)req, (void *)conn);
-	disconnect_and_free_connection(server->connection);
-	server->connection = NULL;
+	nameserver_tcp_close(server, 0);
 	return 2;
 }
 
+/* Send a copy of a request that has just gone to req->ns to a second good
+ * nameserver, so that the first answer from either one is used.  This is
+ * best-effort: the request is still tracked (and retransmitted) via
+ * req->ns alone. */
+static void
+evdns_request_transmit_hedge(struct request *req)
+{
+	struct evdns_base *base = req->base;
+	struct nameserver *ns;
+
+	/* The other server's socket might not be polled at all. */
+	if (base->disable_when_inactive)
+		return;
+	if (base->global_select_by_rtt) {
+		ns = nameserver_pick_fastest(base, req->ns);
+	} else {
+		for (ns = req->ns->next; ns != req->ns && !ns->state; ns = ns->next)
+			;
+	}
+	if (!ns || ns == req->ns || ns->choked)
+		return;
+
+	log(EVDNS_LOG_DEBUG, "Hedging request %p to nameserver %p",
+	    (void *)req, (void *)ns);
+	if (sendto(ns->socket, (void*)req->request, req->request_len, 0,
+		(struct sockaddr *)&ns->address, ns->addrlen) >= 0) {
+		req->hedge_ns = ns;
+		NS_STATS_INC(ns, hedged);
+	}
+}
+
 /* try to send a request, updating the fields of the request */
 /* as needed */
 /* */
@@ -2962,6 +3640,7 @@ evdns_request_transmit(struct request *req) {
 		return 1;
 	}
 
+	evutil_gettimeofday(&req->tx_time, NULL);
 	if (req->handle->tcp_flags & DNS_QUERY_USEVC) {
 		r = evdns_request_transmit_through_tcp(req, req->ns);
 		/*
@@ -2973,6 +3652,9 @@ evdns_request_transmit(struct request *req) {
 		}
 	} else {
 		r = evdns_request_transmit_to(req, req->ns);
+		if (r == 0 && req->tx_count == 0 &&
+		    (req->handle->tcp_flags & DNS_QUERY_HEDGE))
+			evdns_request_transmit_hedge(req);
 	}
 	switch (r) {
 	case 1:
@@ -2996,6 +3678,11 @@ evdns_request_transmit(struct request *req) {
 			    (void *)req);
 			/* ???? Do more? */
 		}
+		if (r == 0) {
+			NS_STATS_INC(req->ns, queries_sent);
+			if (req->tx_count)
+				NS_STATS_INC(req->ns, retransmits);
+		}
 		req->tx_count++;
 		req->transmit_me = 0;
 		return retcode;
@@ -3151,7 +3838,8 @@ evdns_base_clear_nameservers_and_suspend(struct evdns_base *base)
 		while (req) {
 			struct request *next = req->next;
 			req->tx_count = req->reissue_count = 0;
-			req->ns = NULL;
+			req->tcp_inflight = req->tcp_resend = 0;
+			req->ns = req->hedge_ns = NULL;
 			/* ???? What to do about searches? */
 			(void) evtimer_del(&req->timeout_event);
 			req->trans_id = 0;
@@ -3420,6 +4108,46 @@ done:
 	return result;
 }
 
+int
+evdns_base_get_stats(struct evdns_base *base, struct evdns_stats *stats)
+{
+	EVDNS_LOCK(base);
+	memcpy(stats, &base->stats, sizeof(*stats));
+	stats->requests_inflight = base->global_requests_inflight;
+	stats->requests_waiting = base->global_requests_waiting;
+	stats->getaddrinfo_ipv4_timeouts = base->getaddrinfo_ipv4_timeouts;
+	stats->getaddrinfo_ipv6_timeouts = base->getaddrinfo_ipv6_timeouts;
+	stats->getaddrinfo_ipv4_answered = base->getaddrinfo_ipv4_answered;
+	stats->getaddrinfo_ipv6_answered = base->getaddrinfo_ipv6_answered;
+	EVDNS_UNLOCK(base);
+	return 0;
+}
+
+int
+evdns_base_get_nameserver_stats(struct evdns_base *base, int idx,
+    struct evdns_stats *stats)
+{
+	int result = -1;
+	int i;
+	struct nameserver *server;
+	EVDNS_LOCK(base);
+	server = base->server_head;
+	for (i = 0; i < idx && server; ++i, server = server->next) {
+		if (server->next == base->server_head)
+			goto done;
+	}
+	if (! server)
+		goto done;
+
+	memcpy(stats, &server->stats, sizeof(*stats));
+	stats->requests_inflight = server->requests_inflight;
+	stats->srtt_usec = server->srtt_usec;
+	result = 0;
+done:
+	EVDNS_UNLOCK(base);
+	return result;
+}
+
 int
 evdns_base_get_nameserver_fd(struct evdns_base *base, int idx)
 {
@@ -3685,7 +4413,7 @@ evdns_base_resolve_ipv4(struct evdns_base *base, const char *name, int flags,
 	handle->user_pointer = ptr;
 	EVDNS_LOCK(base);
 	handle->tcp_flags = base->global_tcp_flags;
-	handle->tcp_flags |= flags & (DNS_QUERY_USEVC | DNS_QUERY_IGNTC);
+	handle->tcp_flags |= flags & (DNS_QUERY_USEVC | DNS_QUERY_IGNTC | DNS_QUERY_HEDGE);
 	if (flags & DNS_QUERY_NO_SEARCH) {
 		req =
 			request_new(base, handle, TYPE_A, name, flags);
@@ -3726,7 +4454,7 @@ evdns_base_resolve_ipv6(struct evdns_base *base,
 	handle->user_pointer = ptr;
 	EVDNS_LOCK(base);
 	handle->tcp_flags = base->global_tcp_flags;
-	handle->tcp_flags |= flags & (DNS_QUERY_USEVC | DNS_QUERY_IGNTC);
+	handle->tcp_flags |= flags & (DNS_QUERY_USEVC | DNS_QUERY_IGNTC | DNS_QUERY_HEDGE);
 	if (flags & DNS_QUERY_NO_SEARCH) {
 		req = request_new(base, handle, TYPE_AAAA, name, flags);
 		if (req)
@@ -3769,7 +4497,7 @@ evdns_base_resolve_reverse(struct evdns_base *base, const struct in_addr *in, in
 	log(EVDNS_LOG_DEBUG, "Resolve requested for %s (reverse)", buf);
 	EVDNS_LOCK(base);
 	handle->tcp_flags = base->global_tcp_flags;
-	handle->tcp_flags |= flags & (DNS_QUERY_USEVC | DNS_QUERY_IGNTC);
+	handle->tcp_flags |= flags & (DNS_QUERY_USEVC | DNS_QUERY_IGNTC | DNS_QUERY_HEDGE);
 	req = request_new(base, handle, TYPE_PTR, buf, flags);
 	if (req)
 		request_submit(req);
@@ -3813,7 +4541,7 @@ evdns_base_resolve_reverse_ipv6(struct evdns_base *base, const struct in6_addr *
 	log(EVDNS_LOG_DEBUG, "Resolve requested for %s (reverse)", buf);
 	EVDNS_LOCK(base);
 	handle->tcp_flags = base->global_tcp_flags;
-	handle->tcp_flags |= flags & (DNS_QUERY_USEVC | DNS_QUERY_IGNTC);
+	handle->tcp_flags |= flags & (DNS_QUERY_USEVC | DNS_QUERY_IGNTC | DNS_QUERY_HEDGE);
 	req = request_new(base, handle, TYPE_PTR, buf, flags);
 	if (req)
 		request_submit(req);
@@ -4344,6 +5072,12 @@ evdns_base_set_option_impl(struct evdns_base *base,
 		if (randcase == -1) return -1;
 		if (!(flags & DNS_OPTION_MISC)) return 0;
 		base->global_randomize_case = randcase;
+	} else if (str_matches_option(option, "select-by-rtt:")) {
+		int select_by_rtt = strtoint(val);
+		if (select_by_rtt == -1) return -1;
+		if (!(flags & DNS_OPTION_MISC)) return 0;
+		log(EVDNS_LOG_DEBUG, "Setting select-by-rtt to %d", select_by_rtt);
+		base->global_select_by_rtt = select_by_rtt;
 	} else if (str_matches_option(option, "bind-to:")) {
 		/* XXX This only applies to successive nameservers, not
 		 * to already-configured ones.	We might want to fix that. */
@@ -4411,6 +5145,11 @@ evdns_base_set_option_impl(struct evdns_base *base,
 		if (val && strlen(val)) return -1;
 		log(EVDNS_LOG_DEBUG, "Setting ignore-tc option");
 		base->global_tcp_flags |= DNS_QUERY_IGNTC;
+	} else if (str_matches_option(option, "hedge:")) {
+		if (!(flags & DNS_OPTION_MISC)) return 0;
+		if (val && strlen(val)) return -1;
+		log(EVDNS_LOG_DEBUG, "Setting hedge option");
+		base->global_tcp_flags |= DNS_QUERY_HEDGE;
 	} else if (str_matches_option(option, "edns-udp-size:")) {
 		const int sz = strtoint_clipped(val, DNS_MAX_UDP_SIZE, EDNS_MAX_UDP_SIZE);
 		if (sz == -1) return -1;
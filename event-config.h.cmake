@@ -187,6 +187,9 @@
 /* Define to 1 if you have the <mach/mach.h> header file. */
 #cmakedefine EVENT__HAVE_MACH_MACH_H 1
 
+/* Define to 1 if you have the `makecontext' function. */
+#cmakedefine EVENT__HAVE_MAKECONTEXT 1
+
 /* Define to 1 if you have the <memory.h> header file. */
 #cmakedefine EVENT__HAVE_MEMORY_H 1
 
@@ -268,6 +271,9 @@
 /* Define to 1 if you have the `sendfile' function. */
 #cmakedefine EVENT__HAVE_SENDFILE 1
 
+/* Define to 1 if you have the `splice' function. */
+#cmakedefine EVENT__HAVE_SPLICE 1
+
 /* Define to 1 if you have the `pread' function. */
 #cmakedefine EVENT__HAVE_PREAD 1
 
@@ -452,6 +458,9 @@
 /* Define to 1 if the system has the type `uintptr_t'. */
 #cmakedefine EVENT__HAVE_UINTPTR_T 1
 
+/* Define to 1 if you have the <ucontext.h> header file. */
+#cmakedefine EVENT__HAVE_UCONTEXT_H 1
+
 /* Define to 1 if you have the `umask' function. */
 #cmakedefine EVENT__HAVE_UMASK 1
 
@@ -206,6 +206,52 @@ struct event_once {
 	void *arg;
 };
 
+/** One slot in the ring of slow callbacks.  seq is the index of the record
+ * in it plus one, or 0 while it is being rewritten. */
+struct event_slow_callback_slot {
+	unsigned seq;
+	struct event_slow_callback cb;
+};
+
+/** A ring of the last EVENT_SLOW_CALLBACK_RING_SIZE slow callbacks.  Only
+ * the thread running the loop writes to it; any thread may read it without
+ * locking. */
+struct event_slow_callback_ring {
+	/** How many records have been written in all */
+	unsigned head;
+	struct event_slow_callback_slot slots[EVENT_SLOW_CALLBACK_RING_SIZE];
+};
+
+/** What a trace record describes; see event_base_trace_start().  Kinds from
+ * EVTRACE_CALLBACK on are about a function that ran. */
+#define EVTRACE_POLL		1
+#define EVTRACE_TIMEOUTS	2
+#define EVTRACE_CALLBACK	3
+#define EVTRACE_BEV_READ	4
+#define EVTRACE_BEV_WRITE	5
+#define EVTRACE_BEV_EVENT	6
+
+/** One entry in the timeline of an event_base. */
+struct evtrace_record {
+	ev_uint64_t start_usec;
+	ev_uint32_t dur_usec;
+	ev_uint8_t kind;
+	ev_int8_t priority;
+	short events;
+	evutil_socket_t fd;
+	void (*fn)(void);
+	const void *obj;
+};
+
+/** The last 'size' entries in the timeline of an event_base.  Only the
+ * thread running the loop writes to it. */
+struct evtrace_ring {
+	unsigned size;
+	/** How many records have been written in all */
+	unsigned head;
+	struct evtrace_record records[1];
+};
+
 /** Contextual information passed from event_base_loop to the "prepare" watcher
  * callbacks. We define this as a struct rather than individual parameters to
  * the callback function for the sake of future extensibility. */
@@ -213,14 +259,16 @@ struct evwatch_prepare_cb_info {
 	/** The timeout duration passed to the underlying implementation's `dispatch`.
 	 * See evwatch_prepare_get_timeout. */
 	const struct timeval *timeout;
+	/** The event_base that is about to poll. */
+	const struct event_base *base;
 };
 
 /** Contextual information passed from event_base_loop to the "check" watcher
  * callbacks. We define this as a struct rather than individual parameters to
  * the callback function for the sake of future extensibility. */
 struct evwatch_check_cb_info {
-	/** Placeholder, since empty struct is not allowed by some compilers. */
-	void *unused;
+	/** The event_base that has just polled. */
+	const struct event_base *base;
 };
 
 /** Watcher types (prepare and check, perhaps others in the future). */
@@ -373,6 +421,62 @@ struct event_base {
 	int max_dispatch_callbacks;
 	int limit_callbacks_after_prio;
 
+	/** Busy polling (see event_config_set_busy_poll()): the longest we
+	 * may spin before sleeping, or zero; how long we spin right now; and
+	 * EVENT_BUSY_POLL_* flags. */
+	struct timeval busy_poll_max;
+	struct timeval busy_poll_budget;
+	int busy_poll_flags;
+	/** Busy polling statistics, see evwatch_check_get_busy_poll(). */
+	ev_uint64_t busy_poll_last_usec;
+	ev_uint64_t busy_poll_hits;
+	ev_uint64_t busy_poll_wakeups;
+	ev_uint64_t busy_poll_total_usec;
+	ev_uint64_t busy_poll_idle_usec;
+
+	/** The most events the backend may fetch at once, or 0 for its
+	 * default; and how many it can fetch right now, or -1 if it doesn't
+	 * say. */
+	int max_batch_size;
+	int cur_batch_size;
+	/** How many events each poll returned; see
+	 * event_base_get_batch_sizes(). */
+	ev_uint64_t batch_sizes[EVENT_BATCH_SIZE_BUCKETS];
+
+	/** What timeouts are rounded up to a multiple of, in usec, or 0; see
+	 * event_config_set_timer_slack(). */
+	ev_uint64_t timer_slack_usec;
+	/** For backends: true if the timeout passed to dispatch is for an
+	 * event that wants it to be precise, rather than for a batch of
+	 * timeouts that can be a little late anyway. */
+	int timeout_precise;
+
+	/** True if we collect runtime statistics; see
+	 * event_base_enable_stats(). */
+	int stats_enabled;
+	/** A precise clock to time polls and callbacks with;
+	 * monotonic_timer may be a coarse one. */
+	struct evutil_monotonic_timer stats_timer;
+	struct event_base_stats stats;
+
+	/** Slow callback detection; see event_base_watch_slow_callbacks().
+	 * The ring is allocated the first time this is turned on, and stays
+	 * until the base is freed, since other threads may be reading it. */
+	struct event_slow_callback_ring *slow_cbs;
+	ev_uint64_t slow_cb_threshold_usec;
+	/** Time one callback out of this many, or 0 if we're not watching. */
+	int slow_cb_sample_interval;
+	int slow_cb_countdown;
+
+	/** The timeline we record, if any, and whether we are recording it
+	 * right now; see event_base_trace_start(). */
+	struct evtrace_ring *trace;
+	int trace_on;
+
+	/** Stacks and bookkeeping for the tasks running on this base, if any;
+	 * see event2/task.h. */
+	struct evtask_pool *task_pool;
+
 	/* Notify main thread to wake up break, etc. */
 	/** True if the base already has a pending notify, and we don't need
 	 * to add any more. */
@@ -412,6 +516,10 @@ struct event_config {
 	struct timeval max_dispatch_interval;
 	int max_dispatch_callbacks;
 	int limit_callbacks_after_prio;
+	struct timeval busy_poll;
+	int busy_poll_flags;
+	int max_batch_size;
+	struct timeval timer_slack;
 	enum event_method_feature require_features;
 	enum event_base_config_flag flags;
 };
@@ -511,6 +619,25 @@ EVENT2_EXPORT_SYMBOL
 void event_base_assert_ok_(struct event_base *base);
 void event_base_assert_ok_nolock_(struct event_base *base);
 
+/** Tracing: if 'base' is recording a timeline, return the time to pass as
+ * 'start' to evtrace_record_() once the traced thing is done; else 0. */
+#define EVTRACE_BEGIN(base) ((base)->trace_on ? evtrace_now_(base) : 0)
+ev_uint64_t evtrace_now_(struct event_base *base);
+/** Tracing: record that something of the given kind ran from 'start' until
+ * now.  Does nothing if 'start' is 0.  Must be called from the thread that
+ * runs the loop. */
+void evtrace_record_(struct event_base *base, int kind, ev_uint64_t start,
+    void (*fn)(void), const void *obj, evutil_socket_t fd, short events,
+    int priority);
+
+/** Tasks: free every task of 'base', finished or not, and their stacks.
+ * Called when 'base' is freed. */
+void evtask_pool_free_(struct event_base *base);
+
+/** For backends: note that a poll returned n events.  Requires that 'base'
+ * be locked. */
+void event_base_count_batch_(struct event_base *base, int n);
+
 
 /* Helper function: Call 'fn' exactly once every inserted or active event in
  * the event_base 'base'.
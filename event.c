@@ -71,6 +71,7 @@
 #include "changelist-internal.h"
 #define HT_NO_CACHE_HASH_VALUES
 #include "ht-internal.h"
+#include "atomic-internal.h"
 #include "util-internal.h"
 
 
@@ -643,6 +644,8 @@ event_base_new_with_config(const struct event_config *cfg)
 		}
 		flags = precise_time ? EV_MONOT_PRECISE : 0;
 		evutil_configure_monotonic_time_(&base->monotonic_timer, flags);
+		evutil_configure_monotonic_time_(&base->stats_timer,
+		    EV_MONOT_PRECISE);
 
 		gettime(base, &tmp);
 	}
@@ -680,6 +683,20 @@ event_base_new_with_config(const struct event_config *cfg)
 	    base->max_dispatch_time.tv_sec == -1)
 		base->limit_callbacks_after_prio = INT_MAX;
 
+	base->max_batch_size = cfg ? cfg->max_batch_size : 0;
+	if (cfg)
+		base->timer_slack_usec =
+		    (ev_uint64_t)cfg->timer_slack.tv_sec * 1000000 +
+		    cfg->timer_slack.tv_usec;
+	base->timeout_precise = 1;
+	base->cur_batch_size = -1;
+
+	if (cfg && evutil_timerisset(&cfg->busy_poll)) {
+		base->busy_poll_max = cfg->busy_poll;
+		base->busy_poll_budget = cfg->busy_poll;
+		base->busy_poll_flags = cfg->busy_poll_flags;
+	}
+
 	for (i = 0; eventops[i] && !base->evbase; i++) {
 		if (cfg != NULL) {
 			/* determine if this backend should be avoided */
@@ -870,6 +887,10 @@ event_base_free_(struct event_base *base, int run_finalizers)
 	event_base_stop_iocp_(base);
 #endif
 
+	/* Tasks that are still waiting own events we are about to delete. */
+	if (base->task_pool)
+		evtask_pool_free_(base);
+
 	/* threading fds if we have them */
 	if (base->th_notify_fd[0] != -1) {
 		event_del(&base->th_notify);
@@ -949,6 +970,11 @@ event_base_free_(struct event_base *base, int run_finalizers)
 	evmap_signal_clear_(&base->sigmap);
 	event_changelist_freemem_(&base->changelist);
 
+	if (base->slow_cbs)
+		mm_free(base->slow_cbs);
+	if (base->trace)
+		mm_free(base->trace);
+
 	EVTHREAD_FREE_LOCK(base->th_base_lock, 0);
 	EVTHREAD_FREE_COND(base->current_event_cond);
 
@@ -1252,6 +1278,46 @@ event_config_set_max_dispatch_interval(struct event_config *cfg,
 	return (0);
 }
 
+int
+event_config_set_busy_poll(struct event_config *cfg,
+    const struct timeval *budget, int flags)
+{
+	if (flags & ~(EVENT_BUSY_POLL_ADAPTIVE|EVENT_BUSY_POLL_KERNEL))
+		return -1;
+	if (budget && (budget->tv_sec < 0 || budget->tv_usec < 0 ||
+		budget->tv_usec >= 1000000))
+		return -1;
+	if (budget)
+		cfg->busy_poll = *budget;
+	else
+		evutil_timerclear(&cfg->busy_poll);
+	cfg->busy_poll_flags = flags;
+	return (0);
+}
+
+int
+event_config_set_max_batch_size(struct event_config *cfg, int max_batch)
+{
+	if (max_batch < 0)
+		return -1;
+	cfg->max_batch_size = max_batch;
+	return (0);
+}
+
+int
+event_config_set_timer_slack(struct event_config *cfg,
+    const struct timeval *slack)
+{
+	if (slack && (slack->tv_sec < 0 || slack->tv_usec < 0 ||
+		slack->tv_usec >= 1000000))
+		return -1;
+	if (slack)
+		cfg->timer_slack = *slack;
+	else
+		evutil_timerclear(&cfg->timer_slack);
+	return (0);
+}
+
 int
 event_priority_init(int npriorities)
 {
@@ -1363,6 +1429,34 @@ event_base_get_max_events(struct event_base *base, unsigned int type, int clear)
 	return r;
 }
 
+void
+event_base_count_batch_(struct event_base *base, int n)
+{
+	int bucket = 0;
+
+	while (n && bucket < EVENT_BATCH_SIZE_BUCKETS - 1) {
+		n >>= 1;
+		++bucket;
+	}
+	++base->batch_sizes[bucket];
+}
+
+int
+event_base_get_batch_sizes(struct event_base *base,
+    ev_uint64_t buckets[EVENT_BATCH_SIZE_BUCKETS], int clear)
+{
+	int r;
+
+	EVBASE_ACQUIRE_LOCK(base, th_base_lock);
+	memcpy(buckets, base->batch_sizes, sizeof(base->batch_sizes));
+	if (clear)
+		memset(base->batch_sizes, 0, sizeof(base->batch_sizes));
+	r = base->cur_batch_size;
+	EVBASE_RELEASE_LOCK(base, th_base_lock);
+
+	return r;
+}
+
 /* Returns true iff we're currently watching any events. */
 static int
 event_haveevents(struct event_base *base)
@@ -1577,7 +1671,9 @@ event_base_init_common_timeout(struct event_base *base,
 	new_ctl->duration.tv_usec =
 	    duration->tv_usec | COMMON_TIMEOUT_MAGIC |
 	    (base->n_common_timeouts << COMMON_TIMEOUT_IDX_SHIFT);
-	evtimer_assign(&new_ctl->timeout_event, base,
+	/* The events in the queue already fire together; timer slack
+	 * mustn't make them later still. */
+	event_assign(&new_ctl->timeout_event, base, -1, EV_PRECISE,
 	    common_timeout_callback, new_ctl);
 	new_ctl->timeout_event.ev_flags |= EVLIST_INTERNAL;
 	event_priority_set(&new_ctl->timeout_event, 0);
@@ -1659,6 +1755,240 @@ event_persist_closure(struct event_base *base, struct event *ev)
 	(evcb_callback)(evcb_fd, evcb_res, evcb_arg);
 }
 
+/* Runtime statistics: see event_base_enable_stats(). */
+static inline ev_uint64_t
+event_stats_now_(struct event_base *base)
+{
+	struct timeval tv;
+
+	if (evutil_gettime_monotonic_(&base->stats_timer, &tv) == -1)
+		return 0;
+	return (ev_uint64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+static int
+event_stats_latency_bucket(ev_uint64_t usec)
+{
+	int e, bucket;
+
+	if (usec < 4)
+		return (int)usec;
+	/* e = floor(log2(usec)); the two bits below the top one pick one
+	 * of four buckets within the octave */
+	for (e = 2; (usec >> (e + 1)) != 0; ++e)
+		;
+	bucket = 4 + (e - 2) * 4 + (int)((usec >> (e - 2)) & 3);
+	return bucket < EVENT_STATS_LATENCY_BUCKETS ?
+	    bucket : EVENT_STATS_LATENCY_BUCKETS - 1;
+}
+
+ev_uint64_t
+event_stats_latency_bucket_usec(int bucket)
+{
+	if (bucket < 4)
+		return bucket < 0 ? 0 : (ev_uint64_t)bucket;
+	if (bucket >= EVENT_STATS_LATENCY_BUCKETS)
+		bucket = EVENT_STATS_LATENCY_BUCKETS - 1;
+	return ((ev_uint64_t)(4 | ((bucket - 4) & 3))) << ((bucket - 4) / 4);
+}
+
+/* Record that a callback ran for usec microseconds.  Requires that 'base' be
+ * locked. */
+static void
+event_stats_count_callback_(struct event_base *base, ev_uint64_t usec)
+{
+	struct event_base_stats *stats = &base->stats;
+
+	++stats->n_callbacks;
+	stats->callback_usec += usec;
+	if (usec > stats->max_callback_usec)
+		stats->max_callback_usec = usec;
+	++stats->callback_usec_hist[event_stats_latency_bucket(usec)];
+}
+
+int
+event_base_enable_stats(struct event_base *base, int enable)
+{
+	EVBASE_ACQUIRE_LOCK(base, th_base_lock);
+	base->stats_enabled = enable ? 1 : 0;
+	EVBASE_RELEASE_LOCK(base, th_base_lock);
+	return (0);
+}
+
+int
+event_base_get_stats(struct event_base *base, struct event_base_stats *stats,
+    int clear)
+{
+	EVBASE_ACQUIRE_LOCK(base, th_base_lock);
+	*stats = base->stats;
+	if (clear)
+		memset(&base->stats, 0, sizeof(base->stats));
+	stats->n_timers = (int)min_heap_size_(&base->timeheap);
+	stats->n_active = N_ACTIVE_CALLBACKS(base);
+	stats->n_priorities = base->nactivequeues;
+	EVBASE_RELEASE_LOCK(base, th_base_lock);
+	return (0);
+}
+
+int
+event_base_get_queue_depths(struct event_base *base, int *depths,
+    int n_depths)
+{
+	struct event_callback *evcb;
+	int i, r;
+
+	EVBASE_ACQUIRE_LOCK(base, th_base_lock);
+	for (i = 0; i < n_depths && i < base->nactivequeues; ++i) {
+		depths[i] = 0;
+		TAILQ_FOREACH(evcb, &base->activequeues[i], evcb_active_next)
+			++depths[i];
+	}
+	for (; i < n_depths; ++i)
+		depths[i] = 0;
+	r = base->nactivequeues;
+	EVBASE_RELEASE_LOCK(base, th_base_lock);
+	return r;
+}
+
+#ifdef EVUTIL_HAVE_ATOMICS_
+#define SLOW_CB_LOAD(p) EVUTIL_ATOMIC_LOAD_(p)
+#define SLOW_CB_STORE(p, v) EVUTIL_ATOMIC_STORE_(p, v)
+#define SLOW_CB_FENCE() EVUTIL_ATOMIC_FENCE_()
+#else
+/* Readers take the base lock instead; we only write with it held. */
+#define SLOW_CB_LOAD(p) (*(p))
+#define SLOW_CB_STORE(p, v) (*(p) = (v))
+#define SLOW_CB_FENCE() EVUTIL_NIL_STMT_
+#endif
+
+int
+event_base_watch_slow_callbacks(struct event_base *base,
+    const struct timeval *threshold, int sample_interval)
+{
+	int r = 0;
+
+	if (threshold && (threshold->tv_sec < 0 || threshold->tv_usec < 0 ||
+		sample_interval < 1))
+		return -1;
+
+	EVBASE_ACQUIRE_LOCK(base, th_base_lock);
+	if (!threshold) {
+		base->slow_cb_sample_interval = 0;
+		goto done;
+	}
+	if (!base->slow_cbs &&
+	    !(base->slow_cbs = mm_calloc(1, sizeof(*base->slow_cbs)))) {
+		r = -1;
+		goto done;
+	}
+	base->slow_cb_threshold_usec =
+	    (ev_uint64_t)threshold->tv_sec * 1000000 + threshold->tv_usec;
+	base->slow_cb_sample_interval = sample_interval;
+	base->slow_cb_countdown = 1;
+done:
+	EVBASE_RELEASE_LOCK(base, th_base_lock);
+	return r;
+}
+
+/* Describe the callback evcb (of the event ev, if it is one) that is about
+ * to run, in case it turns out to be slow. */
+static void
+event_slow_callback_describe_(struct event_callback *evcb, struct event *ev,
+    struct event_slow_callback *cb)
+{
+	memset(cb, 0, sizeof(*cb));
+	cb->fd = -1;
+	cb->priority = evcb->evcb_pri;
+	cb->arg = evcb->evcb_arg;
+	switch (evcb->evcb_closure) {
+	case EV_CLOSURE_EVENT:
+	case EV_CLOSURE_EVENT_SIGNAL:
+	case EV_CLOSURE_EVENT_PERSIST:
+		cb->callback = (void (*)(void))ev->ev_callback;
+		cb->fd = ev->ev_fd;
+		cb->events = ev->ev_res;
+		break;
+	case EV_CLOSURE_CB_SELF:
+		cb->callback = (void (*)(void))evcb->evcb_cb_union.evcb_selfcb;
+		break;
+	case EV_CLOSURE_EVENT_FINALIZE:
+	case EV_CLOSURE_EVENT_FINALIZE_FREE:
+		cb->callback =
+		    (void (*)(void))evcb->evcb_cb_union.evcb_evfinalize;
+		cb->fd = ev->ev_fd;
+		break;
+	case EV_CLOSURE_CB_FINALIZE:
+		cb->callback =
+		    (void (*)(void))evcb->evcb_cb_union.evcb_cbfinalize;
+		break;
+	}
+}
+
+/* Add cb to the ring of slow callbacks.  Requires that 'base' be locked. */
+static void
+event_slow_callback_record_(struct event_base *base,
+    struct event_slow_callback *cb)
+{
+	struct event_slow_callback_ring *ring = base->slow_cbs;
+	unsigned head = ring->head;
+	struct event_slow_callback_slot *slot =
+	    &ring->slots[head % EVENT_SLOW_CALLBACK_RING_SIZE];
+
+	evutil_gettimeofday(&cb->when, NULL);
+	cb->seq = head;
+
+	/* Tell readers the slot is changing before we change it */
+	SLOW_CB_STORE(&slot->seq, 0);
+	SLOW_CB_FENCE();
+	slot->cb = *cb;
+	SLOW_CB_STORE(&slot->seq, head + 1);
+	SLOW_CB_STORE(&ring->head, head + 1);
+}
+
+int
+event_base_get_slow_callbacks(struct event_base *base,
+    struct event_slow_callback *out, int n_out, unsigned *cursor)
+{
+	struct event_slow_callback_ring *ring;
+	unsigned head, pos;
+	int n = 0;
+
+	/* The ring never goes away once it is there; we only need the lock
+	 * to see it appear */
+	EVBASE_ACQUIRE_LOCK(base, th_base_lock);
+	ring = base->slow_cbs;
+#ifdef EVUTIL_HAVE_ATOMICS_
+	EVBASE_RELEASE_LOCK(base, th_base_lock);
+#endif
+	if (!ring)
+		goto done;
+
+	head = SLOW_CB_LOAD(&ring->head);
+	pos = *cursor;
+	if (head - pos > EVENT_SLOW_CALLBACK_RING_SIZE)
+		pos = head - EVENT_SLOW_CALLBACK_RING_SIZE;
+	for (; pos != head && n < n_out; ++pos) {
+		struct event_slow_callback_slot *slot =
+		    &ring->slots[pos % EVENT_SLOW_CALLBACK_RING_SIZE];
+		if (SLOW_CB_LOAD(&slot->seq) != pos + 1)
+			continue;
+		out[n] = slot->cb;
+		/* If the slot changed while we copied it, it was
+		 * overwritten: our copy is garbage, and the record lost. */
+		SLOW_CB_FENCE();
+		if (SLOW_CB_LOAD(&slot->seq) != pos + 1)
+			continue;
+		++n;
+	}
+	*cursor = pos;
+
+done:
+#ifndef EVUTIL_HAVE_ATOMICS_
+	EVBASE_RELEASE_LOCK(base, th_base_lock);
+#endif
+	return n;
+}
+
 /*
   Helper for event_process_active to process all the events in a single queue,
   releasing the lock as we go.  This function requires that the lock be held
@@ -1678,6 +2008,16 @@ event_process_active_single_queue(struct event_base *base,
 
 	for (evcb = TAILQ_FIRST(activeq); evcb; evcb = TAILQ_FIRST(activeq)) {
 		struct event *ev=NULL;
+		const int timed = base->stats_enabled;
+		const int traced = base->trace_on;
+		int watched = 0;
+		struct event_slow_callback slow_cb;
+		ev_uint64_t cb_start = 0, cb_usec = 0;
+		if (base->slow_cb_sample_interval &&
+		    --base->slow_cb_countdown <= 0) {
+			base->slow_cb_countdown = base->slow_cb_sample_interval;
+			watched = 1;
+		}
 		if (evcb->evcb_flags & EVLIST_INIT) {
 			ev = event_callback_to_event(evcb);
 
@@ -1708,6 +2048,11 @@ event_process_active_single_queue(struct event_base *base,
 		base->current_event_waiters = 0;
 #endif
 
+		if (watched || traced)
+			event_slow_callback_describe_(evcb, ev, &slow_cb);
+		if (timed || watched || traced)
+			cb_start = event_stats_now_(base);
+
 		switch (evcb->evcb_closure) {
 		case EV_CLOSURE_EVENT_SIGNAL:
 			EVUTIL_ASSERT(ev != NULL);
@@ -1760,8 +2105,22 @@ event_process_active_single_queue(struct event_base *base,
 			EVUTIL_ASSERT(0);
 		}
 
+		if (timed || watched)
+			cb_usec = event_stats_now_(base) - cb_start;
+
 		EVBASE_ACQUIRE_LOCK(base, th_base_lock);
 		base->current_event = NULL;
+		if (timed)
+			event_stats_count_callback_(base, cb_usec);
+		if (watched && cb_usec >= base->slow_cb_threshold_usec &&
+		    base->slow_cb_sample_interval) {
+			slow_cb.usec = cb_usec;
+			event_slow_callback_record_(base, &slow_cb);
+		}
+		if (traced)
+			evtrace_record_(base, EVTRACE_CALLBACK, cb_start,
+			    slow_cb.callback, evcb, slow_cb.fd,
+			    slow_cb.events, slow_cb.priority);
 #ifndef EVENT__DISABLE_THREAD_SUPPORT
 		if (base->current_event_waiters) {
 			base->current_event_waiters = 0;
@@ -1962,6 +2321,88 @@ event_loop(int flags)
 	return event_base_loop(current_base, flags);
 }
 
+/* Helper for event_base_loop: poll the backend with a zero timeout until
+ * something becomes active, for at most the busy-poll budget and at most
+ * *tv_p.  Returns -1 on error, 1 if we found something to do, and 0 if the
+ * caller should go to sleep; then *tv_p is reduced by the time we spun. */
+static int
+event_base_spin_(struct event_base *base, struct timeval **tv_p)
+{
+	const struct eventop *evsel = base->evsel;
+	struct timeval zero, start, now, deadline, spun;
+	ev_uint64_t usec;
+	int found = 0;
+
+	evutil_timerclear(&zero);
+	if (evutil_gettime_monotonic_(&base->monotonic_timer, &start) == -1)
+		return 0;
+	evutil_timeradd(&start, &base->busy_poll_budget, &deadline);
+	if (*tv_p) {
+		struct timeval end;
+		evutil_timeradd(&start, *tv_p, &end);
+		if (evutil_timercmp(&end, &deadline, <))
+			deadline = end;
+	}
+
+	do {
+		if (evsel->dispatch(base, &zero) == -1)
+			return -1;
+		if (evutil_gettime_monotonic_(&base->monotonic_timer,
+			&now) == -1)
+			return -1;
+		if (N_ACTIVE_CALLBACKS(base) || base->event_break ||
+		    base->event_gotterm) {
+			found = 1;
+			break;
+		}
+	} while (evutil_timercmp(&now, &deadline, <));
+
+	evutil_timersub(&now, &start, &spun);
+	usec = (ev_uint64_t)spun.tv_sec * 1000000 + spun.tv_usec;
+	base->busy_poll_last_usec = usec;
+	base->busy_poll_total_usec += usec;
+
+	if (found) {
+		++base->busy_poll_hits;
+		if (base->busy_poll_flags & EVENT_BUSY_POLL_ADAPTIVE) {
+			/* Spinning pays off: spin for longer again */
+			evutil_timeradd(&base->busy_poll_budget,
+			    &base->busy_poll_budget, &base->busy_poll_budget);
+			if (evutil_timercmp(&base->busy_poll_budget,
+				&base->busy_poll_max, >))
+				base->busy_poll_budget = base->busy_poll_max;
+		}
+		return 1;
+	}
+
+	base->busy_poll_idle_usec += usec;
+	if (base->busy_poll_flags & EVENT_BUSY_POLL_ADAPTIVE) {
+		/* Spinning is wasted: back off, down to 1/64th of the most
+		 * we may spin, so that we notice when it pays off again */
+		ev_uint64_t budget = ((ev_uint64_t)
+		    base->busy_poll_budget.tv_sec * 1000000 +
+		    base->busy_poll_budget.tv_usec) / 2;
+		ev_uint64_t floor = ((ev_uint64_t)
+		    base->busy_poll_max.tv_sec * 1000000 +
+		    base->busy_poll_max.tv_usec) / 64;
+		if (budget < floor)
+			budget = floor;
+		if (!budget)
+			budget = 1;
+		base->busy_poll_budget.tv_sec = (time_t)(budget / 1000000);
+		base->busy_poll_budget.tv_usec = budget % 1000000;
+	}
+	if (*tv_p) {
+		if (evutil_timercmp(*tv_p, &spun, >))
+			evutil_timersub(*tv_p, &spun, *tv_p);
+		else
+			evutil_timerclear(*tv_p);
+	}
+	if (!*tv_p || evutil_timerisset(*tv_p))
+		++base->busy_poll_wakeups;
+	return 0;
+}
+
 int
 event_base_loop(struct event_base *base, int flags)
 {
@@ -1972,6 +2413,8 @@ event_base_loop(struct event_base *base, int flags)
 	struct evwatch_prepare_cb_info prepare_info;
 	struct evwatch_check_cb_info check_info;
 	struct evwatch *watcher;
+	ev_uint64_t poll_start = 0, trace_start;
+	int timed;
 
 	/* Grab the lock.  We will release it inside evsel.dispatch, and again
 	 * as we invoke watchers and user callbacks. */
@@ -2035,6 +2478,7 @@ event_base_loop(struct event_base *base, int flags)
 
 		/* Invoke prepare watchers before polling for events */
 		prepare_info.timeout = tv_p;
+		prepare_info.base = base;
 		TAILQ_FOREACH(watcher, &base->watchers[EVWATCH_PREPARE], next) {
 			EVBASE_RELEASE_LOCK(base, th_base_lock);
 			(*watcher->callback.prepare)(watcher, &prepare_info, watcher->arg);
@@ -2043,7 +2487,28 @@ event_base_loop(struct event_base *base, int flags)
 
 		clear_time_cache(base);
 
-		res = evsel->dispatch(base, tv_p);
+		timed = base->stats_enabled;
+		if (timed)
+			poll_start = event_stats_now_(base);
+		trace_start = EVTRACE_BEGIN(base);
+
+		res = 0;
+		base->busy_poll_last_usec = 0;
+		if (evutil_timerisset(&base->busy_poll_max) &&
+		    (!tv_p || evutil_timerisset(tv_p))) {
+			/* We would sleep: spin for a while first */
+			res = event_base_spin_(base, &tv_p);
+		}
+		if (res == 0)
+			res = evsel->dispatch(base, tv_p);
+
+		if (timed) {
+			++base->stats.n_iterations;
+			base->stats.dispatch_usec +=
+			    event_stats_now_(base) - poll_start;
+		}
+		evtrace_record_(base, EVTRACE_POLL, trace_start, NULL, NULL,
+		    -1, 0, -1);
 
 		if (res == -1) {
 			event_debug(("%s: dispatch returned unsuccessfully.",
@@ -2056,16 +2521,28 @@ event_base_loop(struct event_base *base, int flags)
 
 		/* Invoke check watchers after polling for events, and before
 		 * processing them */
+		check_info.base = base;
 		TAILQ_FOREACH(watcher, &base->watchers[EVWATCH_CHECK], next) {
 			EVBASE_RELEASE_LOCK(base, th_base_lock);
 			(*watcher->callback.check)(watcher, &check_info, watcher->arg);
 			EVBASE_ACQUIRE_LOCK(base, th_base_lock);
 		}
 
+		trace_start = EVTRACE_BEGIN(base);
 		timeout_process(base);
+		evtrace_record_(base, EVTRACE_TIMEOUTS, trace_start, NULL, NULL,
+		    -1, 0, -1);
 
 		if (N_ACTIVE_CALLBACKS(base)) {
+			ev_uint64_t n_callbacks = base->stats.n_callbacks;
 			int n = event_process_active(base);
+			/* (Another thread may have cleared the counters
+			 * while the callbacks ran.) */
+			if (timed && base->stats.n_callbacks >= n_callbacks &&
+			    base->stats.n_callbacks - n_callbacks >
+			    base->stats.max_callbacks_per_iteration)
+				base->stats.max_callbacks_per_iteration =
+				    base->stats.n_callbacks - n_callbacks;
 			if ((flags & EVLOOP_ONCE)
 			    && N_ACTIVE_CALLBACKS(base) == 0
 			    && n != 0)
@@ -2655,6 +3132,21 @@ event_remove_timer(struct event *ev)
 	return (res);
 }
 
+/* Round the deadline 'tv' up to a multiple of base's timer slack, so that
+ * timeouts close to each other expire together. */
+static void
+timeout_round_up(struct event_base *base, struct timeval *tv)
+{
+	ev_uint64_t usec = (ev_uint64_t)tv->tv_sec * 1000000 + tv->tv_usec;
+	ev_uint64_t rem = usec % base->timer_slack_usec;
+
+	if (rem) {
+		usec += base->timer_slack_usec - rem;
+		tv->tv_sec = (time_t)(usec / 1000000);
+		tv->tv_usec = (int)(usec % 1000000);
+	}
+}
+
 /* Implementation function to add an event.  Works just like event_add,
  * except: 1) it requires that we have the lock.  2) if tv_is_absolute is set,
  * we treat tv as an absolute time, not as an interval to add to the current
@@ -2789,6 +3281,9 @@ event_add_nolock_(struct event *ev, const struct timeval *tv,
 		} else {
 			evutil_timeradd(&now, tv, &ev->ev_timeout);
 		}
+		if (base->timer_slack_usec && !common_timeout &&
+		    !(ev->ev_events & EV_PRECISE))
+			timeout_round_up(base, &ev->ev_timeout);
 
 		event_debug((
 			 "event_add: event %p, timeout in %d seconds %d useconds, call %p",
@@ -3227,6 +3722,9 @@ timeout_next(struct event_base *base, struct timeval **tv_p)
 		goto out;
 	}
 
+	base->timeout_precise = !base->timer_slack_usec ||
+	    (ev->ev_events & EV_PRECISE);
+
 	if (evutil_timercmp(&ev->ev_timeout, &now, <=)) {
 		evutil_timerclear(tv);
 		goto out;
@@ -0,0 +1,281 @@
+/*
+ * Copyright (c) 2026 The Libevent authors
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "event2/event-config.h"
+#include "evconfig-private.h"
+
+#include <sys/types.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include "event2/buffer.h"
+#include "event2/file.h"
+#include "event2/threadpool.h"
+#include "mm-internal.h"
+
+/* How much to read with one pread() */
+#define EVFILE_READ_CHUNK (256 * 1024)
+/* How many chains to look at at once when writing */
+#define EVFILE_WRITE_IOVECS 16
+
+enum evfile_op_kind {
+	EVFILE_READ,
+	EVFILE_WRITE,
+	EVFILE_FSYNC
+};
+
+struct evfile_op {
+	enum evfile_op_kind kind;
+	int fd;
+	ev_off_t offset;
+	size_t length;
+	/* What we read or are to write; only touched by the worker until the
+	 * operation is done. */
+	struct evbuffer *buf;
+	/* Where reads go once they're done */
+	struct evbuffer *dst;
+	evfile_cb cb;
+	void *arg;
+
+	ev_ssize_t result;
+	int err;
+};
+
+static void
+evfile_do_read(struct evfile_op *op)
+{
+	struct evbuffer_iovec vec;
+	size_t done = 0;
+	ev_ssize_t r;
+
+	while (done < op->length) {
+		size_t want = op->length - done;
+		if (want > EVFILE_READ_CHUNK)
+			want = EVFILE_READ_CHUNK;
+		if (evbuffer_reserve_space(op->buf, (ev_ssize_t)want,
+			&vec, 1) < 1) {
+			op->err = ENOMEM;
+			return;
+		}
+		if (vec.iov_len > want)
+			vec.iov_len = want;
+		r = pread(op->fd, vec.iov_base, vec.iov_len,
+		    (off_t)(op->offset + done));
+		if (r < 0) {
+			if (errno == EINTR)
+				continue;
+			op->err = errno;
+			return;
+		}
+		if (r == 0)
+			break;
+		vec.iov_len = (size_t)r;
+		evbuffer_commit_space(op->buf, &vec, 1);
+		done += (size_t)r;
+	}
+	op->result = (ev_ssize_t)done;
+}
+
+static void
+evfile_do_write(struct evfile_op *op)
+{
+	struct evbuffer_iovec vec[EVFILE_WRITE_IOVECS];
+	size_t done = 0, len, pos;
+	ev_ssize_t r;
+	int i, n;
+
+	while ((len = evbuffer_get_length(op->buf))) {
+		n = evbuffer_peek(op->buf, (ev_ssize_t)len, NULL, vec,
+		    EVFILE_WRITE_IOVECS);
+		if (n > EVFILE_WRITE_IOVECS)
+			n = EVFILE_WRITE_IOVECS;
+		/* Write what we peeked one chain at a time, then drain it */
+		for (i = 0, pos = 0; i < n; ) {
+			if (pos == vec[i].iov_len) {
+				++i;
+				pos = 0;
+				continue;
+			}
+			if (op->offset < 0)
+				r = write(op->fd, (char *)vec[i].iov_base + pos,
+				    vec[i].iov_len - pos);
+			else
+				r = pwrite(op->fd, (char *)vec[i].iov_base + pos,
+				    vec[i].iov_len - pos,
+				    (off_t)(op->offset + done));
+			if (r < 0) {
+				if (errno == EINTR)
+					continue;
+				op->err = errno;
+				return;
+			}
+			if (r == 0) {
+				/* No progress on a nonempty write; don't spin */
+				op->err = EIO;
+				return;
+			}
+			evbuffer_drain(op->buf, (size_t)r);
+			pos += (size_t)r;
+			done += (size_t)r;
+		}
+	}
+	op->result = (ev_ssize_t)done;
+}
+
+/* Runs on a worker */
+static void
+evfile_work(void *arg)
+{
+	struct evfile_op *op = arg;
+
+	op->result = -1;
+	op->err = 0;
+	switch (op->kind) {
+	case EVFILE_READ:
+		evfile_do_read(op);
+		break;
+	case EVFILE_WRITE:
+		evfile_do_write(op);
+		break;
+	case EVFILE_FSYNC:
+		if (fsync(op->fd) == 0)
+			op->result = 0;
+		else
+			op->err = errno;
+		break;
+	}
+}
+
+/* Runs in the loop once evfile_work() is done */
+static void
+evfile_done(void *arg)
+{
+	struct evfile_op *op = arg;
+
+	if (op->kind == EVFILE_READ && op->result >= 0)
+		evbuffer_add_buffer(op->dst, op->buf);
+	if (op->buf)
+		evbuffer_free(op->buf);
+	if (op->cb)
+		op->cb(op->result, op->err, op->arg);
+	mm_free(op);
+}
+
+static struct evfile_op *
+evfile_op_new(enum evfile_op_kind kind, int fd, evfile_cb cb, void *arg)
+{
+	struct evfile_op *op;
+
+	if (fd < 0)
+		return NULL;
+	if (!(op = mm_calloc(1, sizeof(struct evfile_op))))
+		return NULL;
+	op->kind = kind;
+	op->fd = fd;
+	op->cb = cb;
+	op->arg = arg;
+	if (kind != EVFILE_FSYNC && !(op->buf = evbuffer_new())) {
+		mm_free(op);
+		return NULL;
+	}
+	return op;
+}
+
+static void
+evfile_op_free(struct evfile_op *op)
+{
+	if (op->buf)
+		evbuffer_free(op->buf);
+	mm_free(op);
+}
+
+static int
+evfile_submit(struct evthreadpool *pool, struct event_base *base,
+    struct evfile_op *op)
+{
+	return evthreadpool_submit(pool, base, evfile_work, evfile_done, op);
+}
+
+int
+evfile_read(struct evthreadpool *pool, struct event_base *base, int fd,
+    ev_off_t offset, size_t length, struct evbuffer *dst, evfile_cb cb,
+    void *arg)
+{
+	struct evfile_op *op;
+
+	if (offset < 0 || !dst || !base)
+		return -1;
+	if (!(op = evfile_op_new(EVFILE_READ, fd, cb, arg)))
+		return -1;
+	op->offset = offset;
+	op->length = length;
+	op->dst = dst;
+	if (evfile_submit(pool, base, op) < 0) {
+		evfile_op_free(op);
+		return -1;
+	}
+	return 0;
+}
+
+int
+evfile_write(struct evthreadpool *pool, struct event_base *base, int fd,
+    ev_off_t offset, struct evbuffer *src, evfile_cb cb, void *arg)
+{
+	struct evfile_op *op;
+
+	if (!src || !base)
+		return -1;
+	if (!(op = evfile_op_new(EVFILE_WRITE, fd, cb, arg)))
+		return -1;
+	op->offset = offset < 0 ? -1 : offset;
+	if (evbuffer_add_buffer(op->buf, src) < 0) {
+		evfile_op_free(op);
+		return -1;
+	}
+	if (evfile_submit(pool, base, op) < 0) {
+		/* Give the data back, so that nothing is lost */
+		evbuffer_prepend_buffer(src, op->buf);
+		evfile_op_free(op);
+		return -1;
+	}
+	return 0;
+}
+
+int
+evfile_fsync(struct evthreadpool *pool, struct event_base *base, int fd,
+    evfile_cb cb, void *arg)
+{
+	struct evfile_op *op;
+
+	if (!base)
+		return -1;
+	if (!(op = evfile_op_new(EVFILE_FSYNC, fd, cb, arg)))
+		return -1;
+	if (evfile_submit(pool, base, op) < 0) {
+		evfile_op_free(op);
+		return -1;
+	}
+	return 0;
+}
@@ -77,6 +77,15 @@ int evmap_io_del_(struct event_base *base, evutil_socket_t fd, struct event *ev)
 */
 void evmap_io_active_(struct event_base *base, evutil_socket_t fd, short events);
 
+/** As evmap_io_active_, but for a backend that remembers the fdinfo pointer
+    it was given when the fd was added, and so can skip looking the fd up.
+
+    @param base the event_base to operate on.
+    @param fdinfo the fdinfo that evmap passed to the backend's add function.
+    @param events a bitmask of EV_READ|EV_WRITE|EV_ET.
+*/
+void evmap_io_active_fdinfo_(struct event_base *base, void *fdinfo, short events);
+
 
 /* These functions behave in the same way as evmap_io_*, except they work on
  * signals rather than fds.  signals use a linear map everywhere; fds use
@@ -416,12 +416,22 @@ evmap_io_del_(struct event_base *base, evutil_socket_t fd, struct event *ev)
 	return (retval);
 }
 
+static inline void
+evmap_io_activate_events(struct evmap_io *ctx, short events)
+{
+	struct event *ev;
+
+	LIST_FOREACH(ev, &ctx->events, ev_io_next) {
+		if (ev->ev_events & (events & ~EV_ET))
+			event_active_nolock_(ev, ev->ev_events & events, 1);
+	}
+}
+
 void
 evmap_io_active_(struct event_base *base, evutil_socket_t fd, short events)
 {
 	struct event_io_map *io = &base->io;
 	struct evmap_io *ctx;
-	struct event *ev;
 
 #ifndef EVMAP_USE_HT
 	if (fd < 0 || fd >= io->nentries)
@@ -431,10 +441,19 @@ evmap_io_active_(struct event_base *base, evutil_socket_t fd, short events)
 
 	if (NULL == ctx)
 		return;
-	LIST_FOREACH(ev, &ctx->events, ev_io_next) {
-		if (ev->ev_events & (events & ~EV_ET))
-			event_active_nolock_(ev, ev->ev_events & events, 1);
-	}
+	evmap_io_activate_events(ctx, events);
+}
+
+void
+evmap_io_active_fdinfo_(struct event_base *base, void *fdinfo, short events)
+{
+	/* The fdinfo lives right after its evmap_io, in the same allocation;
+	 * entries stay put until the event_base is freed, so the pointer a
+	 * backend saved when it added the fd is still good. */
+	struct evmap_io *ctx = (struct evmap_io *)
+	    ((char *)fdinfo - sizeof(struct evmap_io));
+
+	evmap_io_activate_events(ctx, events);
 }
 
 /* code specific to signals */
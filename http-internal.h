@@ -11,6 +11,7 @@
 #define HTTP_INTERNAL_H_INCLUDED_
 
 #include "event2/event_struct.h"
+#include "event2/http_struct.h"
 #include "util-internal.h"
 #include "defer-internal.h"
 
@@ -44,6 +45,17 @@ enum evhttp_connection_state {
 };
 
 struct event_base;
+struct evzlib_stream_;
+
+/* An evhttp_request together with the state that only http.c looks at,
+ * which we keep out of the public struct. */
+struct evhttp_request_internal_ {
+	struct evhttp_request req;
+	/* Compressor for a reply that is sent gzip-encoded in chunks */
+	struct evzlib_stream_ *gzip_stream;
+};
+#define EVHTTP_REQ_INTERNAL_(r) \
+	EVUTIL_UPCAST((r), struct evhttp_request_internal_, req)
 
 /* A client or server connection. */
 struct evhttp_connection {
@@ -176,6 +188,11 @@ struct evhttp {
 	int flags;
 	const char *default_content_type;
 
+	/* Compressors for gzip-encoded replies, or NULL if we don't
+	 * compress; see evhttp_set_gzip(). */
+	struct bufferevent_zlib_pool *gzip_pool;
+	size_t gzip_min_size;
+
 	/* Bitmask of all HTTP methods that we accept and pass to user
 	 * callbacks. */
 	ev_uint32_t allowed_methods;
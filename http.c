@@ -115,6 +115,7 @@
 #include "http-internal.h"
 #include "mm-internal.h"
 #include "bufferevent-internal.h"
+#include "zlib-internal.h"
 
 #ifndef EVENT__HAVE_GETNAMEINFO
 #define NI_MAXSERV 32
@@ -3118,11 +3119,112 @@ evhttp_send_notfound(struct evhttp_request *req, const char *url)
 }
 
 
+/* Return true iff the q-value at q is zero. */
+static int
+evhttp_qvalue_is_zero(const char *q)
+{
+	if (*q++ != '0')
+		return 0;
+	if (*q == '.') {
+		++q;
+		q += strspn(q, "0");
+	}
+	return !EVUTIL_ISDIGIT_(*q);
+}
+
+/* Return true iff the Accept-Encoding header in headers lets us send a
+ * gzip-encoded body. */
+static int
+evhttp_accepts_gzip(struct evkeyvalq *headers)
+{
+	const char *p = evhttp_find_header(headers, "Accept-Encoding");
+	int any = 0;
+
+	while (p && *p) {
+		size_t len;
+		int gzip, star, zero = 0;
+
+		p += strspn(p, " \t,");
+		len = strcspn(p, " \t;,");
+		gzip = (len == 4 && !evutil_ascii_strncasecmp(p, "gzip", 4)) ||
+		    (len == 6 && !evutil_ascii_strncasecmp(p, "x-gzip", 6));
+		star = len == 1 && *p == '*';
+		p += len;
+		while (*p && *p != ',') {
+			p += strspn(p, " \t;");
+			if ((*p == 'q' || *p == 'Q') && p[1] == '=')
+				zero = evhttp_qvalue_is_zero(p + 2);
+			p += strcspn(p, ";,");
+		}
+		if (gzip)
+			return !zero;
+		if (star)
+			any = !zero;
+	}
+	return any;
+}
+
+/* If the server wants the response to req gzipped, and the client takes
+ * that, return the pool to take a compressor from.  body_len is the length
+ * of the body, if we know it. */
+static struct bufferevent_zlib_pool *
+evhttp_response_gzip_pool(struct evhttp_request *req, size_t body_len)
+{
+	struct evhttp *http = req->evcon->http_server;
+
+	if (http == NULL || http->gzip_pool == NULL ||
+	    req->kind != EVHTTP_RESPONSE ||
+	    body_len < http->gzip_min_size ||
+	    !evhttp_response_needs_body(req) ||
+	    evhttp_find_header(req->output_headers, "Content-Encoding"))
+		return NULL;
+
+	/* Caches must not hand this response to clients that can't take
+	 * gzip, even if this one can't either. */
+	if (evhttp_find_header(req->output_headers, "Vary") == NULL)
+		evhttp_add_header(req->output_headers,
+		    "Vary", "Accept-Encoding");
+
+	if (!evhttp_accepts_gzip(req->input_headers))
+		return NULL;
+	return http->gzip_pool;
+}
+
+/* Replace the body of the response to req with its gzip encoding.  If
+ * anything goes wrong, we leave it as it was. */
+static void
+evhttp_gzip_response_body(struct evhttp_request *req,
+    struct bufferevent_zlib_pool *pool)
+{
+	struct evzlib_stream_ *stream = evzlib_stream_new_(pool, 1);
+	struct evbuffer *src = evbuffer_new();
+	struct evbuffer *dst = evbuffer_new();
+
+	if (stream && src && dst &&
+	    !evbuffer_add_buffer_reference(src, req->output_buffer) &&
+	    evzlib_stream_process_(stream, src, dst, -1,
+		BEV_FINISHED) != BEV_ERROR) {
+		evbuffer_drain(req->output_buffer,
+		    evbuffer_get_length(req->output_buffer));
+		evbuffer_add_buffer(req->output_buffer, dst);
+		evhttp_remove_header(req->output_headers, "Content-Length");
+		evhttp_add_header(req->output_headers,
+		    "Content-Encoding", "gzip");
+	}
+
+	evzlib_stream_free_(stream);
+	if (src)
+		evbuffer_free(src);
+	if (dst)
+		evbuffer_free(dst);
+}
+
 /* Requires that headers and response code are already set up */
 
 static inline void
 evhttp_send(struct evhttp_request *req, struct evbuffer *databuf)
 {
+	struct bufferevent_zlib_pool *gzip_pool;
 	struct evhttp_connection *evcon = req->evcon;
 
 	if (evcon == NULL) {
@@ -3139,6 +3241,11 @@ evhttp_send(struct evhttp_request *req, struct evbuffer *databuf)
 	if (databuf != NULL)
 		evbuffer_add_buffer(req->output_buffer, databuf);
 
+	gzip_pool = evhttp_response_gzip_pool(req,
+	    evbuffer_get_length(req->output_buffer));
+	if (gzip_pool)
+		evhttp_gzip_response_body(req, gzip_pool);
+
 	/* Adds headers to the response */
 	evhttp_make_header(evcon, req);
 
@@ -3158,11 +3265,22 @@ void
 evhttp_send_reply_start(struct evhttp_request *req, int code,
     const char *reason)
 {
+	struct evhttp_request_internal_ *ri = EVHTTP_REQ_INTERNAL_(req);
+	struct bufferevent_zlib_pool *gzip_pool;
+
 	evhttp_response_code_(req, code, reason);
 
 	if (req->evcon == NULL)
 		return;
 
+	/* We can only compress as we go if we don't promise a length */
+	if (evhttp_find_header(req->output_headers, "Content-Length") == NULL &&
+	    (gzip_pool = evhttp_response_gzip_pool(req, EV_SIZE_MAX)) &&
+	    (ri->gzip_stream = evzlib_stream_new_(gzip_pool, 1))) {
+		evhttp_add_header(req->output_headers,
+		    "Content-Encoding", "gzip");
+	}
+
 	if (evhttp_find_header(req->output_headers, "Content-Length") == NULL &&
 	    REQ_VERSION_ATLEAST(req, 1, 1) &&
 	    evhttp_response_needs_body(req)) {
@@ -3181,22 +3299,16 @@ evhttp_send_reply_start(struct evhttp_request *req, int code,
 	evhttp_write_buffer(req->evcon, NULL, NULL);
 }
 
-void
-evhttp_send_reply_chunk_with_cb(struct evhttp_request *req, struct evbuffer *databuf,
+/* Helper: send databuf as the next piece of the reply to req, as it is. */
+static void
+evhttp_send_reply_data(struct evhttp_request *req, struct evbuffer *databuf,
     void (*cb)(struct evhttp_connection *, void *), void *arg)
 {
 	struct evhttp_connection *evcon = req->evcon;
-	struct evbuffer *output;
-
-	if (evcon == NULL)
-		return;
-
-	output = bufferevent_get_output(evcon->bufev);
+	struct evbuffer *output = bufferevent_get_output(evcon->bufev);
 
 	if (evbuffer_get_length(databuf) == 0)
 		return;
-	if (!evhttp_response_needs_body(req))
-		return;
 	if (req->chunked) {
 		evbuffer_add_printf(output, "%x\r\n",
 				    (unsigned)evbuffer_get_length(databuf));
@@ -3208,6 +3320,44 @@ evhttp_send_reply_chunk_with_cb(struct evhttp_request *req, struct evbuffer *dat
 	evhttp_write_buffer(evcon, cb, arg);
 }
 
+/* Helper: run databuf through the compressor of a gzip-encoded reply, and
+ * send whatever comes out.  Each chunk is flushed so the client can show
+ * it right away; finish ends the stream. */
+static void
+evhttp_send_reply_gzip(struct evhttp_request *req, struct evbuffer *databuf,
+    int finish, void (*cb)(struct evhttp_connection *, void *), void *arg)
+{
+	struct evhttp_request_internal_ *ri = EVHTTP_REQ_INTERNAL_(req);
+	struct evbuffer *out = evbuffer_new();
+
+	if (out == NULL ||
+	    evzlib_stream_process_(ri->gzip_stream, databuf, out, -1,
+		finish ? BEV_FINISHED : BEV_FLUSH) == BEV_ERROR) {
+		event_warnx("%s: can't compress the reply", __func__);
+	} else {
+		evhttp_send_reply_data(req, out, cb, arg);
+	}
+	if (out)
+		evbuffer_free(out);
+}
+
+void
+evhttp_send_reply_chunk_with_cb(struct evhttp_request *req, struct evbuffer *databuf,
+    void (*cb)(struct evhttp_connection *, void *), void *arg)
+{
+	if (req->evcon == NULL)
+		return;
+
+	if (evbuffer_get_length(databuf) == 0)
+		return;
+	if (!evhttp_response_needs_body(req))
+		return;
+	if (EVHTTP_REQ_INTERNAL_(req)->gzip_stream)
+		evhttp_send_reply_gzip(req, databuf, 0, cb, arg);
+	else
+		evhttp_send_reply_data(req, databuf, cb, arg);
+}
+
 struct bufferevent *
 evhttp_start_ws_(struct evhttp_request *req)
 {
@@ -3242,6 +3392,7 @@ void
 evhttp_send_reply_end(struct evhttp_request *req)
 {
 	struct evhttp_connection *evcon = req->evcon;
+	struct evhttp_request_internal_ *ri = EVHTTP_REQ_INTERNAL_(req);
 	struct evbuffer *output;
 
 	if (evcon == NULL) {
@@ -3254,6 +3405,16 @@ evhttp_send_reply_end(struct evhttp_request *req)
 	/* we expect no more calls form the user on this request */
 	req->userdone = 1;
 
+	if (ri->gzip_stream) {
+		struct evbuffer *empty = evbuffer_new();
+		if (empty) {
+			evhttp_send_reply_gzip(req, empty, 1, NULL, NULL);
+			evbuffer_free(empty);
+		}
+		evzlib_stream_free_(ri->gzip_stream);
+		ri->gzip_stream = NULL;
+	}
+
 	if (req->chunked) {
 		evbuffer_add(output, "0\r\n\r\n", 5);
 		evhttp_write_buffer(req->evcon, evhttp_send_done, NULL);
@@ -4090,6 +4251,8 @@ evhttp_free(struct evhttp* http)
 		mm_free(alias);
 	}
 
+	bufferevent_zlib_pool_free(http->gzip_pool);
+
 	mm_free(http);
 }
 
@@ -4238,6 +4401,24 @@ evhttp_set_default_content_type(struct evhttp *http,
 	http->default_content_type = content_type;
 }
 
+int
+evhttp_set_gzip(struct evhttp *http, int level, size_t min_size)
+{
+	struct bufferevent_zlib_pool *pool = NULL;
+
+	if (level) {
+		/* Keep a few compressors around for the next replies */
+		pool = bufferevent_zlib_pool_new(BUFFEREVENT_ZLIB_GZIP,
+		    level, 8);
+		if (pool == NULL)
+			return -1;
+	}
+	bufferevent_zlib_pool_free(http->gzip_pool);
+	http->gzip_pool = pool;
+	http->gzip_min_size = min_size;
+	return 0;
+}
+
 void
 evhttp_set_allowed_methods(struct evhttp* http, ev_uint32_t methods)
 {
@@ -4338,13 +4519,15 @@ evhttp_set_errorcb(struct evhttp *http,
 struct evhttp_request *
 evhttp_request_new(void (*cb)(struct evhttp_request *, void *), void *arg)
 {
+	struct evhttp_request_internal_ *ri;
 	struct evhttp_request *req = NULL;
 
 	/* Allocate request structure */
-	if ((req = mm_calloc(1, sizeof(struct evhttp_request))) == NULL) {
+	if ((ri = mm_calloc(1, sizeof(*ri))) == NULL) {
 		event_warn("%s: calloc", __func__);
 		goto error;
 	}
+	req = &ri->req;
 
 	req->headers_size = 0;
 	req->body_size = 0;
@@ -4388,6 +4571,8 @@ evhttp_request_new(void (*cb)(struct evhttp_request *, void *), void *arg)
 void
 evhttp_request_free(struct evhttp_request *req)
 {
+	struct evhttp_request_internal_ *ri = EVHTTP_REQ_INTERNAL_(req);
+
 	if ((req->flags & EVHTTP_REQ_DEFER_FREE) != 0) {
 		req->flags |= EVHTTP_REQ_NEEDS_FREE;
 		return;
@@ -4416,7 +4601,10 @@ evhttp_request_free(struct evhttp_request *req)
 	if (req->output_buffer != NULL)
 		evbuffer_free(req->output_buffer);
 
-	mm_free(req);
+	if (ri->gzip_stream != NULL)
+		evzlib_stream_free_(ri->gzip_stream);
+
+	mm_free(ri);
 }
 
 void
@@ -255,6 +255,16 @@ int bufferevent_socket_connect_hostname(struct bufferevent *bufev,
        ::1		(ipv6address)
        [::1]		([ipv6address])
 
+   If the bufferevent is a socket bufferevent without a socket of its own,
+   the connection is made as described in RFC 8305 ("Happy Eyeballs"): when
+   the family is AF_UNSPEC, the A and AAAA lookups are made separately, and
+   we start connecting as soon as either one answers.  We then try every
+   address we got, alternating between address families, and start a new
+   attempt whenever the previous one fails or has been outstanding for 250
+   msec.  The first socket that connects is kept, and the others are closed.
+   The write timeout of the bufferevent, if any, limits the whole process.
+   Other bufferevents only ever try the first address.
+
    Performance note: If you do not provide an evdns_base, this function
    may block while it waits for a DNS response.	 This is probably not
    what you want.
@@ -760,6 +770,63 @@ bufferevent_filter_new(struct bufferevent *underlying,
 		       int options,
 		       void (*free_context)(void *),
 		       void *ctx);
+
+/** A callback function to implement an in-place filter for a bufferevent.
+
+    Unlike a bufferevent_filter_cb, this kind of filter never sees the
+    evbuffers: it is handed the buffered data one contiguous piece at a
+    time, may inspect it or rewrite it in place without changing its length
+    (XOR masking, checksumming, framing inspection...), and says how much
+    of it may go on.  Whatever it lets through is moved to the other side
+    without being copied, whenever the buffer layout allows it.
+
+    @param data The data to filter.  It may be modified in place, but only
+       the bytes that the filter lets through.
+    @param len The number of bytes at data.
+    @param mode Whether we should write data as may be convenient
+       (BEV_NORMAL), or flush as much data as we can (BEV_FLUSH),
+       or flush as much as we can (BEV_FINISH).
+    @param ctx A user-supplied pointer.
+
+    @return The number of bytes at the start of data to pass on, which may
+       be less than len if the filter needs to see more data before it can
+       decide about the rest; those bytes will be handed to it again later.
+       If it returns 0 while more data is buffered, it is called again with
+       a larger piece.  Return -1 on an error.
+ */
+typedef ev_ssize_t (*bufferevent_filter_inplace_cb)(
+    unsigned char *data, size_t len, enum bufferevent_flush_mode mode,
+    void *ctx);
+
+/**
+   Allocate a new filtering bufferevent with in-place filters on top of an
+   existing bufferevent.
+
+   It works like a bufferevent from bufferevent_filter_new(), but data that
+   the filters pass on is spliced from one buffer to the next instead of
+   being copied, so filters that don't change the length of the data cost
+   no copies.  Read-only data, such as what was added with
+   evbuffer_add_reference(), is copied before it is handed to the filter.
+
+   @param underlying the underlying bufferevent.
+   @param input_filter The filter to apply to data we read from the
+     underlying bufferevent, or NULL to pass it through unchanged.
+   @param output_filter The filter to apply to data we write to the
+     underlying bufferevent, or NULL to pass it through unchanged.
+   @param options A bitfield of bufferevent options.
+   @param free_context A function to use to free the filter context when
+     this bufferevent is freed.
+   @param ctx A context pointer to pass to the filter functions.
+   @return the new bufferevent, or NULL on failure.
+ */
+EVENT2_EXPORT_SYMBOL
+struct bufferevent *
+bufferevent_filter_inplace_new(struct bufferevent *underlying,
+    bufferevent_filter_inplace_cb input_filter,
+    bufferevent_filter_inplace_cb output_filter,
+    int options,
+    void (*free_context)(void *),
+    void *ctx);
 /**@}*/
 
 /**
@@ -783,6 +850,104 @@ int bufferevent_pair_new(struct event_base *base, int options,
 EVENT2_EXPORT_SYMBOL
 struct bufferevent *bufferevent_pair_get_partner(struct bufferevent *bev);
 
+/**
+   Allocate a pair of linked bufferevents that belong to two different
+   event_bases, typically run by two different threads.
+
+   They behave like the bufferevents from bufferevent_pair_new(), except
+   that they don't share a lock: data goes from one to the other through a
+   lock-free queue, and the receiving event_base is woken up only when the
+   queue was empty.  Use it to connect an I/O thread to a worker thread.
+
+   When one of them is freed, the other one gets BEV_EVENT_EOF once it has
+   read everything that was sent before.  So does flushing one with
+   BEV_FINISHED.
+
+   Unless both event_bases are the same, threading must be enabled (see
+   evthread_use_pthreads()).  Pass BEV_OPT_THREADSAFE if you use a
+   bufferevent from any thread but that of its event_base.
+
+   @param base1 The event base for pair[0]
+   @param base2 The event base for pair[1]
+   @param options A set of options for both bufferevents
+   @param pair A pointer to an array to hold the two new bufferevent objects.
+   @return 0 on success, -1 on failure.
+ */
+EVENT2_EXPORT_SYMBOL
+int bufferevent_pair_new_cross(struct event_base *base1,
+    struct event_base *base2, int options, struct bufferevent *pair[2]);
+
+/** A relay that passes data between two bufferevents in both directions */
+struct bufferevent_relay;
+
+/**
+   A callback invoked when one side of a relay hits EOF or an error.
+
+   The relay stops passing data in the direction that failed; usually the
+   callback frees the relay and both bufferevents.
+
+   @param relay the relay
+   @param bev the bufferevent that hit EOF or an error
+   @param what a conjunction of BEV_EVENT_* flags, as for a
+      bufferevent_event_cb
+   @param ctx the user-specified context for the relay
+ */
+typedef void (*bufferevent_relay_cb)(struct bufferevent_relay *relay,
+    struct bufferevent *bev, short what, void *ctx);
+
+/** Flag for bufferevent_relay_new(): always copy data through evbuffers,
+ * even when splice() could be used. */
+#define BEV_RELAY_NO_SPLICE 0x01
+
+/**
+   Relay everything read on one bufferevent to the other, in both
+   directions, the way a TCP proxy does.
+
+   When both are connected socket bufferevents without rate limits, and
+   the platform has splice(), data moves from one socket to the other
+   through a kernel pipe without being copied to user space.  Otherwise,
+   it is moved from the input buffer of one to the output buffer of the
+   other, and reading stops while the other side has a lot of output
+   pending.
+
+   The relay takes over the callbacks of both bufferevents, and in the
+   splice case does the reading and writing itself, with both bufferevents
+   disabled (so their timeouts don't apply).  Data already in their input
+   buffers is relayed first.  Both must belong to the same event_base.
+
+   @param a one bufferevent
+   @param b the other bufferevent
+   @param flags 0 or BEV_RELAY_NO_SPLICE
+   @param eventcb a callback for EOF and errors, or NULL
+   @param ctx the context to pass to eventcb
+   @return a new relay, or NULL on failure
+ */
+EVENT2_EXPORT_SYMBOL
+struct bufferevent_relay *bufferevent_relay_new(struct bufferevent *a,
+    struct bufferevent *b, int flags, bufferevent_relay_cb eventcb,
+    void *ctx);
+
+/**
+   Stop relaying and free a relay.
+
+   The bufferevents are left with no callbacks and are not freed.  Data
+   that a splicing relay had read but not yet written is lost.
+ */
+EVENT2_EXPORT_SYMBOL
+void bufferevent_relay_free(struct bufferevent_relay *relay);
+
+/** Return 1 if a relay moves data with splice(), 0 if it copies it. */
+EVENT2_EXPORT_SYMBOL
+int bufferevent_relay_is_spliced(struct bufferevent_relay *relay);
+
+/**
+   Return how many bytes a relay has passed on from bev to the other
+   bufferevent.
+ */
+EVENT2_EXPORT_SYMBOL
+ev_uint64_t bufferevent_relay_get_relayed(struct bufferevent_relay *relay,
+    struct bufferevent *bev);
+
 /**
    Abstract type used to configure rate-limiting on a bufferevent or a group
    of bufferevents.
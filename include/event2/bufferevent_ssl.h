@@ -77,6 +77,24 @@ enum bufferevent_ssl_state {
     Useful in conjunction with http layer.
 */
 #define BUFFEREVENT_SSL_BATCH_WRITE 2
+/** Offload record encryption to the kernel (kTLS) where possible.
+
+    Must be set before the handshake starts, and only applies to SSL
+    bufferevents created on a socket.  If the SSL library manages to hand
+    the session keys to the kernel once the handshake is done, outgoing
+    data is written straight to the socket, as a bufferevent_socket
+    would: nothing is encrypted or copied in user space, and segments added
+    with evbuffer_add_file() are sent with sendfile().  Incoming data is
+    still read through the SSL library, which then only moves already
+    decrypted bytes.
+
+    If kTLS is not available (e.g. the "tls" kernel module is not loaded,
+    or the cipher is not supported by the kernel) this flag has no effect.
+    Use bufferevent_ssl_get_ktls() to find out whether it took.
+
+    Currently only supported with OpenSSL 3.0 or later.
+*/
+#define BUFFEREVENT_SSL_KTLS 4
 
 #if defined(EVENT__HAVE_OPENSSL) || defined(EVENT__HAVE_MBEDTLS)
 /**
@@ -104,6 +122,86 @@ ev_uint64_t bufferevent_ssl_set_flags(struct bufferevent *bev, ev_uint64_t flags
 EVENT2_EXPORT_SYMBOL
 ev_uint64_t bufferevent_ssl_clear_flags(struct bufferevent *bev, ev_uint64_t flags);
 
+/** Tell whether an SSL bufferevent is using kernel TLS offload.
+ *
+ * @see BUFFEREVENT_SSL_KTLS
+ * @param bev the ssl bufferevent.
+ * @return EV_READ and/or EV_WRITE for the directions in which the kernel
+ *   does the record processing, or 0.
+ */
+EVENT2_EXPORT_SYMBOL
+short bufferevent_ssl_get_ktls(struct bufferevent *bev);
+
+/** Default size of the records sent while the connection is ramping up. */
+#define BUFFEREVENT_SSL_RECORD_SMALL 1400
+/** Default (and maximum) size of the records sent for bulk transfers. */
+#define BUFFEREVENT_SSL_RECORD_LARGE 16384
+/** Default number of bytes sent in small records before going large. */
+#define BUFFEREVENT_SSL_RECORD_RAMP (128 << 10)
+/** Default idle time in msec after which we go back to small records. */
+#define BUFFEREVENT_SSL_RECORD_IDLE_MSEC 1000
+
+/**
+ * Configure dynamic TLS record sizing.
+ *
+ * An SSL bufferevent starts out sending records small enough to fit in a
+ * single TCP segment, so that the peer can decrypt the first bytes of a
+ * response as soon as they arrive, without waiting for the rest of a 16k
+ * record.  Once ramp_bytes have been sent it switches to large records,
+ * which cost less CPU and framing overhead per byte.  If nothing is
+ * written for idle, the next burst starts with small records again.
+ *
+ * By default small_size is BUFFEREVENT_SSL_RECORD_SMALL, large_size is
+ * BUFFEREVENT_SSL_RECORD_LARGE, ramp_bytes is BUFFEREVENT_SSL_RECORD_RAMP
+ * and idle is BUFFEREVENT_SSL_RECORD_IDLE_MSEC.
+ *
+ * Record sizes are ignored if the kernel does the encryption
+ * (BUFFEREVENT_SSL_KTLS).
+ *
+ * @param bev the ssl bufferevent.
+ * @param small_size size of the records at the start and after idle
+ *   periods, or 0 to always send large_size records.
+ * @param large_size size of the records for bulk transfers, at most
+ *   BUFFEREVENT_SSL_RECORD_LARGE; 0 means BUFFEREVENT_SSL_RECORD_LARGE.
+ * @param ramp_bytes how many bytes to send in small records.
+ * @param idle how long the connection must be idle to go back to small
+ *   records, or NULL never to go back.
+ * @return 0 on success, -1 if bev is not an SSL bufferevent or the sizes
+ *   are out of range.
+ */
+EVENT2_EXPORT_SYMBOL
+int bufferevent_ssl_set_record_size(struct bufferevent *bev,
+    size_t small_size, size_t large_size, size_t ramp_bytes,
+    const struct timeval *idle);
+
+/** Counters for the records written by an SSL bufferevent.
+ *
+ * @see bufferevent_ssl_get_record_stats()
+ */
+struct bufferevent_ssl_record_stats {
+	/** Number of records written while ramping up */
+	ev_uint64_t small_records;
+	/** Number of records written at full size */
+	ev_uint64_t large_records;
+	/** Number of plaintext bytes written */
+	ev_uint64_t bytes;
+	/** Number of times we went back to small records after being idle */
+	ev_uint64_t idle_resets;
+	/** Number of records gathered from more than one evbuffer chain */
+	ev_uint64_t coalesced_records;
+};
+
+/**
+ * Get the record counters of an SSL bufferevent.
+ *
+ * @param bev the ssl bufferevent.
+ * @param stats the structure to fill.
+ * @return 0 on success, -1 if bev is not an SSL bufferevent.
+ */
+EVENT2_EXPORT_SYMBOL
+int bufferevent_ssl_get_record_stats(struct bufferevent *bev,
+    struct bufferevent_ssl_record_stats *stats);
+
 #endif /* defined(EVENT__HAVE_OPENSSL) || defined(EVENT__HAVE_MBEDTLS) */
 
 #if defined(EVENT__HAVE_OPENSSL) || defined(EVENT_IN_DOXYGEN_)
@@ -180,6 +278,153 @@ int bufferevent_ssl_renegotiate(struct bufferevent *bev);
 EVENT2_EXPORT_SYMBOL
 unsigned long bufferevent_get_openssl_error(struct bufferevent *bev);
 
+/* This is what openssl's SSL_CTX objects are underneath. */
+struct ssl_ctx_st;
+
+/**
+   Give a server SSL_CTX a session cache, so that returning clients can
+   resume their sessions instead of doing a full handshake.
+
+   Sessions are kept in a hash table split into independently locked
+   shards, and expire after timeout seconds (which also becomes the
+   SSL_CTX session timeout).  When a shard is full its oldest session is
+   dropped.  This replaces OpenSSL's internal cache, which is a single
+   table behind a single lock.  Unlike OpenSSL's cache, it keeps the
+   sessions of connections that were closed without a close_notify alert,
+   which is how freeing an SSL bufferevent closes them.
+
+   The cache belongs to the SSL_CTX and is freed along with it.  Calling
+   this function again replaces the cache.
+
+   Note that with TLS 1.3 and session tickets enabled, OpenSSL issues
+   stateless tickets and doesn't use the cache at all; set
+   SSL_OP_NO_TICKET to use the cache for TLS 1.3 too.
+
+   @param ctx the server SSL_CTX
+   @param max_sessions how many sessions to keep at most
+   @param timeout session lifetime in seconds; 0 keeps the SSL_CTX
+      session timeout
+   @return 0 on success, -1 on failure
+*/
+EVENT2_EXPORT_SYMBOL
+int bufferevent_openssl_ctx_set_session_cache(struct ssl_ctx_st *ctx,
+    size_t max_sessions, long timeout);
+
+/** Counters for bufferevent_openssl_ctx_set_session_cache() */
+struct bufferevent_openssl_session_cache_stats {
+	/** Sessions currently in the cache */
+	ev_uint64_t entries;
+	/** Lookups that found a live session */
+	ev_uint64_t hits;
+	/** Lookups that found nothing, or an expired session */
+	ev_uint64_t misses;
+	/** Sessions dropped to make room for new ones */
+	ev_uint64_t evictions;
+};
+
+/**
+   Get the counters of the session cache of an SSL_CTX.
+
+   @return 0 on success, -1 if the SSL_CTX has no session cache
+*/
+EVENT2_EXPORT_SYMBOL
+int bufferevent_openssl_ctx_get_session_cache_stats(struct ssl_ctx_st *ctx,
+    struct bufferevent_openssl_session_cache_stats *stats);
+
+/** Length of a session ticket key: 16 bytes of key name, 32 bytes of HMAC
+ * secret and 32 bytes of AES secret. */
+#define BUFFEREVENT_OPENSSL_TICKET_KEY_LEN 80
+
+/**
+   Have a server SSL_CTX encrypt its session tickets with keys that we
+   rotate.
+
+   A fresh random key is generated now and then every rotate_secs seconds.
+   The keep most recent previous keys are still accepted for decryption,
+   so clients can resume with a ticket issued up to
+   (keep + 1) * rotate_secs seconds ago; they get a new ticket under the
+   current key when they do.
+
+   The keys belong to the SSL_CTX and are freed along with it.
+
+   @param ctx the server SSL_CTX
+   @param rotate_secs how often to switch to a new key, or 0 to rotate
+     only with bufferevent_openssl_ctx_rotate_ticket_key()
+   @param keep how many previous keys to accept, at most 8
+   @return 0 on success, -1 on failure
+*/
+EVENT2_EXPORT_SYMBOL
+int bufferevent_openssl_ctx_set_ticket_keys(struct ssl_ctx_st *ctx,
+    int rotate_secs, int keep);
+
+/**
+   Switch the session ticket encryption of an SSL_CTX to a new key.
+
+   Servers behind the same load balancer can feed the same key to all of
+   them, so that each of them can decrypt the tickets of the others.
+
+   @param ctx an SSL_CTX set up with bufferevent_openssl_ctx_set_ticket_keys()
+   @param key BUFFEREVENT_OPENSSL_TICKET_KEY_LEN bytes of key material, or
+     NULL to generate a random key
+   @param keylen length of key
+   @return 0 on success, -1 on failure
+*/
+EVENT2_EXPORT_SYMBOL
+int bufferevent_openssl_ctx_rotate_ticket_key(struct ssl_ctx_st *ctx,
+    const unsigned char *key, size_t keylen);
+
+/** A place for clients to keep one session per server. */
+struct bufferevent_openssl_session_store;
+
+/**
+   Create a client side session store.
+
+   @param max_hosts how many servers to remember sessions for; when full,
+     the least recently used server is forgotten
+   @return the new store, or NULL on failure
+*/
+EVENT2_EXPORT_SYMBOL
+struct bufferevent_openssl_session_store *
+bufferevent_openssl_session_store_new(size_t max_hosts);
+
+/**
+   Free a session store.
+
+   No bufferevent may still be using it.
+*/
+EVENT2_EXPORT_SYMBOL
+void bufferevent_openssl_session_store_free(
+    struct bufferevent_openssl_session_store *store);
+
+/**
+   Make a client SSL bufferevent resume sessions from a session store.
+
+   Must be called before the handshake starts, i.e. right after creating a
+   bufferevent in BUFFEREVENT_SSL_CONNECTING state.  If the store has a
+   session for host and port, the handshake will try to resume it; either
+   way, the sessions the server gives us end up in the store.  When the
+   bufferevent reconnects (for example an evhttp_connection that retries,
+   or that is reused after the server closed it) the latest session is
+   tried again.
+
+   To share sessions between the connections of an evhttp_connection,
+   create its bufferevent with this set, and pass it to
+   evhttp_connection_base_bufferevent_new().
+
+   This installs a new session callback and client session caching on the
+   SSL_CTX of the bufferevent.
+
+   @param bev a socket based OpenSSL bufferevent
+   @param store the store to use
+   @param host the name of the server
+   @param port the port of the server
+   @return 0 on success, -1 on failure
+*/
+EVENT2_EXPORT_SYMBOL
+int bufferevent_openssl_set_session_store(struct bufferevent *bev,
+    struct bufferevent_openssl_session_store *store,
+    const char *host, int port);
+
 #endif
 #if defined(EVENT__HAVE_MBEDTLS) || defined(EVENT_IN_DOXYGEN_)
 struct mbedtls_ssl_context;
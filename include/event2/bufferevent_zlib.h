@@ -0,0 +1,118 @@
+/*
+ * Copyright (c) 2026 The Libevent authors
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef EVENT2_BUFFEREVENT_ZLIB_H_INCLUDED_
+#define EVENT2_BUFFEREVENT_ZLIB_H_INCLUDED_
+
+/** @file event2/bufferevent_zlib.h
+
+    @brief Compressing bufferevents, built on zlib.
+
+    A compressing bufferevent is a filtering bufferevent (see
+    bufferevent_filter_new()) that compresses everything written to it
+    before passing it to the underlying bufferevent, and decompresses
+    everything read from the underlying bufferevent.
+
+    The compressors and decompressors come from a
+    bufferevent_zlib_pool, which keeps the ones that are done with
+    around for the next connection: setting up a zlib stream costs a few
+    hundred kilobytes of allocations, and a busy server would otherwise pay
+    that for every connection.
+
+    These functions exist even when Libevent was built without zlib; then
+    they always fail.
+ */
+#include <event2/visibility.h>
+#include <event2/event-config.h>
+#include <event2/bufferevent.h>
+#include <event2/util.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** The compressed data formats we know about. */
+enum bufferevent_zlib_format {
+	/** raw deflate data, with no header or trailer (RFC 1951) */
+	BUFFEREVENT_ZLIB_DEFLATE = 0,
+	/** the zlib format (RFC 1950) */
+	BUFFEREVENT_ZLIB_ZLIB = 1,
+	/** the gzip format (RFC 1952) */
+	BUFFEREVENT_ZLIB_GZIP = 2
+};
+
+struct bufferevent_zlib_pool;
+
+/**
+   Create a pool of compressors and decompressors.
+
+   @param format the data format to compress to and decompress from.  When
+     decompressing, BUFFEREVENT_ZLIB_ZLIB and BUFFEREVENT_ZLIB_GZIP both
+     accept either format.
+   @param level the compression level, from 1 (fastest) to 9 (smallest),
+     0 for no compression, or -1 for zlib's default.
+   @param max_idle how many compressors, and how many decompressors, to
+     keep around once they are no longer used.
+   @return the new pool, or NULL on error or if Libevent was built without
+     zlib.
+ */
+EVENT2_EXPORT_SYMBOL
+struct bufferevent_zlib_pool *bufferevent_zlib_pool_new(
+    enum bufferevent_zlib_format format, int level, int max_idle);
+
+/**
+   Release a pool from bufferevent_zlib_pool_new().
+
+   Bufferevents that use the pool keep it alive until they are freed.
+ */
+EVENT2_EXPORT_SYMBOL
+void bufferevent_zlib_pool_free(struct bufferevent_zlib_pool *pool);
+
+/**
+   Create a new compressing bufferevent on top of an existing bufferevent.
+
+   Data written to the new bufferevent is compressed as a single stream.
+   Compressing in BEV_NORMAL mode lets zlib hold back data until it has
+   enough to compress well; use bufferevent_flush() with BEV_FLUSH to push
+   out everything written so far, and with BEV_FINISHED to end the stream.
+   Writing more after that starts a new stream.
+
+   Data read is decompressed; several streams in a row are decompressed
+   one after the other.  Corrupt data is reported as BEV_EVENT_ERROR.
+
+   @param underlying the underlying bufferevent.
+   @param pool the pool to take compressors and decompressors from.
+   @param options A bitfield of bufferevent options.
+   @return the new bufferevent, or NULL on error.
+ */
+EVENT2_EXPORT_SYMBOL
+struct bufferevent *bufferevent_zlib_new(struct bufferevent *underlying,
+    struct bufferevent_zlib_pool *pool, int options);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* EVENT2_BUFFEREVENT_ZLIB_H_INCLUDED_ */
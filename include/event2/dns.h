@@ -190,6 +190,9 @@ extern "C" {
 #define DNS_QUERY_USEVC 0x02
 /** Ignore trancation flag in responses (don't fallback to TCP connections). */
 #define DNS_QUERY_IGNTC 0x04
+/** Send a UDP query to two nameservers at once and use whichever answer
+ * arrives first.  Trades extra load on the servers for lower tail latency. */
+#define DNS_QUERY_HEDGE 0x08
 /** Make a separate callback for CNAME in answer */
 #define DNS_CNAME_CALLBACK 0x80
 
@@ -204,6 +207,7 @@ extern "C" {
  * - max-inflight:
  * - attempts:
  * - randomize-case:
+ * - select-by-rtt:
  * - initial-probe-timeout:
  * - max-probe-timeout:
  * - probe-backoff-factor:
@@ -211,6 +215,7 @@ extern "C" {
  * - edns-udp-size:
  * - use-vc
  * - ignore-tc
+ * - hedge
  */
 #define DNS_OPTION_MISC 4
 /* Load hosts file (i.e. "/etc/hosts") */
@@ -492,7 +497,7 @@ void evdns_cancel_request(struct evdns_base *base, struct evdns_request *req);
     ndots, timeout, max-timeouts, max-inflight, attempts, randomize-case,
     bind-to, initial-probe-timeout, max-probe-timeout, probe-backoff-factor,
     getaddrinfo-allow-skew, so-rcvbuf, so-sndbuf, tcp-idle-timeout, use-vc,
-    ignore-tc, edns-udp-size.
+    ignore-tc, edns-udp-size, select-by-rtt, hedge.
 
   - probe-backoff-factor
     Backoff factor of probe timeout
@@ -501,10 +506,26 @@ void evdns_cancel_request(struct evdns_base *base, struct evdns_request *req);
     Maximum timeout between two probe packets will change initial-probe-timeout
     when this value is smaller
 
+  - select-by-rtt
+    If nonzero, send each request to the healthy nameserver with the lowest
+    smoothed round trip time (penalized by its recent timeout rate) instead
+    of round-robin.  One pick in sixteen is still round-robin, so that slow
+    servers get measured again.
+
+  - hedge
+    Like DNS_QUERY_HEDGE on every request.
+
+  - tcp-idle-timeout
+    How long a TCP connection to a nameserver (see use-vc) is kept open
+    without any outstanding queries, so that later queries can reuse it.
+    Queries sent over TCP are pipelined on a single connection per
+    nameserver; while any of them are outstanding the connection is not
+    considered idle.
+
   In versions before Libevent 2.0.3-alpha, the option name needed to end with
   a colon.
 
-  In case of options without values (use-vc, ingore-tc) val should be an empty
+  In case of options without values (use-vc, ingore-tc, hedge) val should be an empty
   string or NULL.
 
   @param base the evdns_base to which to apply this operation
@@ -732,6 +753,38 @@ enum evdns_server_option {
 EVENT2_EXPORT_SYMBOL
 int evdns_server_port_set_option(struct evdns_server_port *port, enum evdns_server_option option, size_t value);
 
+/**
+   Add a precompiled answer to a DNS server port.
+
+   From then on, every standard query with a single question about 'name'
+   (compared case-insensitively), 'type' and 'dns_class' is answered by the
+   port itself with all the records added for that question, without
+   invoking the request callback.  The answers are encoded once, here, so
+   answering costs no more than copying them; this is meant for serving a
+   static zone at a high rate.  Answers are marked authoritative.  Questions
+   that have no static answer still go to the request callback.
+
+   The arguments have the same meaning as for
+   evdns_server_request_add_reply().  Call this more than once to give a
+   question several answers.
+
+   @return 0 on success, or -1 if the record could not be added.
+   @see evdns_server_port_clear_static_replies()
+ */
+EVENT2_EXPORT_SYMBOL
+int evdns_server_port_add_static_reply(struct evdns_server_port *port, const char *name, int type, int dns_class, int ttl, int datalen, int is_name, const char *data);
+/** Add 'n' A records for 'name' to the static answers of 'port', as with
+    evdns_server_port_add_static_reply(). */
+EVENT2_EXPORT_SYMBOL
+int evdns_server_port_add_static_a_reply(struct evdns_server_port *port, const char *name, int n, const void *addrs, int ttl);
+/** Add 'n' AAAA records for 'name' to the static answers of 'port', as with
+    evdns_server_port_add_static_reply(). */
+EVENT2_EXPORT_SYMBOL
+int evdns_server_port_add_static_aaaa_reply(struct evdns_server_port *port, const char *name, int n, const void *addrs, int ttl);
+/** Remove all the static answers from a DNS server port. */
+EVENT2_EXPORT_SYMBOL
+void evdns_server_port_clear_static_replies(struct evdns_server_port *port);
+
 /** Sets some flags in a reply we're building.
     Allows setting of the AA or RD flags
  */
@@ -819,6 +872,85 @@ EVENT2_EXPORT_SYMBOL
 int evdns_base_get_nameserver_addr(struct evdns_base *base, int idx,
     struct sockaddr *sa, ev_socklen_t len);
 
+/** Number of buckets in evdns_stats.rtt_histogram. */
+#define EVDNS_RTT_HISTOGRAM_BUCKETS 16
+
+/**
+   Counters describing the work done by an evdns_base, or by one of its
+   nameservers.
+
+   The counters start at zero when the evdns_base (or nameserver) is
+   created and only ever grow; the other fields are snapshots.  Fields that
+   only make sense for one of the two are left zero in the other.
+
+   @see evdns_base_get_stats(), evdns_base_get_nameserver_stats()
+ */
+struct evdns_stats {
+	/** Queries written to the network, including retransmits. */
+	ev_uint64_t queries_sent;
+	/** Queries written again after timing out. */
+	ev_uint64_t retransmits;
+	/** Extra copies of DNS_QUERY_HEDGE queries sent to a second
+	 * nameserver; counted against that second nameserver. */
+	ev_uint64_t hedged;
+	/** Replies received. */
+	ev_uint64_t replies;
+	/** Queries that timed out. */
+	ev_uint64_t timeouts;
+	/** Truncated UDP replies that made us retry the query over TCP. */
+	ev_uint64_t tc_fallbacks;
+	/** Round trip times of answered queries.  Bucket 0 counts answers
+	 * that took under 1 msec, bucket i (i > 0) those that took from
+	 * 2^(i-1) up to 2^i msec, and the last bucket everything slower.
+	 * Retransmitted queries are not counted, since their RTT is
+	 * ambiguous. */
+	ev_uint64_t rtt_histogram[EVDNS_RTT_HISTOGRAM_BUCKETS];
+
+	/** Requests currently sent and awaiting an answer. */
+	int requests_inflight;
+	/** Requests not yet sent because max-inflight was reached.
+	 * (evdns_base only) */
+	int requests_waiting;
+	/** Smoothed round trip time in usec, or 0 if we have no sample yet.
+	 * Timeouts, and losing a hedged query to another server, raise it
+	 * too. (nameserver only) */
+	int srtt_usec;
+	/** evdns_getaddrinfo() lookups whose IPv4 or IPv6 half timed out, or
+	 * was answered. (evdns_base only) */
+	int getaddrinfo_ipv4_timeouts;
+	int getaddrinfo_ipv6_timeouts;
+	int getaddrinfo_ipv4_answered;
+	int getaddrinfo_ipv6_answered;
+};
+
+/**
+   Retrieve the statistics of an evdns_base, summed over all nameservers it
+   has ever used.
+
+   @param base The evdns_base to examine.
+   @param stats A structure to fill in.
+   @return 0 on success, -1 on failure.
+   @see evdns_base_get_nameserver_stats()
+ */
+EVENT2_EXPORT_SYMBOL
+int evdns_base_get_stats(struct evdns_base *base, struct evdns_stats *stats);
+
+/**
+   Retrieve the statistics of the 'idx'th configured nameserver.
+
+   Nameservers are numbered the same way as for
+   evdns_base_get_nameserver_addr().
+
+   @param base The evdns_base to examine.
+   @param idx The index of the nameserver.
+   @param stats A structure to fill in.
+   @return 0 on success, -1 if idx is greater than the number of configured
+     nameservers.
+ */
+EVENT2_EXPORT_SYMBOL
+int evdns_base_get_nameserver_stats(struct evdns_base *base, int idx,
+    struct evdns_stats *stats);
+
 /**
    Retrieve the fd of the 'idx'th configured nameserver.
 
@@ -465,6 +465,249 @@ int event_base_get_num_events(struct event_base *eb, unsigned int flags);
 EVENT2_EXPORT_SYMBOL
 int event_base_get_max_events(struct event_base *eb, unsigned int flags, int clear);
 
+/** Number of buckets filled in by event_base_get_batch_sizes(). */
+#define EVENT_BATCH_SIZE_BUCKETS 24
+
+/**
+  Get how many events the backend has fetched from the kernel at a time.
+
+  buckets[0] counts the polls that returned nothing, and buckets[i] counts
+  the polls that returned between 2^(i-1) and 2^i - 1 events; the last
+  bucket also counts everything larger.  Polls that were not allowed to
+  block and found nothing (as with EVLOOP_NONBLOCK, or while busy-polling)
+  are not counted.  Only the epoll backend reports this so far; with other
+  backends all buckets stay 0.
+
+  @param eb the event_base structure returned by event_base_new()
+  @param buckets an array of EVENT_BATCH_SIZE_BUCKETS counters to fill in.
+  @param clear if true, reset the counters afterwards.
+  @return how many events the backend can fetch right now, or -1 if the
+    backend does not say.
+  @see event_config_set_max_batch_size()
+ */
+EVENT2_EXPORT_SYMBOL
+int event_base_get_batch_sizes(struct event_base *eb,
+    ev_uint64_t buckets[EVENT_BATCH_SIZE_BUCKETS], int clear);
+
+/** Number of buckets in event_base_stats.callback_usec_hist. */
+#define EVENT_STATS_LATENCY_BUCKETS 96
+
+/**
+  Runtime statistics of an event_base, as reported by event_base_get_stats().
+
+  All times are in microseconds, and are only collected while statistics
+  are enabled with event_base_enable_stats().
+ */
+struct event_base_stats {
+	/** How many times the loop has polled for events. */
+	ev_uint64_t n_iterations;
+	/** Time spent polling for events, including sleeping. */
+	ev_uint64_t dispatch_usec;
+	/** Time spent running callbacks. */
+	ev_uint64_t callback_usec;
+	/** How many callbacks have run. */
+	ev_uint64_t n_callbacks;
+	/** The most callbacks that ran after a single poll. */
+	ev_uint64_t max_callbacks_per_iteration;
+	/** The longest any single callback ran. */
+	ev_uint64_t max_callback_usec;
+	/** How long callbacks ran: callback_usec_hist[i] counts the callbacks
+	 * that took at least event_stats_latency_bucket_usec(i), and less
+	 * than event_stats_latency_bucket_usec(i + 1). */
+	ev_uint64_t callback_usec_hist[EVENT_STATS_LATENCY_BUCKETS];
+
+	/** How many timers are pending right now.  All the events that use
+	 * the same common timeout count as one. */
+	int n_timers;
+	/** How many callbacks are active right now. */
+	int n_active;
+	/** How many priorities the event_base has; see
+	 * event_base_get_queue_depths(). */
+	int n_priorities;
+};
+
+/**
+  Start or stop collecting runtime statistics on an event_base.
+
+  This is off by default.  When it is on, the event loop reads a precise
+  monotonic clock twice around every poll and every callback; that is cheap
+  enough for production on systems with a fast clock (such as Linux with a
+  vDSO), but not free.
+
+  @param eb the event_base structure returned by event_base_new()
+  @param enable true to collect statistics, false to stop.
+  @return 0 on success, -1 on failure.
+  @see event_base_get_stats()
+ */
+EVENT2_EXPORT_SYMBOL
+int event_base_enable_stats(struct event_base *eb, int enable);
+
+/**
+  Get the runtime statistics of an event_base.
+
+  The counters cover the time since statistics were first enabled, or
+  since they were last cleared; the snapshot fields (n_timers, n_active and
+  n_priorities) are always filled in.
+
+  @param eb the event_base structure returned by event_base_new()
+  @param stats a structure to fill in.
+  @param clear if true, reset the counters afterwards.
+  @return 0 on success, -1 on failure.
+ */
+EVENT2_EXPORT_SYMBOL
+int event_base_get_stats(struct event_base *eb, struct event_base_stats *stats,
+    int clear);
+
+/**
+  Get how many callbacks are active at each priority of an event_base.
+
+  @param eb the event_base structure returned by event_base_new()
+  @param depths an array to fill in: depths[i] is the number of active
+    callbacks at priority i.
+  @param n_depths how many entries depths has room for.
+  @return the number of priorities of the event_base, which may be more
+    than n_depths.
+ */
+EVENT2_EXPORT_SYMBOL
+int event_base_get_queue_depths(struct event_base *eb, int *depths,
+    int n_depths);
+
+/**
+  Get the shortest duration, in microseconds, that counts toward a bucket of
+  event_base_stats.callback_usec_hist.
+
+  Durations below 4 usec each get their own bucket; above that, each power
+  of two is split into four buckets of equal width, so that every bucket
+  is accurate to within 25%.  The last bucket also counts everything
+  longer.
+ */
+EVENT2_EXPORT_SYMBOL
+ev_uint64_t event_stats_latency_bucket_usec(int bucket);
+
+/** How many slow callbacks an event_base remembers; see
+ * event_base_watch_slow_callbacks(). */
+#define EVENT_SLOW_CALLBACK_RING_SIZE 128
+
+/**
+  A callback that ran for too long, as reported by
+  event_base_get_slow_callbacks().
+ */
+struct event_slow_callback {
+	/** The function that ran: an event_callback_fn for an event, or
+	 * whatever function libevent or the user scheduled otherwise.  Cast it
+	 * back to compare it with your own functions. */
+	void (*callback)(void);
+	/** The argument it got. */
+	void *arg;
+	/** For an event, its fd (or signal number); otherwise -1. */
+	evutil_socket_t fd;
+	/** For an event, what made it run (EV_READ, EV_TIMEOUT, ...);
+	 * otherwise 0. */
+	short events;
+	/** The priority it ran at. */
+	int priority;
+	/** How long it ran, in microseconds. */
+	ev_uint64_t usec;
+	/** When it returned, by the wall clock. */
+	struct timeval when;
+	/** Counts up by one for every slow callback recorded, so gaps show
+	 * how many were lost. */
+	unsigned seq;
+};
+
+/**
+  Record callbacks that block the event loop for too long.
+
+  Every callback that runs for at least threshold is recorded, along with
+  what it was and how long it took, in a ring of the last
+  EVENT_SLOW_CALLBACK_RING_SIZE such callbacks.  Any thread can read the
+  ring with event_base_get_slow_callbacks(), without waiting for the event
+  loop.
+
+  To make this cheaper, only time one out of every sample_interval
+  callbacks; a callback that is slow often will still show up.
+
+  @param eb the event_base structure returned by event_base_new()
+  @param threshold record callbacks that run for at least this long, or
+    NULL to stop.
+  @param sample_interval time one out of this many callbacks; 1 to time
+    every one.
+  @return 0 on success, -1 on failure.
+ */
+EVENT2_EXPORT_SYMBOL
+int event_base_watch_slow_callbacks(struct event_base *eb,
+    const struct timeval *threshold, int sample_interval);
+
+/**
+  Get the slow callbacks recorded since the last call.
+
+  Set *cursor to 0 before the first call; each call then returns the
+  callbacks that were recorded since the one before, oldest first, and
+  advances *cursor.  If more were recorded in between than the ring holds,
+  the oldest ones are lost.  This is safe to call from any thread, even
+  while the event loop is stuck in a callback.
+
+  @param eb the event_base structure returned by event_base_new()
+  @param out an array to fill in.
+  @param n_out how many entries out has room for.
+  @param cursor where to continue from; updated.
+  @return the number of entries filled in.
+ */
+EVENT2_EXPORT_SYMBOL
+int event_base_get_slow_callbacks(struct event_base *eb,
+    struct event_slow_callback *out, int n_out, unsigned *cursor);
+
+/**
+  Start recording a timeline of what the event loop does.
+
+  While tracing, the event_base notes when each poll for events, each pass
+  over expired timeouts, each callback, and each deferred bufferevent
+  callback starts and how long it takes, in a ring that keeps the last
+  n_records of them.  Use event_base_trace_dump() to look at them.
+
+  Starting a trace again discards what was recorded.
+
+  The ring is written without locking, so call this, like
+  event_base_trace_stop() and event_base_trace_dump(), from the thread that
+  runs the event loop (for instance from a callback), or while no thread is
+  running it.
+
+  @param eb the event_base structure returned by event_base_new()
+  @param n_records how many records to keep, or 0 for a default of 16384.
+  @return 0 on success, -1 on failure.
+ */
+EVENT2_EXPORT_SYMBOL
+int event_base_trace_start(struct event_base *eb, int n_records);
+
+/**
+  Stop recording a timeline, but keep what was recorded so far.
+
+  Like event_base_trace_start(), call this from the thread that runs the
+  event loop, or while no thread is running it.
+
+  @param eb the event_base structure returned by event_base_new()
+ */
+EVENT2_EXPORT_SYMBOL
+void event_base_trace_stop(struct event_base *eb);
+
+/**
+  Write the recorded timeline as Chrome trace event JSON.
+
+  The output can be loaded into chrome://tracing or the Perfetto UI.
+  Timestamps are in microseconds of the monotonic clock; callbacks are
+  named by the address of their function, which addr2line or a debugger
+  can turn into a name.
+
+  Call this from the thread that runs the event loop (for instance from a
+  callback), or while no thread is running it.
+
+  @param eb the event_base structure returned by event_base_new()
+  @param output the stream to write to
+  @return the number of records written.
+ */
+EVENT2_EXPORT_SYMBOL
+int event_base_trace_dump(struct event_base *eb, FILE *output);
+
 /**
    Allocates a new event configuration object.
 
@@ -695,6 +938,86 @@ int event_config_set_max_dispatch_interval(struct event_config *cfg,
     const struct timeval *max_interval, int max_callbacks,
     int min_priority);
 
+/** @name Busy polling flags
+
+    These flags can be passed to event_config_set_busy_poll().
+    @{
+*/
+/** Spin for less while spinning keeps finding nothing to do, and for longer
+ * again, up to the configured budget, once it does. */
+#define EVENT_BUSY_POLL_ADAPTIVE	0x01
+/** Also ask the kernel to busy-poll the network devices of our sockets
+ * when we do sleep.  Only epoll on Linux 6.9 or later does this; elsewhere
+ * the flag is ignored. */
+#define EVENT_BUSY_POLL_KERNEL		0x02
+/**@}*/
+
+/**
+ * Make the event base spin before it sleeps.
+ *
+ * Whenever the event loop would wait for events, it first polls the backend
+ * with a zero timeout over and over, for at most the given budget (or until
+ * the next timeout, if that comes first), and only goes to sleep if nothing
+ * happened meanwhile.  This trades CPU time for wakeup latency: an event
+ * that arrives while the loop spins is handled without the cost of the
+ * thread going to sleep and waking up again.
+ *
+ * Use evwatch_check_get_busy_poll() to see how well spinning pays off.
+ *
+ * @param cfg The event_base configuration object.
+ * @param budget The longest to spin before sleeping, or NULL to never spin.
+ * @param flags Any number of EVENT_BUSY_POLL_* flags.
+ * @return 0 on success, -1 on failure.
+ */
+EVENT2_EXPORT_SYMBOL
+int event_config_set_busy_poll(struct event_config *cfg,
+    const struct timeval *budget, int flags);
+
+/**
+ * Limit how many events the backend fetches from the kernel at once.
+ *
+ * Backends that fetch events into an array (currently epoll) start with a
+ * small one, double it whenever a poll fills it, and halve it again after
+ * it stays mostly empty for a while.  This sets how large the array may
+ * get: raise it for servers with very many busy connections, so that one
+ * poll picks up more of them, or lower it to bound the memory that many
+ * mostly idle event_bases hold.  The default is 4096.
+ *
+ * @param cfg The event_base configuration object.
+ * @param max_batch The most events to fetch in one poll, or 0 for the
+ *    default.
+ * @return 0 on success, -1 on failure.
+ * @see event_base_get_batch_sizes()
+ */
+EVENT2_EXPORT_SYMBOL
+int event_config_set_max_batch_size(struct event_config *cfg, int max_batch);
+
+/**
+ * Let timeouts fire up to a given time late, so that they fire together.
+ *
+ * Each timeout that isn't a common timeout is rounded up to a multiple of
+ * slack on the monotonic clock, so that timeouts falling into the same
+ * interval of that length expire at the same moment and cost one wakeup
+ * instead of many.  Events with the EV_PRECISE flag are exempt: their
+ * timeouts keep their exact deadlines, and when one of them is next to
+ * expire, the epoll backend waits for it with a timerfd if it has one (see
+ * EVENT_BASE_FLAG_PRECISE_TIMER) instead of rounding to milliseconds.
+ *
+ * Without slack, which is the default, no timeout is delayed and every one
+ * is waited for as precisely as the backend can.
+ *
+ * For timeouts more precise than the coarse clock can measure (a
+ * millisecond or several, depending on the system), also set
+ * EVENT_BASE_FLAG_PRECISE_TIMER.
+ *
+ * @param cfg The event_base configuration object.
+ * @param slack The longest to delay a timeout, or NULL for no delay.
+ * @return 0 on success, -1 on failure.
+ */
+EVENT2_EXPORT_SYMBOL
+int event_config_set_timer_slack(struct event_config *cfg,
+    const struct timeval *slack);
+
 /**
   Initialize the event API.
 
@@ -986,6 +1309,13 @@ int event_base_got_break(struct event_base *eb);
  * feature flag EV_FEATURE_EARLY_CLOSE.
  **/
 #define EV_CLOSED	0x80
+/**
+ * Fire the event's timeout as close to its deadline as we can, even if the
+ * event_base was told it may delay timeouts to fire them together.
+ *
+ * @see event_config_set_timer_slack()
+ **/
+#define EV_PRECISE	0x100
 /**@}*/
 
 /**
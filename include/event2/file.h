@@ -0,0 +1,135 @@
+/*
+ * Copyright (c) 2026 The Libevent authors
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef EVENT2_FILE_H_INCLUDED_
+#define EVENT2_FILE_H_INCLUDED_
+
+/** @file event2/file.h
+
+  @brief File I/O that doesn't block the event loop.
+
+  Reading or writing a file can take as long as the disk likes, and
+  evbuffer_add_file() and friends do it in the thread that runs the loop,
+  which stalls every connection on the event_base meanwhile.  The
+  functions here do the I/O on the workers of an evthreadpool instead, and
+  report back to the event_base once it is done, with the data in an
+  evbuffer.
+
+  Like the pool, these need Pthreads and live in libevent_pthreads.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <event2/event-config.h>
+#include <event2/visibility.h>
+#include <event2/util.h>
+
+#if defined(EVENT__HAVE_PTHREADS) || defined(EVENT_IN_DOXYGEN_)
+
+struct event_base;
+struct evbuffer;
+struct evthreadpool;
+
+/**
+  A function to call in the event_base's thread once a file operation is
+  done.
+
+  @param result the number of bytes read or written (0 for
+    evfile_fsync()), or -1 on error.
+  @param err the errno of the failure if result is -1; else 0.
+  @param arg the argument passed along with the operation.
+ */
+typedef void (*evfile_cb)(ev_ssize_t result, int err, void *arg);
+
+/**
+  Read from a file into an evbuffer, without blocking the loop.
+
+  Reads length bytes from fd, or as many as there are before the end of the
+  file, and appends them to dst.  Until the callback runs, don't close fd or
+  free dst, and don't expect the data to be in dst.
+
+  @param pool the pool to read on.
+  @param base the event_base to run cb in.
+  @param fd the file to read.
+  @param offset where in the file to read from.
+  @param length how many bytes to read.
+  @param dst the evbuffer to add what was read to.
+  @param cb called once the read is done; may be NULL.
+  @param arg an argument for cb.
+  @return 0 if the read was started, -1 on failure.
+ */
+EVENT2_EXPORT_SYMBOL
+int evfile_read(struct evthreadpool *pool, struct event_base *base,
+    int fd, ev_off_t offset, size_t length,
+    struct evbuffer *dst, evfile_cb cb, void *arg);
+
+/**
+  Write the contents of an evbuffer to a file, without blocking the loop.
+
+  All of src is removed right away, and written to fd later.  If writing
+  fails partway, cb gets -1, and whatever wasn't written is lost.  Don't
+  close fd until the callback runs.
+
+  @param pool the pool to write on.
+  @param base the event_base to run cb in.
+  @param fd the file to write.
+  @param offset where in the file to write to, or -1 to write at its
+    current position, as for a file opened with O_APPEND.
+  @param src the data to write.
+  @param cb called once the write is done; may be NULL.
+  @param arg an argument for cb.
+  @return 0 if the write was started, -1 on failure.
+ */
+EVENT2_EXPORT_SYMBOL
+int evfile_write(struct evthreadpool *pool, struct event_base *base,
+    int fd, ev_off_t offset, struct evbuffer *src,
+    evfile_cb cb, void *arg);
+
+/**
+  Flush a file to disk with fsync(), without blocking the loop.
+
+  This is only ordered after earlier writes to fd once their callbacks
+  have run: the pool may run operations in any order.
+
+  @param pool the pool to flush on.
+  @param base the event_base to run cb in.
+  @param fd the file to flush.
+  @param cb called once the flush is done; may be NULL.
+  @param arg an argument for cb.
+  @return 0 if the flush was started, -1 on failure.
+ */
+EVENT2_EXPORT_SYMBOL
+int evfile_fsync(struct evthreadpool *pool, struct event_base *base,
+    int fd, evfile_cb cb, void *arg);
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* EVENT2_FILE_H_INCLUDED_ */
@@ -272,6 +272,28 @@ EVENT2_EXPORT_SYMBOL
 void evhttp_set_default_content_type(struct evhttp *http,
 	const char *content_type);
 
+/**
+  Compress replies with gzip for clients that accept it.
+
+  Replies get a "Content-Encoding: gzip" header and a gzip-encoded body if
+  the request's Accept-Encoding header allows it, the reply has a body of
+  at least min_size bytes, and the callback did not set a Content-Encoding
+  header itself (set one to "identity" to keep a reply as it is).
+  Replies sent with evhttp_send_reply_start() are compressed as they go,
+  unless they have a Content-Length header, and every chunk is flushed so
+  the client can decompress it right away.  Compressors are reused from
+  one reply to the next.
+
+  @param http the http server on which to enable compression
+  @param level the compression level, from 1 (fastest) to 9 (smallest),
+    -1 for zlib's default, or 0 to stop compressing replies
+  @param min_size the smallest body worth compressing
+  @return 0 on success, -1 on failure or if Libevent was built without zlib
+  @see bufferevent_zlib_new()
+*/
+EVENT2_EXPORT_SYMBOL
+int evhttp_set_gzip(struct evhttp *http, int level, size_t min_size);
+
 /**
   Sets the what HTTP methods are supported in requests accepted by this
   server, and passed to user callbacks.
@@ -37,6 +37,7 @@ extern "C" {
 
 struct sockaddr;
 struct evconnlistener;
+struct bufferevent;
 
 /**@file event2/listener.h
 
@@ -50,6 +51,31 @@ struct evconnlistener;
  */
 typedef void (*evconnlistener_cb)(struct evconnlistener *, evutil_socket_t, struct sockaddr *, int socklen, void *);
 
+/** A connection accepted by a listener, as handed to an
+ * evconnlistener_batch_cb. */
+struct evconnlistener_accepted {
+	/** The new file descriptor */
+	evutil_socket_t fd;
+	/** The source address of the connection.  It is only valid until the
+	 * callback returns. */
+	struct sockaddr *addr;
+	/** The length of addr */
+	int socklen;
+};
+
+/**
+   A callback that we invoke with a batch of new connections.
+
+   The callback owns the file descriptors, but not the array.
+
+   @param listener The evconnlistener
+   @param conns The new connections
+   @param n_conns The number of connections in conns, at least 1
+   @param user_arg the pointer passed to evconnlistener_set_batch_cb()
+ */
+typedef void (*evconnlistener_batch_cb)(struct evconnlistener *,
+    struct evconnlistener_accepted *conns, int n_conns, void *);
+
 /**
    A callback that we invoke when a listener encounters a non-retriable error.
 
@@ -58,6 +84,19 @@ typedef void (*evconnlistener_cb)(struct evconnlistener *, evutil_socket_t, stru
  */
 typedef void (*evconnlistener_errorcb)(struct evconnlistener *, void *);
 
+/**
+   A callback that we invoke in a worker's thread for each connection handed
+   to it by evconnlistener_set_workers().
+
+   @param bev A new socket bufferevent for the connection, on the worker's
+      event_base
+   @param addr The source address of the connection
+   @param socklen The length of addr
+   @param user_arg the pointer passed to evconnlistener_set_workers()
+ */
+typedef void (*evconnlistener_worker_cb)(struct bufferevent *bev,
+    struct sockaddr *addr, int socklen, void *user_arg);
+
 /** Flag: Indicates that we should not make incoming sockets nonblocking
  * before passing them to the callback. */
 #define LEV_OPT_LEAVE_SOCKETS_BLOCKING	(1u<<0)
@@ -195,6 +234,90 @@ EVENT2_EXPORT_SYMBOL
 void evconnlistener_set_error_cb(struct evconnlistener *lev,
     evconnlistener_errorcb errorcb);
 
+/**
+   Have an evconnlistener hand new connections to cb in batches, instead of
+   one at a time.
+
+   Each time the listening socket becomes readable, the listener accepts
+   connections until there are none left (or the accept budget is used up),
+   calling cb whenever it has max_batch of them and once more for the
+   remainder.  This replaces any callback set with evconnlistener_set_cb(),
+   and evconnlistener_set_cb() replaces the batch callback in turn.
+
+   Not supported on listeners that use IOCP.
+
+   @param lev the listener
+   @param cb the callback, or NULL to leave the listener without a callback
+   @param max_batch the most connections to pass to cb at a time
+   @param arg the user_arg to pass to cb
+   @return 0 on success, -1 on failure
+ */
+EVENT2_EXPORT_SYMBOL
+int evconnlistener_set_batch_cb(struct evconnlistener *lev,
+    evconnlistener_batch_cb cb, int max_batch, void *arg);
+
+/**
+   Limit how many connections an evconnlistener accepts each time its
+   socket becomes readable.
+
+   By default, a listener accepts every pending connection before returning
+   to the event loop, so a burst of connections can keep the loop from
+   running anything else for a long time.  With a budget, the rest of the
+   connections are accepted in the next iterations of the loop, after other
+   active events have had their turn.
+
+   Has no effect on listeners that use IOCP.
+
+   @param lev the listener
+   @param budget the most connections to accept at a time, or 0 for no limit
+   @return 0 on success, -1 on failure
+ */
+EVENT2_EXPORT_SYMBOL
+int evconnlistener_set_accept_budget(struct evconnlistener *lev, int budget);
+
+/** Policy for evconnlistener_set_workers(): hand each connection to the
+ * next worker in turn. */
+#define LEV_WORKERS_ROUND_ROBIN		0
+/** Policy for evconnlistener_set_workers(): hand each connection to the
+ * worker whose event_base has the fewest events added, counting the
+ * connections still waiting to be picked up. */
+#define LEV_WORKERS_LEAST_LOADED	1
+
+/**
+   Have an evconnlistener hand its connections over to a set of worker
+   event_bases, each usually running in its own thread.
+
+   Connections are accepted in the listener's thread, queued for the
+   worker picked by policy, and the worker's event_base is woken up.  In
+   the worker's thread, we create a socket bufferevent for each connection
+   with bev_options and pass it to cb, which owns it from then on.
+
+   This replaces any callback set with evconnlistener_set_cb() or
+   evconnlistener_set_batch_cb().  Calling it again replaces the workers;
+   connections still queued for the old ones are closed.
+
+   Threading must be enabled (see evthread_use_pthreads()) before the
+   worker event_bases are created.  The workers are released when the
+   listener is freed, which must happen before any of their event_bases
+   are freed.  Since freeing the listener waits for running worker
+   callbacks to finish, cb must not call into the listener itself.
+
+   Not supported on listeners that use IOCP.
+
+   @param lev the listener
+   @param bases the worker event_bases
+   @param n_bases the number of entries in bases
+   @param policy LEV_WORKERS_ROUND_ROBIN or LEV_WORKERS_LEAST_LOADED
+   @param bev_options the BEV_OPT_* options for the new bufferevents
+   @param cb the callback to invoke with each new bufferevent
+   @param arg the user_arg to pass to cb
+   @return 0 on success, -1 on failure
+ */
+EVENT2_EXPORT_SYMBOL
+int evconnlistener_set_workers(struct evconnlistener *lev,
+    struct event_base **bases, int n_bases, int policy, int bev_options,
+    evconnlistener_worker_cb cb, void *arg);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,179 @@
+/*
+ * Copyright (c) 2026 The Libevent authors
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef EVENT2_TASK_H_INCLUDED_
+#define EVENT2_TASK_H_INCLUDED_
+
+/** @file event2/task.h
+
+  @brief Cooperative tasks that run on an event_base.
+
+  A task is a function with a stack of its own, which the event loop runs
+  until it waits for something: an fd to become ready, a timeout, or data
+  on a bufferevent.  The loop then goes on with other callbacks and tasks,
+  and resumes the task once the thing it waited for has happened.  This
+  lets you write a protocol handler as straight-line code instead of a
+  state machine spread over callbacks, without a thread per connection.
+
+  Tasks only ever run in the thread that runs their event_base's loop, and
+  only one at a time, so they need no locking among themselves.  They must
+  not block, and must not run the event loop themselves.
+
+  Stacks are kept in a pool per event_base and reused, so memory use stays
+  flat as tasks come and go.  Tasks need ucontext support (getcontext(),
+  makecontext() and swapcontext()); where it is missing, evtask_spawn()
+  fails.
+
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <event2/visibility.h>
+#include <event2/util.h>
+
+struct event_base;
+struct bufferevent;
+struct evtask;
+
+/**
+  The function a task runs.
+
+  @param task the task; pass it to the evtask_await_*() functions.
+  @param arg the argument passed to evtask_spawn().
+ */
+typedef void (*evtask_fn)(struct evtask *task, void *arg);
+
+/**
+  Set the size of task stacks, and how many unused ones to keep around.
+
+  The new size applies to stacks allocated from now on.  The default is 64
+  KiB per stack, keeping up to 64 unused ones.
+
+  @param base the event_base to run tasks on.
+  @param stack_size the size of each task's stack, in bytes; at least 16
+    KiB.
+  @param max_idle how many stacks of finished tasks to keep for reuse.
+  @return 0 on success, -1 on failure.
+ */
+EVENT2_EXPORT_SYMBOL
+int evtask_set_stacks(struct event_base *base, size_t stack_size,
+    int max_idle);
+
+/**
+  Start a new task.
+
+  The task starts running from the event loop of base, like an active
+  event; evtask_spawn() itself returns right away.  The task ends when fn
+  returns.  Tasks that are still waiting when the event_base is freed are
+  freed with it, without returning from what they wait for.
+
+  @param base the event_base to run the task on.
+  @param fn the function to run.
+  @param arg an argument to pass to fn.
+  @return 0 on success, -1 on failure.
+ */
+EVENT2_EXPORT_SYMBOL
+int evtask_spawn(struct event_base *base, evtask_fn fn, void *arg);
+
+/**
+  Get the event_base a task runs on.
+ */
+EVENT2_EXPORT_SYMBOL
+struct event_base *evtask_get_base(const struct evtask *task);
+
+/**
+  Wait until an fd is ready, or until a timeout passes.
+
+  May only be called by the task itself.
+
+  @param task the running task.
+  @param fd the fd to wait for.
+  @param events EV_READ, EV_WRITE and/or EV_CLOSED.
+  @param timeout the longest to wait, or NULL to wait forever.
+  @return the events that happened (including EV_TIMEOUT if the timeout
+    passed first), or -1 on error.
+ */
+EVENT2_EXPORT_SYMBOL
+int evtask_await_fd(struct evtask *task, evutil_socket_t fd, short events,
+    const struct timeval *timeout);
+
+/**
+  Wait until an fd is readable.  As evtask_await_fd() with EV_READ.
+ */
+EVENT2_EXPORT_SYMBOL
+int evtask_await_read(struct evtask *task, evutil_socket_t fd,
+    const struct timeval *timeout);
+
+/**
+  Wait until an fd is writable.  As evtask_await_fd() with EV_WRITE.
+ */
+EVENT2_EXPORT_SYMBOL
+int evtask_await_write(struct evtask *task, evutil_socket_t fd,
+    const struct timeval *timeout);
+
+/**
+  Sleep for a while, letting the event loop do other things meanwhile.
+
+  @param task the running task.
+  @param duration how long to sleep.
+  @return 0 on success, -1 on error.
+ */
+EVENT2_EXPORT_SYMBOL
+int evtask_sleep(struct evtask *task, const struct timeval *duration);
+
+/**
+  Let the event loop run the other active callbacks before going on.
+
+  @param task the running task.
+  @return 0 on success, -1 on error.
+ */
+EVENT2_EXPORT_SYMBOL
+int evtask_yield(struct evtask *task);
+
+/**
+  Wait until a bufferevent has at least min bytes of input.
+
+  If bev doesn't have that much input yet, this enables reading on it and
+  replaces its callbacks with ones of the task's own until the wait is over;
+  then they are cleared.  The input stays in bev for the task to remove.
+
+  @param task the running task.
+  @param bev the bufferevent to read from.
+  @param min how much input to wait for; 0 means 1.
+  @param timeout the longest to wait, or NULL to wait forever.
+  @return the number of bytes of input bev has, which is less than min only
+    if the other side closed the connection; or -1 on error or timeout.
+ */
+EVENT2_EXPORT_SYMBOL
+ev_ssize_t evtask_await_bufferevent_read(struct evtask *task,
+    struct bufferevent *bev, size_t min, const struct timeval *timeout);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* EVENT2_TASK_H_INCLUDED_ */
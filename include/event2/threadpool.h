@@ -0,0 +1,125 @@
+/*
+ * Copyright (c) 2026 The Libevent authors
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef EVENT2_THREADPOOL_H_INCLUDED_
+#define EVENT2_THREADPOOL_H_INCLUDED_
+
+/** @file event2/threadpool.h
+
+  @brief A pool of worker threads that report back to an event_base.
+
+  Some work is too slow to do in an event callback: compressing, hashing,
+  reading a file from a slow disk.  An evthreadpool runs such work on
+  worker threads of its own, then runs a completion callback back in the
+  thread of the event_base the work came from, as one of its deferred
+  callbacks.
+
+  Each worker has a queue of its own.  Work submitted from a loop goes to
+  the workers in turn; work submitted by a job goes to the queue of the
+  worker running it.  A worker whose queue is empty takes work from the
+  back of another's before it goes to sleep.
+
+  The pool needs Pthreads, and lives in libevent_pthreads.  The event_bases
+  it reports back to must have been created after a call to
+  evthread_use_pthreads().
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <event2/event-config.h>
+#include <event2/visibility.h>
+
+#if defined(EVENT__HAVE_PTHREADS) || defined(EVENT_IN_DOXYGEN_)
+
+struct event_base;
+struct evthreadpool;
+
+/**
+  A job to run on a worker thread.
+
+  @param arg the argument passed to evthreadpool_submit().
+ */
+typedef void (*evthreadpool_work_cb)(void *arg);
+
+/**
+  A function to call in the event_base's thread once a job is done.
+
+  @param arg the argument passed to evthreadpool_submit().
+ */
+typedef void (*evthreadpool_done_cb)(void *arg);
+
+/**
+  Create a pool of worker threads.
+
+  @param n_workers how many threads to start; at least 1.
+  @return the new pool, or NULL on failure.
+ */
+EVENT2_EXPORT_SYMBOL
+struct evthreadpool *evthreadpool_new(int n_workers);
+
+/**
+  Run a job on a worker thread, then tell an event_base it is done.
+
+  This may be called from any thread, including from a job.  Jobs may run
+  in any order.
+
+  @param pool the pool to run the job on.
+  @param base the event_base to run done in, or NULL if there is nothing to
+    run once the job is done.
+  @param work the job to run.
+  @param done called from the loop of base once work has returned, like an
+    event callback with the middle priority of base.  May be NULL if base
+    is NULL.
+  @param arg an argument for work and done.
+  @return 0 on success, -1 on failure.
+ */
+EVENT2_EXPORT_SYMBOL
+int evthreadpool_submit(struct evthreadpool *pool, struct event_base *base,
+    evthreadpool_work_cb work, evthreadpool_done_cb done, void *arg);
+
+/**
+  Finish every job already submitted to a pool, then free it.
+
+  The completions of those jobs are still delivered to their event_bases,
+  so free the pool before freeing the event_bases it reports to.  Jobs must
+  not submit more jobs once this has been called.
+
+  @param pool the pool to free.
+ */
+EVENT2_EXPORT_SYMBOL
+void evthreadpool_free(struct evthreadpool *pool);
+
+/** Defined if Libevent was built with evthreadpool support. */
+#define EVTHREADPOOL_IMPLEMENTED 1
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* EVENT2_THREADPOOL_H_INCLUDED_ */
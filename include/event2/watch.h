@@ -41,6 +41,7 @@ extern "C" {
 #endif
 
 #include <event2/visibility.h>
+#include <event2/util.h>
 
 struct event_base;
 struct evwatch;
@@ -129,6 +130,47 @@ void evwatch_free(struct evwatch *watcher);
 EVENT2_EXPORT_SYMBOL
 int evwatch_prepare_get_timeout(const struct evwatch_prepare_cb_info *info, struct timeval *timeout);
 
+/**
+  Get how long the event_base will spin before it sleeps, if it is set up
+  to busy-poll with event_config_set_busy_poll().  With
+  EVENT_BUSY_POLL_ADAPTIVE, this changes as the loop runs.
+
+  @param info the "prepare" callback info.
+  @param budget address of a timeval to write the spinning budget to.
+  @return 1 if a value was written to *budget, or 0 if the event_base does
+    not busy-poll.
+ */
+EVENT2_EXPORT_SYMBOL
+int evwatch_prepare_get_spin_budget(const struct evwatch_prepare_cb_info *info, struct timeval *budget);
+
+/**
+  Busy polling statistics, as reported by evwatch_check_get_busy_poll().
+ */
+struct evwatch_busy_poll_info {
+	/** How long the loop spun before this poll, in microseconds. */
+	ev_uint64_t spin_usec;
+	/** How many times spinning found something to do. */
+	ev_uint64_t n_spin_hits;
+	/** How many times the loop had to sleep after spinning in vain. */
+	ev_uint64_t n_wakeups;
+	/** How long the loop has spun in all, in microseconds. */
+	ev_uint64_t total_spin_usec;
+	/** Which fraction of that found nothing to do, from 0 to 1. */
+	double idle_ratio;
+};
+
+/**
+  Get the busy polling statistics of an event_base set up with
+  event_config_set_busy_poll().
+
+  @param info the "check" callback info.
+  @param stats address of a structure to fill in.
+  @return 1 if *stats was filled in, or 0 if the event_base does not
+    busy-poll.
+ */
+EVENT2_EXPORT_SYMBOL
+int evwatch_check_get_busy_poll(const struct evwatch_check_cb_info *info, struct evwatch_busy_poll_info *stats);
+
 #ifdef __cplusplus
 }
 #endif
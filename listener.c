@@ -46,6 +46,7 @@
 #include <afunix.h>
 #endif
 #include <errno.h>
+#include <string.h>
 #ifdef EVENT__HAVE_SYS_SOCKET_H
 #include <sys/socket.h>
 #endif
@@ -60,6 +61,7 @@
 #include "event2/util.h"
 #include "event2/event.h"
 #include "event2/event_struct.h"
+#include "event2/bufferevent.h"
 #include "mm-internal.h"
 #include "util-internal.h"
 #include "log-internal.h"
@@ -89,8 +91,19 @@ struct evconnlistener {
 	short refcnt;
 	int accept4_flags;
 	unsigned enabled : 1;
+	/* Set instead of cb by evconnlistener_set_batch_cb() */
+	evconnlistener_batch_cb batch_cb;
+	struct evconnlistener_accepted *batch;
+	struct sockaddr_storage *batch_addrs;
+	int batch_max;
+	/* Most connections to accept per wakeup, or 0 for no limit */
+	int accept_budget;
+	/* Set by evconnlistener_set_workers() */
+	struct listener_workers *workers;
 };
 
+#define LISTENER_HAS_CB(listener) ((listener)->cb || (listener)->batch_cb)
+
 struct evconnlistener_event {
 	struct evconnlistener base;
 	struct event listener;
@@ -123,6 +136,8 @@ static void event_listener_destroy(struct evconnlistener *);
 static evutil_socket_t event_listener_getfd(struct evconnlistener *);
 static struct event_base *event_listener_getbase(struct evconnlistener *);
 
+static void listener_workers_free(struct listener_workers *);
+
 #if 0
 static void
 listener_incref_and_lock(struct evconnlistener *listener)
@@ -140,6 +155,10 @@ listener_decref_and_unlock(struct evconnlistener *listener)
 		listener->ops->destroy(listener);
 		UNLOCK(listener);
 		EVTHREAD_FREE_LOCK(listener->lock, EVTHREAD_LOCKTYPE_RECURSIVE);
+		if (listener->workers)
+			listener_workers_free(listener->workers);
+		mm_free(listener->batch);
+		mm_free(listener->batch_addrs);
 		mm_free(listener);
 		return 1;
 	} else {
@@ -297,6 +316,7 @@ evconnlistener_free(struct evconnlistener *lev)
 {
 	LOCK(lev);
 	lev->cb = NULL;
+	lev->batch_cb = NULL;
 	lev->errorcb = NULL;
 	if (lev->ops->shutdown)
 		lev->ops->shutdown(lev);
@@ -321,7 +341,7 @@ evconnlistener_enable(struct evconnlistener *lev)
 	int r;
 	LOCK(lev);
 	lev->enabled = 1;
-	if (lev->cb)
+	if (LISTENER_HAS_CB(lev))
 		r = lev->ops->enable(lev);
 	else
 		r = 0;
@@ -398,15 +418,63 @@ evconnlistener_set_cb(struct evconnlistener *lev,
 {
 	int enable = 0;
 	LOCK(lev);
-	if (lev->enabled && !lev->cb)
+	if (lev->enabled && !LISTENER_HAS_CB(lev))
 		enable = 1;
 	lev->cb = cb;
+	lev->batch_cb = NULL;
 	lev->user_data = arg;
 	if (enable)
 		evconnlistener_enable(lev);
 	UNLOCK(lev);
 }
 
+int
+evconnlistener_set_batch_cb(struct evconnlistener *lev,
+    evconnlistener_batch_cb cb, int max_batch, void *arg)
+{
+	struct evconnlistener_accepted *batch = NULL;
+	struct sockaddr_storage *batch_addrs = NULL;
+	int enable = 0;
+
+	if (lev->ops != &evconnlistener_event_ops || max_batch <= 0)
+		return -1;
+
+	batch = mm_calloc(max_batch, sizeof(*batch));
+	batch_addrs = mm_calloc(max_batch, sizeof(*batch_addrs));
+	if (!batch || !batch_addrs) {
+		mm_free(batch);
+		mm_free(batch_addrs);
+		return -1;
+	}
+
+	LOCK(lev);
+	if (lev->enabled && !LISTENER_HAS_CB(lev))
+		enable = 1;
+	mm_free(lev->batch);
+	mm_free(lev->batch_addrs);
+	lev->batch = batch;
+	lev->batch_addrs = batch_addrs;
+	lev->batch_max = max_batch;
+	lev->batch_cb = cb;
+	lev->cb = NULL;
+	lev->user_data = arg;
+	if (enable)
+		evconnlistener_enable(lev);
+	UNLOCK(lev);
+	return 0;
+}
+
+int
+evconnlistener_set_accept_budget(struct evconnlistener *lev, int budget)
+{
+	if (budget < 0)
+		return -1;
+	LOCK(lev);
+	lev->accept_budget = budget;
+	UNLOCK(lev);
+	return 0;
+}
+
 void
 evconnlistener_set_error_cb(struct evconnlistener *lev,
     evconnlistener_errorcb errorcb)
@@ -416,19 +484,348 @@ evconnlistener_set_error_cb(struct evconnlistener *lev,
 	UNLOCK(lev);
 }
 
+/* A connection on its way to a worker */
+struct listener_handoff {
+	evutil_socket_t fd;
+	int socklen;
+	struct sockaddr_storage addr;
+};
+
+struct listener_worker {
+	struct listener_workers *workers;
+	struct event_base *base;
+	/* Activated from the listener's thread when queue becomes nonempty */
+	struct event *notify;
+	/* Protects queue, n_queued and queue_alloc */
+	void *lock;
+	struct listener_handoff *queue;
+	int n_queued;
+	int queue_alloc;
+	/* Only touched in the worker's thread: the queue we are working on */
+	struct listener_handoff *spare;
+	int spare_alloc;
+};
+
+struct listener_workers {
+	struct listener_worker *workers;
+	int n_workers;
+	int policy;
+	/* For LEV_WORKERS_ROUND_ROBIN: the worker to use next */
+	int next;
+	int bev_options;
+	evconnlistener_worker_cb cb;
+	void *user_data;
+};
+
+#define LISTENER_WORKERS_BATCH 64
+
+static void
+listener_worker_cb(evutil_socket_t fd, short what, void *arg)
+{
+	struct listener_worker *w = arg;
+	struct listener_workers *ws = w->workers;
+	struct listener_handoff *queue;
+	int i, n, alloc;
+
+	/* Swap queues, so that the listener can go on queueing while we
+	 * set up bufferevents */
+	EVLOCK_LOCK(w->lock, 0);
+	queue = w->queue;
+	alloc = w->queue_alloc;
+	n = w->n_queued;
+	w->queue = w->spare;
+	w->queue_alloc = w->spare_alloc;
+	w->n_queued = 0;
+	EVLOCK_UNLOCK(w->lock, 0);
+	w->spare = queue;
+	w->spare_alloc = alloc;
+
+	for (i = 0; i < n; ++i) {
+		struct listener_handoff *h = &queue[i];
+		struct bufferevent *bev =
+		    bufferevent_socket_new(w->base, h->fd, ws->bev_options);
+		if (!bev) {
+			event_sock_warn(h->fd, "Couldn't create bufferevent "
+			    "for new connection");
+			evutil_closesocket(h->fd);
+			continue;
+		}
+		ws->cb(bev, (struct sockaddr *)&h->addr, h->socklen,
+		    ws->user_data);
+	}
+}
+
+static struct listener_worker *
+listener_workers_pick(struct listener_workers *ws)
+{
+	struct listener_worker *best = NULL;
+	int i, load, best_load = 0;
+
+	if (ws->policy == LEV_WORKERS_ROUND_ROBIN) {
+		best = &ws->workers[ws->next];
+		ws->next = (ws->next + 1) % ws->n_workers;
+		return best;
+	}
+
+	for (i = 0; i < ws->n_workers; ++i) {
+		struct listener_worker *w = &ws->workers[i];
+		load = event_base_get_num_events(w->base,
+		    EVENT_BASE_COUNT_ADDED);
+		EVLOCK_LOCK(w->lock, 0);
+		load += w->n_queued;
+		EVLOCK_UNLOCK(w->lock, 0);
+		if (!best || load < best_load) {
+			best = w;
+			best_load = load;
+		}
+	}
+	return best;
+}
+
+static void
+listener_workers_batch_cb(struct evconnlistener *lev,
+    struct evconnlistener_accepted *conns, int n_conns, void *arg)
+{
+	struct listener_workers *ws = arg;
+	int i, wakeup;
+
+	for (i = 0; i < n_conns; ++i) {
+		struct listener_worker *w = listener_workers_pick(ws);
+		struct listener_handoff *h;
+
+		EVLOCK_LOCK(w->lock, 0);
+		if (w->n_queued == w->queue_alloc) {
+			int alloc = w->queue_alloc ? w->queue_alloc * 2 : 16;
+			struct listener_handoff *queue =
+			    mm_realloc(w->queue, alloc * sizeof(*queue));
+			if (!queue) {
+				EVLOCK_UNLOCK(w->lock, 0);
+				evutil_closesocket(conns[i].fd);
+				continue;
+			}
+			w->queue = queue;
+			w->queue_alloc = alloc;
+		}
+		h = &w->queue[w->n_queued];
+		h->fd = conns[i].fd;
+		h->socklen = conns[i].socklen;
+		memcpy(&h->addr, conns[i].addr, conns[i].socklen);
+		/* If the queue wasn't empty, the worker has been woken up
+		 * already and hasn't got round to it yet */
+		wakeup = w->n_queued++ == 0;
+		EVLOCK_UNLOCK(w->lock, 0);
+
+		if (wakeup)
+			event_active(w->notify, EV_READ, 1);
+	}
+}
+
+static void
+listener_workers_free(struct listener_workers *ws)
+{
+	int i, j;
+
+	for (i = 0; i < ws->n_workers; ++i) {
+		struct listener_worker *w = &ws->workers[i];
+		/* Waits for the callback if it is running */
+		if (w->notify)
+			event_free(w->notify);
+		for (j = 0; j < w->n_queued; ++j)
+			evutil_closesocket(w->queue[j].fd);
+		mm_free(w->queue);
+		mm_free(w->spare);
+		EVTHREAD_FREE_LOCK(w->lock, 0);
+	}
+	mm_free(ws->workers);
+	mm_free(ws);
+}
+
+int
+evconnlistener_set_workers(struct evconnlistener *lev,
+    struct event_base **bases, int n_bases, int policy, int bev_options,
+    evconnlistener_worker_cb cb, void *arg)
+{
+	struct listener_workers *ws, *old;
+	int i;
+
+	if (!bases || n_bases <= 0 || !cb ||
+	    (policy != LEV_WORKERS_ROUND_ROBIN &&
+		policy != LEV_WORKERS_LEAST_LOADED))
+		return -1;
+
+	ws = mm_calloc(1, sizeof(*ws));
+	if (!ws)
+		return -1;
+	ws->workers = mm_calloc(n_bases, sizeof(*ws->workers));
+	if (!ws->workers) {
+		mm_free(ws);
+		return -1;
+	}
+	ws->n_workers = n_bases;
+	ws->policy = policy;
+	ws->bev_options = bev_options;
+	ws->cb = cb;
+	ws->user_data = arg;
+	for (i = 0; i < n_bases; ++i) {
+		struct listener_worker *w = &ws->workers[i];
+		w->workers = ws;
+		w->base = bases[i];
+		EVTHREAD_ALLOC_LOCK(w->lock, 0);
+		w->notify = event_new(bases[i], -1, 0, listener_worker_cb, w);
+		if (!w->notify) {
+			listener_workers_free(ws);
+			return -1;
+		}
+	}
+
+	LOCK(lev);
+	if (evconnlistener_set_batch_cb(lev, listener_workers_batch_cb,
+		LISTENER_WORKERS_BATCH, ws) < 0) {
+		UNLOCK(lev);
+		listener_workers_free(ws);
+		return -1;
+	}
+	old = lev->workers;
+	lev->workers = ws;
+	UNLOCK(lev);
+
+	if (old)
+		listener_workers_free(old);
+	return 0;
+}
+
+/* Called with the listener locked when accept() has failed with err;
+ * unlocks it. */
+static void
+listener_accept_error(struct evconnlistener *lev, evutil_socket_t fd, int err)
+{
+	evconnlistener_errorcb errorcb;
+	void *user_data;
+
+	if (EVUTIL_ERR_ACCEPT_RETRIABLE(err)) {
+		UNLOCK(lev);
+		return;
+	}
+	if (lev->errorcb != NULL) {
+		++lev->refcnt;
+		errorcb = lev->errorcb;
+		user_data = lev->user_data;
+		errorcb(lev, user_data);
+		listener_decref_and_unlock(lev);
+	} else {
+		event_sock_warn(fd, "Error from accept() call");
+		UNLOCK(lev);
+	}
+}
+
+/* Hand the n accepted connections in lev->batch to the batch callback.
+ * Returns 0 if we should go on accepting, or -1 if the listener has been
+ * freed or unlocked. */
+static int
+listener_deliver_batch(struct evconnlistener *lev, int n)
+{
+	evconnlistener_batch_cb cb;
+	void *user_data;
+	int i;
+
+	if (lev->batch_cb == NULL) {
+		for (i = 0; i < n; ++i)
+			evutil_closesocket(lev->batch[i].fd);
+		UNLOCK(lev);
+		return -1;
+	}
+	++lev->refcnt;
+	cb = lev->batch_cb;
+	user_data = lev->user_data;
+	cb(lev, lev->batch, n, user_data);
+	if (lev->refcnt == 1) {
+		int freed = listener_decref_and_unlock(lev);
+		EVUTIL_ASSERT(freed);
+		return -1;
+	}
+	--lev->refcnt;
+	if (!lev->enabled) {
+		/* the callback could have disabled the listener */
+		UNLOCK(lev);
+		return -1;
+	}
+	return 0;
+}
+
+/* Called with the listener locked; unlocks it. */
+static void
+listener_read_batch(struct evconnlistener *lev, evutil_socket_t fd)
+{
+	int n = 0, accepted = 0;
+
+	while (1) {
+		ev_socklen_t socklen = sizeof(lev->batch_addrs[n]);
+		struct sockaddr *sa = (struct sockaddr *)&lev->batch_addrs[n];
+		evutil_socket_t new_fd;
+
+		if (lev->accept_budget && accepted == lev->accept_budget) {
+			/* Leave the rest for the next time round the loop */
+			if (!n || listener_deliver_batch(lev, n) == 0)
+				UNLOCK(lev);
+			return;
+		}
+
+		new_fd = evutil_accept4_(fd, sa, &socklen, lev->accept4_flags);
+		if (new_fd < 0) {
+			int err = evutil_socket_geterror(fd);
+			if (n && listener_deliver_batch(lev, n) < 0)
+				return;
+			listener_accept_error(lev, fd, err);
+			return;
+		}
+		if (socklen == 0) {
+			/* This can happen with some older linux kernels in
+			 * response to nmap. */
+			evutil_closesocket(new_fd);
+			continue;
+		}
+
+		lev->batch[n].fd = new_fd;
+		lev->batch[n].addr = sa;
+		lev->batch[n].socklen = (int)socklen;
+		++accepted;
+		if (++n == lev->batch_max) {
+			if (listener_deliver_batch(lev, n) < 0)
+				return;
+			n = 0;
+			if (!lev->batch_cb) {
+				/* the callback switched to evconnlistener_set_cb() */
+				UNLOCK(lev);
+				return;
+			}
+		}
+	}
+}
+
 static void
 listener_read_cb(evutil_socket_t fd, short what, void *p)
 {
 	struct evconnlistener *lev = p;
-	int err;
 	evconnlistener_cb cb;
-	evconnlistener_errorcb errorcb;
 	void *user_data;
+	int accepted = 0;
 	LOCK(lev);
+	if (lev->batch_cb) {
+		listener_read_batch(lev, fd);
+		return;
+	}
 	while (1) {
 		struct sockaddr_storage ss;
 		ev_socklen_t socklen = sizeof(ss);
-		evutil_socket_t new_fd = evutil_accept4_(fd, (struct sockaddr*)&ss, &socklen, lev->accept4_flags);
+		evutil_socket_t new_fd;
+
+		if (lev->accept_budget && accepted == lev->accept_budget) {
+			/* Leave the rest for the next time round the loop */
+			UNLOCK(lev);
+			return;
+		}
+
+		new_fd = evutil_accept4_(fd, (struct sockaddr*)&ss, &socklen, lev->accept4_flags);
 		if (new_fd < 0)
 			break;
 		if (socklen == 0) {
@@ -437,6 +834,7 @@ listener_read_cb(evutil_socket_t fd, short what, void *p)
 			evutil_closesocket(new_fd);
 			continue;
 		}
+		++accepted;
 
 		if (lev->cb == NULL) {
 			evutil_closesocket(new_fd);
@@ -460,21 +858,7 @@ listener_read_cb(evutil_socket_t fd, short what, void *p)
 			return;
 		}
 	}
-	err = evutil_socket_geterror(fd);
-	if (EVUTIL_ERR_ACCEPT_RETRIABLE(err)) {
-		UNLOCK(lev);
-		return;
-	}
-	if (lev->errorcb != NULL) {
-		++lev->refcnt;
-		errorcb = lev->errorcb;
-		user_data = lev->user_data;
-		errorcb(lev, user_data);
-		listener_decref_and_unlock(lev);
-	} else {
-		event_sock_warn(fd, "Error from accept() call");
-		UNLOCK(lev);
-	}
+	listener_accept_error(lev, fd, evutil_socket_geterror(fd));
 }
 
 #ifdef _WIN32
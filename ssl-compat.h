@@ -30,6 +30,15 @@ struct le_ssl_ops {
 	void (*conn_closed)(
 		struct bufferevent_ssl *bev, int when, int errcode, int ret);
 	void (*print_err)(int err);
+	/* Ask the library to hand the session keys to the kernel (kTLS)
+	 * once the handshake is done.  May be NULL. */
+	void (*enable_ktls)(void *ssl);
+	/* Return EV_READ and/or EV_WRITE for the directions in which the
+	 * kernel is doing the record encryption.  May be NULL. */
+	short (*ktls_active)(void *ssl);
+	/* Called before each client handshake, once the SSL has been reset;
+	 * lets us offer a session to resume.  May be NULL. */
+	void (*prepare_connect)(void *ssl);
 };
 
 struct bio_data_counts {
@@ -80,6 +89,25 @@ struct bufferevent_ssl {
 	unsigned state : 2;
 	/* If we reset fd, we sould reset state too */
 	unsigned old_state : 2;
+	/* Set if the kernel encrypts what we write (kTLS): we then write the
+	 * plaintext to the socket ourselves, bypassing the SSL library. */
+	unsigned ktls_write : 1;
+	/* Set if the kernel decrypts what we read (kTLS). */
+	unsigned ktls_read : 1;
+
+	/* Dynamic record sizing: see bufferevent_ssl_set_record_size() */
+	size_t record_small;
+	size_t record_large;
+	size_t record_ramp;
+	struct timeval record_idle;
+	/* Bytes written since the start or the last idle period */
+	size_t record_sent;
+	/* When we last wrote anything */
+	struct timeval last_write_tv;
+	struct bufferevent_ssl_record_stats record_stats;
+	/* Where small chains are gathered into one record; allocated on first
+	 * use, BUFFEREVENT_SSL_RECORD_LARGE bytes long. */
+	unsigned char *write_stage;
 
 	ev_uint64_t flags;
 };
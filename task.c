@@ -0,0 +1,578 @@
+/*
+ * Copyright (c) 2026 The Libevent authors
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "event2/event-config.h"
+#include "evconfig-private.h"
+
+#include <sys/types.h>
+#include <string.h>
+
+#include "event2/event.h"
+#include "event2/event_struct.h"
+#include "event2/buffer.h"
+#include "event2/bufferevent.h"
+#include "event2/task.h"
+#include "event-internal.h"
+#include "evthread-internal.h"
+#include "log-internal.h"
+#include "mm-internal.h"
+#include "util-internal.h"
+
+/* makecontext() is deprecated on Darwin and broken on some of its
+ * versions, so we don't even try there. */
+#if defined(EVENT__HAVE_UCONTEXT_H) && defined(EVENT__HAVE_MAKECONTEXT) && \
+    !defined(__APPLE__)
+#define EVTASK_USE_UCONTEXT
+#include <ucontext.h>
+#endif
+
+/* Stacks come from mmap(), with an inaccessible page below them so that a
+ * task that overflows its stack crashes instead of overwriting the heap. */
+#if defined(EVTASK_USE_UCONTEXT) && defined(EVENT__HAVE_MMAP) && \
+    defined(EVENT__HAVE_SYS_MMAN_H) && defined(EVENT__HAVE_UNISTD_H)
+#define EVTASK_GUARD_PAGE
+#include <sys/mman.h>
+#include <unistd.h>
+#ifndef MAP_ANONYMOUS
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+#endif
+
+#define EVTASK_DEFAULT_STACK_SIZE (64 * 1024)
+#define EVTASK_MIN_STACK_SIZE (16 * 1024)
+#define EVTASK_DEFAULT_MAX_IDLE 64
+
+#ifdef EVTASK_USE_UCONTEXT
+
+struct evtask {
+	LIST_ENTRY(evtask) next;
+	struct event_base *base;
+	evtask_fn fn;
+	void *arg;
+
+	/* Where the task runs, and where it left off when it last waited.
+	 * stack_size is what the pool asked for; the stack is the part of
+	 * map above its guard page, if it has one, and may be a little
+	 * bigger. */
+	void *stack;
+	size_t stack_size;
+	void *map;
+	size_t map_len;
+	ucontext_t ctx;
+
+	/* The event a waiting task is resumed by; reassigned for every wait,
+	 * and never pending while the task runs. */
+	struct event ev;
+	/* The events ev reported when it resumed us. */
+	short result;
+	/* Set once fn has returned. */
+	int done;
+
+	/* While we await input on a bufferevent: how much, and the
+	 * BEV_EVENT_EOF and BEV_EVENT_ERROR flags it has reported. */
+	size_t bev_min;
+	short bev_what;
+};
+
+LIST_HEAD(evtask_list, evtask);
+
+struct evtask_pool {
+	size_t stack_size;
+	int max_idle;
+
+	/* The task running right now, if any, and where the loop left off to
+	 * run it.  Only touched by the thread running the loop. */
+	struct evtask *current;
+	ucontext_t loop_ctx;
+
+	/* Tasks that haven't finished, and finished tasks kept for their
+	 * stacks.  Protected by th_base_lock. */
+	struct evtask_list live;
+	struct evtask_list idle;
+	int n_idle;
+};
+
+static void evtask_wake_cb(evutil_socket_t fd, short what, void *arg);
+
+/* Return the task pool of 'base', creating it if need be.  Requires that
+ * 'base' be locked. */
+static struct evtask_pool *
+evtask_pool_get(struct event_base *base)
+{
+	struct evtask_pool *pool = base->task_pool;
+
+	if (pool)
+		return pool;
+	if (!(pool = mm_calloc(1, sizeof(struct evtask_pool))))
+		return NULL;
+	pool->stack_size = EVTASK_DEFAULT_STACK_SIZE;
+	pool->max_idle = EVTASK_DEFAULT_MAX_IDLE;
+	LIST_INIT(&pool->live);
+	LIST_INIT(&pool->idle);
+	base->task_pool = pool;
+	return pool;
+}
+
+/* Give 'task' a stack of at least 'size' bytes.  Returns 0 on success,
+ * -1 on failure. */
+static int
+evtask_stack_alloc(struct evtask *task, size_t size)
+{
+#ifdef EVTASK_GUARD_PAGE
+	long page = sysconf(_SC_PAGESIZE);
+	size_t len;
+	char *map;
+
+	if (page <= 0)
+		page = 4096;
+	len = (size + page - 1) / page * page + page;
+	map = mmap(NULL, len, PROT_READ|PROT_WRITE,
+	    MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+	if (map == MAP_FAILED)
+		return -1;
+	/* Stacks grow down, on every platform we have ucontext on */
+	if (mprotect(map, page, PROT_NONE) < 0) {
+		munmap(map, len);
+		return -1;
+	}
+	task->map = map;
+	task->map_len = len;
+	task->stack = map + page;
+	task->stack_size = size;
+	return 0;
+#else
+	if (!(task->map = task->stack = mm_malloc(size)))
+		return -1;
+	task->map_len = task->stack_size = size;
+	return 0;
+#endif
+}
+
+static void
+evtask_free(struct evtask *task)
+{
+	event_debug_unassign(&task->ev);
+#ifdef EVTASK_GUARD_PAGE
+	munmap(task->map, task->map_len);
+#else
+	mm_free(task->map);
+#endif
+	mm_free(task);
+}
+
+int
+evtask_set_stacks(struct event_base *base, size_t stack_size, int max_idle)
+{
+	struct evtask_pool *pool;
+	struct evtask *task, *next;
+	int r = -1;
+
+	if (stack_size < EVTASK_MIN_STACK_SIZE || max_idle < 0)
+		return -1;
+
+	EVBASE_ACQUIRE_LOCK(base, th_base_lock);
+	if (!(pool = evtask_pool_get(base)))
+		goto done;
+	pool->stack_size = stack_size;
+	pool->max_idle = max_idle;
+	/* Drop idle stacks of the wrong size, then any beyond max_idle */
+	for (task = LIST_FIRST(&pool->idle); task; task = next) {
+		next = LIST_NEXT(task, next);
+		if (task->stack_size != stack_size ||
+		    pool->n_idle > max_idle) {
+			LIST_REMOVE(task, next);
+			--pool->n_idle;
+			evtask_free(task);
+		}
+	}
+	r = 0;
+done:
+	EVBASE_RELEASE_LOCK(base, th_base_lock);
+	return r;
+}
+
+/* The function every task starts in.  makecontext() only passes ints, so
+ * the task pointer comes in two halves. */
+static void
+evtask_trampoline(unsigned hi, unsigned lo)
+{
+	struct evtask *task = (struct evtask *)(ev_uintptr_t)
+	    (((ev_uint64_t)hi << 32) | lo);
+
+	task->fn(task, task->arg);
+	task->done = 1;
+	/* The loop frees or reuses our stack once we're off it. */
+	setcontext(&task->base->task_pool->loop_ctx);
+}
+
+/* Set up task->ctx to start running the task on its own stack.  This is a
+ * function of its own since getcontext() returns twice, as far as the
+ * compiler knows. */
+static int
+evtask_make_context(struct evtask *task)
+{
+	ev_uint64_t p = (ev_uint64_t)(ev_uintptr_t)task;
+
+	if (getcontext(&task->ctx) < 0)
+		return -1;
+	task->ctx.uc_stack.ss_sp = task->stack;
+	/* The whole mapping above the guard page, if there is one */
+	task->ctx.uc_stack.ss_size =
+	    (size_t)((char *)task->map + task->map_len - (char *)task->stack);
+	task->ctx.uc_link = NULL;
+	makecontext(&task->ctx, (void (*)(void))evtask_trampoline, 2,
+	    (unsigned)(p >> 32), (unsigned)(p & 0xffffffffu));
+	return 0;
+}
+
+int
+evtask_spawn(struct event_base *base, evtask_fn fn, void *arg)
+{
+	struct evtask_pool *pool;
+	struct evtask *task;
+
+	EVBASE_ACQUIRE_LOCK(base, th_base_lock);
+	if (!(pool = evtask_pool_get(base)))
+		goto err;
+	if ((task = LIST_FIRST(&pool->idle))) {
+		LIST_REMOVE(task, next);
+		--pool->n_idle;
+	} else {
+		if (!(task = mm_calloc(1, sizeof(struct evtask))))
+			goto err;
+		if (evtask_stack_alloc(task, pool->stack_size) < 0) {
+			mm_free(task);
+			goto err;
+		}
+	}
+	LIST_INSERT_HEAD(&pool->live, task, next);
+	EVBASE_RELEASE_LOCK(base, th_base_lock);
+
+	task->base = base;
+	task->fn = fn;
+	task->arg = arg;
+	task->done = 0;
+	task->bev_min = 0;
+	task->bev_what = 0;
+
+	if (evtask_make_context(task) < 0) {
+		event_warn("%s: getcontext", __func__);
+		EVBASE_ACQUIRE_LOCK(base, th_base_lock);
+		LIST_REMOVE(task, next);
+		EVBASE_RELEASE_LOCK(base, th_base_lock);
+		evtask_free(task);
+		return -1;
+	}
+
+	/* Start it from the loop, like any other callback */
+	event_assign(&task->ev, base, -1, 0, evtask_wake_cb, task);
+	event_active(&task->ev, EV_TIMEOUT, 1);
+	return 0;
+
+err:
+	EVBASE_RELEASE_LOCK(base, th_base_lock);
+	return -1;
+}
+
+/* Called from the loop once 'task' has returned: give back what it held,
+ * and keep its stack for the next task if we want more of those. */
+static void
+evtask_finish(struct evtask *task)
+{
+	struct event_base *base = task->base;
+	struct evtask_pool *pool;
+
+	event_del(&task->ev);
+
+	EVBASE_ACQUIRE_LOCK(base, th_base_lock);
+	pool = base->task_pool;
+	LIST_REMOVE(task, next);
+	if (pool->n_idle < pool->max_idle &&
+	    task->stack_size == pool->stack_size) {
+		LIST_INSERT_HEAD(&pool->idle, task, next);
+		++pool->n_idle;
+		task = NULL;
+	}
+	EVBASE_RELEASE_LOCK(base, th_base_lock);
+
+	if (task)
+		evtask_free(task);
+}
+
+/* Run 'task' until it waits again or returns. */
+static void
+evtask_wake_cb(evutil_socket_t fd, short what, void *arg)
+{
+	struct evtask *task = arg;
+	struct evtask_pool *pool = task->base->task_pool;
+
+	/* A task that runs the loop itself could get here */
+	EVUTIL_ASSERT(pool->current == NULL);
+
+	task->result = what;
+	pool->current = task;
+	if (swapcontext(&pool->loop_ctx, &task->ctx) < 0)
+		event_err(1, "%s: swapcontext", __func__);
+	pool->current = NULL;
+
+	if (task->done)
+		evtask_finish(task);
+}
+
+/* Go back to the loop until task->ev is activated; return what it reported.
+ * The caller has set up task->ev. */
+static short
+evtask_suspend(struct evtask *task)
+{
+	struct evtask_pool *pool = task->base->task_pool;
+
+	if (swapcontext(&task->ctx, &pool->loop_ctx) < 0)
+		event_err(1, "%s: swapcontext", __func__);
+	/* Whatever woke us, the other half of the wait mustn't later */
+	event_del(&task->ev);
+	return task->result;
+}
+
+/* Return true iff 'task' is the one running now. */
+static int
+evtask_is_running(struct evtask *task)
+{
+	if (task->base->task_pool->current != task) {
+		event_warnx("%s: task %p is not running", __func__, (void *)task);
+		return 0;
+	}
+	return 1;
+}
+
+struct event_base *
+evtask_get_base(const struct evtask *task)
+{
+	return task->base;
+}
+
+int
+evtask_await_fd(struct evtask *task, evutil_socket_t fd, short events,
+    const struct timeval *timeout)
+{
+	events &= EV_READ|EV_WRITE|EV_CLOSED;
+	if (!evtask_is_running(task) || !events)
+		return -1;
+	event_assign(&task->ev, task->base, fd, events, evtask_wake_cb, task);
+	if (event_add(&task->ev, timeout) < 0)
+		return -1;
+	return evtask_suspend(task);
+}
+
+int
+evtask_await_read(struct evtask *task, evutil_socket_t fd,
+    const struct timeval *timeout)
+{
+	return evtask_await_fd(task, fd, EV_READ, timeout);
+}
+
+int
+evtask_await_write(struct evtask *task, evutil_socket_t fd,
+    const struct timeval *timeout)
+{
+	return evtask_await_fd(task, fd, EV_WRITE, timeout);
+}
+
+int
+evtask_sleep(struct evtask *task, const struct timeval *duration)
+{
+	if (!evtask_is_running(task) || !duration)
+		return -1;
+	event_assign(&task->ev, task->base, -1, 0, evtask_wake_cb, task);
+	if (event_add(&task->ev, duration) < 0)
+		return -1;
+	evtask_suspend(task);
+	return 0;
+}
+
+int
+evtask_yield(struct evtask *task)
+{
+	if (!evtask_is_running(task))
+		return -1;
+	event_assign(&task->ev, task->base, -1, 0, evtask_wake_cb, task);
+	event_active(&task->ev, EV_TIMEOUT, 1);
+	evtask_suspend(task);
+	return 0;
+}
+
+/* Bufferevent callbacks of a task that awaits its input: wake the task
+ * once there is enough of it, or there won't be any more. */
+static void
+evtask_bev_read_cb(struct bufferevent *bev, void *arg)
+{
+	struct evtask *task = arg;
+
+	if (evbuffer_get_length(bufferevent_get_input(bev)) >= task->bev_min)
+		event_active(&task->ev, EV_READ, 1);
+}
+
+static void
+evtask_bev_event_cb(struct bufferevent *bev, short what, void *arg)
+{
+	struct evtask *task = arg;
+
+	task->bev_what |= what & (BEV_EVENT_EOF|BEV_EVENT_ERROR);
+	if (task->bev_what)
+		event_active(&task->ev, EV_READ, 1);
+}
+
+ev_ssize_t
+evtask_await_bufferevent_read(struct evtask *task, struct bufferevent *bev,
+    size_t min, const struct timeval *timeout)
+{
+	struct evbuffer *input = bufferevent_get_input(bev);
+	ev_ssize_t r = -1;
+	size_t len;
+
+	if (!evtask_is_running(task))
+		return -1;
+	if (!min)
+		min = 1;
+	if ((len = evbuffer_get_length(input)) >= min)
+		return (ev_ssize_t)len;
+
+	task->bev_min = min;
+	task->bev_what = 0;
+	bufferevent_setcb(bev, evtask_bev_read_cb, NULL, evtask_bev_event_cb,
+	    task);
+	if (bufferevent_enable(bev, EV_READ) < 0)
+		goto done;
+
+	event_assign(&task->ev, task->base, -1, 0, evtask_wake_cb, task);
+	for (;;) {
+		/* Running the callback deleted the timeout along with the
+		 * wakeup, so a wakeup that didn't get us enough restarts it */
+		if (timeout && event_add(&task->ev, timeout) < 0)
+			goto done;
+		if (evtask_suspend(task) & EV_TIMEOUT)
+			goto done;
+		len = evbuffer_get_length(input);
+		if (len >= min || (task->bev_what & BEV_EVENT_EOF)) {
+			r = (ev_ssize_t)len;
+			goto done;
+		}
+		if (task->bev_what & BEV_EVENT_ERROR)
+			goto done;
+	}
+done:
+	bufferevent_setcb(bev, NULL, NULL, NULL, NULL);
+	task->bev_min = 0;
+	return r;
+}
+
+void
+evtask_pool_free_(struct event_base *base)
+{
+	struct evtask_pool *pool = base->task_pool;
+	struct evtask *task;
+
+	/* Tasks that never finished just stay suspended forever: we can't
+	 * unwind their stacks, so whatever they hold leaks. */
+	while ((task = LIST_FIRST(&pool->live))) {
+		LIST_REMOVE(task, next);
+		event_del(&task->ev);
+		evtask_free(task);
+	}
+	while ((task = LIST_FIRST(&pool->idle))) {
+		LIST_REMOVE(task, next);
+		evtask_free(task);
+	}
+	mm_free(pool);
+	base->task_pool = NULL;
+}
+
+#else /* !EVTASK_USE_UCONTEXT */
+
+int
+evtask_set_stacks(struct event_base *base, size_t stack_size, int max_idle)
+{
+	return -1;
+}
+
+int
+evtask_spawn(struct event_base *base, evtask_fn fn, void *arg)
+{
+	event_warnx("%s: tasks are not supported on this platform", __func__);
+	return -1;
+}
+
+struct event_base *
+evtask_get_base(const struct evtask *task)
+{
+	return NULL;
+}
+
+int
+evtask_await_fd(struct evtask *task, evutil_socket_t fd, short events,
+    const struct timeval *timeout)
+{
+	return -1;
+}
+
+int
+evtask_await_read(struct evtask *task, evutil_socket_t fd,
+    const struct timeval *timeout)
+{
+	return -1;
+}
+
+int
+evtask_await_write(struct evtask *task, evutil_socket_t fd,
+    const struct timeval *timeout)
+{
+	return -1;
+}
+
+int
+evtask_sleep(struct evtask *task, const struct timeval *duration)
+{
+	return -1;
+}
+
+int
+evtask_yield(struct evtask *task)
+{
+	return -1;
+}
+
+ev_ssize_t
+evtask_await_bufferevent_read(struct evtask *task, struct bufferevent *bev,
+    size_t min, const struct timeval *timeout)
+{
+	return -1;
+}
+
+void
+evtask_pool_free_(struct event_base *base)
+{
+}
+
+#endif /* EVTASK_USE_UCONTEXT */
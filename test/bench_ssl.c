@@ -0,0 +1,251 @@
+/*
+ * Copyright (c) 2026 The Libevent authors
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * This benchmark measures how an SSL bufferevent copes with an output
+ * buffer made of many small chains, as built by code that assembles a
+ * response piece by piece.  The client pushes -n chains of -s bytes each
+ * through a socketpair; we report how many TLS records that took and how
+ * long the server needed to receive everything.
+ */
+
+#include "event2/event-config.h"
+
+#include <sys/types.h>
+#ifdef _WIN32
+#include <winsock2.h>
+#include <getopt.h>
+#else
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+#endif
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include <openssl/ssl.h>
+#include <openssl/err.h>
+#include <openssl/x509.h>
+
+#include "event2/event.h"
+#include "event2/buffer.h"
+#include "event2/bufferevent.h"
+#include "event2/bufferevent_ssl.h"
+#include "event2/util.h"
+
+#include "openssl-compat.h"
+
+static size_t received;
+static size_t expected;
+
+static void
+read_cb(struct bufferevent *bev, void *arg)
+{
+	struct evbuffer *input = bufferevent_get_input(bev);
+
+	received += evbuffer_get_length(input);
+	evbuffer_drain(input, evbuffer_get_length(input));
+	if (received >= expected)
+		event_base_loopexit(bufferevent_get_base(bev), NULL);
+}
+
+static void
+event_cb(struct bufferevent *bev, short what, void *arg)
+{
+	if (!(what & BEV_EVENT_CONNECTED)) {
+		fprintf(stderr, "%s: unexpected event %x\n",
+		    (const char *)arg, what);
+		event_base_loopexit(bufferevent_get_base(bev), NULL);
+	}
+}
+
+/* A throwaway self-signed certificate; good enough for a benchmark,
+ * useless for anything else. */
+static int
+setup_server_ctx(SSL_CTX *ctx)
+{
+	EVP_PKEY_CTX *pctx = EVP_PKEY_CTX_new_id(EVP_PKEY_EC, NULL);
+	EVP_PKEY *key = NULL;
+	X509 *x509 = NULL;
+	X509_NAME *name;
+	int ok = 0;
+
+	if (!pctx ||
+	    EVP_PKEY_keygen_init(pctx) <= 0 ||
+	    EVP_PKEY_CTX_set_ec_paramgen_curve_nid(pctx,
+		NID_X9_62_prime256v1) <= 0 ||
+	    EVP_PKEY_keygen(pctx, &key) <= 0)
+		goto done;
+
+	if (!(x509 = X509_new()))
+		goto done;
+	X509_set_version(x509, 2);
+	ASN1_INTEGER_set(X509_get_serialNumber(x509), 1);
+	name = X509_get_subject_name(x509);
+	X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC,
+	    (const unsigned char *)"localhost", -1, -1, 0);
+	X509_set_issuer_name(x509, name);
+	X509_gmtime_adj(X509_getm_notBefore(x509), 0);
+	X509_gmtime_adj(X509_getm_notAfter(x509), 3600);
+	X509_set_pubkey(x509, key);
+	if (!X509_sign(x509, key, EVP_sha256()))
+		goto done;
+
+	ok = SSL_CTX_use_certificate(ctx, x509) == 1 &&
+	    SSL_CTX_use_PrivateKey(ctx, key) == 1;
+done:
+	X509_free(x509);
+	EVP_PKEY_free(key);
+	EVP_PKEY_CTX_free(pctx);
+	return ok ? 0 : -1;
+}
+
+int
+main(int argc, char **argv)
+{
+	struct event_base *base;
+	struct bufferevent *client, *server;
+	struct bufferevent_ssl_record_stats stats;
+	SSL_CTX *client_ctx, *server_ctx;
+	evutil_socket_t pair[2];
+	struct evbuffer *output;
+	struct timeval start, end, diff;
+	size_t chunks = 100000, chunk_size = 64, record = 0, i;
+	char *chunk;
+	double elapsed;
+	int c;
+
+#ifdef _WIN32
+	{
+		WSADATA WSAData;
+		WSAStartup(0x101, &WSAData);
+	}
+#endif
+
+	while ((c = getopt(argc, argv, "n:s:r:")) != -1) {
+		switch (c) {
+		case 'n':
+			chunks = (size_t)atol(optarg);
+			break;
+		case 's':
+			chunk_size = (size_t)atol(optarg);
+			break;
+		case 'r':
+			record = (size_t)atol(optarg);
+			break;
+		default:
+			fprintf(stderr, "Usage: %s [-n chunks] [-s chunk size] "
+			    "[-r record size]\n", argv[0]);
+			exit(1);
+		}
+	}
+	if (!chunks || !chunk_size) {
+		fprintf(stderr, "Bad chunk count or size\n");
+		exit(1);
+	}
+
+#if OPENSSL_VERSION_NUMBER < 0x10100000L || \
+	(defined(LIBRESSL_VERSION_NUMBER) && \
+	 LIBRESSL_VERSION_NUMBER < 0x20700000L)
+	SSL_library_init();
+	SSL_load_error_strings();
+#endif
+
+	client_ctx = SSL_CTX_new(SSLv23_method());
+	server_ctx = SSL_CTX_new(SSLv23_method());
+	if (!client_ctx || !server_ctx || setup_server_ctx(server_ctx) < 0) {
+		ERR_print_errors_fp(stderr);
+		exit(1);
+	}
+
+	if (evutil_socketpair(AF_UNIX, SOCK_STREAM, 0, pair) < 0) {
+		perror("socketpair");
+		exit(1);
+	}
+	evutil_make_socket_nonblocking(pair[0]);
+	evutil_make_socket_nonblocking(pair[1]);
+
+	base = event_base_new();
+	client = bufferevent_openssl_socket_new(base, pair[0],
+	    SSL_new(client_ctx), BUFFEREVENT_SSL_CONNECTING,
+	    BEV_OPT_CLOSE_ON_FREE);
+	server = bufferevent_openssl_socket_new(base, pair[1],
+	    SSL_new(server_ctx), BUFFEREVENT_SSL_ACCEPTING,
+	    BEV_OPT_CLOSE_ON_FREE);
+	if (!client || !server) {
+		fprintf(stderr, "Couldn't create SSL bufferevents\n");
+		exit(1);
+	}
+	if (record && bufferevent_ssl_set_record_size(client, 0, record, 0,
+		NULL) < 0) {
+		fprintf(stderr, "Bad record size\n");
+		exit(1);
+	}
+	bufferevent_setcb(client, NULL, NULL, event_cb, (void *)"client");
+	bufferevent_setcb(server, read_cb, NULL, event_cb, (void *)"server");
+	bufferevent_enable(server, EV_READ);
+
+	/* Every reference is a chain of its own */
+	chunk = malloc(chunk_size);
+	memset(chunk, 'x', chunk_size);
+	output = bufferevent_get_output(client);
+	for (i = 0; i < chunks; ++i)
+		evbuffer_add_reference(output, chunk, chunk_size, NULL, NULL);
+	expected = chunks * chunk_size;
+
+	evutil_gettimeofday(&start, NULL);
+	bufferevent_enable(client, EV_WRITE);
+	event_base_dispatch(base);
+	evutil_gettimeofday(&end, NULL);
+
+	evutil_timersub(&end, &start, &diff);
+	elapsed = diff.tv_sec + diff.tv_usec / 1e6;
+	bufferevent_ssl_get_record_stats(client, &stats);
+
+	printf("%lu chunks of %lu bytes: %lu bytes received in %.3f s "
+	    "(%.1f MB/s)\n",
+	    (unsigned long)chunks, (unsigned long)chunk_size,
+	    (unsigned long)received, elapsed,
+	    elapsed > 0 ? received / elapsed / 1e6 : 0.0);
+	printf("records: %lu small, %lu large, %lu coalesced; "
+	    "%.1f bytes/record\n",
+	    (unsigned long)stats.small_records,
+	    (unsigned long)stats.large_records,
+	    (unsigned long)stats.coalesced_records,
+	    (double)stats.bytes /
+	    (stats.small_records + stats.large_records + !stats.bytes));
+
+	bufferevent_free(client);
+	bufferevent_free(server);
+	event_base_free(base);
+	SSL_CTX_free(client_ctx);
+	SSL_CTX_free(server_ctx);
+	free(chunk);
+
+	return received == expected ? 0 : 1;
+}
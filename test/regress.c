@@ -62,6 +62,8 @@
 #include "event2/tag.h"
 #include "event2/buffer.h"
 #include "event2/buffer_compat.h"
+#include "event2/bufferevent.h"
+#include "event2/task.h"
 #include "event2/util.h"
 #include "event-internal.h"
 #include "evthread-internal.h"
@@ -1807,6 +1809,603 @@ end:
        ;
 }
 
+static void
+test_event_base_get_batch_sizes(void *ptr)
+{
+	struct event_config *cfg = NULL;
+	struct event_base *base = NULL;
+	struct event *evs[100];
+	evutil_socket_t pairs[100][2];
+	ev_uint64_t buckets[EVENT_BATCH_SIZE_BUCKETS];
+	struct timeval msec = { 0, 1000 };
+	int i;
+
+	memset(evs, 0, sizeof(evs));
+	for (i = 0; i < 100; ++i)
+		pairs[i][0] = pairs[i][1] = EVUTIL_INVALID_SOCKET;
+
+	cfg = event_config_new();
+	tt_assert(cfg);
+	tt_int_op(event_config_set_max_batch_size(cfg, -1), ==, -1);
+	tt_int_op(event_config_set_max_batch_size(cfg, 64), ==, 0);
+	base = event_base_new_with_config(cfg);
+	tt_assert(base);
+	if (strncmp(event_base_get_method(base), "epoll", 5)) {
+		tt_int_op(event_base_get_batch_sizes(base, buckets, 0), ==, -1);
+		tt_skip();
+	}
+	tt_int_op(event_base_get_batch_sizes(base, buckets, 0), ==, 32);
+
+	/* 100 readable fds that we never read from: every poll fills the
+	 * array, which grows up to the cap */
+	for (i = 0; i < 100; ++i) {
+		tt_int_op(evutil_socketpair(AF_UNIX, SOCK_STREAM, 0, pairs[i]),
+		    ==, 0);
+		tt_int_op(send(pairs[i][1], "x", 1, 0), ==, 1);
+		evs[i] = event_new(base, pairs[i][0], EV_READ|EV_PERSIST,
+		    null_cb, NULL);
+		event_add(evs[i], NULL);
+	}
+	event_base_loop(base, EVLOOP_ONCE);
+	tt_int_op(event_base_get_batch_sizes(base, buckets, 0), ==, 64);
+	event_base_loop(base, EVLOOP_ONCE);
+	event_base_loop(base, EVLOOP_ONCE);
+	tt_int_op(event_base_get_batch_sizes(base, buckets, 1), ==, 64);
+	tt_int_op(buckets[0], ==, 0);
+	tt_int_op(buckets[6], ==, 1); /* 32 */
+	tt_int_op(buckets[7], ==, 2); /* 64 */
+
+	/* Nothing to do for a while: the array shrinks back */
+	for (i = 0; i < 100; ++i)
+		event_del(evs[i]);
+	for (i = 0; i < 32; ++i) {
+		event_base_loopexit(base, &msec);
+		event_base_dispatch(base);
+	}
+	tt_int_op(event_base_get_batch_sizes(base, buckets, 0), ==, 32);
+	tt_int_op(buckets[1], ==, 0);
+	tt_int_op(buckets[0], >=, 32);
+
+end:
+	for (i = 0; i < 100; ++i) {
+		if (evs[i])
+			event_free(evs[i]);
+		if (pairs[i][0] != EVUTIL_INVALID_SOCKET)
+			evutil_closesocket(pairs[i][0]);
+		if (pairs[i][1] != EVUTIL_INVALID_SOCKET)
+			evutil_closesocket(pairs[i][1]);
+	}
+	if (base)
+		event_base_free(base);
+	if (cfg)
+		event_config_free(cfg);
+}
+
+static void
+stats_slow_cb(evutil_socket_t fd, short what, void *arg)
+{
+	struct timeval msec = { 0, 2000 };
+	evutil_usleep_(&msec);
+}
+
+static void
+test_event_base_get_stats(void *ptr)
+{
+	struct basic_test_data *data = ptr;
+	struct event_base *base = data->base;
+	struct event_base_stats stats;
+	struct event *fast = NULL, *slow = NULL, *later = NULL;
+	struct timeval hour = { 3600, 0 };
+	ev_uint64_t n;
+	int depths[4];
+	int i;
+
+	tt_int_op(event_stats_latency_bucket_usec(0), ==, 0);
+	tt_int_op(event_stats_latency_bucket_usec(3), ==, 3);
+	tt_int_op(event_stats_latency_bucket_usec(4), ==, 4);
+	tt_int_op(event_stats_latency_bucket_usec(7), ==, 7);
+	tt_int_op(event_stats_latency_bucket_usec(8), ==, 8);
+	tt_int_op(event_stats_latency_bucket_usec(11), ==, 14);
+	tt_int_op(event_stats_latency_bucket_usec(12), ==, 16);
+
+	tt_int_op(event_base_priority_init(base, 3), ==, 0);
+	fast = evtimer_new(base, null_cb, NULL);
+	slow = evtimer_new(base, stats_slow_cb, NULL);
+	later = evtimer_new(base, null_cb, NULL);
+	tt_assert(fast && slow && later);
+	event_priority_set(slow, 2);
+	evtimer_add(later, &hour);
+
+	/* Nothing is counted until we ask for it */
+	event_active(fast, EV_TIMEOUT, 1);
+	event_base_loop(base, EVLOOP_NONBLOCK);
+	event_base_get_stats(base, &stats, 0);
+	tt_int_op(stats.n_iterations, ==, 0);
+	tt_int_op(stats.n_callbacks, ==, 0);
+	tt_int_op(stats.n_timers, ==, 1);
+	tt_int_op(stats.n_priorities, ==, 3);
+
+	tt_int_op(event_base_enable_stats(base, 1), ==, 0);
+	event_active(fast, EV_TIMEOUT, 1);
+	event_active(slow, EV_TIMEOUT, 1);
+	event_base_get_stats(base, &stats, 0);
+	tt_int_op(stats.n_active, ==, 2);
+	tt_int_op(event_base_get_queue_depths(base, depths, 4), ==, 3);
+	tt_int_op(depths[0], ==, 0);
+	tt_int_op(depths[1], ==, 1);
+	tt_int_op(depths[2], ==, 1);
+	tt_int_op(depths[3], ==, 0);
+
+	/* The fast callback runs after the first poll and the slow one after
+	 * the second, since a lower priority only runs when nothing more
+	 * urgent is active; the third poll finds nothing left */
+	event_base_loop(base, EVLOOP_NONBLOCK);
+	event_base_get_stats(base, &stats, 1);
+	tt_int_op(stats.n_iterations, ==, 3);
+	tt_int_op(stats.n_callbacks, ==, 2);
+	tt_int_op(stats.max_callbacks_per_iteration, ==, 1);
+	tt_int_op(stats.n_active, ==, 0);
+	tt_assert(stats.max_callback_usec >= 2000);
+	tt_assert(stats.callback_usec >= stats.max_callback_usec);
+	for (n = 0, i = 0; i < EVENT_STATS_LATENCY_BUCKETS; ++i) {
+		n += stats.callback_usec_hist[i];
+		if (stats.callback_usec_hist[i] &&
+		    event_stats_latency_bucket_usec(i) >= 2000) {
+			tt_assert(stats.max_callback_usec <
+			    event_stats_latency_bucket_usec(i + 1));
+		}
+	}
+	tt_int_op(n, ==, 2);
+
+	/* Clearing and turning it off */
+	tt_int_op(event_base_enable_stats(base, 0), ==, 0);
+	event_active(fast, EV_TIMEOUT, 1);
+	event_base_loop(base, EVLOOP_NONBLOCK);
+	event_base_get_stats(base, &stats, 0);
+	tt_int_op(stats.n_iterations, ==, 0);
+	tt_int_op(stats.n_callbacks, ==, 0);
+	tt_int_op(stats.max_callback_usec, ==, 0);
+
+end:
+	if (fast)
+		event_free(fast);
+	if (slow)
+		event_free(slow);
+	if (later)
+		event_free(later);
+}
+
+static void
+test_event_base_watch_slow_callbacks(void *ptr)
+{
+	struct basic_test_data *data = ptr;
+	struct event_base *base = data->base;
+	struct event_slow_callback cbs[EVENT_SLOW_CALLBACK_RING_SIZE + 1];
+	struct event *fast = NULL, *slow = NULL;
+	struct timeval msec = { 0, 1000 }, zero = { 0, 0 };
+	unsigned cursor = 0;
+	int i;
+
+	tt_int_op(event_base_get_slow_callbacks(base, cbs, 4, &cursor), ==, 0);
+	tt_int_op(event_base_watch_slow_callbacks(base, &msec, 0), ==, -1);
+	tt_int_op(event_base_watch_slow_callbacks(base, &msec, 1), ==, 0);
+
+	fast = evtimer_new(base, null_cb, NULL);
+	slow = event_new(base, data->pair[0], EV_READ, stats_slow_cb, fast);
+	tt_assert(fast && slow);
+
+	/* Only the slow one is recorded */
+	event_active(fast, EV_TIMEOUT, 1);
+	event_active(slow, EV_READ, 1);
+	event_base_loop(base, EVLOOP_NONBLOCK);
+	tt_int_op(event_base_get_slow_callbacks(base, cbs, 4, &cursor), ==, 1);
+	tt_int_op(cursor, ==, 1);
+	tt_assert(cbs[0].callback == (void (*)(void))stats_slow_cb);
+	tt_ptr_op(cbs[0].arg, ==, fast);
+	tt_int_op(cbs[0].fd, ==, data->pair[0]);
+	tt_int_op(cbs[0].events, ==, EV_READ);
+	tt_int_op(cbs[0].seq, ==, 0);
+	tt_assert(cbs[0].usec >= 1000);
+	tt_assert(cbs[0].when.tv_sec > 0);
+	tt_int_op(event_base_get_slow_callbacks(base, cbs, 4, &cursor), ==, 0);
+
+	/* Record everything, and overflow the ring: the oldest are lost */
+	tt_int_op(event_base_watch_slow_callbacks(base, &zero, 1), ==, 0);
+	for (i = 0; i < EVENT_SLOW_CALLBACK_RING_SIZE + 10; ++i) {
+		event_active(fast, EV_TIMEOUT, 1);
+		event_base_loop(base, EVLOOP_NONBLOCK);
+	}
+	tt_int_op(event_base_get_slow_callbacks(base, cbs,
+		EVENT_SLOW_CALLBACK_RING_SIZE + 1, &cursor),
+	    ==, EVENT_SLOW_CALLBACK_RING_SIZE);
+	tt_int_op(cbs[0].seq, ==, 11);
+	tt_int_op(cbs[EVENT_SLOW_CALLBACK_RING_SIZE - 1].seq, ==,
+	    EVENT_SLOW_CALLBACK_RING_SIZE + 10);
+	tt_assert(cbs[0].callback == (void (*)(void))null_cb);
+	tt_int_op(cbs[0].fd, ==, -1);
+	tt_int_op(cbs[0].events, ==, EV_TIMEOUT);
+
+	/* Sampling: only every fourth callback is timed */
+	tt_int_op(event_base_watch_slow_callbacks(base, &zero, 4), ==, 0);
+	for (i = 0; i < 8; ++i) {
+		event_active(fast, EV_TIMEOUT, 1);
+		event_base_loop(base, EVLOOP_NONBLOCK);
+	}
+	tt_int_op(event_base_get_slow_callbacks(base, cbs, 4, &cursor), ==, 2);
+
+	/* And off */
+	tt_int_op(event_base_watch_slow_callbacks(base, NULL, 0), ==, 0);
+	event_active(fast, EV_TIMEOUT, 1);
+	event_base_loop(base, EVLOOP_NONBLOCK);
+	tt_int_op(event_base_get_slow_callbacks(base, cbs, 4, &cursor), ==, 0);
+
+end:
+	if (fast)
+		event_free(fast);
+	if (slow)
+		event_free(slow);
+}
+
+static void
+trace_read_cb(struct bufferevent *bev, void *arg)
+{
+	evbuffer_drain(bufferevent_get_input(bev),
+	    evbuffer_get_length(bufferevent_get_input(bev)));
+}
+
+static void
+test_event_base_trace(void *ptr)
+{
+	struct basic_test_data *data = ptr;
+	struct event_base *base = data->base;
+	struct bufferevent *pair[2] = { NULL, NULL };
+	struct event *ev = NULL;
+	FILE *f = NULL;
+	char buf[8192];
+	size_t len;
+	int i;
+
+	tt_int_op(event_base_trace_start(base, -1), ==, -1);
+	tt_int_op(event_base_trace_start(base, 0), ==, 0);
+
+	ev = evtimer_new(base, null_cb, NULL);
+	tt_assert(ev);
+	tt_int_op(bufferevent_pair_new(base, BEV_OPT_DEFER_CALLBACKS, pair),
+	    ==, 0);
+	bufferevent_setcb(pair[1], trace_read_cb, NULL, NULL, NULL);
+	bufferevent_enable(pair[1], EV_READ);
+	bufferevent_write(pair[0], "hello", 5);
+	event_active(ev, EV_TIMEOUT, 1);
+	event_base_loop(base, EVLOOP_NONBLOCK);
+	event_base_trace_stop(base);
+	/* Not recorded */
+	event_active(ev, EV_TIMEOUT, 1);
+	event_base_loop(base, EVLOOP_NONBLOCK);
+
+	f = tmpfile();
+	tt_assert(f);
+	tt_int_op(event_base_trace_dump(base, f), >=, 4);
+	rewind(f);
+	len = fread(buf, 1, sizeof(buf) - 1, f);
+	buf[len] = '\0';
+	tt_assert(!strncmp(buf, "{\"traceEvents\":[", 16));
+	tt_assert(strstr(buf, "\"name\":\"poll\""));
+	tt_assert(strstr(buf, "\"name\":\"timeouts\""));
+	tt_assert(strstr(buf, "\"name\":\"callback\""));
+	tt_assert(strstr(buf, "\"name\":\"bufferevent read\""));
+	tt_assert(strstr(buf, "\"events\":1,"));
+	fclose(f);
+	f = NULL;
+
+	/* A small trace keeps only the latest records */
+	tt_int_op(event_base_trace_start(base, 4), ==, 0);
+	for (i = 0; i < 10; ++i) {
+		event_active(ev, EV_TIMEOUT, 1);
+		event_base_loop(base, EVLOOP_NONBLOCK);
+	}
+	f = tmpfile();
+	tt_assert(f);
+	tt_int_op(event_base_trace_dump(base, f), ==, 4);
+
+end:
+	if (f)
+		fclose(f);
+	if (ev)
+		event_free(ev);
+	if (pair[0])
+		bufferevent_free(pair[0]);
+	if (pair[1])
+		bufferevent_free(pair[1]);
+}
+
+static struct event *slack_ev[3];
+static int slack_order[3];
+static int slack_n;
+
+static ev_uint64_t
+slack_get_deadline(const struct event *ev)
+{
+	return (ev_uint64_t)ev->ev_timeout.tv_sec * 1000000 +
+	    ev->ev_timeout.tv_usec;
+}
+
+static void
+slack_cb(evutil_socket_t fd, short what, void *arg)
+{
+	if (slack_n < 3)
+		slack_order[slack_n++] = (int)(ev_intptr_t)arg;
+}
+
+/* Adds the timers from a callback, where the time is cached, so that we
+ * know exactly when they were added relative to each other */
+static void
+slack_setup_cb(evutil_socket_t fd, short what, void *arg)
+{
+	struct timeval tv = { 0, 500 };
+	ev_uint64_t now;
+
+	event_add(slack_ev[1], &tv);
+	now = slack_get_deadline(slack_ev[1]) - 500;
+	tv.tv_usec = 1000;
+	event_add(slack_ev[0], &tv);
+	/* Later than the first, but within the same 20 msec */
+	tv.tv_usec = (long)(slack_get_deadline(slack_ev[0]) - now - 500);
+	event_add(slack_ev[2], &tv);
+}
+
+static void
+test_event_config_set_timer_slack(void *ptr)
+{
+	struct event_config *cfg = NULL;
+	struct event_base *base = NULL;
+	struct timeval tv = { 0, 20000 }, bad = { 0, 1000000 };
+	int i, n_before;
+	ev_uint64_t deadline[3];
+
+	cfg = event_config_new();
+	tt_assert(cfg);
+	tt_int_op(event_config_set_timer_slack(cfg, &bad), ==, -1);
+	tt_int_op(event_config_set_timer_slack(cfg, &tv), ==, 0);
+	event_config_set_flag(cfg, EVENT_BASE_FLAG_PRECISE_TIMER);
+	base = event_base_new_with_config(cfg);
+	tt_assert(base);
+
+	for (i = 0; i < 3; ++i) {
+		slack_ev[i] = event_new(base, -1, i == 1 ? EV_PRECISE : 0,
+		    slack_cb, (void *)(ev_intptr_t)i);
+		tt_assert(slack_ev[i]);
+	}
+	tt_int_op(event_base_once(base, -1, EV_TIMEOUT, slack_setup_cb, NULL,
+		NULL), ==, 0);
+	tt_int_op(event_base_loop(base, EVLOOP_NONBLOCK), ==, 0);
+	for (i = 0; i < 3; ++i)
+		deadline[i] = slack_get_deadline(slack_ev[i]);
+
+	/* The others share a deadline on a 20 msec boundary; the precise
+	 * one keeps its own, before theirs */
+	tt_int_op(deadline[0] % 20000, ==, 0);
+	tt_assert(deadline[0] == deadline[2]);
+	tt_assert(deadline[1] < deadline[0]);
+
+	/* ... and so they expire in the same loop iteration */
+	while (slack_n < 3) {
+		n_before = slack_n;
+		tt_int_op(event_base_loop(base, EVLOOP_ONCE), ==, 0);
+		if (slack_n > n_before && slack_order[n_before] != 1)
+			tt_int_op(slack_n - n_before, ==, 2);
+	}
+	tt_int_op(slack_order[0], ==, 1);
+
+end:
+	for (i = 0; i < 3; ++i)
+		if (slack_ev[i])
+			event_free(slack_ev[i]);
+	if (base)
+		event_base_free(base);
+	if (cfg)
+		event_config_free(cfg);
+}
+
+static void
+slack_common_cb(evutil_socket_t fd, short what, void *arg)
+{
+	*(int *)arg = 1;
+}
+
+static void
+test_event_config_set_timer_slack_common(void *ptr)
+{
+	struct event_config *cfg = NULL;
+	struct event_base *base = NULL;
+	struct event *ev = NULL, *guard = NULL;
+	struct timeval slack = { 100, 0 }, msec10 = { 0, 10000 };
+	struct timeval limit = { 5, 0 }, start, end, elapsed;
+	const struct timeval *common;
+	int fired = 0, timed_out = 0;
+
+	cfg = event_config_new();
+	tt_assert(cfg);
+	tt_int_op(event_config_set_timer_slack(cfg, &slack), ==, 0);
+	base = event_base_new_with_config(cfg);
+	tt_assert(base);
+
+	/* A common timeout is not rounded up to the slack */
+	common = event_base_init_common_timeout(base, &msec10);
+	tt_assert(common);
+	ev = evtimer_new(base, slack_common_cb, &fired);
+	guard = event_new(base, -1, EV_PRECISE, slack_common_cb, &timed_out);
+	tt_assert(ev);
+	tt_assert(guard);
+	event_add(guard, &limit);
+	evutil_gettimeofday(&start, NULL);
+	event_add(ev, common);
+	tt_int_op(event_base_loop(base, EVLOOP_ONCE), ==, 0);
+	evutil_gettimeofday(&end, NULL);
+	evutil_timersub(&end, &start, &elapsed);
+	tt_int_op(fired, ==, 1);
+	tt_int_op(timed_out, ==, 0);
+	tt_int_op(elapsed.tv_sec, <, 2);
+
+end:
+	if (ev)
+		event_free(ev);
+	if (guard)
+		event_free(guard);
+	if (base)
+		event_base_free(base);
+	if (cfg)
+		event_config_free(cfg);
+}
+
+#if defined(EVENT__HAVE_UCONTEXT_H) && defined(EVENT__HAVE_MAKECONTEXT) && \
+    !defined(__APPLE__)
+struct task_test_state {
+	evutil_socket_t fd[2];
+	struct bufferevent *bev[2];
+	int log[8];
+	int n_log;
+	ev_ssize_t got;
+	struct evtask *seen[2];
+	struct event_base *base;
+};
+
+/* Note a result once we have it: the task may have been suspended while
+ * computing it, and others may have logged in the meantime. */
+static void
+task_log(struct task_test_state *st, int result)
+{
+	st->log[st->n_log++] = result;
+}
+
+static void
+task_fd_reader(struct evtask *task, void *arg)
+{
+	struct task_test_state *st = arg;
+	struct timeval tv = { 0, 20000 };
+	char c;
+
+	task_log(st, evtask_await_read(task, st->fd[1], &tv));
+	task_log(st, evtask_await_read(task, st->fd[1], NULL));
+	task_log(st, (int)recv(st->fd[1], &c, 1, 0));
+}
+
+static void
+task_fd_writer(struct evtask *task, void *arg)
+{
+	struct task_test_state *st = arg;
+	struct timeval tv = { 0, 50000 };
+
+	task_log(st, evtask_sleep(task, &tv));
+	task_log(st, (int)send(st->fd[0], "x", 1, 0));
+}
+
+static void
+task_bev_reader(struct evtask *task, void *arg)
+{
+	struct task_test_state *st = arg;
+	struct timeval tv = { 0, 20000 };
+
+	st->got = evtask_await_bufferevent_read(task, st->bev[1], 10, NULL);
+	/* Nothing more is coming */
+	task_log(st, (int)evtask_await_bufferevent_read(task,
+	    st->bev[1], 11, &tv));
+}
+
+static void
+task_bev_writer(struct evtask *task, void *arg)
+{
+	struct task_test_state *st = arg;
+
+	bufferevent_write(st->bev[0], "hello", 5);
+	task_log(st, evtask_yield(task));
+	bufferevent_write(st->bev[0], "world", 5);
+}
+
+static void
+task_note_self(struct evtask *task, void *arg)
+{
+	struct task_test_state *st = arg;
+
+	st->seen[st->seen[0] != NULL] = task;
+	st->base = evtask_get_base(task);
+}
+
+static void
+task_wait_forever(struct evtask *task, void *arg)
+{
+	struct task_test_state *st = arg;
+
+	evtask_await_read(task, st->fd[1], NULL);
+	task_log(st, -100);
+}
+
+static void
+test_evtask(void *ptr)
+{
+	struct basic_test_data *data = ptr;
+	struct event_base *base = data->base;
+	struct task_test_state st;
+
+	memset(&st, 0, sizeof(st));
+	st.fd[0] = data->pair[0];
+	st.fd[1] = data->pair[1];
+
+	tt_int_op(evtask_set_stacks(base, 1024, 4), ==, -1);
+	tt_int_op(evtask_set_stacks(base, 32 * 1024, -1), ==, -1);
+
+	/* Waiting on an fd, with and without a timeout, and sleeping */
+	tt_int_op(evtask_spawn(base, task_fd_reader, &st), ==, 0);
+	tt_int_op(evtask_spawn(base, task_fd_writer, &st), ==, 0);
+	tt_int_op(st.n_log, ==, 0);
+	event_base_dispatch(base);
+	tt_int_op(st.n_log, ==, 5);
+	tt_int_op(st.log[0], ==, EV_TIMEOUT);
+	tt_int_op(st.log[1], ==, 0);
+	tt_int_op(st.log[2], ==, 1);
+	tt_int_op(st.log[3], ==, EV_READ);
+	tt_int_op(st.log[4], ==, 1);
+
+	/* Waiting on a bufferevent until it has enough input */
+	st.n_log = 0;
+	tt_int_op(bufferevent_pair_new(base, BEV_OPT_DEFER_CALLBACKS, st.bev),
+	    ==, 0);
+	tt_int_op(evtask_spawn(base, task_bev_reader, &st), ==, 0);
+	tt_int_op(evtask_spawn(base, task_bev_writer, &st), ==, 0);
+	event_base_dispatch(base);
+	tt_int_op(st.got, ==, 10);
+	tt_int_op(st.n_log, ==, 2);
+	tt_int_op(st.log[0], ==, 0);
+	tt_int_op(st.log[1], ==, -1);
+	/* The task's callbacks are gone */
+	bufferevent_write(st.bev[0], "!", 1);
+	event_base_dispatch(base);
+	tt_int_op(evbuffer_get_length(bufferevent_get_input(st.bev[1])), ==,
+	    11);
+
+	/* A finished task's stack goes to the next one */
+	tt_int_op(evtask_set_stacks(base, 32 * 1024, 1), ==, 0);
+	tt_int_op(evtask_spawn(base, task_note_self, &st), ==, 0);
+	event_base_dispatch(base);
+	tt_int_op(evtask_spawn(base, task_note_self, &st), ==, 0);
+	event_base_dispatch(base);
+	tt_assert(st.seen[0]);
+	tt_ptr_op(st.seen[0], ==, st.seen[1]);
+	tt_ptr_op(st.base, ==, base);
+
+	/* A task still waiting when the base goes away is just freed */
+	st.n_log = 0;
+	tt_int_op(evtask_spawn(base, task_wait_forever, &st), ==, 0);
+	event_base_loop(base, EVLOOP_ONCE|EVLOOP_NONBLOCK);
+	tt_int_op(st.n_log, ==, 0);
+
+end:
+	if (st.bev[0])
+		bufferevent_free(st.bev[0]);
+	if (st.bev[1])
+		bufferevent_free(st.bev[1]);
+}
+#endif
+
 static void
 test_bad_assign(void *ptr)
 {
@@ -3518,6 +4117,17 @@ struct testcase_t main_testcases[] = {
 	BASIC(event_assign_selfarg, TT_FORK|TT_NEED_BASE),
 	BASIC(event_base_get_num_events, TT_FORK|TT_NEED_BASE),
 	BASIC(event_base_get_max_events, TT_FORK|TT_NEED_BASE),
+	BASIC(event_base_get_batch_sizes, TT_FORK),
+	BASIC(event_base_get_stats, TT_FORK|TT_NEED_BASE),
+	BASIC(event_base_watch_slow_callbacks,
+	    TT_FORK|TT_NEED_BASE|TT_NEED_SOCKETPAIR),
+	BASIC(event_base_trace, TT_FORK|TT_NEED_BASE),
+	BASIC(event_config_set_timer_slack, TT_FORK),
+	BASIC(event_config_set_timer_slack_common, TT_FORK),
+#if defined(EVENT__HAVE_UCONTEXT_H) && defined(EVENT__HAVE_MAKECONTEXT) && \
+    !defined(__APPLE__)
+	BASIC(evtask, TT_FORK|TT_NEED_BASE|TT_NEED_SOCKETPAIR),
+#endif
 	BASIC(evmap_invalid_slots, TT_FORK|TT_NEED_BASE),
 
 	BASIC(bad_assign, TT_FORK|TT_NEED_BASE|TT_NO_LOGS),
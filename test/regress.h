@@ -63,6 +63,8 @@ extern struct evutil_weakrand_state test_weakrand_state;
 
 void regress_threads(void *);
 void test_bufferevent_zlib(void *);
+void test_bufferevent_zlib_pool(void *);
+void test_http_gzip(void *);
 
 /* Helpers to wrap old testcases */
 extern evutil_socket_t pair[2];
@@ -84,6 +84,9 @@
 
 #include "regress.h"
 #include "regress_testutils.h"
+#ifndef EVENT__DISABLE_THREAD_SUPPORT
+#include "regress_thread.h"
+#endif
 
 /*
  * simple bufferevent test
@@ -1389,6 +1392,117 @@ end:
 		bufferevent_free(filter);
 }
 
+struct filter_inplace_test {
+	const unsigned char *first_out;
+	int first_in_matched;
+	int n_in;
+	struct evbuffer *got;
+};
+
+/* mask every byte on the way out */
+static ev_ssize_t
+filter_inplace_mask(unsigned char *data, size_t len,
+    enum bufferevent_flush_mode mode, void *ctx)
+{
+	struct filter_inplace_test *t = ctx;
+	size_t i;
+
+	if (!t->first_out)
+		t->first_out = data;
+	for (i = 0; i < len; ++i)
+		data[i] ^= 0x5a;
+	return len;
+}
+
+/* unmask whole 7-byte frames on the way in */
+static ev_ssize_t
+filter_inplace_unmask(unsigned char *data, size_t len,
+    enum bufferevent_flush_mode mode, void *ctx)
+{
+	struct filter_inplace_test *t = ctx;
+	size_t i, n = len - len % 7;
+
+	if (!t->n_in++ && data == t->first_out)
+		t->first_in_matched = 1;
+	for (i = 0; i < n; ++i)
+		data[i] ^= 0x5a;
+	return n;
+}
+
+static void
+filter_inplace_readcb(struct bufferevent *bev, void *arg)
+{
+	struct filter_inplace_test *t = arg;
+	evbuffer_add_buffer(t->got, bufferevent_get_input(bev));
+}
+
+static void
+test_bufferevent_filter_inplace(void *arg)
+{
+	static const char ref[] = "ABCDEFGHIJKLMN";
+	struct basic_test_data *data = arg;
+	struct filter_inplace_test t;
+	struct bufferevent *pair[2] = { NULL, NULL };
+	struct bufferevent *out = NULL, *in = NULL;
+	struct evbuffer *expect = evbuffer_new();
+	char chunk[7 * 600];
+	size_t i;
+
+	memset(&t, 0, sizeof(t));
+	t.got = evbuffer_new();
+	for (i = 0; i < sizeof(chunk); ++i)
+		chunk[i] = (char)i;
+
+	tt_int_op(bufferevent_pair_new(data->base, 0, pair), ==, 0);
+	out = bufferevent_filter_inplace_new(pair[0], NULL,
+	    filter_inplace_mask, BEV_OPT_CLOSE_ON_FREE, NULL, &t);
+	tt_assert(out);
+	in = bufferevent_filter_inplace_new(pair[1], filter_inplace_unmask,
+	    NULL, BEV_OPT_CLOSE_ON_FREE, NULL, &t);
+	tt_assert(in);
+	bufferevent_setcb(in, filter_inplace_readcb, NULL, NULL, &t);
+	bufferevent_enable(in, EV_READ);
+	bufferevent_enable(out, EV_WRITE);
+
+	/* Whole chains go through both filters without being copied */
+	bufferevent_write(out, chunk, sizeof(chunk));
+	evbuffer_add(expect, chunk, sizeof(chunk));
+	event_base_loop(data->base, EVLOOP_NONBLOCK);
+	tt_assert(t.first_out);
+	tt_assert(t.first_in_matched);
+
+	/* Read-only data gets copied before it is masked */
+	evbuffer_add_reference(bufferevent_get_output(out), ref, 14,
+	    NULL, NULL);
+	evbuffer_add(expect, ref, 14);
+	event_base_loop(data->base, EVLOOP_NONBLOCK);
+	tt_str_op(ref, ==, "ABCDEFGHIJKLMN");
+
+	/* A frame split across two chains gets glued together */
+	bufferevent_write(out, "abc", 3);
+	event_base_loop(data->base, EVLOOP_NONBLOCK);
+	tt_int_op(evbuffer_get_length(t.got), ==, sizeof(chunk) + 14);
+	bufferevent_write(out, "defg", 4);
+	evbuffer_add(expect, "abcdefg", 7);
+	event_base_loop(data->base, EVLOOP_NONBLOCK);
+
+	tt_int_op(evbuffer_get_length(t.got), ==, evbuffer_get_length(expect));
+	tt_assert(!memcmp(evbuffer_pullup(t.got, -1),
+		evbuffer_pullup(expect, -1), evbuffer_get_length(expect)));
+
+end:
+	if (out)
+		bufferevent_free(out);
+	else if (pair[0])
+		bufferevent_free(pair[0]);
+	if (in)
+		bufferevent_free(in);
+	else if (pair[1])
+		bufferevent_free(pair[1]);
+	evbuffer_free(t.got);
+	evbuffer_free(expect);
+}
+
 static void
 read_failed_readcb(struct bufferevent *bev, void *arg)
 {
@@ -1435,6 +1549,295 @@ end:;
 	bufferevent_free(bev);
 }
 
+struct relay_test {
+	struct bufferevent *client;
+	struct bufferevent *server;
+	struct bufferevent *eof_bev;
+	struct evbuffer *to_server;
+	struct evbuffer *to_client;
+	size_t server_got;
+	size_t client_got;
+	short what;
+	int bad_data;
+};
+
+static void
+relay_test_fill(struct evbuffer *buf, size_t len, char c)
+{
+	char chunk[1024];
+	size_t i;
+
+	for (i = 0; i < sizeof(chunk); ++i)
+		chunk[i] = c + (i % 26);
+	while (len) {
+		size_t n = len < sizeof(chunk) ? len : sizeof(chunk);
+		evbuffer_add(buf, chunk, n);
+		len -= n;
+	}
+}
+
+/* Check that what arrived matches what was sent */
+static size_t
+relay_test_check(struct bufferevent *bev, struct evbuffer *expect,
+    int *bad_data)
+{
+	struct evbuffer *input = bufferevent_get_input(bev);
+	size_t len = evbuffer_get_length(input);
+
+	if (len > evbuffer_get_length(expect) ||
+	    memcmp(evbuffer_pullup(input, len), evbuffer_pullup(expect, len),
+		len))
+		*bad_data = 1;
+	evbuffer_drain(input, len);
+	evbuffer_drain(expect, len);
+	return len;
+}
+
+static void
+relay_test_server_readcb(struct bufferevent *bev, void *arg)
+{
+	struct relay_test *t = arg;
+
+	t->server_got += relay_test_check(bev, t->to_server, &t->bad_data);
+	if (!evbuffer_get_length(t->to_server) && !t->client_got) {
+		/* Everything is here; answer */
+		struct evbuffer *reply = evbuffer_new();
+		relay_test_fill(reply, 100000, 'A');
+		bufferevent_write_buffer(bev, reply);
+		evbuffer_free(reply);
+	}
+}
+
+static void
+relay_test_client_readcb(struct bufferevent *bev, void *arg)
+{
+	struct relay_test *t = arg;
+
+	t->client_got += relay_test_check(bev, t->to_client, &t->bad_data);
+	if (!evbuffer_get_length(t->to_client)) {
+		/* Hang up, so that the relay sees EOF */
+		bufferevent_free(t->client);
+		t->client = NULL;
+	}
+}
+
+static void
+relay_test_eventcb(struct bufferevent_relay *relay, struct bufferevent *bev,
+    short what, void *arg)
+{
+	struct relay_test *t = arg;
+
+	t->eof_bev = bev;
+	t->what = what;
+	event_base_loopexit(bufferevent_get_base(bev), NULL);
+}
+
+static void
+test_bufferevent_relay(void *arg)
+{
+	struct basic_test_data *data = arg;
+	struct relay_test t;
+	struct bufferevent *a = NULL, *b = NULL;
+	struct bufferevent_relay *relay = NULL;
+	evutil_socket_t pair1[2] = { -1, -1 }, pair2[2] = { -1, -1 };
+	int no_splice = data->setup_data &&
+	    !strcmp(data->setup_data, "no_splice");
+	struct timeval tv = { 10, 0 };
+
+	memset(&t, 0, sizeof(t));
+	t.to_server = evbuffer_new();
+	t.to_client = evbuffer_new();
+
+	tt_int_op(evutil_socketpair(AF_UNIX, SOCK_STREAM, 0, pair1), ==, 0);
+	tt_int_op(evutil_socketpair(AF_UNIX, SOCK_STREAM, 0, pair2), ==, 0);
+
+	/* client <-> a ... relay ... b <-> server */
+	t.client = bufferevent_socket_new(data->base, pair1[0],
+	    BEV_OPT_CLOSE_ON_FREE);
+	a = bufferevent_socket_new(data->base, pair1[1], BEV_OPT_CLOSE_ON_FREE);
+	b = bufferevent_socket_new(data->base, pair2[0], BEV_OPT_CLOSE_ON_FREE);
+	t.server = bufferevent_socket_new(data->base, pair2[1],
+	    BEV_OPT_CLOSE_ON_FREE);
+	pair1[0] = pair1[1] = pair2[0] = pair2[1] = -1;
+	tt_assert(t.client && a && b && t.server);
+	bufferevent_setcb(t.client, relay_test_client_readcb, NULL, NULL, &t);
+	bufferevent_setcb(t.server, relay_test_server_readcb, NULL, NULL, &t);
+	bufferevent_enable(t.client, EV_READ);
+	bufferevent_enable(t.server, EV_READ);
+
+	/* Some data that a has read already */
+	bufferevent_write(t.client, "early", 5);
+	evbuffer_add(t.to_server, "early", 5);
+	bufferevent_enable(a, EV_READ);
+	while (evbuffer_get_length(bufferevent_get_input(a)) < 5)
+		event_base_loop(data->base, EVLOOP_ONCE);
+
+	tt_assert(!bufferevent_relay_new(a, a, 0, relay_test_eventcb, &t));
+	relay = bufferevent_relay_new(a, b,
+	    no_splice ? BEV_RELAY_NO_SPLICE : 0, relay_test_eventcb, &t);
+	tt_assert(relay);
+#ifdef EVENT__HAVE_SPLICE
+	tt_int_op(bufferevent_relay_is_spliced(relay), ==, !no_splice);
+#else
+	tt_int_op(bufferevent_relay_is_spliced(relay), ==, 0);
+#endif
+
+	relay_test_fill(t.to_server, 300000, 'a');
+	bufferevent_write(t.client, evbuffer_pullup(t.to_server, -1) + 5,
+	    300000);
+	relay_test_fill(t.to_client, 100000, 'A');
+
+	event_base_loopexit(data->base, &tv);
+	event_base_dispatch(data->base);
+
+	tt_assert(!t.bad_data);
+	tt_int_op(t.server_got, ==, 300005);
+	tt_int_op(t.client_got, ==, 100000);
+	tt_ptr_op(t.eof_bev, ==, a);
+	tt_int_op(t.what, ==, BEV_EVENT_EOF|BEV_EVENT_READING);
+	tt_int_op(bufferevent_relay_get_relayed(relay, a), ==, 300005);
+	tt_int_op(bufferevent_relay_get_relayed(relay, b), ==, 100000);
+
+end:
+	if (relay)
+		bufferevent_relay_free(relay);
+	if (a)
+		bufferevent_free(a);
+	if (b)
+		bufferevent_free(b);
+	if (t.client)
+		bufferevent_free(t.client);
+	if (t.server)
+		bufferevent_free(t.server);
+	evbuffer_free(t.to_server);
+	evbuffer_free(t.to_client);
+	if (pair1[0] >= 0)
+		evutil_closesocket(pair1[0]);
+	if (pair1[1] >= 0)
+		evutil_closesocket(pair1[1]);
+	if (pair2[0] >= 0)
+		evutil_closesocket(pair2[0]);
+	if (pair2[1] >= 0)
+		evutil_closesocket(pair2[1]);
+}
+
+#ifndef EVENT__DISABLE_THREAD_SUPPORT
+struct pair_cross_test {
+	struct event_base *worker_base;
+	struct evbuffer *expect;
+	size_t got;
+	int bad_data;
+	int worker_eof;
+};
+
+static void
+pair_cross_echo_readcb(struct bufferevent *bev, void *arg)
+{
+	bufferevent_write_buffer(bev, bufferevent_get_input(bev));
+}
+
+static void
+pair_cross_echo_eventcb(struct bufferevent *bev, short what, void *arg)
+{
+	struct pair_cross_test *t = arg;
+
+	if (what == (BEV_EVENT_EOF|BEV_EVENT_READING))
+		t->worker_eof = 1;
+	bufferevent_free(bev);
+	event_base_loopbreak(t->worker_base);
+}
+
+static void
+pair_cross_readcb(struct bufferevent *bev, void *arg)
+{
+	struct pair_cross_test *t = arg;
+	struct evbuffer *input = bufferevent_get_input(bev);
+	size_t len = evbuffer_get_length(input);
+
+	if (len > evbuffer_get_length(t->expect) ||
+	    memcmp(evbuffer_pullup(input, len),
+		evbuffer_pullup(t->expect, len), len))
+		t->bad_data = 1;
+	evbuffer_drain(input, len);
+	evbuffer_drain(t->expect, len);
+	t->got += len;
+	if (!evbuffer_get_length(t->expect))
+		event_base_loopexit(bufferevent_get_base(bev), NULL);
+}
+
+static THREAD_FN
+pair_cross_worker(void *arg)
+{
+	event_base_loop(arg, EVLOOP_NO_EXIT_ON_EMPTY);
+	THREAD_RETURN();
+}
+
+static void
+test_bufferevent_pair_cross(void *arg)
+{
+	struct basic_test_data *data = arg;
+	struct pair_cross_test t;
+	struct bufferevent *pair[2] = { NULL, NULL };
+	struct timeval tv = { 10, 0 };
+	THREAD_T thread;
+	char chunk[1000];
+	int i, started = 0;
+
+	memset(&t, 0, sizeof(t));
+	t.expect = evbuffer_new();
+	t.worker_base = event_base_new();
+	tt_assert(t.worker_base);
+
+	tt_int_op(bufferevent_pair_new_cross(data->base, t.worker_base, 0,
+		pair), ==, 0);
+	tt_ptr_op(bufferevent_pair_get_partner(pair[0]), ==, pair[1]);
+	tt_ptr_op(bufferevent_pair_get_partner(pair[1]), ==, pair[0]);
+
+	bufferevent_setcb(pair[0], pair_cross_readcb, NULL, NULL, &t);
+	bufferevent_setcb(pair[1], pair_cross_echo_readcb, NULL,
+	    pair_cross_echo_eventcb, &t);
+	/* Make the worker take its input a bit at a time */
+	bufferevent_setwatermark(pair[1], EV_READ, 0, 8192);
+	bufferevent_enable(pair[0], EV_READ|EV_WRITE);
+	bufferevent_enable(pair[1], EV_READ|EV_WRITE);
+
+	/* Many small writes: far more than the queue between them holds */
+	for (i = 0; i < 1000; ++i) {
+		memset(chunk, 'a' + i % 26, sizeof(chunk));
+		evbuffer_add(t.expect, chunk, sizeof(chunk));
+		bufferevent_write(pair[0], chunk, sizeof(chunk));
+	}
+
+	THREAD_START(thread, pair_cross_worker, t.worker_base);
+	started = 1;
+
+	event_base_loopexit(data->base, &tv);
+	event_base_dispatch(data->base);
+	tt_int_op(t.got, ==, 1000 * sizeof(chunk));
+	tt_assert(!t.bad_data);
+
+	/* The worker sees EOF and frees its end */
+	bufferevent_free(pair[0]);
+	pair[0] = NULL;
+	THREAD_JOIN(thread);
+	started = 0;
+	tt_assert(t.worker_eof);
+
+end:
+	if (started) {
+		event_base_loopbreak(t.worker_base);
+		THREAD_JOIN(thread);
+	}
+	if (pair[0])
+		bufferevent_free(pair[0]);
+	/* Run the finalizers of the main end */
+	event_base_loop(data->base, EVLOOP_NONBLOCK);
+	if (t.worker_base)
+		event_base_free(t.worker_base);
+	evbuffer_free(t.expect);
+}
+#endif
+
 struct testcase_t bufferevent_testcases[] = {
 
 	LEGACY(bufferevent, TT_ISOLATED),
@@ -1490,8 +1893,11 @@ struct testcase_t bufferevent_testcases[] = {
 	  (void*)"defer postpone" },
 #ifdef EVENT__HAVE_LIBZ
 	LEGACY(bufferevent_zlib, TT_ISOLATED),
+	{ "bufferevent_zlib_pool", test_bufferevent_zlib_pool,
+	  TT_FORK|TT_NEED_BASE, &basic_setup, NULL },
 #else
 	{ "bufferevent_zlib", NULL, TT_SKIP, NULL, NULL },
+	{ "bufferevent_zlib_pool", NULL, TT_SKIP, NULL, NULL },
 #endif
 
 	{ "bufferevent_connect_fail_eventcb_defer",
@@ -1510,9 +1916,20 @@ struct testcase_t bufferevent_testcases[] = {
 	{ "bufferevent_filter_data_stuck",
 	  test_bufferevent_filter_data_stuck,
 	  TT_FORK|TT_NEED_BASE, &basic_setup, NULL },
+	{ "bufferevent_filter_inplace",
+	  test_bufferevent_filter_inplace,
+	  TT_FORK|TT_NEED_BASE, &basic_setup, NULL },
 	{ "bufferevent_read_failed",
 	  test_bufferevent_read_failed,
 	  TT_FORK|TT_NEED_SOCKETPAIR|TT_NEED_BASE, &basic_setup, NULL },
+#ifndef EVENT__DISABLE_THREAD_SUPPORT
+	{ "bufferevent_pair_cross", test_bufferevent_pair_cross,
+	  TT_FORK|TT_NEED_BASE|TT_NEED_THREADS, &basic_setup, NULL },
+#endif
+	{ "bufferevent_relay", test_bufferevent_relay,
+	  TT_FORK|TT_NEED_BASE, &basic_setup, NULL },
+	{ "bufferevent_relay_no_splice", test_bufferevent_relay,
+	  TT_FORK|TT_NEED_BASE, &basic_setup, (void*)"no_splice" },
 
 	LEGACY(bufferevent_ratelimit_div_by_zero, TT_ISOLATED),
 	LEGACY(bufferevent_ratelimit_overflow, TT_ISOLATED),
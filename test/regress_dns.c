@@ -75,6 +75,7 @@
 #include "event2/util.h"
 #include "event2/listener.h"
 #include "event2/bufferevent.h"
+#include "event2/buffer.h"
 #include <event2/thread.h>
 #include "log-internal.h"
 #include "evthread-internal.h"
@@ -562,6 +563,7 @@ static struct regress_dns_server_table search_table[] = {
 	{ "hostn.b.example.com", "errsoa", "3", 0, 0 },
 	{ "hostn.c.example.com", "err", "0", 0, 0 },
 	{ "hostc.c.example.com", "CNAME", "cname.c.example.com", 0, 0 },
+	{ "servfail.example.com", "err", "2", 0, 0 },
 	{ "host", "err", "3", 0, 0 },
 	{ "host2", "err", "3", 0, 0 },
 	{ "*", "err", "3", 0, 0 },
@@ -1457,6 +1459,44 @@ be_getaddrinfo_server_cb(struct evdns_server_request *req, void *data)
 				evdns_server_request_drop(req);
 				return;
 			}
+		} else if (!evutil_ascii_strcasecmp(qname,
+			"refused-first.example.com")) {
+			if (qtype == EVDNS_TYPE_A) {
+				/* Nobody listens on 127.0.0.2; only the second
+				 * address will accept the connection. */
+				ev_uint32_t addrs[2];
+				addrs[0] = htonl(0x7f000002);
+				addrs[1] = htonl(0x7f000001);
+				evdns_server_request_add_a_reply(req, qname,
+				    2, addrs, 2000);
+				added_any = 1;
+			}
+		} else if (!evutil_ascii_strcasecmp(qname,
+			"dualstack.example.com")) {
+			if (qtype == EVDNS_TYPE_A) {
+				ans.s_addr = htonl(0x7f000001);
+				evdns_server_request_add_a_reply(req, qname,
+				    1, &ans.s_addr, 2000);
+				added_any = 1;
+			} else if (qtype == EVDNS_TYPE_AAAA) {
+				/* ::1, where nobody is listening. */
+				ans6.s6_addr[15] = 1;
+				evdns_server_request_add_aaaa_reply(req, qname,
+				    1, &ans6.s6_addr, 2000);
+				added_any = 1;
+			}
+		} else if (!evutil_ascii_strcasecmp(qname,
+			"v6drop.example.com")) {
+			if (qtype == EVDNS_TYPE_A) {
+				ans.s_addr = htonl(0x7f000001);
+				evdns_server_request_add_a_reply(req, qname,
+				    1, &ans.s_addr, 2000);
+				added_any = 1;
+			} else if (qtype == EVDNS_TYPE_AAAA) {
+				/* Never answer the AAAA request. */
+				evdns_server_request_drop(req);
+				return;
+			}
 		} else if (!evutil_ascii_strcasecmp(qname,
 			"all-timeout.example.com")) {
 			/* drop all requests */
@@ -1694,6 +1734,115 @@ end:
 	}
 }
 
+/* Bufferevent event callback for the connect_hostname_race test. */
+static void
+be_connect_race_event_cb(struct bufferevent *bev, short what, void *ctx)
+{
+	struct be_conn_hostname_result *got = ctx;
+
+	if (got->what) {
+		TT_FAIL(("Two events on one bufferevent. %d,%d",
+			got->what, (int)what));
+	}
+	got->what = what;
+	got->dnserr = bufferevent_socket_get_dns_error(bev);
+	if (++total_connected_or_failed == 3)
+		event_base_loopexit(be_connect_hostname_base, NULL);
+}
+
+static void
+test_bufferevent_connect_hostname_race(void *arg)
+{
+	struct basic_test_data *data = arg;
+	static const char *hosts[] = {
+		"refused-first.example.com",
+		"dualstack.example.com",
+		"v6drop.example.com",
+	};
+	struct bufferevent *be[3] = { NULL, NULL, NULL };
+	struct be_conn_hostname_result be_outcome[ARRAY_SIZE(be)];
+	struct evconnlistener *listener = NULL;
+	struct evdns_base *dns = NULL;
+	struct evdns_server_port *port = NULL;
+	struct sockaddr_in sin;
+	struct timeval tv = { 2, 0 };
+	int listener_port = -1;
+	ev_uint16_t dns_port = 0;
+	int n_accept = 0, n_dns = 0;
+	char buf[128];
+	unsigned i;
+
+	be_connect_hostname_base = data->base;
+	total_connected_or_failed = 0;
+
+	memset(&sin, 0, sizeof(sin));
+	sin.sin_family = AF_INET;
+	sin.sin_addr.s_addr = htonl(0x7f000001); /* 127.0.0.1 */
+	sin.sin_port = 0;
+	listener = evconnlistener_new_bind(data->base, nil_accept_cb,
+	    &n_accept,
+	    LEV_OPT_REUSEABLE|LEV_OPT_CLOSE_ON_EXEC,
+	    -1, (struct sockaddr *)&sin, sizeof(sin));
+	tt_assert(listener);
+	listener_port = regress_get_socket_port(
+		evconnlistener_get_fd(listener));
+
+	port = regress_get_udp_dnsserver(data->base, &dns_port, NULL,
+	    be_getaddrinfo_server_cb, &n_dns);
+	tt_assert(port);
+
+	dns = evdns_base_new(data->base, 0);
+	tt_assert(dns);
+	evutil_snprintf(buf, sizeof(buf), "127.0.0.1:%d", (int)dns_port);
+	evdns_base_nameserver_ip_add(dns, buf);
+	/* The dropped AAAA request must not hold up the connection. */
+	tt_assert(!evdns_base_set_option(dns, "timeout", "10"));
+	tt_assert(!evdns_base_set_option(dns, "getaddrinfo-allow-skew", "10"));
+
+	for (i = 0; i < ARRAY_SIZE(be); ++i) {
+		memset(&be_outcome[i], 0, sizeof(be_outcome[i]));
+		be[i] = bufferevent_socket_new(data->base, -1,
+		    BEV_OPT_CLOSE_ON_FREE);
+		tt_assert(be[i]);
+		bufferevent_setcb(be[i], NULL, NULL, be_connect_race_event_cb,
+		    &be_outcome[i]);
+		tt_assert(!bufferevent_socket_connect_hostname(be[i], dns,
+			AF_UNSPEC, hosts[i], listener_port));
+	}
+
+	event_base_loopexit(data->base, &tv);
+	tt_int_op(event_base_dispatch(data->base), ==, 0);
+
+	for (i = 0; i < ARRAY_SIZE(be); ++i) {
+		struct sockaddr_storage ss;
+		ev_socklen_t socklen = sizeof(ss);
+		struct sockaddr_in *peer = (struct sockaddr_in *)&ss;
+
+		TT_BLATHER(("%s: %d", hosts[i], be_outcome[i].what));
+		tt_int_op(be_outcome[i].what, ==, BEV_EVENT_CONNECTED);
+		tt_int_op(be_outcome[i].dnserr, ==, 0);
+		tt_assert(!getpeername(bufferevent_getfd(be[i]),
+			(struct sockaddr *)&ss, &socklen));
+		tt_int_op(peer->sin_family, ==, AF_INET);
+		tt_int_op(ntohl(peer->sin_addr.s_addr), ==, 0x7f000001);
+		tt_int_op(ntohs(peer->sin_port), ==, listener_port);
+	}
+	/* One A and one AAAA request per hostname. */
+	tt_int_op(n_dns, ==, 6);
+
+end:
+	for (i = 0; i < ARRAY_SIZE(be); ++i) {
+		if (be[i])
+			bufferevent_free(be[i]);
+	}
+	if (listener)
+		evconnlistener_free(listener);
+	if (port)
+		evdns_close_server_port(port);
+	if (dns)
+		evdns_base_free(dns, 0);
+}
+
 struct gai_outcome {
 	int err;
 	struct evutil_addrinfo *ai;
@@ -2761,6 +2910,115 @@ end:
 	regress_clean_dnsserver();
 }
 
+static void
+dns_server_static_cb(struct evdns_server_request *req, void *arg)
+{
+	int *n_callbacks = arg;
+	++*n_callbacks;
+	evdns_server_request_respond(req, DNS_ERR_NOTEXIST);
+}
+
+static void
+test_dns_server_static(void *arg)
+{
+	struct basic_test_data *data = arg;
+	struct event_base *base = data->base;
+	struct evdns_base *dns = NULL;
+	struct evdns_server_port *udp_port = NULL, *tcp_port = NULL;
+	ev_uint16_t portnum = 0;
+	struct generic_dns_callback_result r;
+	ev_uint32_t addrs[100];
+	const char addr6[16] = "abcdefghijklmnop";
+	int n_callbacks = 0;
+	char buf[64];
+	int i;
+
+	exit_base = base;
+
+	udp_port = regress_get_udp_dnsserver(base, &portnum, NULL,
+	    dns_server_static_cb, &n_callbacks);
+	tt_assert(udp_port);
+	tcp_port = regress_get_tcp_dnsserver(base, &portnum, NULL,
+	    dns_server_static_cb, &n_callbacks);
+	tt_assert(tcp_port);
+
+	for (i = 0; i < (int)ARRAY_SIZE(addrs); ++i)
+		addrs[i] = htonl(0x0a000000 + i);
+	tt_assert(!evdns_server_port_add_static_a_reply(udp_port,
+		"Static.Example.COM", 2, addrs, 300));
+	tt_assert(!evdns_server_port_add_static_aaaa_reply(udp_port,
+		"static.example.com", 1, addr6, 400));
+	/* Too big for UDP: the client has to come back over TCP. */
+	tt_assert(!evdns_server_port_add_static_a_reply(udp_port,
+		"big.example.com", ARRAY_SIZE(addrs), addrs, 500));
+	tt_assert(!evdns_server_port_add_static_a_reply(tcp_port,
+		"big.example.com", ARRAY_SIZE(addrs), addrs, 500));
+
+	dns = evdns_base_new(base, 0);
+	tt_assert(dns);
+	evutil_snprintf(buf, sizeof(buf), "127.0.0.1:%d", (int)portnum);
+	tt_assert(!evdns_base_nameserver_ip_add(dns, buf));
+
+	memset(&r, 0, sizeof(r));
+	evdns_base_resolve_ipv4(dns, "static.example.com", 0,
+	    generic_dns_callback, &r);
+	n_replies_left = 1;
+	event_base_dispatch(base);
+	tt_int_op(r.result, ==, DNS_ERR_NONE);
+	tt_int_op(r.type, ==, DNS_IPv4_A);
+	tt_int_op(r.count, ==, 2);
+	tt_int_op(r.ttl, ==, 300);
+	tt_mem_op(r.addrs, ==, addrs, 8);
+
+	memset(&r, 0, sizeof(r));
+	evdns_base_resolve_ipv6(dns, "STATIC.example.com", 0,
+	    generic_dns_callback, &r);
+	n_replies_left = 1;
+	event_base_dispatch(base);
+	tt_int_op(r.result, ==, DNS_ERR_NONE);
+	tt_int_op(r.type, ==, DNS_IPv6_AAAA);
+	tt_int_op(r.count, ==, 1);
+	tt_int_op(r.ttl, ==, 400);
+	tt_mem_op(r.addrs, ==, addr6, 16);
+	tt_int_op(n_callbacks, ==, 0);
+
+	memset(&r, 0, sizeof(r));
+	evdns_base_resolve_ipv4(dns, "big.example.com", 0,
+	    generic_dns_callback, &r);
+	n_replies_left = 1;
+	event_base_dispatch(base);
+	tt_int_op(r.result, ==, DNS_ERR_NONE);
+	tt_int_op(r.count, ==, ARRAY_SIZE(addrs));
+	tt_mem_op(r.addrs, ==, addrs, sizeof(addrs));
+	tt_int_op(n_callbacks, ==, 0);
+
+	/* Anything else still goes to the callback. */
+	memset(&r, 0, sizeof(r));
+	evdns_base_resolve_ipv4(dns, "dynamic.example.com", 0,
+	    generic_dns_callback, &r);
+	n_replies_left = 1;
+	event_base_dispatch(base);
+	tt_int_op(r.result, ==, DNS_ERR_NOTEXIST);
+	tt_int_op(n_callbacks, ==, 1);
+
+	evdns_server_port_clear_static_replies(udp_port);
+	memset(&r, 0, sizeof(r));
+	evdns_base_resolve_ipv4(dns, "static.example.com", 0,
+	    generic_dns_callback, &r);
+	n_replies_left = 1;
+	event_base_dispatch(base);
+	tt_int_op(r.result, ==, DNS_ERR_NOTEXIST);
+	tt_int_op(n_callbacks, ==, 2);
+
+end:
+	if (dns)
+		evdns_base_free(dns, 0);
+	if (udp_port)
+		evdns_close_server_port(udp_port);
+	if (tcp_port)
+		evdns_close_server_port(tcp_port);
+}
+
 static void
 test_tcp_resolve_pipeline(void *arg)
 {
@@ -2842,6 +3100,370 @@ end:
 	regress_clean_dnsserver();
 }
 
+/* A bare-bones DNS-over-TCP server: it answers every query with NXDOMAIN,
+ * but only once 'batch' queries have arrived, and then in reverse order. */
+struct tcp_pipeline_server {
+	int n_accepted;
+	int batch;
+	int drop_first; /* close the first connection instead of answering */
+	int n_queued;
+	struct bufferevent *bev; /* the open connection, if any */
+	ev_uint16_t lens[8];
+	ev_uint8_t queries[8][512];
+};
+
+static void
+tcp_pipeline_server_close(struct tcp_pipeline_server *srv)
+{
+	bufferevent_free(srv->bev);
+	srv->bev = NULL;
+}
+
+static void
+tcp_pipeline_server_event_cb(struct bufferevent *bev, short what, void *arg)
+{
+	if (what & (BEV_EVENT_EOF|BEV_EVENT_ERROR))
+		tcp_pipeline_server_close(arg);
+}
+
+static void
+tcp_pipeline_server_read_cb(struct bufferevent *bev, void *arg)
+{
+	struct tcp_pipeline_server *srv = arg;
+	struct evbuffer *input = bufferevent_get_input(bev);
+	ev_uint16_t len;
+	int i;
+
+	while (evbuffer_get_length(input) >= 2) {
+		evbuffer_copyout(input, &len, 2);
+		len = ntohs(len);
+		if (evbuffer_get_length(input) < 2 + (size_t)len)
+			break;
+		evbuffer_drain(input, 2);
+		if (len > sizeof(srv->queries[0]) ||
+		    srv->n_queued == (int)ARRAY_SIZE(srv->queries)) {
+			TT_FAIL(("unexpected query"));
+			tcp_pipeline_server_close(srv);
+			return;
+		}
+		evbuffer_remove(input, srv->queries[srv->n_queued], len);
+		srv->lens[srv->n_queued++] = len;
+	}
+	if (srv->n_queued < srv->batch)
+		return;
+
+	if (srv->drop_first && srv->n_accepted == 1) {
+		srv->n_queued = 0;
+		tcp_pipeline_server_close(srv);
+		return;
+	}
+	for (i = srv->n_queued - 1; i >= 0; --i) {
+		ev_uint8_t *q = srv->queries[i];
+		len = htons(srv->lens[i]);
+		q[2] |= 0x80; /* QR */
+		q[3] = 0x80 | 3; /* RA, NXDOMAIN */
+		bufferevent_write(bev, &len, 2);
+		bufferevent_write(bev, q, srv->lens[i]);
+	}
+	srv->n_queued = 0;
+	srv->batch = 1;
+}
+
+static void
+tcp_pipeline_server_accept_cb(struct evconnlistener *listener,
+    evutil_socket_t fd, struct sockaddr *addr, int socklen, void *arg)
+{
+	struct tcp_pipeline_server *srv = arg;
+	struct bufferevent *bev = bufferevent_socket_new(
+		evconnlistener_get_base(listener), fd, BEV_OPT_CLOSE_ON_FREE);
+	++srv->n_accepted;
+	srv->n_queued = 0;
+	srv->bev = bev;
+	bufferevent_setcb(bev, tcp_pipeline_server_read_cb, NULL,
+	    tcp_pipeline_server_event_cb, srv);
+	bufferevent_enable(bev, EV_READ);
+}
+
+static void
+test_tcp_connection_reuse(void *arg)
+{
+	struct basic_test_data *data = arg;
+	struct event_base *base = data->base;
+	struct evdns_base *dns = NULL;
+	struct evconnlistener *listener = NULL;
+	struct tcp_pipeline_server srv;
+	struct generic_dns_callback_result r[3];
+	struct sockaddr_in sin;
+	struct timeval start, end, elapsed;
+	char buf[64];
+	int i;
+
+	exit_base = base;
+	memset(&srv, 0, sizeof(srv));
+	memset(&sin, 0, sizeof(sin));
+	sin.sin_family = AF_INET;
+	sin.sin_addr.s_addr = htonl(0x7f000001); /* 127.0.0.1 */
+	listener = evconnlistener_new_bind(base, tcp_pipeline_server_accept_cb,
+	    &srv, LEV_OPT_REUSEABLE|LEV_OPT_CLOSE_ON_FREE,
+	    -1, (struct sockaddr *)&sin, sizeof(sin));
+	tt_assert(listener);
+	evutil_snprintf(buf, sizeof(buf), "127.0.0.1:%d",
+	    regress_get_socket_port(evconnlistener_get_fd(listener)));
+
+	dns = evdns_base_new(base, 0);
+	tt_assert(!evdns_base_nameserver_ip_add(dns, buf));
+	tt_assert(!evdns_base_set_option(dns, "use-vc", NULL));
+	tt_assert(!evdns_base_set_option(dns, "timeout:", "10"));
+
+	/* Three queries share one connection; the first connection is
+	 * closed with all of them outstanding, so they have to be resent at
+	 * once, not after the 10 second timeout. */
+	srv.batch = 3;
+	srv.drop_first = 1;
+	evutil_gettimeofday(&start, NULL);
+	for (i = 0; i < 3; ++i) {
+		tt_assert(evdns_base_resolve_ipv4(dns, "pipelined.example.com",
+			0, generic_dns_callback, &r[i]));
+	}
+	n_replies_left = 3;
+	event_base_dispatch(base);
+	evutil_gettimeofday(&end, NULL);
+	evutil_timersub(&end, &start, &elapsed);
+	for (i = 0; i < 3; ++i)
+		tt_int_op(r[i].result, ==, DNS_ERR_NOTEXIST);
+	tt_int_op(srv.n_accepted, ==, 2);
+	tt_int_op(elapsed.tv_sec, <, 5);
+
+	/* The now idle connection is reused for the next query. */
+	tt_assert(evdns_base_resolve_ipv4(dns, "pipelined.example.com",
+		0, generic_dns_callback, &r[0]));
+	n_replies_left = 1;
+	event_base_dispatch(base);
+	tt_int_op(r[0].result, ==, DNS_ERR_NOTEXIST);
+	tt_int_op(srv.n_accepted, ==, 2);
+
+end:
+	if (dns)
+		evdns_base_free(dns, 0);
+	if (listener)
+		evconnlistener_free(listener);
+	if (srv.bev)
+		bufferevent_free(srv.bev);
+}
+
+/* A nameserver that answers every query with NXDOMAIN, after 'delay'
+ * (or never, if 'drop' is set). */
+struct latency_dns_server {
+	struct event_base *base;
+	struct timeval delay;
+	int drop;
+	int n_queries;
+};
+
+static void
+latency_dns_server_respond_cb(evutil_socket_t fd, short what, void *arg)
+{
+	evdns_server_request_respond(arg, DNS_ERR_NOTEXIST);
+}
+
+static void
+latency_dns_server_cb(struct evdns_server_request *req, void *arg)
+{
+	struct latency_dns_server *srv = arg;
+	++srv->n_queries;
+	if (srv->drop)
+		evdns_server_request_drop(req);
+	else
+		event_base_once(srv->base, -1, EV_TIMEOUT,
+		    latency_dns_server_respond_cb, req, &srv->delay);
+}
+
+static void
+test_select_by_rtt(void *arg)
+{
+	struct basic_test_data *data = arg;
+	struct event_base *base = data->base;
+	struct evdns_base *dns = NULL;
+	struct evdns_server_port *slow_port = NULL, *fast_port = NULL;
+	struct latency_dns_server slow, fast;
+	ev_uint16_t slow_portnum = 0, fast_portnum = 0;
+	struct generic_dns_callback_result r[4];
+	struct timeval start, end, elapsed;
+	char buf[64];
+	int i;
+
+	exit_base = base;
+	memset(&slow, 0, sizeof(slow));
+	memset(&fast, 0, sizeof(fast));
+	slow.base = fast.base = base;
+	slow.delay.tv_usec = 200 * 1000;
+	slow_port = regress_get_udp_dnsserver(base, &slow_portnum, NULL,
+	    latency_dns_server_cb, &slow);
+	tt_assert(slow_port);
+	fast_port = regress_get_udp_dnsserver(base, &fast_portnum, NULL,
+	    latency_dns_server_cb, &fast);
+	tt_assert(fast_port);
+
+	dns = evdns_base_new(base, 0);
+	tt_assert(dns);
+	evutil_snprintf(buf, sizeof(buf), "127.0.0.1:%d", (int)slow_portnum);
+	tt_assert(!evdns_base_nameserver_ip_add(dns, buf));
+	evutil_snprintf(buf, sizeof(buf), "127.0.0.1:%d", (int)fast_portnum);
+	tt_assert(!evdns_base_nameserver_ip_add(dns, buf));
+	tt_assert(!evdns_base_set_option(dns, "select-by-rtt:", "1"));
+
+	/* Both servers get measured first; after that the slow one only
+	 * gets the occasional exploratory query. */
+	for (i = 0; i < 20; ++i) {
+		tt_assert(evdns_base_resolve_ipv4(dns, "rtt.example.com",
+			DNS_QUERY_NO_SEARCH, generic_dns_callback, &r[0]));
+		n_replies_left = 1;
+		event_base_dispatch(base);
+		tt_int_op(r[0].result, ==, DNS_ERR_NOTEXIST);
+	}
+	tt_int_op(slow.n_queries + fast.n_queries, ==, 20);
+	tt_int_op(slow.n_queries, >=, 1);
+	tt_int_op(slow.n_queries, <=, 3);
+	evdns_base_free(dns, 0);
+
+	/* A server that never answers gives no RTT sample, but its timeouts
+	 * make it more expensive than one that does answer. */
+	slow.drop = 1;
+	slow.n_queries = fast.n_queries = 0;
+	dns = evdns_base_new(base, 0);
+	tt_assert(dns);
+	evutil_snprintf(buf, sizeof(buf), "127.0.0.1:%d", (int)slow_portnum);
+	tt_assert(!evdns_base_nameserver_ip_add(dns, buf));
+	evutil_snprintf(buf, sizeof(buf), "127.0.0.1:%d", (int)fast_portnum);
+	tt_assert(!evdns_base_nameserver_ip_add(dns, buf));
+	tt_assert(!evdns_base_set_option(dns, "select-by-rtt:", "1"));
+	tt_assert(!evdns_base_set_option(dns, "timeout:", "0.1"));
+	tt_assert(!evdns_base_set_option(dns, "max-timeouts:", "100"));
+	for (i = 0; i < 10; ++i) {
+		tt_assert(evdns_base_resolve_ipv4(dns, "rtt.example.com",
+			DNS_QUERY_NO_SEARCH, generic_dns_callback, &r[0]));
+		n_replies_left = 1;
+		event_base_dispatch(base);
+		tt_int_op(r[0].result, ==, DNS_ERR_NOTEXIST);
+	}
+	tt_int_op(fast.n_queries, ==, 10);
+	tt_int_op(slow.n_queries, <=, 1);
+	evdns_base_free(dns, 0);
+
+	/* Hedged queries are answered by whichever server is up, even when
+	 * the one they were sent to first never answers. */
+	slow.n_queries = fast.n_queries = 0;
+	dns = evdns_base_new(base, 0);
+	tt_assert(dns);
+	evutil_snprintf(buf, sizeof(buf), "127.0.0.1:%d", (int)slow_portnum);
+	tt_assert(!evdns_base_nameserver_ip_add(dns, buf));
+	evutil_snprintf(buf, sizeof(buf), "127.0.0.1:%d", (int)fast_portnum);
+	tt_assert(!evdns_base_nameserver_ip_add(dns, buf));
+	tt_assert(!evdns_base_set_option(dns, "timeout:", "3"));
+	evutil_gettimeofday(&start, NULL);
+	for (i = 0; i < 4; ++i) {
+		tt_assert(evdns_base_resolve_ipv4(dns, "hedge.example.com",
+			DNS_QUERY_NO_SEARCH|DNS_QUERY_HEDGE,
+			generic_dns_callback, &r[i]));
+	}
+	n_replies_left = 4;
+	event_base_dispatch(base);
+	evutil_gettimeofday(&end, NULL);
+	evutil_timersub(&end, &start, &elapsed);
+	for (i = 0; i < 4; ++i)
+		tt_int_op(r[i].result, ==, DNS_ERR_NOTEXIST);
+	tt_int_op(slow.n_queries, ==, 4);
+	tt_int_op(fast.n_queries, ==, 4);
+	tt_int_op(elapsed.tv_sec, <, 2);
+
+end:
+	if (dns)
+		evdns_base_free(dns, 0);
+	if (slow_port)
+		evdns_close_server_port(slow_port);
+	if (fast_port)
+		evdns_close_server_port(fast_port);
+}
+
+static void
+test_dns_stats(void *arg)
+{
+	struct basic_test_data *data = arg;
+	struct event_base *base = data->base;
+	struct evdns_base *dns = NULL;
+	struct evdns_stats stats, ns_stats;
+	struct generic_dns_callback_result r;
+	ev_uint16_t portnum = 0;
+	ev_uint64_t n_rtts = 0;
+	char buf[64];
+	int i, srtt;
+
+	exit_base = base;
+	tt_assert(regress_dnsserver(base, &portnum, search_table, tcp_search_table));
+	evutil_snprintf(buf, sizeof(buf), "127.0.0.1:%d", (int)portnum);
+	dns = evdns_base_new(base, 0);
+	tt_assert(!evdns_base_nameserver_ip_add(dns, buf));
+	tt_assert(!evdns_base_set_option(dns, "timeout:", "0.3"));
+	tt_assert(!evdns_base_set_option(dns, "attempts:", "2"));
+
+	tt_assert(!evdns_base_get_stats(dns, &stats));
+	tt_int_op(stats.queries_sent, ==, 0);
+
+	/* answered over UDP */
+	evdns_base_resolve_ipv4(dns, "small.a.example.com",
+	    DNS_QUERY_NO_SEARCH, generic_dns_callback, &r);
+	/* truncated over UDP, answered over TCP */
+	evdns_base_resolve_ipv4(dns, "medium.b.example.com",
+	    DNS_QUERY_NO_SEARCH, generic_dns_callback, &r);
+	n_replies_left = 2;
+	event_base_dispatch(base);
+	/* never answered: sent twice */
+	evdns_base_resolve_ipv4(dns, "lost.request.com",
+	    DNS_QUERY_NO_SEARCH, generic_dns_callback, &r);
+	n_replies_left = 1;
+	event_base_dispatch(base);
+	tt_int_op(r.result, ==, DNS_ERR_TIMEOUT);
+
+	tt_assert(!evdns_base_get_stats(dns, &stats));
+	tt_int_op(stats.queries_sent, ==, 5);
+	tt_int_op(stats.retransmits, ==, 1);
+	tt_int_op(stats.replies, ==, 3);
+	tt_int_op(stats.timeouts, ==, 2);
+	tt_int_op(stats.tc_fallbacks, ==, 1);
+	tt_int_op(stats.hedged, ==, 0);
+	tt_int_op(stats.requests_inflight, ==, 0);
+	tt_int_op(stats.requests_waiting, ==, 0);
+	for (i = 0; i < EVDNS_RTT_HISTOGRAM_BUCKETS; ++i)
+		n_rtts += stats.rtt_histogram[i];
+	tt_int_op(n_rtts, ==, 3);
+
+	tt_assert(!evdns_base_get_nameserver_stats(dns, 0, &ns_stats));
+	tt_int_op(ns_stats.queries_sent, ==, 5);
+	tt_int_op(ns_stats.replies, ==, 3);
+	tt_int_op(ns_stats.srtt_usec, >, 0);
+	tt_assert(!memcmp(ns_stats.rtt_histogram, stats.rtt_histogram,
+		sizeof(stats.rtt_histogram)));
+	tt_int_op(evdns_base_get_nameserver_stats(dns, 1, &ns_stats), ==, -1);
+
+	/* SERVFAILs get retried like timeouts, but they came back quickly,
+	 * so they don't make the server look slower */
+	srtt = ns_stats.srtt_usec;
+	evdns_base_resolve_ipv4(dns, "servfail.example.com",
+	    DNS_QUERY_NO_SEARCH, generic_dns_callback, &r);
+	n_replies_left = 1;
+	event_base_dispatch(base);
+	tt_int_op(r.result, ==, DNS_ERR_TIMEOUT);
+	tt_assert(!evdns_base_get_nameserver_stats(dns, 0, &ns_stats));
+	tt_int_op(ns_stats.replies, ==, 5);
+	tt_int_op(ns_stats.timeouts, ==, 2);
+	tt_int_op(ns_stats.srtt_usec, ==, srtt);
+
+end:
+	if (dns)
+		evdns_base_free(dns, 0);
+	regress_clean_dnsserver();
+}
+
 static void
 test_tcp_timeout(void *arg)
 {
@@ -3102,6 +3724,9 @@ struct testcase_t dns_testcases[] = {
 #endif
 	{ "bufferevent_connect_hostname_hints", test_bufferevent_connect_hostname,
 	  TT_FORK|TT_NEED_BASE, &basic_setup, (char*)"hints" },
+	{ "bufferevent_connect_hostname_race",
+	  test_bufferevent_connect_hostname_race,
+	  TT_FORK|TT_NEED_BASE, &basic_setup, NULL },
 	{ "disable_when_inactive", dns_disable_when_inactive_test,
 	  TT_FORK|TT_NEED_BASE, &basic_setup, NULL },
 	{ "disable_when_inactive_no_ns", dns_disable_when_inactive_no_ns_test,
@@ -3150,6 +3775,8 @@ struct testcase_t dns_testcases[] = {
 	  getaddrinfo_race_gotresolve_test,
 	  TT_FORK|TT_OFF_BY_DEFAULT, NULL, NULL },
 #endif
+	{ "server_static", test_dns_server_static,
+	  TT_FORK|TT_NEED_BASE, &basic_setup, NULL },
 	{ "tcp_resolve", test_tcp_resolve,
 	  TT_FORK | TT_NEED_BASE | TT_RETRIABLE, &basic_setup, NULL },
 	{ "tcp_resolve_pipeline", test_tcp_resolve_pipeline,
@@ -3158,6 +3785,12 @@ struct testcase_t dns_testcases[] = {
 	  TT_FORK | TT_NEED_BASE | TT_RETRIABLE, &basic_setup, NULL },
 	{ "tcp_timeout", test_tcp_timeout,
 	  TT_FORK | TT_NEED_BASE | TT_RETRIABLE | TT_NO_LOGS, &basic_setup, NULL },
+	{ "tcp_connection_reuse", test_tcp_connection_reuse,
+	  TT_FORK | TT_NEED_BASE, &basic_setup, NULL },
+	{ "select_by_rtt", test_select_by_rtt,
+	  TT_FORK | TT_NEED_BASE, &basic_setup, NULL },
+	{ "stats", test_dns_stats,
+	  TT_FORK | TT_NEED_BASE | TT_NO_LOGS, &basic_setup, NULL },
 
 	{ "set_SO_RCVBUF_SO_SNDBUF", test_set_so_rcvbuf_so_sndbuf,
 	  TT_FORK|TT_NEED_BASE, &basic_setup, NULL },
@@ -6112,6 +6112,12 @@ struct testcase_t http_testcases[] = {
 	HTTPS_MBEDTLS(per_socket_bevcb),
 #endif
 
+#ifdef EVENT__HAVE_LIBZ
+	{ "gzip", test_http_gzip, TT_FORK|TT_NEED_BASE, &basic_setup, NULL },
+#else
+	{ "gzip", NULL, TT_SKIP, NULL, NULL },
+#endif
+
 	END_OF_TESTCASES
 };
 
@@ -48,6 +48,7 @@
 
 #include "event2/listener.h"
 #include "event2/event.h"
+#include "event2/bufferevent.h"
 #include "event2/util.h"
 #ifndef EVENT__DISABLE_THREAD_SUPPORT
 #include "event2/thread.h"
@@ -274,6 +275,162 @@ end:
 		evconnlistener_free(listener);
 }
 
+struct batch_info {
+	int calls;
+	int conns;
+	int largest;
+};
+
+static void
+batch_acceptcb(struct evconnlistener *listener,
+    struct evconnlistener_accepted *conns, int n_conns, void *arg)
+{
+	struct batch_info *info = arg;
+	int i;
+
+	++info->calls;
+	info->conns += n_conns;
+	if (n_conns > info->largest)
+		info->largest = n_conns;
+	for (i = 0; i < n_conns; ++i) {
+		tt_int_op(conns[i].addr->sa_family, ==, AF_INET);
+		tt_int_op(conns[i].socklen, ==, sizeof(struct sockaddr_in));
+		evutil_closesocket(conns[i].fd);
+	}
+end:
+	;
+}
+
+static void
+count_acceptcb(struct evconnlistener *listener, evutil_socket_t fd,
+    struct sockaddr *addr, int socklen, void *arg)
+{
+	++*(int *)arg;
+	evutil_closesocket(fd);
+}
+
+/* Start a listener on a random port and make n connections to it */
+static struct evconnlistener *
+listener_with_pending(struct event_base *base, evutil_socket_t *fds, int n,
+    unsigned flags)
+{
+	struct evconnlistener *listener;
+	struct sockaddr_in sin;
+	struct sockaddr_storage ss;
+	ev_socklen_t slen = sizeof(ss);
+	int i;
+
+	memset(&sin, 0, sizeof(sin));
+	sin.sin_family = AF_INET;
+	sin.sin_addr.s_addr = htonl(0x7f000001); /* 127.0.0.1 */
+	sin.sin_port = 0; /* "You pick!" */
+
+	listener = evconnlistener_new_bind(base, NULL, NULL,
+	    LEV_OPT_CLOSE_ON_FREE|LEV_OPT_REUSEABLE|flags, -1,
+	    (struct sockaddr *)&sin, sizeof(sin));
+	if (!listener)
+		return NULL;
+	if (getsockname(evconnlistener_get_fd(listener),
+		(struct sockaddr*)&ss, &slen) < 0) {
+		evconnlistener_free(listener);
+		return NULL;
+	}
+	for (i = 0; i < n; ++i)
+		evutil_socket_connect_(&fds[i], (struct sockaddr*)&ss, slen);
+#ifdef _WIN32
+	Sleep(100); /* XXXX this is a stupid stopgap. */
+#endif
+	return listener;
+}
+
+static void
+regress_listener_batch(void *arg)
+{
+	struct basic_test_data *data = arg;
+	struct event_base *base = data->base;
+	struct evconnlistener *listener = NULL;
+	struct batch_info info = { 0, 0, 0 };
+	evutil_socket_t fds[10];
+	int i;
+
+	for (i = 0; i < 10; ++i)
+		fds[i] = EVUTIL_INVALID_SOCKET;
+
+	listener = listener_with_pending(base, fds, 10, 0);
+	tt_assert(listener);
+	tt_int_op(evconnlistener_set_batch_cb(listener, batch_acceptcb, 0,
+		&info), ==, -1);
+	tt_int_op(evconnlistener_set_batch_cb(listener, batch_acceptcb, 4,
+		&info), ==, 0);
+
+	while (info.conns < 10)
+		event_base_loop(base, EVLOOP_ONCE);
+
+	tt_int_op(info.conns, ==, 10);
+	tt_int_op(info.largest, ==, 4);
+	tt_int_op(info.calls, >=, 3);
+
+end:
+	for (i = 0; i < 10; ++i)
+		if (fds[i] != EVUTIL_INVALID_SOCKET)
+			evutil_closesocket(fds[i]);
+	if (listener)
+		evconnlistener_free(listener);
+}
+
+static void
+regress_listener_accept_budget(void *arg)
+{
+	struct basic_test_data *data = arg;
+	struct event_base *base = data->base;
+	struct evconnlistener *listener = NULL;
+	struct batch_info info = { 0, 0, 0 };
+	evutil_socket_t fds[7];
+	int i, count = 0;
+
+	for (i = 0; i < 7; ++i)
+		fds[i] = EVUTIL_INVALID_SOCKET;
+
+	listener = listener_with_pending(base, fds, 7, 0);
+	tt_assert(listener);
+	tt_int_op(evconnlistener_set_accept_budget(listener, -1), ==, -1);
+	tt_int_op(evconnlistener_set_accept_budget(listener, 3), ==, 0);
+	evconnlistener_set_cb(listener, count_acceptcb, &count);
+
+	/* Each wakeup takes at most three */
+	event_base_loop(base, EVLOOP_ONCE);
+	tt_int_op(count, ==, 3);
+	event_base_loop(base, EVLOOP_ONCE);
+	tt_int_op(count, ==, 6);
+	event_base_loop(base, EVLOOP_ONCE);
+	tt_int_op(count, ==, 7);
+
+	/* The budget cuts batches short too */
+	for (i = 0; i < 7; ++i) {
+		evutil_closesocket(fds[i]);
+		fds[i] = EVUTIL_INVALID_SOCKET;
+	}
+	evconnlistener_free(listener);
+	listener = listener_with_pending(base, fds, 7, 0);
+	tt_assert(listener);
+	tt_int_op(evconnlistener_set_accept_budget(listener, 5), ==, 0);
+	tt_int_op(evconnlistener_set_batch_cb(listener, batch_acceptcb, 4,
+		&info), ==, 0);
+	event_base_loop(base, EVLOOP_ONCE);
+	tt_int_op(info.conns, ==, 5);
+	tt_int_op(info.calls, ==, 2);
+	event_base_loop(base, EVLOOP_ONCE);
+	tt_int_op(info.conns, ==, 7);
+	tt_int_op(info.calls, ==, 3);
+
+end:
+	for (i = 0; i < 7; ++i)
+		if (fds[i] != EVUTIL_INVALID_SOCKET)
+			evutil_closesocket(fds[i]);
+	if (listener)
+		evconnlistener_free(listener);
+}
+
 #ifdef EVENT__HAVE_SETRLIMIT
 static void
 regress_listener_error_unlock(void *arg)
@@ -319,6 +476,43 @@ disable_thread(void * arg)
 	return NULL;
 }
 
+/* The accept budget cutting a batch short must not leave a threadsafe
+ * listener locked */
+static void
+regress_listener_accept_budget_ts(void *arg)
+{
+	struct basic_test_data *data = arg;
+	struct event_base *base = data->base;
+	struct evconnlistener *listener = NULL;
+	struct batch_info info = { 0, 0, 0 };
+	evutil_socket_t fds[7];
+	THREAD_T threadid;
+	int i;
+
+	for (i = 0; i < 7; ++i)
+		fds[i] = EVUTIL_INVALID_SOCKET;
+
+	listener = listener_with_pending(base, fds, 7, LEV_OPT_THREADSAFE);
+	tt_assert(listener);
+	tt_int_op(evconnlistener_set_accept_budget(listener, 5), ==, 0);
+	tt_int_op(evconnlistener_set_batch_cb(listener, batch_acceptcb, 4,
+		&info), ==, 0);
+	event_base_loop(base, EVLOOP_ONCE);
+	tt_int_op(info.conns, ==, 5);
+	tt_int_op(info.calls, ==, 2);
+
+	/* Deadlocks if the listener is still locked */
+	THREAD_START(threadid, disable_thread, listener);
+	THREAD_JOIN(threadid);
+
+end:
+	for (i = 0; i < 7; ++i)
+		if (fds[i] != EVUTIL_INVALID_SOCKET)
+			evutil_closesocket(fds[i]);
+	if (listener)
+		evconnlistener_free(listener);
+}
+
 static void
 acceptcb_for_thread_test(struct evconnlistener *listener, evutil_socket_t fd,
     struct sockaddr *addr, int socklen, void *arg)
@@ -428,6 +622,135 @@ end:
 	if (listener)
 		evconnlistener_free(listener);
 }
+
+struct handoff_test {
+	struct event_base *bases[2];
+	THREAD_T threads[2];
+	int handed[2];
+	int n_read;
+	int n_conns;
+	struct event_base *main_base;
+};
+
+static void
+handoff_workercb(struct bufferevent *bev, struct sockaddr *addr,
+    int socklen, void *arg)
+{
+	struct handoff_test *t = arg;
+	int i;
+
+	for (i = 0; i < 2; ++i)
+		if (bufferevent_get_base(bev) == t->bases[i])
+			++t->handed[i];
+	send(bufferevent_getfd(bev), "x", 1, 0);
+	bufferevent_free(bev);
+}
+
+static void
+handoff_clientcb(evutil_socket_t fd, short what, void *arg)
+{
+	struct handoff_test *t = arg;
+	char c;
+
+	if (recv(fd, &c, 1, 0) == 1 && ++t->n_read == t->n_conns)
+		event_base_loopbreak(t->main_base);
+}
+
+static void
+handoff_busycb(evutil_socket_t fd, short what, void *arg)
+{
+}
+
+static THREAD_FN
+handoff_worker(void *arg)
+{
+	event_base_loop(arg, EVLOOP_NO_EXIT_ON_EMPTY);
+	THREAD_RETURN();
+}
+
+static void
+regress_listener_workers(void *arg)
+{
+	struct basic_test_data *data = arg;
+	struct event_base *base = data->base;
+	struct evconnlistener *listener = NULL;
+	struct handoff_test t;
+	struct event *busy[4];
+	struct event *client_evs[6];
+	evutil_socket_t fds[6];
+	struct timeval hour = { 3600, 0 };
+	int least_loaded = data->setup_data &&
+	    !strcmp(data->setup_data, "least_loaded");
+	int i;
+
+	memset(&t, 0, sizeof(t));
+	memset(busy, 0, sizeof(busy));
+	memset(client_evs, 0, sizeof(client_evs));
+	for (i = 0; i < 6; ++i)
+		fds[i] = EVUTIL_INVALID_SOCKET;
+	t.main_base = base;
+	t.n_conns = 6;
+
+	for (i = 0; i < 2; ++i) {
+		t.bases[i] = event_base_new();
+		tt_assert(t.bases[i]);
+	}
+	/* Make the first worker look busy */
+	for (i = 0; i < 4; ++i) {
+		busy[i] = evtimer_new(t.bases[0], handoff_busycb, NULL);
+		evtimer_add(busy[i], &hour);
+	}
+
+	listener = listener_with_pending(base, fds, 6, 0);
+	tt_assert(listener);
+	tt_int_op(evconnlistener_set_workers(listener, t.bases, 2, 42,
+		BEV_OPT_CLOSE_ON_FREE, handoff_workercb, &t), ==, -1);
+	tt_int_op(evconnlistener_set_workers(listener, t.bases, 2,
+		least_loaded ? LEV_WORKERS_LEAST_LOADED :
+		LEV_WORKERS_ROUND_ROBIN,
+		BEV_OPT_CLOSE_ON_FREE, handoff_workercb, &t), ==, 0);
+
+	for (i = 0; i < 6; ++i) {
+		client_evs[i] = event_new(base, fds[i], EV_READ,
+		    handoff_clientcb, &t);
+		event_add(client_evs[i], NULL);
+	}
+	for (i = 0; i < 2; ++i)
+		THREAD_START(t.threads[i], handoff_worker, t.bases[i]);
+
+	event_base_dispatch(base);
+
+	for (i = 0; i < 2; ++i) {
+		event_base_loopbreak(t.bases[i]);
+		THREAD_JOIN(t.threads[i]);
+	}
+
+	tt_int_op(t.n_read, ==, 6);
+	tt_int_op(t.handed[0] + t.handed[1], ==, 6);
+	if (least_loaded) {
+		tt_int_op(t.handed[0], <=, 1);
+	} else {
+		tt_int_op(t.handed[0], ==, 3);
+		tt_int_op(t.handed[1], ==, 3);
+	}
+
+end:
+	/* The listener has to go before the worker bases */
+	if (listener)
+		evconnlistener_free(listener);
+	for (i = 0; i < 6; ++i) {
+		if (client_evs[i])
+			event_free(client_evs[i]);
+		if (fds[i] != EVUTIL_INVALID_SOCKET)
+			evutil_closesocket(fds[i]);
+	}
+	for (i = 0; i < 4; ++i)
+		if (busy[i])
+			event_free(busy[i]);
+	for (i = 0; i < 2; ++i)
+		if (t.bases[i])
+			event_base_free(t.bases[i]);
+}
 #endif
 
 struct testcase_t listener_testcases[] = {
@@ -458,6 +781,12 @@ struct testcase_t listener_testcases[] = {
 	{ "immediate_close", regress_listener_immediate_close,
 	  TT_FORK|TT_NEED_BASE, &basic_setup, NULL, },
 
+	{ "batch", regress_listener_batch,
+	  TT_FORK|TT_NEED_BASE, &basic_setup, NULL, },
+
+	{ "accept_budget", regress_listener_accept_budget,
+	  TT_FORK|TT_NEED_BASE, &basic_setup, NULL, },
+
 #ifndef EVENT__DISABLE_THREAD_SUPPORT
 	{ "disable_in_thread", regress_listener_disable_in_thread,
 		TT_FORK|TT_NEED_BASE|TT_NEED_THREADS,
@@ -466,6 +795,18 @@ struct testcase_t listener_testcases[] = {
 	{ "disable_in_thread_error", regress_listener_disable_in_thread_error,
 		TT_FORK|TT_NEED_BASE|TT_NEED_THREADS|TT_NEED_SOCKETPAIR,
 		&basic_setup, NULL, },
+
+	{ "workers", regress_listener_workers,
+		TT_FORK|TT_NEED_BASE|TT_NEED_THREADS,
+		&basic_setup, NULL, },
+
+	{ "workers_least_loaded", regress_listener_workers,
+		TT_FORK|TT_NEED_BASE|TT_NEED_THREADS,
+		&basic_setup, (char*)"least_loaded", },
+
+	{ "accept_budget_ts", regress_listener_accept_budget_ts,
+		TT_FORK|TT_NEED_BASE|TT_NEED_THREADS,
+		&basic_setup, NULL, },
 #endif
 
 	END_OF_TESTCASES,
@@ -749,6 +749,447 @@ end:
 		event_base_loop(base, EVLOOP_ONCE);
 }
 
+struct ktls_context {
+	struct bufferevent *server;
+	struct evbuffer *got;
+	size_t expect;
+};
+static void
+ktls_readcb(struct bufferevent *bev, void *arg)
+{
+	struct ktls_context *ctx = arg;
+	evbuffer_add_buffer(ctx->got, bufferevent_get_input(bev));
+	if (evbuffer_get_length(ctx->got) >= ctx->expect)
+		event_base_loopexit(bufferevent_get_base(bev), NULL);
+}
+static void
+ktls_eventcb(struct bufferevent *bev, short what, void *arg)
+{
+	TT_BLATHER(("ktls_eventcb(%p): %i, ktls %i",
+		bev, what, bufferevent_ssl_get_ktls(bev)));
+	if (!(what & BEV_EVENT_CONNECTED))
+		event_base_loopexit(bufferevent_get_base(bev), NULL);
+}
+static void
+ktls_acceptcb(struct evconnlistener *listener, evutil_socket_t fd,
+    struct sockaddr *addr, int socklen, void *arg)
+{
+	struct ktls_context *ctx = arg;
+	struct event_base *base = evconnlistener_get_base(listener);
+	SSL *ssl = SSL_new(get_ssl_ctx(SSL_IS_SERVER));
+
+	SSL_use_certificate(ssl, the_cert);
+	SSL_use_PrivateKey(ssl, the_key);
+
+	ctx->server = bufferevent_ssl_socket_new(base, fd, ssl,
+	    BUFFEREVENT_SSL_ACCEPTING, BEV_OPT_CLOSE_ON_FREE);
+	bufferevent_ssl_set_flags(ctx->server, BUFFEREVENT_SSL_KTLS);
+	bufferevent_setcb(ctx->server, ktls_readcb, NULL, ktls_eventcb, ctx);
+	bufferevent_enable(ctx->server, EV_READ);
+
+	evconnlistener_disable(listener);
+}
+/* Send a file segment sandwiched between two plain chunks with
+ * BUFFEREVENT_SSL_KTLS set: whether or not the kernel takes over the
+ * records, the peer must see exactly the same bytes. */
+static void
+regress_bufferevent_openssl_ktls(void *arg)
+{
+	struct basic_test_data *data = arg;
+	struct event_base *base = data->base;
+	struct evconnlistener *listener = NULL;
+	struct bufferevent *bev = NULL;
+	struct sockaddr_in sin;
+	struct sockaddr_storage ss;
+	ev_socklen_t slen = sizeof(ss);
+	struct ktls_context ctx;
+	struct evbuffer *expect = evbuffer_new();
+	char *payload = NULL, *tmpfilename = NULL;
+	size_t payload_len = 100<<10, i;
+	int fd = -1;
+
+	memset(&ctx, 0, sizeof(ctx));
+	ctx.got = evbuffer_new();
+
+	payload = malloc(payload_len);
+	tt_assert(payload);
+	for (i = 0; i < payload_len; ++i)
+		payload[i] = (char)(i * 7 + (i >> 9));
+	fd = regress_make_tmpfile(payload, payload_len, &tmpfilename);
+	tt_fd_op(fd, >=, 0);
+
+	evbuffer_add_printf(expect, "header\n");
+	evbuffer_add(expect, payload, payload_len);
+	evbuffer_add_printf(expect, "trailer\n");
+	ctx.expect = evbuffer_get_length(expect);
+
+	memset(&sin, 0, sizeof(sin));
+	sin.sin_family = AF_INET;
+	sin.sin_addr.s_addr = htonl(0x7f000001);
+	listener = evconnlistener_new_bind(base, ktls_acceptcb, &ctx,
+	    LEV_OPT_CLOSE_ON_FREE|LEV_OPT_REUSEABLE,
+	    -1, (struct sockaddr *)&sin, sizeof(sin));
+	tt_assert(listener);
+	tt_assert(getsockname(evconnlistener_get_fd(listener),
+		(struct sockaddr*)&ss, &slen) == 0);
+
+	bev = bufferevent_ssl_socket_new(base, -1,
+	    SSL_new(get_ssl_ctx(SSL_IS_CLIENT)),
+	    BUFFEREVENT_SSL_CONNECTING, BEV_OPT_CLOSE_ON_FREE);
+	tt_assert(bev);
+	tt_int_op(bufferevent_ssl_get_ktls(bev), ==, 0);
+	bufferevent_ssl_set_flags(bev, BUFFEREVENT_SSL_KTLS);
+	tt_uint_op(bufferevent_ssl_get_flags(bev) & BUFFEREVENT_SSL_KTLS,
+	    ==, BUFFEREVENT_SSL_KTLS);
+	bufferevent_setcb(bev, NULL, NULL, ktls_eventcb, NULL);
+
+	evbuffer_add_printf(bufferevent_get_output(bev), "header\n");
+	tt_assert(!evbuffer_add_file(bufferevent_get_output(bev),
+		fd, 0, payload_len));
+	fd = -1;
+	evbuffer_add_printf(bufferevent_get_output(bev), "trailer\n");
+
+	tt_assert(!bufferevent_socket_connect(bev, (struct sockaddr*)&ss, slen));
+	tt_assert(!bufferevent_enable(bev, EV_READ|EV_WRITE));
+
+	event_base_dispatch(base);
+
+	TT_BLATHER(("ktls: client %i, server %i",
+		bufferevent_ssl_get_ktls(bev),
+		ctx.server ? bufferevent_ssl_get_ktls(ctx.server) : -1));
+	tt_int_op(evbuffer_get_length(ctx.got), ==, ctx.expect);
+	tt_assert(!memcmp(evbuffer_pullup(ctx.got, -1),
+		evbuffer_pullup(expect, -1), ctx.expect));
+
+end:
+	if (fd >= 0)
+		evutil_closesocket(fd);
+	if (tmpfilename) {
+		unlink(tmpfilename);
+		free(tmpfilename);
+	}
+	free(payload);
+	evbuffer_free(expect);
+	evbuffer_free(ctx.got);
+	if (bev)
+		bufferevent_free(bev);
+	if (ctx.server)
+		bufferevent_free(ctx.server);
+	if (listener)
+		evconnlistener_free(listener);
+}
+
+static void
+regress_bufferevent_openssl_record_size(void *arg)
+{
+	struct basic_test_data *data = arg;
+	struct event_base *base = data->base;
+	struct bufferevent *client = NULL, *server = NULL;
+	struct bufferevent_ssl_record_stats stats;
+	struct ktls_context ctx;
+	struct timeval idle = { 0, 50*1000 };
+	struct timeval tv = { 5, 0 };
+	char payload[40000];
+	SSL *ssl;
+	size_t i;
+
+	memset(&ctx, 0, sizeof(ctx));
+	ctx.got = evbuffer_new();
+	for (i = 0; i < sizeof(payload); ++i)
+		payload[i] = (char)(i * 13);
+
+	ssl = SSL_new(get_ssl_ctx(SSL_IS_SERVER));
+	SSL_use_certificate(ssl, the_cert);
+	SSL_use_PrivateKey(ssl, the_key);
+	server = bufferevent_ssl_socket_new(base, data->pair[1], ssl,
+	    BUFFEREVENT_SSL_ACCEPTING, BEV_OPT_CLOSE_ON_FREE);
+	client = bufferevent_ssl_socket_new(base, data->pair[0],
+	    SSL_new(get_ssl_ctx(SSL_IS_CLIENT)),
+	    BUFFEREVENT_SSL_CONNECTING, BEV_OPT_CLOSE_ON_FREE);
+	tt_assert(server);
+	tt_assert(client);
+	data->pair[0] = data->pair[1] = EVUTIL_INVALID_SOCKET;
+
+	tt_int_op(bufferevent_ssl_set_record_size(client, 2000, 1000, 0, NULL),
+	    ==, -1);
+	tt_int_op(bufferevent_ssl_set_record_size(client, 1000, 1<<15, 0, NULL),
+	    ==, -1);
+	tt_int_op(bufferevent_ssl_set_record_size(client, 1000, 4000, 5000,
+		&idle), ==, 0);
+
+	bufferevent_setcb(server, ktls_readcb, NULL, NULL, &ctx);
+	bufferevent_enable(server, EV_READ);
+	bufferevent_enable(client, EV_WRITE);
+
+	/* 5000 bytes in 1000-byte records, then at most 4000 per record */
+	ctx.expect = sizeof(payload);
+	evbuffer_add(bufferevent_get_output(client), payload, sizeof(payload));
+	event_base_loopexit(base, &tv);
+	event_base_dispatch(base);
+
+	tt_int_op(evbuffer_get_length(ctx.got), ==, sizeof(payload));
+	tt_assert(!memcmp(evbuffer_pullup(ctx.got, -1), payload,
+		sizeof(payload)));
+	tt_int_op(bufferevent_ssl_get_record_stats(client, &stats), ==, 0);
+	tt_int_op(stats.small_records, ==, 5);
+	tt_int_op(stats.large_records, >=, (sizeof(payload) - 5000) / 4000);
+	tt_int_op(stats.large_records, <=, (sizeof(payload) - 5000) / 1000);
+	tt_int_op(stats.bytes, ==, sizeof(payload));
+	tt_int_op(stats.idle_resets, ==, 0);
+
+	/* After being idle, we start small again */
+	evutil_usleep_(&idle);
+	evutil_usleep_(&idle);
+	ctx.expect += 3000;
+	evbuffer_add(bufferevent_get_output(client), payload, 3000);
+	event_base_loopexit(base, &tv);
+	event_base_dispatch(base);
+
+	tt_int_op(evbuffer_get_length(ctx.got), ==, ctx.expect);
+	tt_int_op(bufferevent_ssl_get_record_stats(client, &stats), ==, 0);
+	tt_int_op(stats.idle_resets, ==, 1);
+	tt_int_op(stats.small_records, ==, 8);
+	tt_int_op(stats.bytes, ==, sizeof(payload) + 3000);
+
+end:
+	evbuffer_free(ctx.got);
+	if (client)
+		bufferevent_free(client);
+	if (server)
+		bufferevent_free(server);
+}
+
+/* Lots of small chains must not turn into lots of small records. */
+static void
+regress_bufferevent_openssl_coalesce(void *arg)
+{
+	struct basic_test_data *data = arg;
+	struct event_base *base = data->base;
+	struct bufferevent *client = NULL, *server = NULL;
+	struct bufferevent_ssl_record_stats stats;
+	struct ktls_context ctx;
+	struct evbuffer *expect = evbuffer_new();
+	struct timeval tv = { 5, 0 };
+	static const char piece[] = "0123456789abcdefghijklmnopqrstuvwxyz"
+	    "ABCDEFGHIJKLM\n";
+	SSL *ssl;
+	int i;
+
+	memset(&ctx, 0, sizeof(ctx));
+	ctx.got = evbuffer_new();
+
+	ssl = SSL_new(get_ssl_ctx(SSL_IS_SERVER));
+	SSL_use_certificate(ssl, the_cert);
+	SSL_use_PrivateKey(ssl, the_key);
+	server = bufferevent_ssl_socket_new(base, data->pair[1], ssl,
+	    BUFFEREVENT_SSL_ACCEPTING, BEV_OPT_CLOSE_ON_FREE);
+	client = bufferevent_ssl_socket_new(base, data->pair[0],
+	    SSL_new(get_ssl_ctx(SSL_IS_CLIENT)),
+	    BUFFEREVENT_SSL_CONNECTING, BEV_OPT_CLOSE_ON_FREE);
+	tt_assert(server);
+	tt_assert(client);
+	data->pair[0] = data->pair[1] = EVUTIL_INVALID_SOCKET;
+
+	tt_int_op(bufferevent_ssl_set_record_size(client, 0, 4000, 0, NULL),
+	    ==, 0);
+	bufferevent_setcb(server, ktls_readcb, NULL, NULL, &ctx);
+	bufferevent_enable(server, EV_READ);
+	bufferevent_enable(client, EV_WRITE);
+
+	/* 200 chains of 50 bytes */
+	for (i = 0; i < 200; ++i) {
+		evbuffer_add_reference(bufferevent_get_output(client),
+		    piece, sizeof(piece) - 1, NULL, NULL);
+		evbuffer_add(expect, piece, sizeof(piece) - 1);
+	}
+	ctx.expect = evbuffer_get_length(expect);
+	event_base_loopexit(base, &tv);
+	event_base_dispatch(base);
+
+	tt_int_op(evbuffer_get_length(ctx.got), ==, ctx.expect);
+	tt_assert(!memcmp(evbuffer_pullup(ctx.got, -1),
+		evbuffer_pullup(expect, -1), ctx.expect));
+	tt_int_op(bufferevent_ssl_get_record_stats(client, &stats), ==, 0);
+	tt_int_op(stats.small_records, ==, 0);
+	tt_int_op(stats.large_records, ==, 3);
+	tt_int_op(stats.coalesced_records, ==, 3);
+	tt_int_op(stats.bytes, ==, ctx.expect);
+
+end:
+	evbuffer_free(expect);
+	evbuffer_free(ctx.got);
+	if (client)
+		bufferevent_free(client);
+	if (server)
+		bufferevent_free(server);
+}
+
+#if OPENSSL_VERSION_NUMBER >= 0x10101000L && !defined(LIBRESSL_VERSION_NUMBER)
+static void
+resume_readcb(struct bufferevent *bev, void *arg)
+{
+	evbuffer_drain(bufferevent_get_input(bev), -1);
+	event_base_loopexit(bufferevent_get_base(bev), NULL);
+}
+static void
+resume_eventcb(struct bufferevent *bev, short what, void *arg)
+{
+	if (what & BEV_EVENT_CONNECTED) {
+		if (arg)
+			bufferevent_write(bev, "x", 1);
+	} else {
+		event_base_loopexit(bufferevent_get_base(bev), NULL);
+	}
+}
+/* Do a handshake between client_ctx and server_ctx over a fresh
+ * socketpair, wait for one byte of application data, and return 1 if the
+ * session was resumed, 0 if not, -1 on error. */
+static int
+resume_connect(struct event_base *base, SSL_CTX *client_ctx,
+    SSL_CTX *server_ctx, struct bufferevent_openssl_session_store *store)
+{
+	struct bufferevent *client = NULL, *server = NULL;
+	evutil_socket_t pair[2];
+	struct timeval tv = { 5, 0 };
+	SSL *ssl;
+	int r = -1;
+
+	if (evutil_socketpair(AF_UNIX, SOCK_STREAM, 0, pair) < 0)
+		return -1;
+	evutil_make_socket_nonblocking(pair[0]);
+	evutil_make_socket_nonblocking(pair[1]);
+
+	ssl = SSL_new(server_ctx);
+	SSL_use_certificate(ssl, the_cert);
+	SSL_use_PrivateKey(ssl, the_key);
+	server = bufferevent_openssl_socket_new(base, pair[1], ssl,
+	    BUFFEREVENT_SSL_ACCEPTING, BEV_OPT_CLOSE_ON_FREE);
+	client = bufferevent_openssl_socket_new(base, pair[0],
+	    SSL_new(client_ctx), BUFFEREVENT_SSL_CONNECTING,
+	    BEV_OPT_CLOSE_ON_FREE);
+	if (!client || !server)
+		goto end;
+	if (bufferevent_openssl_set_session_store(client, store,
+		"example.com", 443) < 0)
+		goto end;
+	/* Server side stores can't be used */
+	if (bufferevent_openssl_set_session_store(server, store,
+		"example.com", 443) == 0)
+		goto end;
+
+	bufferevent_setcb(server, NULL, NULL, resume_eventcb, server);
+	bufferevent_setcb(client, resume_readcb, NULL, resume_eventcb, NULL);
+	bufferevent_enable(server, EV_READ|EV_WRITE);
+	bufferevent_enable(client, EV_READ|EV_WRITE);
+
+	event_base_loopexit(base, &tv);
+	event_base_dispatch(base);
+
+	if (SSL_is_init_finished(bufferevent_openssl_get_ssl(client)))
+		r = SSL_session_reused(bufferevent_openssl_get_ssl(client));
+end:
+	if (client)
+		bufferevent_free(client);
+	if (server)
+		bufferevent_free(server);
+	return r;
+}
+
+static void
+regress_bufferevent_openssl_session_cache(void *arg)
+{
+	struct basic_test_data *data = arg;
+	struct bufferevent_openssl_session_cache_stats stats;
+	struct bufferevent_openssl_session_store *store = NULL;
+	SSL_CTX *client_ctx = SSL_CTX_new(TLS_method());
+	SSL_CTX *server_ctx = SSL_CTX_new(TLS_method());
+
+	tt_assert(client_ctx && server_ctx);
+	/* Stateful sessions, so that TLS 1.3 uses the cache too */
+	SSL_CTX_set_options(server_ctx, SSL_OP_NO_TICKET);
+
+	tt_assert(!bufferevent_openssl_session_store_new(0));
+	tt_int_op(bufferevent_openssl_ctx_set_session_cache(server_ctx, 0, 0),
+	    ==, -1);
+	tt_int_op(bufferevent_openssl_ctx_get_session_cache_stats(server_ctx,
+		&stats), ==, -1);
+	tt_int_op(bufferevent_openssl_ctx_set_session_cache(server_ctx, 64, 300),
+	    ==, 0);
+	store = bufferevent_openssl_session_store_new(8);
+	tt_assert(store);
+
+	tt_int_op(resume_connect(data->base, client_ctx, server_ctx, store), ==, 0);
+	tt_int_op(resume_connect(data->base, client_ctx, server_ctx, store), ==, 1);
+	tt_int_op(resume_connect(data->base, client_ctx, server_ctx, store), ==, 1);
+
+	tt_int_op(bufferevent_openssl_ctx_get_session_cache_stats(server_ctx,
+		&stats), ==, 0);
+	tt_int_op(stats.hits, ==, 2);
+	tt_int_op(stats.misses, ==, 0);
+	tt_int_op(stats.entries, >=, 1);
+	tt_int_op(stats.evictions, ==, 0);
+
+	/* A new cache knows nothing about the old sessions */
+	tt_int_op(bufferevent_openssl_ctx_set_session_cache(server_ctx, 64, 300),
+	    ==, 0);
+	tt_int_op(resume_connect(data->base, client_ctx, server_ctx, store), ==, 0);
+	tt_int_op(bufferevent_openssl_ctx_get_session_cache_stats(server_ctx,
+		&stats), ==, 0);
+	tt_int_op(stats.misses, ==, 1);
+
+end:
+	bufferevent_openssl_session_store_free(store);
+	SSL_CTX_free(client_ctx);
+	SSL_CTX_free(server_ctx);
+}
+
+static void
+regress_bufferevent_openssl_ticket_keys(void *arg)
+{
+	struct basic_test_data *data = arg;
+	struct bufferevent_openssl_session_store *store = NULL;
+	SSL_CTX *client_ctx = SSL_CTX_new(TLS_method());
+	SSL_CTX *server_ctx = SSL_CTX_new(TLS_method());
+	unsigned char key[BUFFEREVENT_OPENSSL_TICKET_KEY_LEN];
+
+	tt_assert(client_ctx && server_ctx);
+	memset(key, 'k', sizeof(key));
+
+	tt_int_op(bufferevent_openssl_ctx_rotate_ticket_key(server_ctx,
+		NULL, 0), ==, -1);
+	tt_int_op(bufferevent_openssl_ctx_set_ticket_keys(server_ctx, 0, 9),
+	    ==, -1);
+	tt_int_op(bufferevent_openssl_ctx_set_ticket_keys(server_ctx, 0, 1),
+	    ==, 0);
+	tt_int_op(bufferevent_openssl_ctx_rotate_ticket_key(server_ctx,
+		key, sizeof(key) - 1), ==, -1);
+	store = bufferevent_openssl_session_store_new(8);
+	tt_assert(store);
+
+	tt_int_op(resume_connect(data->base, client_ctx, server_ctx, store), ==, 0);
+	tt_int_op(resume_connect(data->base, client_ctx, server_ctx, store), ==, 1);
+
+	/* The previous key is still good, and we get a ticket under the new
+	 * one */
+	tt_int_op(bufferevent_openssl_ctx_rotate_ticket_key(server_ctx,
+		key, sizeof(key)), ==, 0);
+	tt_int_op(resume_connect(data->base, client_ctx, server_ctx, store), ==, 1);
+
+	/* Two rotations later, it is gone */
+	tt_int_op(bufferevent_openssl_ctx_rotate_ticket_key(server_ctx,
+		NULL, 0), ==, 0);
+	tt_int_op(bufferevent_openssl_ctx_rotate_ticket_key(server_ctx,
+		NULL, 0), ==, 0);
+	tt_int_op(resume_connect(data->base, client_ctx, server_ctx, store), ==, 0);
+	tt_int_op(resume_connect(data->base, client_ctx, server_ctx, store), ==, 1);
+
+end:
+	bufferevent_openssl_session_store_free(store);
+	SSL_CTX_free(client_ctx);
+	SSL_CTX_free(server_ctx);
+}
+#endif
+
 struct testcase_t TESTCASES_NAME[] = {
 #define T(a) ((void *)(a))
 	{ "bufferevent_socketpair", regress_bufferevent_openssl,
@@ -832,6 +1273,18 @@ struct testcase_t TESTCASES_NAME[] = {
 	  TT_FORK|TT_NEED_BASE, &ssl_setup, T(REGRESS_DEFERRED_CALLBACKS) },
 	{ "bufferevent_wm_filter_defer", regress_bufferevent_openssl_wm,
 	  TT_FORK|TT_NEED_BASE, &ssl_setup, T(REGRESS_OPENSSL_FILTER|REGRESS_DEFERRED_CALLBACKS) },
+	{ "bufferevent_ktls", regress_bufferevent_openssl_ktls,
+	  TT_FORK|TT_NEED_BASE, &ssl_setup, NULL },
+	{ "bufferevent_record_size", regress_bufferevent_openssl_record_size,
+	  TT_FORK|TT_NEED_BASE|TT_NEED_SOCKETPAIR, &ssl_setup, NULL },
+	{ "bufferevent_coalesce", regress_bufferevent_openssl_coalesce,
+	  TT_FORK|TT_NEED_BASE|TT_NEED_SOCKETPAIR, &ssl_setup, NULL },
+#if OPENSSL_VERSION_NUMBER >= 0x10101000L && !defined(LIBRESSL_VERSION_NUMBER)
+	{ "session_cache", regress_bufferevent_openssl_session_cache,
+	  TT_FORK|TT_NEED_BASE, &ssl_setup, NULL },
+	{ "ticket_keys", regress_bufferevent_openssl_ticket_keys,
+	  TT_FORK|TT_NEED_BASE, &ssl_setup, NULL },
+#endif
 
 #undef T
 
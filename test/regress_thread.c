@@ -34,6 +34,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
 #ifdef EVENT__HAVE_UNISTD_H
 #include <unistd.h>
 #endif
@@ -56,8 +57,12 @@
 
 #include "event2/event.h"
 #include "event2/event_struct.h"
+#include "event2/buffer.h"
+#include "event2/file.h"
 #include "event2/thread.h"
+#include "event2/threadpool.h"
 #include "event2/util.h"
+#include "atomic-internal.h"
 #include "evthread-internal.h"
 #include "event-internal.h"
 #include "defer-internal.h"
@@ -564,6 +569,237 @@ end:
 	;
 }
 
+#if defined(EVTHREADPOOL_IMPLEMENTED) && defined(EVUTIL_HAVE_ATOMICS_)
+#define POOL_JOBS 100
+
+struct pool_test_state {
+	struct evthreadpool *pool;
+	struct event_base *base;
+	THREAD_T loop_thread;
+	unsigned n_worked;
+	int n_done;
+	int wrong_thread;
+	/* For the blocking job: whether it saw the others finish */
+	int saw_all;
+};
+
+static void
+pool_work_cb(void *arg)
+{
+	struct pool_test_state *st = arg;
+
+	EVUTIL_ATOMIC_ADD_(&st->n_worked, 1);
+}
+
+static void
+pool_done_cb(void *arg)
+{
+	struct pool_test_state *st = arg;
+
+	if (!pthread_equal(THREAD_SELF(), st->loop_thread))
+		st->wrong_thread = 1;
+	if (++st->n_done == POOL_JOBS)
+		event_base_loopbreak(st->base);
+}
+
+/* Keeps its worker busy until every other job has run, which they can only
+ * do if the other worker steals the ones queued behind this one. */
+static void
+pool_block_cb(void *arg)
+{
+	struct pool_test_state *st = arg;
+	int i;
+
+	for (i = 0; i < 5000; ++i) {
+		if (EVUTIL_ATOMIC_LOAD_(&st->n_worked) == POOL_JOBS - 1) {
+			st->saw_all = 1;
+			break;
+		}
+		SLEEP_MS(1);
+	}
+	EVUTIL_ATOMIC_ADD_(&st->n_worked, 1);
+}
+
+/* Runs the rest of the jobs as children of itself */
+static void
+pool_spawn_cb(void *arg)
+{
+	struct pool_test_state *st = arg;
+	int i;
+
+	for (i = 0; i < POOL_JOBS / 2 - 1; ++i)
+		evthreadpool_submit(st->pool, st->base, pool_work_cb,
+		    pool_done_cb, st);
+	EVUTIL_ATOMIC_ADD_(&st->n_worked, 1);
+}
+
+static void
+pool_timeout_cb(evutil_socket_t fd, short what, void *arg)
+{
+	event_base_loopbreak(arg);
+}
+
+static void
+thread_threadpool(void *arg)
+{
+	struct basic_test_data *data = arg;
+	struct pool_test_state st;
+	struct event *timeout = NULL;
+	struct timeval tv = { 10, 0 };
+	int i;
+
+	memset(&st, 0, sizeof(st));
+	st.base = data->base;
+	st.loop_thread = THREAD_SELF();
+	tt_ptr_op(evthreadpool_new(0), ==, NULL);
+	st.pool = evthreadpool_new(2);
+	tt_assert(st.pool);
+	tt_int_op(evthreadpool_submit(st.pool, NULL, pool_work_cb,
+		pool_done_cb, &st), ==, -1);
+
+	/* A job with nothing to report */
+	tt_int_op(evthreadpool_submit(st.pool, NULL, pool_work_cb, NULL, &st),
+	    ==, 0);
+	for (i = 0; i < 5000 && EVUTIL_ATOMIC_LOAD_(&st.n_worked) != 1; ++i)
+		SLEEP_MS(1);
+	tt_int_op(EVUTIL_ATOMIC_LOAD_(&st.n_worked), ==, 1);
+	st.n_worked = 0;
+
+	/* Don't hang if something goes wrong */
+	timeout = evtimer_new(data->base, pool_timeout_cb, data->base);
+	tt_assert(timeout);
+	evtimer_add(timeout, &tv);
+
+	/* The jobs alternate between the two workers, so the half behind the
+	 * blocking one on its worker must be stolen for it to finish. */
+	tt_int_op(evthreadpool_submit(st.pool, data->base, pool_block_cb,
+		pool_done_cb, &st), ==, 0);
+	for (i = 1; i < POOL_JOBS; ++i)
+		tt_int_op(evthreadpool_submit(st.pool, data->base,
+			pool_work_cb, pool_done_cb, &st), ==, 0);
+	event_base_loop(data->base, EVLOOP_NO_EXIT_ON_EMPTY);
+	tt_int_op(st.n_done, ==, POOL_JOBS);
+	tt_int_op(st.n_worked, ==, POOL_JOBS);
+	tt_assert(st.saw_all);
+	tt_assert(!st.wrong_thread);
+
+	/* Jobs submitted from jobs */
+	st.n_done = 0;
+	st.n_worked = 0;
+	tt_int_op(evthreadpool_submit(st.pool, data->base, pool_spawn_cb,
+		pool_done_cb, &st), ==, 0);
+	tt_int_op(evthreadpool_submit(st.pool, data->base, pool_spawn_cb,
+		pool_done_cb, &st), ==, 0);
+	event_base_loop(data->base, EVLOOP_NO_EXIT_ON_EMPTY);
+	tt_int_op(st.n_done, ==, POOL_JOBS);
+	tt_int_op(st.n_worked, ==, POOL_JOBS);
+	tt_assert(!st.wrong_thread);
+
+end:
+	if (st.pool)
+		evthreadpool_free(st.pool);
+	if (timeout)
+		event_free(timeout);
+}
+
+struct evfile_test_state {
+	struct event_base *base;
+	ev_ssize_t result[4];
+	int err[4];
+	int n;
+};
+
+static void
+evfile_test_cb(ev_ssize_t result, int err, void *arg)
+{
+	struct evfile_test_state *st = arg;
+
+	if (st->n < 4) {
+		st->result[st->n] = result;
+		st->err[st->n] = err;
+	}
+	++st->n;
+	event_base_loopbreak(st->base);
+}
+
+static void
+thread_evfile(void *arg)
+{
+	struct basic_test_data *data = arg;
+	struct evfile_test_state st;
+	struct evthreadpool *pool = NULL;
+	struct evbuffer *out = NULL, *in = NULL;
+	char *tmpfilename = NULL, *big = NULL;
+	const size_t big_len = 600 * 1024;
+	int fd = -1;
+
+	memset(&st, 0, sizeof(st));
+	st.base = data->base;
+	fd = regress_make_tmpfile("", 0, &tmpfilename);
+	if (fd < 0)
+		tt_skip();
+	pool = evthreadpool_new(2);
+	tt_assert(pool);
+	out = evbuffer_new();
+	in = evbuffer_new();
+	tt_assert(out && in);
+
+	/* Several chains, and more than one read's worth */
+	big = malloc(big_len);
+	tt_assert(big);
+	memset(big, 'z', big_len);
+	evbuffer_add(out, "hello ", 6);
+	evbuffer_add(out, "world", 5);
+	evbuffer_add(out, big, big_len);
+	tt_int_op(evfile_write(pool, data->base, fd, 0, out, evfile_test_cb,
+		&st), ==, 0);
+	tt_int_op(evbuffer_get_length(out), ==, 0);
+	event_base_loop(data->base, EVLOOP_NO_EXIT_ON_EMPTY);
+	tt_int_op(st.result[0], ==, big_len + 11);
+
+	tt_int_op(evfile_fsync(pool, data->base, fd, evfile_test_cb, &st),
+	    ==, 0);
+	event_base_loop(data->base, EVLOOP_NO_EXIT_ON_EMPTY);
+	tt_int_op(st.result[1], ==, 0);
+
+	/* Reading past the end gets what there is */
+	tt_int_op(evfile_read(pool, data->base, fd, 6, big_len + 100, in,
+		evfile_test_cb, &st), ==, 0);
+	event_base_loop(data->base, EVLOOP_NO_EXIT_ON_EMPTY);
+	tt_int_op(st.result[2], ==, big_len + 5);
+	tt_int_op(evbuffer_get_length(in), ==, big_len + 5);
+	tt_assert(!memcmp(evbuffer_pullup(in, 5), "world", 5));
+	evbuffer_drain(in, 5);
+	tt_assert(!memcmp(evbuffer_pullup(in, -1), big, big_len));
+
+	/* Errors come back to the callback */
+	tt_int_op(evfile_read(pool, data->base, fd, -1, 10, in,
+		evfile_test_cb, &st), ==, -1);
+	close(fd);
+	tt_int_op(evfile_fsync(pool, data->base, fd, evfile_test_cb, &st),
+	    ==, 0);
+	event_base_loop(data->base, EVLOOP_NO_EXIT_ON_EMPTY);
+	tt_int_op(st.result[3], ==, -1);
+	tt_int_op(st.err[3], ==, EBADF);
+	fd = -1;
+
+end:
+	if (pool)
+		evthreadpool_free(pool);
+	if (out)
+		evbuffer_free(out);
+	if (in)
+		evbuffer_free(in);
+	if (fd >= 0)
+		close(fd);
+	if (tmpfilename) {
+		unlink(tmpfilename);
+		free(tmpfilename);
+	}
+	free(big);
+}
+#endif
+
 #define TEST(name, f)							\
 	{ #name, thread_##name, TT_FORK|TT_NEED_THREADS|TT_NEED_BASE|(f),	\
 	  &basic_setup, NULL }
@@ -587,6 +823,10 @@ struct testcase_t thread_testcases[] = {
 	 * looking into it now. / ellzey
 	 ******/
 	TEST(no_events, TT_RETRIABLE),
+#endif
+#if defined(EVTHREADPOOL_IMPLEMENTED) && defined(EVUTIL_HAVE_ATOMICS_)
+	TEST(threadpool, 0),
+	TEST(evfile, 0),
 #endif
 	END_OF_TESTCASES
 };
@@ -27,6 +27,9 @@
 #include <sys/time.h>
 #endif
 #include <time.h>
+#ifndef _WIN32
+#include <sys/socket.h>
+#endif
 
 #include "event2/event.h"
 #include "event2/watch.h"
@@ -202,6 +205,100 @@ test_timeout_unavailable(void *ptr)
 	event_base_dispatch(base);
 }
 
+static struct timeval spin_budget;
+static struct evwatch_busy_poll_info busy_poll_stats;
+
+static void
+busy_poll_prepare_cb(struct evwatch *watcher, const struct evwatch_prepare_cb_info *info, void *arg)
+{
+	tt_int_op(evwatch_prepare_get_spin_budget(info, &spin_budget), ==, 1);
+end:
+	;
+}
+
+static void
+busy_poll_check_cb(struct evwatch *watcher, const struct evwatch_check_cb_info *info, void *arg)
+{
+	tt_int_op(evwatch_check_get_busy_poll(info, &busy_poll_stats), ==, 1);
+end:
+	;
+}
+
+static void
+busy_poll_read_cb(evutil_socket_t fd, short what, void *arg)
+{
+	char c;
+	tt_int_op(recv(fd, &c, 1, 0), ==, 1);
+end:
+	;
+}
+
+static void
+busy_poll_timeout_cb(evutil_socket_t fd, short what, void *arg)
+{
+}
+
+/**
+  Test that an event_base set up to busy-poll finds events while spinning,
+  sleeps once the budget is spent, and shrinks the budget when spinning does
+  not pay off.
+ */
+static void
+test_busy_poll(void *ptr)
+{
+	struct basic_test_data *data = ptr;
+	struct event_config *cfg = NULL;
+	struct event_base *base = NULL;
+	struct event *ev = NULL, *timer = NULL;
+	struct timeval budget = { 0, 2000 };
+	struct timeval tv = { 0, 20000 };
+
+	cfg = event_config_new();
+	tt_assert(cfg);
+	tt_int_op(event_config_set_busy_poll(cfg, &budget, 0x100), ==, -1);
+	tt_int_op(event_config_set_busy_poll(cfg, &budget,
+		EVENT_BUSY_POLL_ADAPTIVE|EVENT_BUSY_POLL_KERNEL), ==, 0);
+	base = event_base_new_with_config(cfg);
+	tt_assert(base);
+	tt_assert(evwatch_prepare_new(base, busy_poll_prepare_cb, NULL));
+	tt_assert(evwatch_check_new(base, busy_poll_check_cb, NULL));
+
+	/* Something is ready: spinning finds it without sleeping */
+	ev = event_new(base, data->pair[0], EV_READ, busy_poll_read_cb, NULL);
+	tt_assert(ev);
+	event_add(ev, NULL);
+	tt_int_op(send(data->pair[1], "x", 1, 0), ==, 1);
+	event_base_loop(base, EVLOOP_ONCE);
+	tt_int_op(spin_budget.tv_usec, ==, 2000);
+	tt_int_op(busy_poll_stats.n_spin_hits, ==, 1);
+	tt_int_op(busy_poll_stats.n_wakeups, ==, 0);
+
+	/* Nothing to find: we spin for the whole budget, then sleep */
+	timer = evtimer_new(base, busy_poll_timeout_cb, NULL);
+	tt_assert(timer);
+	evtimer_add(timer, &tv);
+	event_base_loop(base, EVLOOP_ONCE);
+	tt_int_op(busy_poll_stats.n_spin_hits, ==, 1);
+	tt_int_op(busy_poll_stats.n_wakeups, ==, 1);
+	tt_assert(busy_poll_stats.idle_ratio > 0);
+
+	/* ... and so spin for less next time */
+	evtimer_add(timer, &tv);
+	event_base_loop(base, EVLOOP_ONCE);
+	tt_int_op(spin_budget.tv_usec, ==, 1000);
+	tt_int_op(busy_poll_stats.n_wakeups, ==, 2);
+
+end:
+	if (ev)
+		event_free(ev);
+	if (timer)
+		event_free(timer);
+	if (base)
+		event_base_free(base);
+	if (cfg)
+		event_config_free(cfg);
+}
+
 #ifndef EVENT__DISABLE_MM_REPLACEMENT
 static void *
 bad_malloc(size_t sz)
@@ -236,6 +333,7 @@ end:
 struct testcase_t watch_testcases[] = {
 	BASIC(callback_ordering, TT_FORK|TT_NEED_BASE),
 	BASIC(timeout_unavailable, TT_FORK|TT_NEED_BASE),
+	BASIC(busy_poll, TT_FORK|TT_NEED_SOCKETPAIR),
 #ifndef EVENT__DISABLE_MM_REPLACEMENT
 	BASIC(malloc_failure, TT_FORK|TT_NEED_BASE),
 #endif
@@ -54,8 +54,11 @@
 #include "event2/event_compat.h"
 #include "event2/buffer.h"
 #include "event2/bufferevent.h"
+#include "event2/bufferevent_zlib.h"
+#include "event2/http.h"
 
 #include "regress.h"
+#include "regress_http.h"
 #include "mm-internal.h"
 
 /* zlib 1.2.4 and 1.2.5 do some "clever" things with macros.  Instead of
@@ -346,3 +349,270 @@ end:
 	if (pair[1] >= 0)
 		evutil_closesocket(pair[1]);
 }
+
+/*
+ * Built-in compressing bufferevents
+ */
+
+/* Something that compresses well, of a given length */
+static void
+add_compressible(struct evbuffer *buf, size_t len)
+{
+	static const char text[] = "libevent compresses this text. ";
+
+	while (len) {
+		size_t n = len < sizeof(text) - 1 ? len : sizeof(text) - 1;
+		evbuffer_add(buf, text, n);
+		len -= n;
+	}
+}
+
+static void
+zlib_count_cb(struct evbuffer *buf, const struct evbuffer_cb_info *info,
+    void *arg)
+{
+	*(size_t *)arg += info->n_added;
+}
+
+static void
+zlib_pool_readcb(struct bufferevent *bev, void *arg)
+{
+	evbuffer_add_buffer(arg, bufferevent_get_input(bev));
+}
+
+void
+test_bufferevent_zlib_pool(void *arg)
+{
+	struct basic_test_data *data = arg;
+	struct bufferevent_zlib_pool *pool;
+	struct bufferevent *pair[2], *a = NULL, *b = NULL;
+	struct evbuffer *sent = evbuffer_new(), *got = evbuffer_new();
+	size_t wire;
+	int round;
+
+	pool = bufferevent_zlib_pool_new(BUFFEREVENT_ZLIB_GZIP, 6, 2);
+	tt_assert(pool);
+	tt_assert(!bufferevent_zlib_pool_new(BUFFEREVENT_ZLIB_GZIP, 10, 2));
+
+	/* The second time around, the streams come from the pool */
+	for (round = 0; round < 2; ++round) {
+		wire = 0;
+		evbuffer_drain(sent, evbuffer_get_length(sent));
+		evbuffer_drain(got, evbuffer_get_length(got));
+
+		tt_int_op(bufferevent_pair_new(data->base, 0, pair), ==, 0);
+		evbuffer_add_cb(bufferevent_get_input(pair[1]), zlib_count_cb,
+		    &wire);
+		a = bufferevent_zlib_new(pair[0], pool, BEV_OPT_CLOSE_ON_FREE);
+		b = bufferevent_zlib_new(pair[1], pool, BEV_OPT_CLOSE_ON_FREE);
+		tt_assert(a);
+		tt_assert(b);
+		bufferevent_setcb(b, zlib_pool_readcb, NULL, NULL, got);
+		bufferevent_enable(b, EV_READ);
+		bufferevent_enable(a, EV_WRITE);
+
+		add_compressible(sent, 20000);
+		bufferevent_write(a, evbuffer_pullup(sent, -1), 20000);
+		bufferevent_flush(a, EV_WRITE, BEV_FLUSH);
+		event_base_loop(data->base, EVLOOP_NONBLOCK);
+		tt_int_op(evbuffer_get_length(got), ==, 20000);
+		tt_int_op(wire, <, 20000 / 10);
+
+		/* Ending the stream and writing more starts a new one */
+		bufferevent_flush(a, EV_WRITE, BEV_FINISHED);
+		evbuffer_add(sent, "more", 4);
+		bufferevent_write(a, "more", 4);
+		bufferevent_flush(a, EV_WRITE, BEV_FLUSH);
+		event_base_loop(data->base, EVLOOP_NONBLOCK);
+		tt_int_op(evbuffer_get_length(got), ==, 20004);
+		tt_assert(!memcmp(evbuffer_pullup(got, -1),
+			evbuffer_pullup(sent, -1), 20004));
+
+		if (round == 1) {
+			/* The bufferevents keep the pool alive */
+			bufferevent_zlib_pool_free(pool);
+			pool = NULL;
+		}
+		bufferevent_free(a);
+		bufferevent_free(b);
+		a = b = NULL;
+	}
+
+end:
+	if (a)
+		bufferevent_free(a);
+	if (b)
+		bufferevent_free(b);
+	bufferevent_zlib_pool_free(pool);
+	evbuffer_free(sent);
+	evbuffer_free(got);
+}
+
+/*
+ * gzip-encoded http replies
+ */
+
+struct http_gzip_reply {
+	struct event_base *base;
+	int *n_done;
+	int gzipped;
+	int vary;
+	size_t wire_len;
+	struct evbuffer *body;
+};
+
+static void
+http_gzip_cb(struct evhttp_request *req, void *arg)
+{
+	struct evbuffer *body = evbuffer_new();
+
+	add_compressible(body, arg ? 50 : 4000);
+	evhttp_send_reply(req, HTTP_OK, "OK", body);
+	evbuffer_free(body);
+}
+
+static void
+http_gzip_chunked_cb(struct evhttp_request *req, void *arg)
+{
+	struct evbuffer *body = evbuffer_new();
+	int i;
+
+	evhttp_send_reply_start(req, HTTP_OK, "OK");
+	for (i = 0; i < 3; ++i) {
+		add_compressible(body, 1000);
+		evhttp_send_reply_chunk(req, body);
+	}
+	evhttp_send_reply_end(req);
+	evbuffer_free(body);
+}
+
+static int
+gunzip_buffer(struct evbuffer *src, struct evbuffer *dst)
+{
+	unsigned char out[1024];
+	z_stream z;
+	int r;
+
+	memset(&z, 0, sizeof(z));
+	if (inflateInit2(&z, MAX_WBITS + 16) != Z_OK)
+		return -1;
+	z.avail_in = (uInt)evbuffer_get_length(src);
+	z.next_in = evbuffer_pullup(src, -1);
+	do {
+		z.next_out = out;
+		z.avail_out = sizeof(out);
+		r = inflate(&z, Z_NO_FLUSH);
+		evbuffer_add(dst, out, sizeof(out) - z.avail_out);
+	} while (r == Z_OK);
+	inflateEnd(&z);
+
+	return r == Z_STREAM_END ? 0 : -1;
+}
+
+static void
+http_gzip_done(struct evhttp_request *req, void *arg)
+{
+	struct http_gzip_reply *r = arg;
+
+	if (req && evhttp_request_get_response_code(req) == HTTP_OK) {
+		struct evkeyvalq *headers = evhttp_request_get_input_headers(req);
+		struct evbuffer *input = evhttp_request_get_input_buffer(req);
+		const char *enc = evhttp_find_header(headers, "Content-Encoding");
+
+		r->vary = evhttp_find_header(headers, "Vary") != NULL;
+		r->wire_len = evbuffer_get_length(input);
+		if (enc && !strcmp(enc, "gzip")) {
+			r->gzipped = 1;
+			if (gunzip_buffer(input, r->body) < 0)
+				r->gzipped = -1;
+		} else {
+			evbuffer_add_buffer(r->body, input);
+		}
+	}
+	if (++*r->n_done == 4)
+		event_base_loopexit(r->base, NULL);
+}
+
+void
+test_http_gzip(void *arg)
+{
+	static const char *paths[4] = {
+		"/gzip", "/gzip", "/gzip_chunked", "/gzip_small" };
+	static const char *accept[4] = {
+		"deflate, gzip;q=0.5", "gzip;q=0, *", "*", "gzip" };
+	struct basic_test_data *data = arg;
+	struct http_gzip_reply replies[4];
+	struct evhttp_connection *evcon = NULL;
+	struct evhttp *http = NULL;
+	struct evbuffer *expect = evbuffer_new();
+	ev_uint16_t port = 0;
+	int i, n_done = 0;
+
+	memset(replies, 0, sizeof(replies));
+	http = http_setup(&port, data->base, 0);
+	tt_assert(http);
+	evhttp_set_cb(http, "/gzip", http_gzip_cb, NULL);
+	evhttp_set_cb(http, "/gzip_small", http_gzip_cb, (void *)"small");
+	evhttp_set_cb(http, "/gzip_chunked", http_gzip_chunked_cb, NULL);
+	tt_int_op(evhttp_set_gzip(http, 6, 100), ==, 0);
+
+	evcon = evhttp_connection_base_new(data->base, NULL, "127.0.0.1", port);
+	tt_assert(evcon);
+	for (i = 0; i < 4; ++i) {
+		struct evhttp_request *req;
+
+		replies[i].base = data->base;
+		replies[i].n_done = &n_done;
+		replies[i].body = evbuffer_new();
+		req = evhttp_request_new(http_gzip_done, &replies[i]);
+		evhttp_add_header(evhttp_request_get_output_headers(req),
+		    "Host", "somehost");
+		evhttp_add_header(evhttp_request_get_output_headers(req),
+		    "Accept-Encoding", accept[i]);
+		tt_int_op(evhttp_make_request(evcon, req, EVHTTP_REQ_GET,
+			paths[i]), ==, 0);
+	}
+	event_base_dispatch(data->base);
+	tt_int_op(n_done, ==, 4);
+
+	/* gzip is one of the codings the client takes */
+	add_compressible(expect, 4000);
+	tt_int_op(replies[0].gzipped, ==, 1);
+	tt_assert(replies[0].vary);
+	tt_int_op(replies[0].wire_len, <, 4000 / 10);
+	tt_int_op(evbuffer_get_length(replies[0].body), ==, 4000);
+	tt_assert(!memcmp(evbuffer_pullup(replies[0].body, -1),
+		evbuffer_pullup(expect, -1), 4000));
+
+	/* The client refuses gzip */
+	tt_int_op(replies[1].gzipped, ==, 0);
+	tt_assert(replies[1].vary);
+	tt_int_op(evbuffer_get_length(replies[1].body), ==, 4000);
+
+	/* Chunks get compressed as they go */
+	evbuffer_drain(expect, evbuffer_get_length(expect));
+	for (i = 0; i < 3; ++i)
+		add_compressible(expect, 1000);
+	tt_int_op(replies[2].gzipped, ==, 1);
+	tt_int_op(evbuffer_get_length(replies[2].body), ==, 3000);
+	tt_assert(!memcmp(evbuffer_pullup(replies[2].body, -1),
+		evbuffer_pullup(expect, -1), 3000));
+
+	/* Too small to bother */
+	tt_int_op(replies[3].gzipped, ==, 0);
+	tt_assert(!replies[3].vary);
+	tt_int_op(evbuffer_get_length(replies[3].body), ==, 50);
+
+	/* Turning it off */
+	tt_int_op(evhttp_set_gzip(http, 0, 0), ==, 0);
+
+end:
+	for (i = 0; i < 4; ++i)
+		if (replies[i].body)
+			evbuffer_free(replies[i].body);
+	if (evcon)
+		evhttp_connection_free(evcon);
+	if (http)
+		evhttp_free(http);
+	evbuffer_free(expect);
+}
@@ -0,0 +1,304 @@
+/*
+ * Copyright (c) 2026 The Libevent authors
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "event2/event-config.h"
+#include "evconfig-private.h"
+
+#include <pthread.h>
+
+#include <sys/queue.h>
+#include <string.h>
+
+#include "event2/event.h"
+#include "event2/event_struct.h"
+#include "event2/threadpool.h"
+#include "atomic-internal.h"
+#include "defer-internal.h"
+#include "event-internal.h"
+#include "log-internal.h"
+#include "mm-internal.h"
+
+struct evthreadpool_job {
+	/* Runs done in the loop of base */
+	struct event_callback done_cb;
+	TAILQ_ENTRY(evthreadpool_job) next;
+	struct event_base *base;
+	evthreadpool_work_cb work;
+	evthreadpool_done_cb done;
+	void *arg;
+};
+
+TAILQ_HEAD(evthreadpool_queue, evthreadpool_job);
+
+struct evthreadpool_worker {
+	struct evthreadpool *pool;
+	pthread_t thread;
+	/* Protects queue, which the worker takes jobs from the front of and
+	 * other workers steal from the back of. */
+	pthread_mutex_t lock;
+	struct evthreadpool_queue queue;
+};
+
+struct evthreadpool {
+	struct evthreadpool_worker *workers;
+	int n_workers;
+	/* Which worker gets the next job submitted from outside the pool */
+	unsigned next_worker;
+	/* The worker running in this thread, if any */
+	pthread_key_t self;
+
+	/* Jobs in all queues together, and workers asleep waiting for one.
+	 * Both are changed atomically; a worker only goes to sleep, and a
+	 * submitter only wakes one, while holding lock. */
+	unsigned n_queued;
+	unsigned n_sleeping;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	/* Set by evthreadpool_free(); protected by lock. */
+	int shutdown;
+};
+
+#ifdef EVUTIL_HAVE_ATOMICS_
+
+/* Take the next job for w: one of its own if it has any, else one from the
+ * back of some other worker's queue. */
+static struct evthreadpool_job *
+evthreadpool_take(struct evthreadpool_worker *w)
+{
+	struct evthreadpool *pool = w->pool;
+	struct evthreadpool_job *job;
+	int i, idx = (int)(w - pool->workers);
+
+	pthread_mutex_lock(&w->lock);
+	if ((job = TAILQ_FIRST(&w->queue)))
+		TAILQ_REMOVE(&w->queue, job, next);
+	pthread_mutex_unlock(&w->lock);
+
+	for (i = 1; !job && i < pool->n_workers; ++i) {
+		struct evthreadpool_worker *victim =
+		    &pool->workers[(idx + i) % pool->n_workers];
+		pthread_mutex_lock(&victim->lock);
+		if ((job = TAILQ_LAST(&victim->queue, evthreadpool_queue)))
+			TAILQ_REMOVE(&victim->queue, job, next);
+		pthread_mutex_unlock(&victim->lock);
+	}
+
+	if (job)
+		EVUTIL_ATOMIC_ADD_(&pool->n_queued, (unsigned)-1);
+	return job;
+}
+
+/* Deferred callback: the job is done; tell whoever submitted it. */
+static void
+evthreadpool_job_done(struct event_callback *cb, void *arg)
+{
+	struct evthreadpool_job *job = arg;
+	evthreadpool_done_cb done = job->done;
+	void *done_arg = job->arg;
+
+	mm_free(job);
+	if (done)
+		done(done_arg);
+}
+
+static void *
+evthreadpool_worker_main(void *arg)
+{
+	struct evthreadpool_worker *w = arg;
+	struct evthreadpool *pool = w->pool;
+	struct evthreadpool_job *job;
+
+	pthread_setspecific(pool->self, w);
+	for (;;) {
+		if ((job = evthreadpool_take(w))) {
+			job->work(job->arg);
+			if (job->base)
+				event_deferred_cb_schedule_(job->base,
+				    &job->done_cb);
+			else
+				mm_free(job);
+			continue;
+		}
+
+		pthread_mutex_lock(&pool->lock);
+		EVUTIL_ATOMIC_ADD_(&pool->n_sleeping, 1);
+		while (!EVUTIL_ATOMIC_LOAD_(&pool->n_queued) && !pool->shutdown)
+			pthread_cond_wait(&pool->cond, &pool->lock);
+		EVUTIL_ATOMIC_ADD_(&pool->n_sleeping, (unsigned)-1);
+		if (pool->shutdown && !EVUTIL_ATOMIC_LOAD_(&pool->n_queued)) {
+			pthread_mutex_unlock(&pool->lock);
+			break;
+		}
+		pthread_mutex_unlock(&pool->lock);
+	}
+	return NULL;
+}
+
+/* Stop and join the first n workers of pool, and free everything. */
+static void
+evthreadpool_destroy(struct evthreadpool *pool, int n)
+{
+	int i;
+
+	pthread_mutex_lock(&pool->lock);
+	pool->shutdown = 1;
+	pthread_cond_broadcast(&pool->cond);
+	pthread_mutex_unlock(&pool->lock);
+
+	for (i = 0; i < n; ++i)
+		pthread_join(pool->workers[i].thread, NULL);
+	for (i = 0; i < pool->n_workers; ++i)
+		pthread_mutex_destroy(&pool->workers[i].lock);
+
+	pthread_key_delete(pool->self);
+	pthread_cond_destroy(&pool->cond);
+	pthread_mutex_destroy(&pool->lock);
+	mm_free(pool->workers);
+	mm_free(pool);
+}
+
+struct evthreadpool *
+evthreadpool_new(int n_workers)
+{
+	struct evthreadpool *pool;
+	int i;
+
+	if (n_workers < 1)
+		return NULL;
+	if (!(pool = mm_calloc(1, sizeof(struct evthreadpool))))
+		return NULL;
+	if (!(pool->workers = mm_calloc(n_workers,
+		    sizeof(struct evthreadpool_worker)))) {
+		mm_free(pool);
+		return NULL;
+	}
+	pool->n_workers = n_workers;
+	/* None of these fail on any system we run on but by running out of
+	 * memory, and we don't try to recover from that partway. */
+	if (pthread_key_create(&pool->self, NULL) ||
+	    pthread_mutex_init(&pool->lock, NULL) ||
+	    pthread_cond_init(&pool->cond, NULL)) {
+		event_warnx("%s: can't set up synchronization", __func__);
+		mm_free(pool->workers);
+		mm_free(pool);
+		return NULL;
+	}
+	for (i = 0; i < n_workers; ++i) {
+		pool->workers[i].pool = pool;
+		TAILQ_INIT(&pool->workers[i].queue);
+		pthread_mutex_init(&pool->workers[i].lock, NULL);
+	}
+
+	for (i = 0; i < n_workers; ++i) {
+		if (pthread_create(&pool->workers[i].thread, NULL,
+			evthreadpool_worker_main, &pool->workers[i])) {
+			event_warnx("%s: can't start worker %d", __func__, i);
+			evthreadpool_destroy(pool, i);
+			return NULL;
+		}
+	}
+	return pool;
+}
+
+int
+evthreadpool_submit(struct evthreadpool *pool, struct event_base *base,
+    evthreadpool_work_cb work, evthreadpool_done_cb done, void *arg)
+{
+	struct evthreadpool_worker *w;
+	struct evthreadpool_job *job;
+
+	if (!work || (done && !base))
+		return -1;
+#ifndef EVENT__DISABLE_THREAD_SUPPORT
+	if (base && !base->th_base_lock) {
+		event_warnx("%s: event_base has no locking; "
+		    "call evthread_use_pthreads() before creating it",
+		    __func__);
+		return -1;
+	}
+#endif
+	if (!(job = mm_calloc(1, sizeof(struct evthreadpool_job))))
+		return -1;
+	job->base = base;
+	job->work = work;
+	job->done = done;
+	job->arg = arg;
+	if (base)
+		event_deferred_cb_init_(&job->done_cb,
+		    event_base_get_npriorities(base) / 2,
+		    evthreadpool_job_done, job);
+
+	/* Jobs submitted by a job stay with its worker, while it's still
+	 * warm with their data; others take turns. */
+	if (!(w = pthread_getspecific(pool->self)))
+		w = &pool->workers[EVUTIL_ATOMIC_ADD_(&pool->next_worker, 1) %
+		    (unsigned)pool->n_workers];
+
+	/* Count the job before it is queued, so the count never goes below
+	 * zero; a worker that sees it too early just looks again. */
+	EVUTIL_ATOMIC_ADD_(&pool->n_queued, 1);
+	pthread_mutex_lock(&w->lock);
+	TAILQ_INSERT_TAIL(&w->queue, job, next);
+	pthread_mutex_unlock(&w->lock);
+
+	if (EVUTIL_ATOMIC_LOAD_(&pool->n_sleeping)) {
+		pthread_mutex_lock(&pool->lock);
+		pthread_cond_signal(&pool->cond);
+		pthread_mutex_unlock(&pool->lock);
+	}
+	return 0;
+}
+
+void
+evthreadpool_free(struct evthreadpool *pool)
+{
+	evthreadpool_destroy(pool, pool->n_workers);
+}
+
+#else /* !EVUTIL_HAVE_ATOMICS_ */
+
+/* The queue counts above need atomic operations, which every compiler we
+ * build libevent_pthreads with has; anywhere else there is no pool. */
+
+struct evthreadpool *
+evthreadpool_new(int n_workers)
+{
+	event_warnx("%s: not supported with this compiler", __func__);
+	return NULL;
+}
+
+int
+evthreadpool_submit(struct evthreadpool *pool, struct event_base *base,
+    evthreadpool_work_cb work, evthreadpool_done_cb done, void *arg)
+{
+	return -1;
+}
+
+void
+evthreadpool_free(struct evthreadpool *pool)
+{
+}
+
+#endif /* EVUTIL_HAVE_ATOMICS_ */
@@ -0,0 +1,199 @@
+/*
+ * Copyright (c) 2026 The Libevent authors
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "event2/event-config.h"
+#include "evconfig-private.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "event2/event.h"
+#include "event-internal.h"
+#include "mm-internal.h"
+#include "util-internal.h"
+
+/* How many records a trace keeps unless told otherwise */
+#define EVTRACE_DEFAULT_RECORDS 16384
+
+int
+event_base_trace_start(struct event_base *base, int n_records)
+{
+	struct evtrace_ring *ring;
+
+	if (n_records < 0)
+		return -1;
+	if (!n_records)
+		n_records = EVTRACE_DEFAULT_RECORDS;
+
+	/* No locking here or in the functions below: the ring belongs to the
+	 * thread running the loop, which writes it without the lock held. */
+	ring = base->trace;
+	if (!ring || ring->size != (unsigned)n_records) {
+		ring = mm_calloc(1, sizeof(struct evtrace_ring) +
+		    (n_records - 1) * sizeof(struct evtrace_record));
+		if (!ring)
+			return -1;
+		ring->size = n_records;
+		if (base->trace)
+			mm_free(base->trace);
+		base->trace = ring;
+	}
+	ring->head = 0;
+	base->trace_on = 1;
+	return 0;
+}
+
+void
+event_base_trace_stop(struct event_base *base)
+{
+	base->trace_on = 0;
+}
+
+ev_uint64_t
+evtrace_now_(struct event_base *base)
+{
+	struct timeval tv;
+
+	if (evutil_gettime_monotonic_(&base->stats_timer, &tv) == -1)
+		return 0;
+	return (ev_uint64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+void
+evtrace_record_(struct event_base *base, int kind, ev_uint64_t start,
+    void (*fn)(void), const void *obj, evutil_socket_t fd, short events,
+    int priority)
+{
+	struct evtrace_ring *ring = base->trace;
+	struct evtrace_record *rec;
+	ev_uint64_t end;
+
+	if (!ring || !start)
+		return;
+	end = evtrace_now_(base);
+	rec = &ring->records[ring->head++ % ring->size];
+	rec->start_usec = start;
+	rec->dur_usec = end > start ? (ev_uint32_t)(end - start) : 0;
+	rec->kind = (ev_uint8_t)kind;
+	rec->priority = (ev_int8_t)priority;
+	rec->events = events;
+	rec->fd = fd;
+	rec->fn = fn;
+	rec->obj = obj;
+}
+
+/* Print a function pointer in hex.  ISO C won't let us convert one to a
+ * void * for %p, so copy its bits instead. */
+static void
+evtrace_print_fn(FILE *output, void (*fn)(void))
+{
+	ev_uintptr_t p = 0;
+	ev_uint64_t v;
+
+	memcpy(&p, &fn, sizeof(p) < sizeof(fn) ? sizeof(p) : sizeof(fn));
+	v = p;
+	if (v >> 32)
+		fprintf(output, "%lx%08lx", (unsigned long)(v >> 32),
+		    (unsigned long)(v & 0xffffffffUL));
+	else
+		fprintf(output, "%lx", (unsigned long)v);
+}
+
+static const char *
+evtrace_name(int kind, const char **cat)
+{
+	*cat = "loop";
+	switch (kind) {
+	case EVTRACE_POLL:
+		return "poll";
+	case EVTRACE_TIMEOUTS:
+		return "timeouts";
+	case EVTRACE_CALLBACK:
+		*cat = "callback";
+		return "callback";
+	case EVTRACE_BEV_READ:
+		*cat = "bufferevent";
+		return "bufferevent read";
+	case EVTRACE_BEV_WRITE:
+		*cat = "bufferevent";
+		return "bufferevent write";
+	case EVTRACE_BEV_EVENT:
+		*cat = "bufferevent";
+		return "bufferevent event";
+	default:
+		return "unknown";
+	}
+}
+
+int
+event_base_trace_dump(struct event_base *base, FILE *output)
+{
+	struct evtrace_ring *ring;
+	unsigned pos, end;
+	unsigned long tid = 1;
+	int n = 0;
+
+	ring = base->trace;
+#ifndef EVENT__DISABLE_THREAD_SUPPORT
+	if (base->th_owner_id)
+		tid = base->th_owner_id;
+#endif
+
+	fputs("{\"traceEvents\":[", output);
+	if (ring) {
+		end = ring->head;
+		pos = end > ring->size ? end - ring->size : 0;
+		for (; pos != end; ++pos) {
+			const struct evtrace_record *rec =
+			    &ring->records[pos % ring->size];
+			const char *cat, *name = evtrace_name(rec->kind, &cat);
+
+			fprintf(output, "%s\n{\"name\":\"%s\",\"cat\":\"%s\","
+			    "\"ph\":\"X\",\"ts\":" EV_U64_FMT ",\"dur\":%u,"
+			    "\"pid\":1,\"tid\":%lu",
+			    n ? "," : "", name, cat,
+			    EV_U64_ARG(rec->start_usec),
+			    (unsigned)rec->dur_usec, tid);
+			if (rec->kind >= EVTRACE_CALLBACK) {
+				fputs(",\"args\":{\"fn\":\"0x", output);
+				evtrace_print_fn(output, rec->fn);
+				fprintf(output, "\",\"obj\":\"%p\"",
+				    (void *)rec->obj);
+				if (rec->kind == EVTRACE_CALLBACK)
+					fprintf(output, ",\"fd\":" EV_SOCK_FMT ","
+					    "\"events\":%d,\"priority\":%d",
+					    EV_SOCK_ARG(rec->fd), (int)rec->events,
+					    (int)rec->priority);
+				fputs("}", output);
+			}
+			fputs("}", output);
+			++n;
+		}
+	}
+	fputs("\n],\"displayTimeUnit\":\"ms\"}\n", output);
+
+	return n;
+}
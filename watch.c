@@ -80,3 +80,28 @@ evwatch_prepare_get_timeout(const struct evwatch_prepare_cb_info *info, struct t
 	}
 	return 0;
 }
+
+int
+evwatch_prepare_get_spin_budget(const struct evwatch_prepare_cb_info *info, struct timeval *budget)
+{
+	if (!evutil_timerisset(&info->base->busy_poll_max))
+		return 0;
+	*budget = info->base->busy_poll_budget;
+	return 1;
+}
+
+int
+evwatch_check_get_busy_poll(const struct evwatch_check_cb_info *info, struct evwatch_busy_poll_info *stats)
+{
+	const struct event_base *base = info->base;
+
+	if (!evutil_timerisset(&base->busy_poll_max))
+		return 0;
+	stats->spin_usec = base->busy_poll_last_usec;
+	stats->n_spin_hits = base->busy_poll_hits;
+	stats->n_wakeups = base->busy_poll_wakeups;
+	stats->total_spin_usec = base->busy_poll_total_usec;
+	stats->idle_ratio = base->busy_poll_total_usec ?
+	    (double)base->busy_poll_idle_usec / base->busy_poll_total_usec : 0;
+	return 1;
+}
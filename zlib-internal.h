@@ -0,0 +1,62 @@
+/*
+ * Copyright (c) 2026 The Libevent authors
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef ZLIB_INTERNAL_H_INCLUDED_
+#define ZLIB_INTERNAL_H_INCLUDED_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "event2/event-config.h"
+#include "event2/bufferevent.h"
+#include "event2/bufferevent_zlib.h"
+
+/* A compressor or decompressor taken from a bufferevent_zlib_pool, without
+ * a bufferevent around it; evhttp uses these to gzip responses. */
+struct evzlib_stream_;
+
+/** Take a reference to pool. */
+void evzlib_pool_incref_(struct bufferevent_zlib_pool *pool);
+
+/** Take a compressor (if compress is true) or a decompressor from pool,
+ * ready to start a new stream.  Returns NULL on failure. */
+struct evzlib_stream_ *evzlib_stream_new_(struct bufferevent_zlib_pool *pool,
+    int compress);
+/** Give s back to its pool. */
+void evzlib_stream_free_(struct evzlib_stream_ *s);
+
+/** Run the data in src through s into dst, in the manner of a
+ * bufferevent_filter_cb.  In BEV_FLUSH mode, everything in src can be
+ * decompressed from dst afterwards; BEV_FINISHED ends the stream. */
+enum bufferevent_filter_result evzlib_stream_process_(
+    struct evzlib_stream_ *s, struct evbuffer *src, struct evbuffer *dst,
+    ev_ssize_t limit, enum bufferevent_flush_mode mode);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ZLIB_INTERNAL_H_INCLUDED_ */